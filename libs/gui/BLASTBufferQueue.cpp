@@ -23,12 +23,17 @@
 #include <gui/BufferItemConsumer.h>
 #include <gui/GLConsumer.h>
 
+#include <android-base/stringprintf.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cinttypes>
 
 using namespace std::chrono_literals;
 
+using android::base::StringAppendF;
+
 namespace android {
 
 void BLASTBufferItemConsumer::onDisconnect() {
@@ -110,9 +115,9 @@ BLASTBufferQueue::BLASTBufferQueue(const sp<SurfaceControl>& surface, int width,
     mBufferItemConsumer =
         new BLASTBufferItemConsumer(mConsumer, GraphicBuffer::USAGE_HW_COMPOSER, 1, true);
     static int32_t id = 0;
-    auto name = std::string("BLAST Consumer") + std::to_string(id);
+    mName = std::string("BLAST Consumer") + std::to_string(id);
     id++;
-    mBufferItemConsumer->setName(String8(name.c_str()));
+    mBufferItemConsumer->setName(String8(mName.c_str()));
     mBufferItemConsumer->setFrameAvailableListener(this);
     mBufferItemConsumer->setBufferFreedListener(this);
     mBufferItemConsumer->setDefaultBufferSize(mWidth, mHeight);
@@ -148,12 +153,13 @@ static void transactionCallbackThunk(void* context, nsecs_t latchTime,
     bq->transactionCallback(latchTime, presentFence, stats);
 }
 
-void BLASTBufferQueue::transactionCallback(nsecs_t /*latchTime*/, const sp<Fence>& /*presentFence*/,
+void BLASTBufferQueue::transactionCallback(nsecs_t latchTime, const sp<Fence>& presentFence,
                                            const std::vector<SurfaceControlStats>& stats) {
     std::unique_lock _lock{mMutex};
     ATRACE_CALL();
 
     if (!stats.empty()) {
+        mCompositorTiming = stats[0].frameEventStats.compositorTiming;
         mTransformHint = stats[0].transformHint;
         mBufferItemConsumer->setTransformHint(mTransformHint);
         mBufferItemConsumer->updateFrameTimestamps(stats[0].frameEventStats.frameNumber,
@@ -165,6 +171,7 @@ void BLASTBufferQueue::transactionCallback(nsecs_t /*latchTime*/, const sp<Fence
                                                    stats[0].latchTime,
                                                    stats[0].frameEventStats.dequeueReadyTime);
     }
+    updatePacingLocked(latchTime, presentFence);
     if (mPendingReleaseItem.item.mGraphicBuffer != nullptr) {
         if (!stats.empty()) {
             mPendingReleaseItem.releaseFence = stats[0].previousReleaseFence;
@@ -195,7 +202,13 @@ void BLASTBufferQueue::transactionCallback(nsecs_t /*latchTime*/, const sp<Fence
 
 void BLASTBufferQueue::processNextBufferLocked(bool useNextTransaction) {
     ATRACE_CALL();
-    if (mNumFrameAvailable == 0 || mNumAcquired == MAX_ACQUIRED_BUFFERS + 1) {
+    if (mNumFrameAvailable == 0 || mNumAcquired == mMaxAcquiredBuffers + 1) {
+        return;
+    }
+    // The paced policies also limit the transactions in flight, and not just the acquired buffers,
+    // one of which is held until the next callback.
+    if (mPacingPolicy != PacingPolicy::Default &&
+        mSubmitted.size() >= static_cast<size_t>(mMaxAcquiredBuffers)) {
         return;
     }
 
@@ -219,16 +232,42 @@ void BLASTBufferQueue::processNextBufferLocked(bool useNextTransaction) {
     if (status != OK) {
         return;
     }
-    auto buffer = bufferItem.mGraphicBuffer;
     mNumFrameAvailable--;
 
+    // Frames that queued up while the previous one was in flight are already late, so skip to
+    // the newest one. Each is released before acquiring the next, to stay within the acquired
+    // buffer limit, and with its own acquire fence, since the producer may still be drawing it.
+    while (mPacingPolicy == PacingPolicy::LowLatency && mNumFrameAvailable > 0) {
+        mBufferItemConsumer->releaseBuffer(bufferItem,
+                                           bufferItem.mFence ? bufferItem.mFence
+                                                             : Fence::NO_FENCE);
+        mDroppedCount++;
+        status = mBufferItemConsumer->acquireBuffer(&bufferItem, -1, false);
+        if (status != OK) {
+            return;
+        }
+        mNumFrameAvailable--;
+    }
+    auto buffer = bufferItem.mGraphicBuffer;
+
     if (buffer == nullptr) {
         mBufferItemConsumer->releaseBuffer(bufferItem, Fence::NO_FENCE);
         return;
     }
 
+    // Computed before this frame is counted in mSubmitted, which tells whether it is pipelined
+    // behind another one.
+    nsecs_t expectedPresentTime = 0;
+    const nsecs_t pacedPresentTime = computePacedPresentTimeLocked(&expectedPresentTime);
+
     mNumAcquired++;
     mSubmitted.push(bufferItem);
+    mSubmittedFrames.push({systemTime(), expectedPresentTime});
+    mSubmittedCount++;
+    if (pacedPresentTime > 0) {
+        mPacedCount++;
+    }
+    mMaxInFlight = std::max(mMaxInFlight, mSubmitted.size());
 
     bool needsDisconnect = false;
     mBufferItemConsumer->getConnectionEvents(bufferItem.mFrameNumber, &needsDisconnect);
@@ -250,13 +289,133 @@ void BLASTBufferQueue::processNextBufferLocked(bool useNextTransaction) {
     t->setCrop(mSurfaceControl, computeCrop(bufferItem));
     t->setTransform(mSurfaceControl, bufferItem.mTransform);
     t->setTransformToDisplayInverse(mSurfaceControl, bufferItem.mTransformToDisplayInverse);
-    t->setDesiredPresentTime(bufferItem.mTimestamp);
+    t->setDesiredPresentTime(std::max(bufferItem.mTimestamp, pacedPresentTime));
 
     if (applyTransaction) {
         t->apply();
     }
 }
 
+nsecs_t BLASTBufferQueue::computePacedPresentTimeLocked(nsecs_t* outExpectedPresentTime) {
+    *outExpectedPresentTime = 0;
+    const nsecs_t interval = mCompositorTiming.interval;
+    if (mPacingPolicy != PacingPolicy::Throughput || interval <= 0 ||
+        mCompositorTiming.deadline <= 0) {
+        return 0;
+    }
+
+    // The earliest a frame submitted now can be presented is at the vsync following the next
+    // composition deadline.
+    nsecs_t presentTime = ProducerFrameEventHistory::snapToNextTick(systemTime(),
+                                                                    mCompositorTiming.deadline,
+                                                                    interval) +
+            mCompositorTiming.presentLatency;
+    bool paced = false;
+    if (!mSubmitted.empty() && presentTime < mLastExpectedPresentTime + interval) {
+        presentTime = mLastExpectedPresentTime + interval;
+        paced = true;
+    }
+    mLastExpectedPresentTime = presentTime;
+    *outExpectedPresentTime = presentTime;
+
+    // SurfaceFlinger applies a transaction once its desired present time is before the
+    // frame being composed is expected to be presented. Half a vsync ahead keeps the frame out
+    // of the composition presenting the previous one, without risking the one after.
+    return paced ? presentTime - interval / 2 : 0;
+}
+
+void BLASTBufferQueue::updatePacingLocked(nsecs_t latchTime, const sp<Fence>& presentFence) {
+    if (mSubmittedFrames.empty()) {
+        return;
+    }
+    const SubmittedFrame frame = mSubmittedFrames.front();
+    mSubmittedFrames.pop();
+
+    // The present fence of a callback rarely has signaled by the time it comes in, so the one
+    // from the previous callback is checked instead. The frames submitted since are behind it.
+    if (mLastPresentFence != nullptr) {
+        const nsecs_t presentTime = mLastPresentFence->getSignalTime();
+        if (presentTime != Fence::SIGNAL_TIME_PENDING &&
+            presentTime != Fence::SIGNAL_TIME_INVALID) {
+            mPresentedCount++;
+            mTotalPresentLatency += presentTime - mLastPresentedFrame.submitTime;
+            if (followPresentTimeLocked(mLastPresentedFrame, presentTime,
+                                        mSubmittedFrames.size() + 1)) {
+                mLateCount++;
+            }
+        }
+    }
+    mLastPresentFence = presentFence;
+    mLastPresentedFrame = frame;
+
+    if (latchTime <= 0 || frame.submitTime <= 0) {
+        return;
+    }
+    mLatchedCount++;
+    mTotalLatchLatency += latchTime - frame.submitTime;
+
+    // Until its present fence signals, a frame is presented at the vsync following the
+    // composition that latched it.
+    const nsecs_t interval = mCompositorTiming.interval;
+    if (interval > 0) {
+        const nsecs_t presentTime =
+                ProducerFrameEventHistory::snapToNextTick(latchTime, mCompositorTiming.deadline,
+                                                          interval) +
+                mCompositorTiming.presentLatency;
+        followPresentTimeLocked(frame, presentTime, mSubmittedFrames.size());
+    }
+}
+
+bool BLASTBufferQueue::followPresentTimeLocked(const SubmittedFrame& frame, nsecs_t presentTime,
+                                               size_t framesBehind) {
+    const nsecs_t interval = mCompositorTiming.interval;
+    if (frame.expectedPresentTime <= 0 || interval <= 0 ||
+        presentTime <= frame.expectedPresentTime + interval / 2) {
+        return false;
+    }
+    // A frame that missed its vsync pushes the ones behind it back as well. Pacing them from
+    // the earlier estimate would only pile them up in the same composition.
+    mLastExpectedPresentTime =
+            std::max(mLastExpectedPresentTime,
+                     presentTime + static_cast<nsecs_t>(framesBehind) * interval);
+    return true;
+}
+
+void BLASTBufferQueue::dump(std::string& result) {
+    static constexpr const char* kPolicyNames[] = {"default", "throughput", "low latency"};
+    std::lock_guard _lock{mMutex};
+    StringAppendF(&result, "%s: pacing policy %s, max acquired buffers %d\n", mName.c_str(),
+                  kPolicyNames[static_cast<int>(mPacingPolicy)], mMaxAcquiredBuffers);
+    StringAppendF(&result,
+                  "  submitted %" PRIu64 ", dropped %" PRIu64 ", paced %" PRIu64
+                  ", late %" PRIu64 ", max in flight %zu\n",
+                  mSubmittedCount, mDroppedCount, mPacedCount, mLateCount, mMaxInFlight);
+    StringAppendF(&result, "  average submit to latch %.2f ms, to present %.2f ms\n",
+                  mLatchedCount > 0 ? mTotalLatchLatency / 1e6 / mLatchedCount : 0.0,
+                  mPresentedCount > 0 ? mTotalPresentLatency / 1e6 / mPresentedCount : 0.0);
+
+    String8 consumerState;
+    mBufferItemConsumer->dumpState(consumerState, "  ");
+    result.append(consumerState.c_str());
+}
+
+status_t BLASTBufferQueue::setPacingPolicy(PacingPolicy policy) {
+    std::lock_guard _lock{mMutex};
+    const int maxAcquiredBuffers = policy == PacingPolicy::Throughput
+            ? THROUGHPUT_MAX_ACQUIRED_BUFFERS
+            : MAX_ACQUIRED_BUFFERS;
+    // Fails if more buffers than the new limit are currently acquired.
+    status_t status = mBufferItemConsumer->setMaxAcquiredBufferCount(maxAcquiredBuffers);
+    if (status != OK) {
+        ALOGE("Failed to set the max acquired buffer count for pacing policy %d: %d",
+              static_cast<int>(policy), status);
+        return status;
+    }
+    mPacingPolicy = policy;
+    mMaxAcquiredBuffers = maxAcquiredBuffers;
+    return OK;
+}
+
 Rect BLASTBufferQueue::computeCrop(const BufferItem& item) {
     if (item.mScalingMode == NATIVE_WINDOW_SCALING_MODE_SCALE_CROP) {
         return GLConsumer::scaleDownCrop(item.mCrop, mWidth, mHeight);
@@ -269,7 +428,7 @@ void BLASTBufferQueue::onFrameAvailable(const BufferItem& /*item*/) {
     std::unique_lock _lock{mMutex};
 
     if (mNextTransaction != nullptr) {
-        while (mNumFrameAvailable > 0 || mNumAcquired == MAX_ACQUIRED_BUFFERS + 1) {
+        while (mNumFrameAvailable > 0 || mNumAcquired == mMaxAcquiredBuffers + 1) {
             mCallbackCV.wait(_lock);
         }
     }
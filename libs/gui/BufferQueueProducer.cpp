@@ -82,6 +82,7 @@ BufferQueueProducer::BufferQueueProducer(const sp<BufferQueueCore>& core,
     mNextCallbackTicket(0),
     mCurrentCallbackTicket(0),
     mCallbackCondition(),
+    mCallbackWaiters(0),
     mDequeueTimeout(-1),
     mDequeueWaitingForAllocation(false) {}
 
@@ -361,14 +362,17 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
                     (acquiredCount <= mCore->mMaxAcquiredBufferCount)) {
                 return WOULD_BLOCK;
             }
+            mCore->mDequeueWaiters++;
             if (mDequeueTimeout >= 0) {
                 std::cv_status result = mCore->mDequeueCondition.wait_for(lock,
                         std::chrono::nanoseconds(mDequeueTimeout));
+                mCore->mDequeueWaiters--;
                 if (result == std::cv_status::timeout) {
                     return TIMED_OUT;
                 }
             } else {
                 mCore->mDequeueCondition.wait(lock);
+                mCore->mDequeueWaiters--;
             }
         }
     } // while (tryAgain)
@@ -844,6 +848,7 @@ status_t BufferQueueProducer::queueBuffer(int slot,
     int callbackTicket = 0;
     uint64_t currentFrameNumber = 0;
     BufferItem item;
+    bool wakeDequeueWaiters = false;
     { // Autolock scope
         std::lock_guard<std::mutex> lock(mCore->mMutex);
 
@@ -996,7 +1001,7 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         }
 
         mCore->mBufferHasBeenQueued = true;
-        mCore->mDequeueCondition.notify_all();
+        wakeDequeueWaiters = mCore->mDequeueWaiters > 0;
         mCore->mLastQueuedSlot = slot;
 
         output->width = mCore->mDefaultWidth;
@@ -1016,6 +1021,10 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         VALIDATE_CONSISTENCY();
     } // Autolock scope
 
+    if (wakeDequeueWaiters) {
+        mCore->mDequeueCondition.notify_all();
+    }
+
     // It is okay not to clear the GraphicBuffer when the consumer is SurfaceFlinger because
     // it is guaranteed that the BufferQueue is inside SurfaceFlinger's process and
     // there will be no Binder call
@@ -1043,7 +1052,9 @@ status_t BufferQueueProducer::queueBuffer(int slot,
     { // scope for the lock
         std::unique_lock<std::mutex> lock(mCallbackMutex);
         while (callbackTicket != mCurrentCallbackTicket) {
+            mCallbackWaiters++;
             mCallbackCondition.wait(lock);
+            mCallbackWaiters--;
         }
 
         if (frameAvailableListener != nullptr) {
@@ -1060,7 +1071,9 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         mLastQueuedTransform = item.mTransform;
 
         ++mCurrentCallbackTicket;
-        mCallbackCondition.notify_all();
+        if (mCallbackWaiters > 0) {
+            mCallbackCondition.notify_all();
+        }
     }
 
     // Wait without lock held
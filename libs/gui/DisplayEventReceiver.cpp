@@ -79,6 +79,22 @@ status_t DisplayEventReceiver::requestNextVsync() {
     return NO_INIT;
 }
 
+status_t DisplayEventReceiver::getVsyncTimeline(gui::VsyncTimeline::Snapshot* outSnapshot) {
+    if (mEventConnection == nullptr) {
+        return NO_INIT;
+    }
+
+    if (mVsyncTimeline == nullptr) {
+        auto timeline = std::make_unique<gui::VsyncTimeline>();
+        status_t err = mEventConnection->getVsyncTimeline(timeline.get());
+        if (err != NO_ERROR) {
+            return err;
+        }
+        mVsyncTimeline = std::move(timeline);
+    }
+    return mVsyncTimeline->read(outSnapshot) ? NO_ERROR : NOT_ENOUGH_DATA;
+}
+
 ssize_t DisplayEventReceiver::getEvents(DisplayEventReceiver::Event* events,
         size_t count) {
     return DisplayEventReceiver::getEvents(mDataChannel.get(), events, count);
@@ -25,8 +25,6 @@
 #include <utils/Log.h>
 
 #include <algorithm>
-#include <limits>
-#include <numeric>
 
 namespace android {
 
@@ -273,6 +271,8 @@ void ProducerFrameEventHistory::applyDelta(
         const FrameEventHistoryDelta& delta) {
     mCompositorTiming = delta.mCompositorTiming;
 
+    FenceTimeCache fenceTimes;
+
     for (auto& d : delta.mDeltas) {
         // Avoid out-of-bounds access.
         if (CC_UNLIKELY(d.mIndex >= mFrames.size())) {
@@ -304,23 +304,24 @@ void ProducerFrameEventHistory::applyDelta(
         }
 
         applyFenceDelta(&mGpuCompositionDoneTimeline,
-                &frame.gpuCompositionDoneFence, d.mGpuCompositionDoneFence);
+                &frame.gpuCompositionDoneFence, d.mGpuCompositionDoneFence,
+                &fenceTimes);
         applyFenceDelta(&mPresentTimeline,
-                &frame.displayPresentFence, d.mDisplayPresentFence);
+                &frame.displayPresentFence, d.mDisplayPresentFence,
+                &fenceTimes);
         applyFenceDelta(&mReleaseTimeline,
-                &frame.releaseFence, d.mReleaseFence);
+                &frame.releaseFence, d.mReleaseFence, &fenceTimes);
     }
 }
 
 void ProducerFrameEventHistory::updateSignalTimes() {
-    mAcquireTimeline.updateSignalTimes();
-    mGpuCompositionDoneTimeline.updateSignalTimes();
-    mPresentTimeline.updateSignalTimes();
-    mReleaseTimeline.updateSignalTimes();
+    mFencePoller.updateSignalTimes({&mAcquireTimeline, &mGpuCompositionDoneTimeline,
+                                    &mPresentTimeline, &mReleaseTimeline});
 }
 
 void ProducerFrameEventHistory::applyFenceDelta(FenceTimeline* timeline,
-        std::shared_ptr<FenceTime>* dst, const FenceTime::Snapshot& src) const {
+        std::shared_ptr<FenceTime>* dst, const FenceTime::Snapshot& src,
+        FenceTimeCache* cache) const {
     if (CC_UNLIKELY(dst == nullptr || dst->get() == nullptr)) {
         ALOGE("applyFenceDelta: dst is null.");
         return;
@@ -329,11 +330,21 @@ void ProducerFrameEventHistory::applyFenceDelta(FenceTimeline* timeline,
     switch (src.state) {
         case FenceTime::Snapshot::State::EMPTY:
             return;
-        case FenceTime::Snapshot::State::FENCE:
+        case FenceTime::Snapshot::State::FENCE: {
             ALOGE_IF((*dst)->isValid(), "applyFenceDelta: Unexpected fence.");
-            *dst = createFenceTime(src.fence);
+            auto cached = std::find_if(cache->begin(), cache->end(),
+                    [&src](const auto& entry) {
+                        return entry.first == src.fence.get();
+                    });
+            if (cached != cache->end()) {
+                *dst = cached->second;
+            } else {
+                *dst = createFenceTime(src.fence);
+                cache->emplace_back(src.fence.get(), *dst);
+            }
             timeline->push(*dst);
             return;
+        }
         case FenceTime::Snapshot::State::SIGNAL_TIME:
             if ((*dst)->isValid()) {
                 (*dst)->applyTrustedSnapshot(src);
@@ -521,107 +532,281 @@ FrameEventsDelta::FrameEventsDelta(
     }
 }
 
-constexpr size_t FrameEventsDelta::minFlattenedSize() {
-    return sizeof(FrameEventsDelta::mFrameNumber) +
-            sizeof(uint16_t) + // mIndex
-            sizeof(uint8_t) + // mAddPostCompositeCalled
-            sizeof(uint8_t) + // mAddReleaseCalled
-            sizeof(FrameEventsDelta::mPostedTime) +
-            sizeof(FrameEventsDelta::mRequestedPresentTime) +
-            sizeof(FrameEventsDelta::mLatchTime) +
-            sizeof(FrameEventsDelta::mFirstRefreshStartTime) +
-            sizeof(FrameEventsDelta::mLastRefreshStartTime) +
-            sizeof(FrameEventsDelta::mDequeueReadyTime);
+// Deltas are flattened into a byte stream rather than fixed size fields:
+//   varint index
+//   uint8_t flags: kAddPostCompositeCalled, kAddReleaseCalled and, from
+//       kTimestampShift on, which of allTimestamps() are not pending
+//   varint zigzag frame number delta to the previous delta's frame number
+//   for each timestamp that is not pending: varint zigzag delta to the
+//       previous timestamp of this or the previous deltas
+//   for each of allFences(): uint8_t FenceEncoding, followed by a varint
+//       zigzag delta to the previous timestamp for SIGNAL_TIME, the flattened
+//       Fence for FENCE, or the varint index of a fence that was already
+//       flattened for FENCE_INDEX.
+// Timestamps of consecutive events are usually within a few frames of each
+// other, so most take 3 or 4 bytes instead of 8.
+
+namespace {
+
+constexpr uint8_t kAddPostCompositeCalled = 1 << 0;
+constexpr uint8_t kAddReleaseCalled = 1 << 1;
+constexpr int kTimestampShift = 2;
+
+enum class FenceEncoding : uint8_t {
+    EMPTY,
+    SIGNAL_TIME,
+    FENCE,
+    FENCE_INDEX,
+};
+
+// The deltas wrap around rather than overflow, so that any timestamp,
+// including the invalid ones, can be encoded.
+uint64_t encodeDelta(int64_t value, int64_t reference) {
+    const auto delta = static_cast<int64_t>(
+            static_cast<uint64_t>(value) - static_cast<uint64_t>(reference));
+    // Zigzag, so that small negative deltas are small too.
+    return (static_cast<uint64_t>(delta) << 1) ^
+            static_cast<uint64_t>(delta >> 63);
 }
 
-// Flattenable implementation
-size_t FrameEventsDelta::getFlattenedSize() const {
-    auto fences = allFences(this);
-    return minFlattenedSize() +
-            std::accumulate(fences.begin(), fences.end(), size_t(0),
-                    [](size_t a, const FenceTime::Snapshot* fence) {
-                            return a + fence->getFlattenedSize();
-                    });
+int64_t decodeDelta(uint64_t encoded, int64_t reference) {
+    const uint64_t delta = (encoded >> 1) ^ (0 - (encoded & 1));
+    return static_cast<int64_t>(static_cast<uint64_t>(reference) + delta);
 }
 
-size_t FrameEventsDelta::getFdCount() const {
-    auto fences = allFences(this);
-    return std::accumulate(fences.begin(), fences.end(), size_t(0),
-            [](size_t a, const FenceTime::Snapshot* fence) {
-                return a + fence->getFdCount();
-            });
+size_t getVarintSize(uint64_t value) {
+    size_t size = 1;
+    for (; value >= 0x80; value >>= 7) {
+        size++;
+    }
+    return size;
 }
 
-status_t FrameEventsDelta::flatten(void*& buffer, size_t& size, int*& fds,
-            size_t& count) const {
-    if (size < getFlattenedSize() || count < getFdCount()) {
-        return NO_MEMORY;
+void writeVarint(void*& buffer, size_t& size, uint64_t value) {
+    uint8_t* bytes = static_cast<uint8_t*>(buffer);
+    size_t length = 0;
+    for (; value >= 0x80; value >>= 7) {
+        bytes[length++] = static_cast<uint8_t>(value) | 0x80;
+    }
+    bytes[length++] = static_cast<uint8_t>(value);
+    FlattenableUtils::advance(buffer, size, length);
+}
+
+bool readVarint(void const*& buffer, size_t& size, uint64_t* value) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+    uint64_t result = 0;
+    for (size_t i = 0; i < size && i * 7 < 64; i++) {
+        result |= static_cast<uint64_t>(bytes[i] & 0x7f) << (i * 7);
+        if ((bytes[i] & 0x80) == 0) {
+            *value = result;
+            FlattenableUtils::advance(buffer, size, i + 1);
+            return true;
+        }
     }
+    return false;
+}
 
-    if (mIndex >= FrameEventHistory::MAX_FRAME_HISTORY ||
-            mIndex > std::numeric_limits<uint16_t>::max()) {
+// Fences that already are in the buffer are referred to by index, so that
+// their file descriptors are only sent once.
+FenceEncoding getFenceEncoding(const FenceTime::Snapshot& snapshot,
+        FrameEventsDelta::Codec* codec, size_t* outIndex) {
+    switch (snapshot.state) {
+        case FenceTime::Snapshot::State::EMPTY:
+            return FenceEncoding::EMPTY;
+        case FenceTime::Snapshot::State::SIGNAL_TIME:
+            return FenceEncoding::SIGNAL_TIME;
+        case FenceTime::Snapshot::State::FENCE:
+            break;
+    }
+    auto& fences = codec->fences;
+    auto fence = std::find(fences.begin(), fences.end(), snapshot.fence);
+    if (fence != fences.end()) {
+        *outIndex = static_cast<size_t>(std::distance(fences.begin(), fence));
+        return FenceEncoding::FENCE_INDEX;
+    }
+    fences.push_back(snapshot.fence);
+    return FenceEncoding::FENCE;
+}
+
+uint8_t getFlags(bool addPostCompositeCalled, bool addReleaseCalled,
+        const std::array<const nsecs_t*, 6>& timestamps) {
+    uint8_t flags = (addPostCompositeCalled ? kAddPostCompositeCalled : 0) |
+            (addReleaseCalled ? kAddReleaseCalled : 0);
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        if (FrameEvents::isValidTimestamp(*timestamps[i])) {
+            flags |= 1 << (kTimestampShift + i);
+        }
+    }
+    return flags;
+}
+
+} // namespace
+
+size_t FrameEventsDelta::getFlattenedSize(Codec* codec, size_t* fdCount) const {
+    size_t size = getVarintSize(mIndex) + sizeof(uint8_t) +
+            getVarintSize(encodeDelta(static_cast<int64_t>(mFrameNumber),
+                    static_cast<int64_t>(codec->frameNumber)));
+    codec->frameNumber = mFrameNumber;
+
+    for (const nsecs_t* timestamp : allTimestamps(this)) {
+        if (FrameEvents::isValidTimestamp(*timestamp)) {
+            size += getVarintSize(encodeDelta(*timestamp, codec->timestamp));
+            codec->timestamp = *timestamp;
+        }
+    }
+
+    for (const FenceTime::Snapshot* fence : allFences(this)) {
+        size += sizeof(FenceEncoding);
+        size_t index = 0;
+        switch (getFenceEncoding(*fence, codec, &index)) {
+            case FenceEncoding::EMPTY:
+                break;
+            case FenceEncoding::SIGNAL_TIME:
+                size += getVarintSize(
+                        encodeDelta(fence->signalTime, codec->timestamp));
+                codec->timestamp = fence->signalTime;
+                break;
+            case FenceEncoding::FENCE:
+                size += fence->fence->getFlattenedSize();
+                *fdCount += fence->fence->getFdCount();
+                break;
+            case FenceEncoding::FENCE_INDEX:
+                size += getVarintSize(index);
+                break;
+        }
+    }
+    return size;
+}
+
+status_t FrameEventsDelta::flatten(Codec* codec, void*& buffer, size_t& size,
+        int*& fds, size_t& count) const {
+    // FrameEventHistoryDelta already checked that the buffers are large
+    // enough.
+    if (mIndex >= FrameEventHistory::MAX_FRAME_HISTORY) {
         return BAD_VALUE;
     }
 
-    FlattenableUtils::write(buffer, size, mFrameNumber);
+    writeVarint(buffer, size, mIndex);
+    FlattenableUtils::write(buffer, size,
+            getFlags(mAddPostCompositeCalled, mAddReleaseCalled,
+                    allTimestamps(this)));
+    writeVarint(buffer, size,
+            encodeDelta(static_cast<int64_t>(mFrameNumber),
+                    static_cast<int64_t>(codec->frameNumber)));
+    codec->frameNumber = mFrameNumber;
+
+    for (const nsecs_t* timestamp : allTimestamps(this)) {
+        if (FrameEvents::isValidTimestamp(*timestamp)) {
+            writeVarint(buffer, size,
+                    encodeDelta(*timestamp, codec->timestamp));
+            codec->timestamp = *timestamp;
+        }
+    }
 
-    // These are static_cast to uint16_t/uint8_t for alignment.
-    FlattenableUtils::write(buffer, size, static_cast<uint16_t>(mIndex));
-    FlattenableUtils::write(
-            buffer, size, static_cast<uint8_t>(mAddPostCompositeCalled));
-    FlattenableUtils::write(
-            buffer, size, static_cast<uint8_t>(mAddReleaseCalled));
-
-    FlattenableUtils::write(buffer, size, mPostedTime);
-    FlattenableUtils::write(buffer, size, mRequestedPresentTime);
-    FlattenableUtils::write(buffer, size, mLatchTime);
-    FlattenableUtils::write(buffer, size, mFirstRefreshStartTime);
-    FlattenableUtils::write(buffer, size, mLastRefreshStartTime);
-    FlattenableUtils::write(buffer, size, mDequeueReadyTime);
-
-    // Fences
-    for (auto fence : allFences(this)) {
-        status_t status = fence->flatten(buffer, size, fds, count);
-        if (status != NO_ERROR) {
-            return status;
+    for (const FenceTime::Snapshot* fence : allFences(this)) {
+        size_t index = 0;
+        const FenceEncoding encoding = getFenceEncoding(*fence, codec, &index);
+        FlattenableUtils::write(buffer, size, encoding);
+        switch (encoding) {
+            case FenceEncoding::EMPTY:
+                break;
+            case FenceEncoding::SIGNAL_TIME:
+                writeVarint(buffer, size,
+                        encodeDelta(fence->signalTime, codec->timestamp));
+                codec->timestamp = fence->signalTime;
+                break;
+            case FenceEncoding::FENCE: {
+                status_t status =
+                        fence->fence->flatten(buffer, size, fds, count);
+                if (status != NO_ERROR) {
+                    return status;
+                }
+                break;
+            }
+            case FenceEncoding::FENCE_INDEX:
+                writeVarint(buffer, size, index);
+                break;
         }
     }
     return NO_ERROR;
 }
 
-status_t FrameEventsDelta::unflatten(void const*& buffer, size_t& size,
-            int const*& fds, size_t& count) {
-    if (size < minFlattenedSize()) {
+status_t FrameEventsDelta::unflatten(Codec* codec, void const*& buffer,
+        size_t& size, int const*& fds, size_t& count) {
+    uint64_t index = 0;
+    if (!readVarint(buffer, size, &index) || size < sizeof(uint8_t)) {
         return NO_MEMORY;
     }
+    if (index >= FrameEventHistory::MAX_FRAME_HISTORY) {
+        return BAD_VALUE;
+    }
+    mIndex = static_cast<size_t>(index);
 
-    FlattenableUtils::read(buffer, size, mFrameNumber);
+    uint8_t flags = 0;
+    FlattenableUtils::read(buffer, size, flags);
+    mAddPostCompositeCalled = (flags & kAddPostCompositeCalled) != 0;
+    mAddReleaseCalled = (flags & kAddReleaseCalled) != 0;
 
-    // These were written as uint16_t/uint8_t for alignment.
-    uint16_t temp16 = 0;
-    FlattenableUtils::read(buffer, size, temp16);
-    mIndex = temp16;
-    if (mIndex >= FrameEventHistory::MAX_FRAME_HISTORY) {
-        return BAD_VALUE;
+    uint64_t encoded = 0;
+    if (!readVarint(buffer, size, &encoded)) {
+        return NO_MEMORY;
     }
-    uint8_t temp8 = 0;
-    FlattenableUtils::read(buffer, size, temp8);
-    mAddPostCompositeCalled = static_cast<bool>(temp8);
-    FlattenableUtils::read(buffer, size, temp8);
-    mAddReleaseCalled = static_cast<bool>(temp8);
-
-    FlattenableUtils::read(buffer, size, mPostedTime);
-    FlattenableUtils::read(buffer, size, mRequestedPresentTime);
-    FlattenableUtils::read(buffer, size, mLatchTime);
-    FlattenableUtils::read(buffer, size, mFirstRefreshStartTime);
-    FlattenableUtils::read(buffer, size, mLastRefreshStartTime);
-    FlattenableUtils::read(buffer, size, mDequeueReadyTime);
-
-    // Fences
-    for (auto fence : allFences(this)) {
-        status_t status = fence->unflatten(buffer, size, fds, count);
-        if (status != NO_ERROR) {
-            return status;
+    mFrameNumber = static_cast<uint64_t>(
+            decodeDelta(encoded, static_cast<int64_t>(codec->frameNumber)));
+    codec->frameNumber = mFrameNumber;
+
+    int bit = kTimestampShift;
+    for (nsecs_t* timestamp : allTimestamps(this)) {
+        if ((flags & (1 << bit++)) == 0) {
+            *timestamp = FrameEvents::TIMESTAMP_PENDING;
+            continue;
+        }
+        if (!readVarint(buffer, size, &encoded)) {
+            return NO_MEMORY;
+        }
+        *timestamp = decodeDelta(encoded, codec->timestamp);
+        codec->timestamp = *timestamp;
+    }
+
+    for (FenceTime::Snapshot* fence : allFences(this)) {
+        if (size < sizeof(FenceEncoding)) {
+            return NO_MEMORY;
+        }
+        FenceEncoding encoding = FenceEncoding::EMPTY;
+        FlattenableUtils::read(buffer, size, encoding);
+        switch (encoding) {
+            case FenceEncoding::EMPTY:
+                *fence = FenceTime::Snapshot();
+                break;
+            case FenceEncoding::SIGNAL_TIME:
+                if (!readVarint(buffer, size, &encoded)) {
+                    return NO_MEMORY;
+                }
+                *fence = FenceTime::Snapshot(
+                        decodeDelta(encoded, codec->timestamp));
+                codec->timestamp = fence->signalTime;
+                break;
+            case FenceEncoding::FENCE: {
+                sp<Fence> newFence = new Fence;
+                status_t status = newFence->unflatten(buffer, size, fds, count);
+                if (status != NO_ERROR) {
+                    return status;
+                }
+                codec->fences.push_back(newFence);
+                *fence = FenceTime::Snapshot(newFence);
+                break;
+            }
+            case FenceEncoding::FENCE_INDEX:
+                if (!readVarint(buffer, size, &index)) {
+                    return NO_MEMORY;
+                }
+                if (index >= codec->fences.size()) {
+                    return BAD_VALUE;
+                }
+                *fence = FenceTime::Snapshot(codec->fences[index]);
+                break;
+            default:
+                return BAD_VALUE;
         }
     }
     return NO_ERROR;
@@ -649,18 +834,23 @@ constexpr size_t FrameEventHistoryDelta::minFlattenedSize() {
 }
 
 size_t FrameEventHistoryDelta::getFlattenedSize() const {
-    return minFlattenedSize() +
-            std::accumulate(mDeltas.begin(), mDeltas.end(), size_t(0),
-                    [](size_t a, const FrameEventsDelta& delta) {
-                            return a + delta.getFlattenedSize();
-                    });
+    size_t fdCount = 0;
+    return getFlattenedSize(&fdCount);
 }
 
 size_t FrameEventHistoryDelta::getFdCount() const {
-    return std::accumulate(mDeltas.begin(), mDeltas.end(), size_t(0),
-            [](size_t a, const FrameEventsDelta& delta) {
-                    return a + delta.getFdCount();
-            });
+    size_t fdCount = 0;
+    getFlattenedSize(&fdCount);
+    return fdCount;
+}
+
+size_t FrameEventHistoryDelta::getFlattenedSize(size_t* fdCount) const {
+    FrameEventsDelta::Codec codec;
+    size_t size = minFlattenedSize();
+    for (const auto& d : mDeltas) {
+        size += d.getFlattenedSize(&codec, fdCount);
+    }
+    return size;
 }
 
 status_t FrameEventHistoryDelta::flatten(
@@ -668,7 +858,8 @@ status_t FrameEventHistoryDelta::flatten(
     if (mDeltas.size() > FrameEventHistory::MAX_FRAME_HISTORY) {
         return BAD_VALUE;
     }
-    if (size < getFlattenedSize()) {
+    size_t fdCount = 0;
+    if (size < getFlattenedSize(&fdCount) || count < fdCount) {
         return NO_MEMORY;
     }
 
@@ -676,8 +867,9 @@ status_t FrameEventHistoryDelta::flatten(
 
     FlattenableUtils::write(
             buffer, size, static_cast<uint32_t>(mDeltas.size()));
+    FrameEventsDelta::Codec codec;
     for (auto& d : mDeltas) {
-        status_t status = d.flatten(buffer, size, fds, count);
+        status_t status = d.flatten(&codec, buffer, size, fds, count);
         if (status != NO_ERROR) {
             return status;
         }
@@ -699,8 +891,9 @@ status_t FrameEventHistoryDelta::unflatten(
         return BAD_VALUE;
     }
     mDeltas.resize(deltaCount);
+    FrameEventsDelta::Codec codec;
     for (auto& d : mDeltas) {
-        status_t status = d.unflatten(buffer, size, fds, count);
+        status_t status = d.unflatten(&codec, buffer, size, fds, count);
         if (status != NO_ERROR) {
             return status;
         }
@@ -1243,11 +1243,10 @@ status_t BnSurfaceComposer::onTransact(
             Vector<ComposerState> state;
             state.setCapacity(count);
             for (size_t i = 0; i < count; i++) {
-                ComposerState s;
-                if (s.read(data) == BAD_VALUE) {
+                // Read in place, rather than copying every layer_state_t into the vector.
+                if (state.editItemAt(state.add()).read(data) == BAD_VALUE) {
                     return BAD_VALUE;
                 }
-                state.add(s);
             }
 
             count = data.readUint32();
@@ -25,7 +25,8 @@ namespace { // Anonymous
 
 enum class Tag : uint32_t {
     ON_TRANSACTION_COMPLETED = IBinder::FIRST_CALL_TRANSACTION,
-    LAST = ON_TRANSACTION_COMPLETED,
+    ON_BUFFER_EVICTED,
+    LAST = ON_BUFFER_EVICTED,
 };
 
 } // Anonymous namespace
@@ -245,6 +246,11 @@ public:
                                          onTransactionCompleted)>(Tag::ON_TRANSACTION_COMPLETED,
                                                                   stats);
     }
+
+    void onBufferEvicted(uint64_t cacheId) override {
+        callRemoteAsync<decltype(&ITransactionCompletedListener::
+                                         onBufferEvicted)>(Tag::ON_BUFFER_EVICTED, cacheId);
+    }
 };
 
 // Out-of-line virtual method definitions to trigger vtable emission in this translation unit (see
@@ -263,6 +269,8 @@ status_t BnTransactionCompletedListener::onTransact(uint32_t code, const Parcel&
         case Tag::ON_TRANSACTION_COMPLETED:
             return callLocalAsync(data, reply,
                                   &ITransactionCompletedListener::onTransactionCompleted);
+        case Tag::ON_BUFFER_EVICTED:
+            return callLocalAsync(data, reply, &ITransactionCompletedListener::onBufferEvicted);
     }
 }
 
@@ -20,6 +20,7 @@
 
 #include <gui/Surface.h>
 
+#include <algorithm>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
@@ -1992,63 +1993,73 @@ void Surface::setSurfaceDamage(android_native_rect_t* rects, size_t numRects) {
 // ----------------------------------------------------------------------
 // the lock/unlock APIs must be used from the same thread
 
+// Copies reg from src to dst, both of which are mapped, with rows of srcBytesPerRow and
+// dstBytesPerRow bytes.
+static void blitRegion(uint8_t* dst, size_t dstBytesPerRow, const uint8_t* src,
+                       size_t srcBytesPerRow, size_t bpp, const Region& reg) {
+    Region::const_iterator head(reg.begin());
+    Region::const_iterator tail(reg.end());
+    while (head != tail) {
+        // The rects of a region come in bands of equal top and bottom, sorted by left. Copy a band
+        // as a single span per row, bridging the gaps between its rects as long as they are no
+        // wider than what the span already covers: one long copy per row beats several short
+        // ones. The source is the front buffer, which holds the latest content everywhere, so
+        // copying the gaps too is harmless.
+        const Rect& first(*head++);
+        int32_t right = first.right;
+        int32_t coveredWidth = first.width();
+        while (head != tail && head->top == first.top && head->left - right <= coveredWidth) {
+            coveredWidth += head->width();
+            right = head->right;
+            head++;
+        }
+
+        int32_t h = first.height();
+        if (h <= 0 || right <= first.left) continue;
+        size_t size = static_cast<uint32_t>(right - first.left) * bpp;
+        const uint8_t* s = src + static_cast<uint32_t>(first.top) * srcBytesPerRow +
+                static_cast<uint32_t>(first.left) * bpp;
+        uint8_t* d = dst + static_cast<uint32_t>(first.top) * dstBytesPerRow +
+                static_cast<uint32_t>(first.left) * bpp;
+        if (dstBytesPerRow == srcBytesPerRow && size == srcBytesPerRow) {
+            size *= static_cast<size_t>(h);
+            h = 1;
+        }
+        do {
+            memcpy(d, s, size);
+            d += dstBytesPerRow;
+            s += srcBytesPerRow;
+        } while (--h > 0);
+    }
+}
+
+// Copies reg from src into dst, which the caller has already locked for writing at dstBits.
 static status_t copyBlt(
         const sp<GraphicBuffer>& dst,
+        void* dstBits,
         const sp<GraphicBuffer>& src,
-        const Region& reg,
-        int *dstFenceFd)
+        const Region& reg)
 {
     if (dst->getId() == src->getId())
         return OK;
 
     // src and dst with, height and format must be identical. no verification
     // is done here.
-    status_t err;
     uint8_t* src_bits = nullptr;
-    err = src->lock(GRALLOC_USAGE_SW_READ_OFTEN, reg.bounds(),
+    status_t err = src->lock(GRALLOC_USAGE_SW_READ_OFTEN, reg.bounds(),
             reinterpret_cast<void**>(&src_bits));
     ALOGE_IF(err, "error locking src buffer %s", strerror(-err));
 
-    uint8_t* dst_bits = nullptr;
-    err = dst->lockAsync(GRALLOC_USAGE_SW_WRITE_OFTEN, reg.bounds(),
-            reinterpret_cast<void**>(&dst_bits), *dstFenceFd);
-    ALOGE_IF(err, "error locking dst buffer %s", strerror(-err));
-    *dstFenceFd = -1;
-
-    Region::const_iterator head(reg.begin());
-    Region::const_iterator tail(reg.end());
-    if (head != tail && src_bits && dst_bits) {
+    if (src_bits && dstBits) {
         const size_t bpp = bytesPerPixel(src->format);
         const size_t dbpr = static_cast<uint32_t>(dst->stride) * bpp;
         const size_t sbpr = static_cast<uint32_t>(src->stride) * bpp;
-
-        while (head != tail) {
-            const Rect& r(*head++);
-            int32_t h = r.height();
-            if (h <= 0) continue;
-            size_t size = static_cast<uint32_t>(r.width()) * bpp;
-            uint8_t const * s = src_bits +
-                    static_cast<uint32_t>(r.left + src->stride * r.top) * bpp;
-            uint8_t       * d = dst_bits +
-                    static_cast<uint32_t>(r.left + dst->stride * r.top) * bpp;
-            if (dbpr==sbpr && size==sbpr) {
-                size *= static_cast<size_t>(h);
-                h = 1;
-            }
-            do {
-                memcpy(d, s, size);
-                d += dbpr;
-                s += sbpr;
-            } while (--h > 0);
-        }
+        blitRegion(static_cast<uint8_t*>(dstBits), dbpr, src_bits, sbpr, bpp, reg);
     }
 
     if (src_bits)
         src->unlock();
 
-    if (dst_bits)
-        dst->unlockAsync(dstFenceFd);
-
     return err;
 }
 
@@ -2093,12 +2104,14 @@ status_t Surface::lock(
                 backBuffer->width  == frontBuffer->width &&
                 backBuffer->height == frontBuffer->height &&
                 backBuffer->format == frontBuffer->format);
+        // Nothing needs to be copied back when the whole buffer is going to be redrawn.
+        const bool fullDamage = newDirtyRegion.isRect() && newDirtyRegion.bounds() == bounds;
 
+        Region copyback;
         if (canCopyBack) {
             // copy the area that is invalid and not repainted this round
-            const Region copyback(mDirtyRegion.subtract(newDirtyRegion));
-            if (!copyback.isEmpty()) {
-                copyBlt(backBuffer, frontBuffer, copyback, &fenceFd);
+            if (!fullDamage) {
+                copyback = mDirtyRegion.subtract(newDirtyRegion);
             }
         } else {
             // if we can't copy-back anything, modify the user's dirty
@@ -2127,10 +2140,20 @@ status_t Surface::lock(
             *inOutDirtyBounds = newDirtyRegion.getBounds();
         }
 
+        // Lock the back buffer once, for both the copy back and the caller, rather than
+        // locking and unlocking it around the copy first.
+        Rect lockBounds(newDirtyRegion.bounds());
+        if (!copyback.isEmpty()) {
+            const Rect copybackBounds(copyback.bounds());
+            lockBounds = Rect(std::min(lockBounds.left, copybackBounds.left),
+                              std::min(lockBounds.top, copybackBounds.top),
+                              std::max(lockBounds.right, copybackBounds.right),
+                              std::max(lockBounds.bottom, copybackBounds.bottom));
+        }
         void* vaddr;
         status_t res = backBuffer->lockAsync(
                 GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN,
-                newDirtyRegion.bounds(), &vaddr, fenceFd);
+                lockBounds, &vaddr, fenceFd);
 
         ALOGW_IF(res, "failed locking buffer (handle = %p)",
                 backBuffer->handle);
@@ -2138,6 +2161,9 @@ status_t Surface::lock(
         if (res != 0) {
             err = INVALID_OPERATION;
         } else {
+            if (!copyback.isEmpty()) {
+                copyBlt(backBuffer, vaddr, frontBuffer, copyback);
+            }
             mLockedBuffer = backBuffer;
             outBuffer->width  = backBuffer->width;
             outBuffer->height = backBuffer->height;
@@ -260,7 +260,8 @@ void removeDeadBufferCallback(void* /*context*/, uint64_t graphicBufferId);
  * A few details about lifetime:
  *     1. The cache evicts by LRU. The server side cache is keyed by BufferCache::getToken
  *        which is per process Unique. The server side cache is larger than the client side
- *        cache so that the server will never evict entries before the client.
+ *        cache so that the server will never evict entries before the client. If it does
+ *        anyway, it tells the client through onBufferEvicted.
  *     2. When the client evicts an entry it notifies the server via an uncacheBuffer
  *        transaction.
  *     3. The client only references the Buffers by ID, and uses buffer->addDeathCallback
@@ -309,6 +310,12 @@ public:
         SurfaceComposerClient::doUncacheBufferTransaction(cacheId);
     }
 
+    // Forgets a buffer that the server already evicted, so that it is cached again when used.
+    void evicted(uint64_t cacheId) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBuffers.erase(cacheId);
+    }
+
 private:
     void evictLeastRecentlyUsedBuffer() REQUIRES(mMutex) {
         auto itr = mBuffers.begin();
@@ -346,6 +353,10 @@ void removeDeadBufferCallback(void* /*context*/, uint64_t graphicBufferId) {
     BufferCache::getInstance().uncache(graphicBufferId);
 }
 
+void TransactionCompletedListener::onBufferEvicted(uint64_t cacheId) {
+    BufferCache::getInstance().evicted(cacheId);
+}
+
 // ---------------------------------------------------------------------------
 
 SurfaceComposerClient::Transaction::Transaction(const Transaction& other)
@@ -432,11 +443,10 @@ status_t SurfaceComposerClient::Transaction::readFromParcel(const Parcel* parcel
     for (size_t i = 0; i < count; i++) {
         sp<IBinder> surfaceControlHandle = parcel->readStrongBinder();
 
-        ComposerState composerState;
-        if (composerState.read(*parcel) == BAD_VALUE) {
+        // Read in place, rather than copying every layer_state_t into the map.
+        if (composerStates[surfaceControlHandle].read(*parcel) == BAD_VALUE) {
             return BAD_VALUE;
         }
-        composerStates[surfaceControlHandle] = composerState;
     }
 
     InputWindowCommands inputWindowCommands;
@@ -452,8 +462,8 @@ status_t SurfaceComposerClient::Transaction::readFromParcel(const Parcel* parcel
     mContainsBuffer = containsBuffer;
     mDesiredPresentTime = desiredPresentTime;
     mDisplayStates = displayStates;
-    mListenerCallbacks = listenerCallbacks;
-    mComposerStates = composerStates;
+    mListenerCallbacks = std::move(listenerCallbacks);
+    mComposerStates = std::move(composerStates);
     mInputWindowCommands = inputWindowCommands;
     return NO_ERROR;
 }
@@ -509,11 +519,18 @@ status_t SurfaceComposerClient::Transaction::writeToParcel(Parcel* parcel) const
 }
 
 SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::merge(Transaction&& other) {
-    for (auto const& [surfaceHandle, composerState] : other.mComposerStates) {
-        if (mComposerStates.count(surfaceHandle) == 0) {
-            mComposerStates[surfaceHandle] = composerState;
-        } else {
-            mComposerStates[surfaceHandle].state.merge(composerState.state);
+    if (mComposerStates.empty()) {
+        // Merging into an empty transaction, which is what most callers do, only takes the
+        // other transaction's states.
+        mComposerStates.swap(other.mComposerStates);
+    } else {
+        mComposerStates.reserve(mComposerStates.size() + other.mComposerStates.size());
+        for (auto& [surfaceHandle, composerState] : other.mComposerStates) {
+            auto [it, inserted] = mComposerStates.try_emplace(surfaceHandle,
+                                                              std::move(composerState));
+            if (!inserted) {
+                it->second.state.merge(composerState.state);
+            }
         }
     }
 
@@ -528,12 +545,12 @@ SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::merge(Tr
 
     for (const auto& [listener, callbackInfo] : other.mListenerCallbacks) {
         auto& [callbackIds, surfaceControls] = callbackInfo;
-        mListenerCallbacks[listener].callbackIds.insert(std::make_move_iterator(
-                                                                callbackIds.begin()),
-                                                        std::make_move_iterator(callbackIds.end()));
+        auto& listenerCallbackInfo = mListenerCallbacks[listener];
+        listenerCallbackInfo.callbackIds.insert(std::make_move_iterator(callbackIds.begin()),
+                                                std::make_move_iterator(callbackIds.end()));
 
-        mListenerCallbacks[listener].surfaceControls.insert(surfaceControls.begin(),
-                                                            surfaceControls.end());
+        listenerCallbackInfo.surfaceControls.insert(surfaceControls.begin(),
+                                                    surfaceControls.end());
 
         auto& currentProcessCallbackInfo =
                 mListenerCallbacks[TransactionCompletedListener::getIInstance()];
@@ -763,14 +780,14 @@ void SurfaceComposerClient::Transaction::setExplicitEarlyWakeupEnd() {
 }
 
 layer_state_t* SurfaceComposerClient::Transaction::getLayerState(const sp<IBinder>& handle) {
-    if (mComposerStates.count(handle) == 0) {
+    // Every setter comes through here, so construct the state in place with a single lookup.
+    auto [it, inserted] = mComposerStates.try_emplace(handle);
+    if (inserted) {
         // we don't have it, add an initialized layer_state to our list
-        ComposerState s;
-        s.state.surface = handle;
-        mComposerStates[handle] = s;
+        it->second.state.surface = handle;
     }
 
-    return &(mComposerStates[handle].state);
+    return &(it->second.state);
 }
 
 void SurfaceComposerClient::Transaction::registerSurfaceControlForCallback(
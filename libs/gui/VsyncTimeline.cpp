@@ -0,0 +1,211 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "VsyncTimeline"
+
+#include <gui/VsyncTimeline.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <binder/Parcel.h>
+#include <cutils/ashmem.h>
+#include <log/log.h>
+
+namespace android {
+namespace gui {
+
+// Layout of the shared memory. It is the same for 32-bit and 64-bit processes. The fields after
+// the sequence are plain loads and stores, ordered by fences around the sequence like the
+// seqlock of system properties, so that readers never write to the read-only mapping.
+struct VsyncTimeline::Data {
+    // Odd while the writer is updating the fields below. Zero until the first publish.
+    std::atomic<uint32_t> sequence;
+    uint32_t count;
+    int64_t timestamp;
+    int64_t expectedVSyncTimestamp;
+    // Zero while the timeline is invalid.
+    int64_t period;
+};
+
+namespace {
+
+// Readers give up after this many attempts, which only happens if they keep racing the writer.
+constexpr int kMaxReadAttempts = 8;
+
+} // namespace
+
+VsyncTimeline::Snapshot VsyncTimeline::Snapshot::advancedBy(uint32_t periods) const {
+    Snapshot snapshot = *this;
+    snapshot.count += periods;
+    snapshot.timestamp += periods * period;
+    snapshot.expectedVSyncTimestamp += periods * period;
+    return snapshot;
+}
+
+VsyncTimeline::Snapshot VsyncTimeline::Snapshot::nextAfter(nsecs_t now) const {
+    if (period <= 0 || now < timestamp) {
+        return *this;
+    }
+    return advancedBy(static_cast<uint32_t>((now - timestamp) / period + 1));
+}
+
+VsyncTimeline::~VsyncTimeline() {
+    unmap();
+}
+
+std::unique_ptr<VsyncTimeline> VsyncTimeline::create(const char* name) {
+    base::unique_fd fd(ashmem_create_region(name, sizeof(Data)));
+    if (fd < 0) {
+        ALOGE("Failed to create %s: %s", name, strerror(errno));
+        return nullptr;
+    }
+
+    auto timeline = std::make_unique<VsyncTimeline>();
+    const int rawFd = fd.get();
+    if (timeline->map(std::move(fd), true) != NO_ERROR) {
+        return nullptr;
+    }
+    // Only the mapping above may write to the timeline. Readers can only map it read-only.
+    if (ashmem_set_prot_region(rawFd, PROT_READ) < 0) {
+        ALOGE("Failed to make %s read-only: %s", name, strerror(errno));
+        return nullptr;
+    }
+    return timeline;
+}
+
+status_t VsyncTimeline::map(base::unique_fd fd, bool writable) {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+    static_assert(offsetof(Data, timestamp) == 8);
+    static_assert(sizeof(Data) == 32);
+
+    unmap();
+    const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* data = mmap(nullptr, sizeof(Data), prot, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        const int error = errno;
+        ALOGE("Failed to map timeline: %s", strerror(error));
+        return -error;
+    }
+    mFd = std::move(fd);
+    mData = static_cast<Data*>(data);
+    mWritable = writable;
+    return NO_ERROR;
+}
+
+void VsyncTimeline::unmap() {
+    if (mData != nullptr) {
+        munmap(mData, sizeof(Data));
+        mData = nullptr;
+    }
+    mFd.reset();
+    mWritable = false;
+}
+
+status_t VsyncTimeline::initCheck() const {
+    return mData != nullptr ? NO_ERROR : NO_INIT;
+}
+
+status_t VsyncTimeline::share(VsyncTimeline* outTimeline) const {
+    if (mData == nullptr) {
+        return NO_INIT;
+    }
+    base::unique_fd fd(dup(mFd));
+    if (fd < 0) {
+        return -errno;
+    }
+    return outTimeline->map(std::move(fd), false);
+}
+
+void VsyncTimeline::publish(const Snapshot& snapshot) {
+    LOG_ALWAYS_FATAL_IF(!mWritable, "Publishing to a read-only timeline");
+    const uint32_t sequence = mData->sequence.load(std::memory_order_relaxed);
+    mData->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    mData->count = snapshot.count;
+    mData->timestamp = snapshot.timestamp;
+    mData->expectedVSyncTimestamp = snapshot.expectedVSyncTimestamp;
+    mData->period = snapshot.period;
+    mData->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void VsyncTimeline::invalidate() {
+    LOG_ALWAYS_FATAL_IF(!mWritable, "Invalidating a read-only timeline");
+    const uint32_t sequence = mData->sequence.load(std::memory_order_relaxed);
+    if (sequence == 0) {
+        return;
+    }
+    mData->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    mData->period = 0;
+    mData->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool VsyncTimeline::read(Snapshot* outSnapshot) const {
+    if (mData == nullptr) {
+        return false;
+    }
+    for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+        const uint32_t sequence = mData->sequence.load(std::memory_order_acquire);
+        if (sequence == 0) {
+            return false;
+        }
+        if (sequence & 1) {
+            continue;
+        }
+        Snapshot snapshot;
+        snapshot.count = mData->count;
+        snapshot.timestamp = mData->timestamp;
+        snapshot.expectedVSyncTimestamp = mData->expectedVSyncTimestamp;
+        snapshot.period = mData->period;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mData->sequence.load(std::memory_order_relaxed) == sequence) {
+            if (snapshot.period <= 0) {
+                return false;
+            }
+            *outSnapshot = snapshot;
+            return true;
+        }
+    }
+    return false;
+}
+
+status_t VsyncTimeline::writeToParcel(Parcel* parcel) const {
+    if (mFd < 0) {
+        return NO_INIT;
+    }
+    return parcel->writeDupFileDescriptor(mFd);
+}
+
+status_t VsyncTimeline::readFromParcel(const Parcel* parcel) {
+    base::unique_fd fd(dup(parcel->readFileDescriptor()));
+    if (fd < 0) {
+        const int error = errno;
+        ALOGE("Failed to read timeline: %s", strerror(error));
+        return -error;
+    }
+    return map(std::move(fd), false);
+}
+
+} // namespace gui
+} // namespace android
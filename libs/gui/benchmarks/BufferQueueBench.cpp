@@ -0,0 +1,348 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <signal.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+#include <gui/BufferItem.h>
+#include <gui/BufferQueue.h>
+#include <gui/FrameTimestamps.h>
+#include <gui/IConsumerListener.h>
+#include <gui/IProducerListener.h>
+#include <gui/StreamSplitter.h>
+#include <system/window.h>
+#include <ui/FenceTime.h>
+#include <ui/GraphicBuffer.h>
+
+namespace android {
+namespace {
+
+// Small buffers, so that the cost measured is the BufferQueue's rather than the allocator's.
+constexpr uint32_t kWidth = 64;
+constexpr uint32_t kHeight = 64;
+
+// Names under which the BufferQueue hosted by another process is registered.
+const String16 kRemoteProducerName("BufferQueueBenchProducer");
+const String16 kRemoteConsumerName("BufferQueueBenchConsumer");
+
+struct Options {
+    int bufferCount = 3;
+    bool async = false;
+    // Whether the producer asks for frame timestamps, like Surface does when an app enables
+    // frame timestamps.
+    bool frameEvents = false;
+};
+
+Options getOptions(const benchmark::State& state) {
+    Options options;
+    options.bufferCount = static_cast<int>(state.range(0));
+    options.async = state.range(1) != 0;
+    options.frameEvents = state.range(2) != 0;
+    return options;
+}
+
+void roundTripArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"buffers", "async", "frameEvents"});
+    for (int bufferCount : {2, 3, 4}) {
+        for (int async : {0, 1}) {
+            for (int frameEvents : {0, 1}) {
+                benchmark->Args({bufferCount, async, frameEvents});
+            }
+        }
+    }
+}
+
+// Lets the consumer block until a frame is queued, like BufferQueue consumers do, and keeps
+// the consumer side of the frame event history, like SurfaceFlinger's layers do.
+class Listener : public BnConsumerListener {
+public:
+    void onFrameAvailable(const BufferItem& /*item*/) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mAvailableFrames++;
+        mCondition.notify_one();
+    }
+    void onBuffersReleased() override {}
+    void onSidebandStreamChanged() override {}
+
+    void addAndGetFrameTimestamps(const NewFrameEventsEntry* newTimestamps,
+                                  FrameEventHistoryDelta* outDelta) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (newTimestamps != nullptr) {
+            mFrameEventHistory.addQueue(*newTimestamps);
+        }
+        if (outDelta != nullptr) {
+            mFrameEventHistory.getAndResetDelta(outDelta);
+        }
+    }
+
+    void waitForFrame() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return mAvailableFrames > 0; });
+        mAvailableFrames--;
+    }
+
+    void onLatched(uint64_t frameNumber) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFrameEventHistory.addLatch(frameNumber, systemTime());
+    }
+
+    void onReleased(uint64_t frameNumber) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFrameEventHistory.addRelease(frameNumber, systemTime(),
+                                      std::shared_ptr<FenceTime>(FenceTime::NO_FENCE));
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    int mAvailableFrames = 0;
+    ConsumerFrameEventHistory mFrameEventHistory;
+};
+
+// Queues frames the way Surface does, minus the buffer contents.
+class Producer {
+public:
+    Producer(const sp<IGraphicBufferProducer>& producer, const Options& options)
+          : mProducer(producer), mOptions(options) {
+        mProducer->setAsyncMode(mOptions.async);
+        IGraphicBufferProducer::QueueBufferOutput output;
+        mProducer->connect(new DummyProducerListener(), NATIVE_WINDOW_API_CPU, false, &output);
+        mProducer->setMaxDequeuedBufferCount(mOptions.bufferCount - 1);
+    }
+
+    ~Producer() { mProducer->disconnect(NATIVE_WINDOW_API_CPU); }
+
+    status_t dequeueAndQueueBuffer() {
+        int slot;
+        sp<Fence> fence;
+        FrameEventHistoryDelta dequeueDelta;
+        status_t result =
+                mProducer->dequeueBuffer(&slot, &fence, kWidth, kHeight, PIXEL_FORMAT_RGBA_8888,
+                                         GRALLOC_USAGE_SW_READ_OFTEN, nullptr,
+                                         mOptions.frameEvents ? &dequeueDelta : nullptr);
+        if (result < 0) {
+            return result;
+        }
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            mProducer->requestBuffer(slot, &buffer);
+        }
+
+        const IGraphicBufferProducer::QueueBufferInput input(systemTime(),
+                                                             true /* autoTimestamp */,
+                                                             HAL_DATASPACE_UNKNOWN,
+                                                             Rect(kWidth, kHeight),
+                                                             NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                             Fence::NO_FENCE, 0,
+                                                             mOptions.frameEvents);
+        IGraphicBufferProducer::QueueBufferOutput output;
+        result = mProducer->queueBuffer(slot, input, &output);
+        if (mOptions.frameEvents) {
+            mFrameEventHistory.applyDelta(dequeueDelta);
+            mFrameEventHistory.applyDelta(output.frameTimestamps);
+        }
+        return result;
+    }
+
+private:
+    const sp<IGraphicBufferProducer> mProducer;
+    const Options mOptions;
+    ProducerFrameEventHistory mFrameEventHistory;
+};
+
+status_t acquireAndReleaseBuffer(const sp<IGraphicBufferConsumer>& consumer,
+                                 Listener* listener) {
+    BufferItem item;
+    status_t result = consumer->acquireBuffer(&item, 0);
+    if (result != NO_ERROR) {
+        return result;
+    }
+    if (listener != nullptr) {
+        listener->onLatched(item.mFrameNumber);
+    }
+    result = consumer->releaseHelper(item.mSlot, item.mFrameNumber, Fence::NO_FENCE);
+    if (listener != nullptr) {
+        listener->onReleased(item.mFrameNumber);
+    }
+    return result;
+}
+
+// Dequeues, queues, acquires and releases a buffer per iteration on a single thread. This is
+// the latency a frame sees through a BufferQueue when neither side has to wait.
+void BM_RoundTrip(benchmark::State& state) {
+    sp<IGraphicBufferProducer> bufferProducer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&bufferProducer, &consumer);
+    const sp<Listener> listener = new Listener();
+    consumer->consumerConnect(listener, false);
+    consumer->setDefaultBufferSize(kWidth, kHeight);
+
+    const Options options = getOptions(state);
+    Producer producer(bufferProducer, options);
+    // Like SurfaceFlinger, only track latch and release times when the producer wants them.
+    Listener* const frameEventListener = options.frameEvents ? listener.get() : nullptr;
+    for (auto _ : state) {
+        if (producer.dequeueAndQueueBuffer() != NO_ERROR ||
+            acquireAndReleaseBuffer(consumer, frameEventListener) != NO_ERROR) {
+            state.SkipWithError("Failed to pass a buffer through the BufferQueue");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RoundTrip)->Apply(roundTripArguments);
+
+// Same as BM_RoundTrip, with the BufferQueue and its consumer listener in another process, like
+// SurfaceFlinger, so that every call crosses binder. Latch and release times are not recorded
+// on this side, so with frameEvents enabled only the queue timestamps travel back.
+void BM_RoundTripOverBinder(benchmark::State& state) {
+    const sp<IServiceManager> serviceManager = defaultServiceManager();
+    const sp<IGraphicBufferProducer> bufferProducer = interface_cast<IGraphicBufferProducer>(
+            serviceManager->getService(kRemoteProducerName));
+    const sp<IGraphicBufferConsumer> consumer = interface_cast<IGraphicBufferConsumer>(
+            serviceManager->getService(kRemoteConsumerName));
+    if (bufferProducer == nullptr || consumer == nullptr) {
+        state.SkipWithError("Failed to get the BufferQueue hosted by another process");
+        return;
+    }
+
+    Producer producer(bufferProducer, getOptions(state));
+    for (auto _ : state) {
+        if (producer.dequeueAndQueueBuffer() != NO_ERROR ||
+            acquireAndReleaseBuffer(consumer, nullptr) != NO_ERROR) {
+            state.SkipWithError("Failed to pass a buffer through the BufferQueue");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RoundTripOverBinder)->Apply(roundTripArguments);
+
+// Queues a buffer into a StreamSplitter and passes it through state.range(0) output
+// BufferQueues per iteration. The input buffer is only released back to the producer once
+// every output has released it.
+void BM_StreamSplitter(benchmark::State& state) {
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+    sp<StreamSplitter> splitter;
+    if (StreamSplitter::createSplitter(inputConsumer, &splitter) != NO_ERROR) {
+        state.SkipWithError("Failed to create the splitter");
+        return;
+    }
+
+    std::vector<sp<IGraphicBufferConsumer>> outputConsumers(state.range(0));
+    for (auto& outputConsumer : outputConsumers) {
+        sp<IGraphicBufferProducer> outputProducer;
+        BufferQueue::createBufferQueue(&outputProducer, &outputConsumer);
+        outputConsumer->consumerConnect(new Listener(), false);
+        splitter->addOutput(outputProducer);
+    }
+
+    Producer producer(inputProducer, Options());
+    for (auto _ : state) {
+        status_t result = producer.dequeueAndQueueBuffer();
+        for (const auto& outputConsumer : outputConsumers) {
+            if (result == NO_ERROR) {
+                result = acquireAndReleaseBuffer(outputConsumer, nullptr);
+            }
+        }
+        if (result != NO_ERROR) {
+            state.SkipWithError("Failed to pass a buffer through the splitter");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StreamSplitter)->Arg(1)->Arg(2)->Arg(4);
+
+// A producer thread queues frames as fast as the consumer, on the benchmark thread, acquires
+// and releases them, with state.range(0) buffers in the queue. This is the handoff between
+// an app and SurfaceFlinger, minus binder and the display.
+void BM_ProducerConsumerContention(benchmark::State& state) {
+    sp<IGraphicBufferProducer> bufferProducer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&bufferProducer, &consumer);
+    const sp<Listener> listener = new Listener();
+    consumer->consumerConnect(listener, false);
+    consumer->setDefaultBufferSize(kWidth, kHeight);
+
+    Options options;
+    options.bufferCount = static_cast<int>(state.range(0));
+    Producer producer(bufferProducer, options);
+    std::thread producerThread([&producer] {
+        // Stops once the consumer disconnects and abandons the queue.
+        while (producer.dequeueAndQueueBuffer() == NO_ERROR) {
+        }
+    });
+
+    for (auto _ : state) {
+        listener->waitForFrame();
+        if (acquireAndReleaseBuffer(consumer, nullptr) != NO_ERROR) {
+            state.SkipWithError("Failed to acquire and release a buffer");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    consumer->consumerDisconnect();
+    producerThread.join();
+}
+BENCHMARK(BM_ProducerConsumerContention)->Arg(2)->Arg(3)->Arg(4)->UseRealTime();
+
+// Hosts a BufferQueue for BM_RoundTripOverBinder in a child process. This has to happen
+// before this process uses binder, see BufferQueueTest.DISABLED_BufferQueueInAnotherProcess.
+void startRemoteBufferQueue() {
+    const pid_t pid = fork();
+    if (pid != 0) {
+        return;
+    }
+
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    consumer->consumerConnect(new Listener(), false);
+    consumer->setDefaultBufferSize(kWidth, kHeight);
+    const sp<IServiceManager> serviceManager = defaultServiceManager();
+    serviceManager->addService(kRemoteProducerName, IInterface::asBinder(producer));
+    serviceManager->addService(kRemoteConsumerName, IInterface::asBinder(consumer));
+    ProcessState::self()->startThreadPool();
+    IPCThreadState::self()->joinThreadPool();
+    _exit(0);
+}
+
+} // namespace
+} // namespace android
+
+int main(int argc, char** argv) {
+    android::startRemoteBufferQueue();
+    android::ProcessState::self()->startThreadPool();
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+
+#include <gui/BufferItem.h>
+#include <gui/BufferQueue.h>
+#include <gui/IConsumerListener.h>
+#include <gui/Surface.h>
+#include <system/window.h>
+
+namespace android {
+namespace {
+
+class NoOpConsumerListener : public BnConsumerListener {
+public:
+    void onFrameAvailable(const BufferItem& /*item*/) override {}
+    void onBuffersReleased() override {}
+    void onSidebandStreamChanged() override {}
+};
+
+void surfaceSizes(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"width", "height", "damage%"});
+    for (const auto& [width, height] : {std::pair(1920, 1080), std::pair(3840, 2160)}) {
+        // Full damage needs no copy back, the others copy back the rest of the buffer.
+        for (int damagePercent : {100, 25, 1}) {
+            benchmark->Args({width, height, damagePercent});
+        }
+    }
+}
+
+// A centered rect covering damagePercent of the surface, like a CPU rendered app redrawing a
+// single view.
+ARect getDamage(int32_t width, int32_t height, int64_t damagePercent) {
+    const double scale = std::sqrt(static_cast<double>(damagePercent) / 100.0);
+    const int32_t damageWidth = static_cast<int32_t>(width * scale);
+    const int32_t damageHeight = static_cast<int32_t>(height * scale);
+    const int32_t left = (width - damageWidth) / 2;
+    const int32_t top = (height - damageHeight) / 2;
+    return {left, top, left + damageWidth, top + damageHeight};
+}
+
+// Locks, posts, acquires and releases a frame of a CPU rendered surface per iteration. Every
+// frame but the first few copies the undamaged part of the previous frame back into the
+// buffer being drawn.
+void BM_SurfaceLock(benchmark::State& state) {
+    const int32_t width = static_cast<int32_t>(state.range(0));
+    const int32_t height = static_cast<int32_t>(state.range(1));
+
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    consumer->consumerConnect(new NoOpConsumerListener(), false);
+    consumer->setDefaultBufferSize(width, height);
+
+    const sp<Surface> surface = new Surface(producer);
+    native_window_set_buffers_format(surface.get(), HAL_PIXEL_FORMAT_RGBA_8888);
+    const ARect damage = getDamage(width, height, state.range(2));
+    for (auto _ : state) {
+        ANativeWindow_Buffer buffer;
+        ARect dirty = damage;
+        if (surface->lock(&buffer, &dirty) != NO_ERROR || surface->unlockAndPost() != NO_ERROR) {
+            state.SkipWithError("Failed to draw a frame");
+            break;
+        }
+
+        BufferItem item;
+        if (consumer->acquireBuffer(&item, 0) != NO_ERROR ||
+            consumer->releaseHelper(item.mSlot, item.mFrameNumber, Fence::NO_FENCE) !=
+                    NO_ERROR) {
+            state.SkipWithError("Failed to consume a frame");
+            break;
+        }
+    }
+    native_window_api_disconnect(surface.get(), NATIVE_WINDOW_API_CPU);
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * width * height * 4);
+}
+BENCHMARK(BM_SurfaceLock)->Apply(surfaceSizes);
+
+} // namespace
+} // namespace android
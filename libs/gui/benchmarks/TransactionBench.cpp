@@ -0,0 +1,132 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include <binder/Binder.h>
+#include <binder/Parcel.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+
+namespace android {
+namespace {
+
+using Transaction = SurfaceComposerClient::Transaction;
+
+// Surface controls that only carry a handle, which is all that building, merging and
+// parcelling a transaction needs.
+std::vector<sp<SurfaceControl>> createSurfaceControls(int64_t count) {
+    std::vector<sp<SurfaceControl>> surfaceControls;
+    surfaceControls.reserve(count);
+    for (int64_t i = 0; i < count; i++) {
+        surfaceControls.push_back(new SurfaceControl(nullptr, new BBinder(), nullptr));
+    }
+    return surfaceControls;
+}
+
+// Sets what a window animation typically changes on every frame.
+void animateLayers(Transaction& transaction,
+                   const std::vector<sp<SurfaceControl>>& surfaceControls, float progress) {
+    for (const auto& surfaceControl : surfaceControls) {
+        transaction.setPosition(surfaceControl, progress * 100.0f, progress * 200.0f)
+                .setAlpha(surfaceControl, progress)
+                .setMatrix(surfaceControl, progress, 0.0f, 0.0f, progress)
+                .setCrop_legacy(surfaceControl, Rect(100, 200))
+                .setCornerRadius(surfaceControl, 16.0f);
+    }
+}
+
+void layerCounts(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgName("layers")->Arg(1)->Arg(10)->Arg(100)->Arg(500);
+}
+
+void BM_TransactionBuild(benchmark::State& state) {
+    const auto surfaceControls = createSurfaceControls(state.range(0));
+    for (auto _ : state) {
+        Transaction transaction;
+        animateLayers(transaction, surfaceControls, 0.5f);
+        benchmark::DoNotOptimize(transaction);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransactionBuild)->Apply(layerCounts);
+
+// Builds a transaction and merges it into an empty one, which takes the states over.
+void BM_TransactionMergeIntoEmpty(benchmark::State& state) {
+    const auto surfaceControls = createSurfaceControls(state.range(0));
+    for (auto _ : state) {
+        Transaction transaction;
+        animateLayers(transaction, surfaceControls, 0.5f);
+        Transaction merged;
+        merged.merge(std::move(transaction));
+        benchmark::DoNotOptimize(merged);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransactionMergeIntoEmpty)->Apply(layerCounts);
+
+// Builds a transaction and merges it into one that already changes the same layers, like
+// animation frames that are merged before being applied. Compare with BM_TransactionBuild for
+// the cost of the merge alone.
+void BM_TransactionMergeIntoPending(benchmark::State& state) {
+    const auto surfaceControls = createSurfaceControls(state.range(0));
+    Transaction pending;
+    animateLayers(pending, surfaceControls, 0.0f);
+    for (auto _ : state) {
+        Transaction transaction;
+        animateLayers(transaction, surfaceControls, 0.5f);
+        pending.merge(std::move(transaction));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransactionMergeIntoPending)->Apply(layerCounts);
+
+void BM_TransactionWriteToParcel(benchmark::State& state) {
+    const auto surfaceControls = createSurfaceControls(state.range(0));
+    Transaction transaction;
+    animateLayers(transaction, surfaceControls, 0.5f);
+    Parcel parcel;
+    for (auto _ : state) {
+        parcel.setDataSize(0);
+        transaction.writeToParcel(&parcel);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["parcelBytes"] = parcel.dataSize();
+}
+BENCHMARK(BM_TransactionWriteToParcel)->Apply(layerCounts);
+
+void BM_TransactionReadFromParcel(benchmark::State& state) {
+    const auto surfaceControls = createSurfaceControls(state.range(0));
+    Transaction transaction;
+    animateLayers(transaction, surfaceControls, 0.5f);
+    Parcel parcel;
+    transaction.writeToParcel(&parcel);
+    for (auto _ : state) {
+        parcel.setDataPosition(0);
+        Transaction result;
+        if (result.readFromParcel(&parcel) != NO_ERROR) {
+            state.SkipWithError("Failed to read the transaction");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransactionReadFromParcel)->Apply(layerCounts);
+
+} // namespace
+} // namespace android
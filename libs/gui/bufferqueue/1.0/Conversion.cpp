@@ -645,6 +645,67 @@ status_t unflatten(
     return NO_ERROR;
 }
 
+/**
+ * \brief Wrap `::android::FenceTime::Snapshot` in
+ * `HGraphicBufferProducer::FenceTimeSnapshot`.
+ *
+ * \param[out] t The wrapper of type `HGraphicBufferProducer::FenceTimeSnapshot`.
+ * \param[out] nh The native handle pointed to by \p t, or `nullptr`.
+ * \param[in] l The source `::android::FenceTime::Snapshot`.
+ *
+ * On success, \p nh will be either `nullptr` or a newly created native handle,
+ * which must be deleted manually with `native_handle_delete()` afterwards.
+ */
+// wrap: FenceTime::Snapshot -> FenceTimeSnapshot
+bool wrapAs(HGraphicBufferProducer::FenceTimeSnapshot* t,
+        native_handle_t** nh, ::android::FenceTime::Snapshot const& l) {
+    *nh = nullptr;
+    switch (l.state) {
+        case ::android::FenceTime::Snapshot::State::EMPTY:
+            t->state = HGraphicBufferProducer::FenceTimeSnapshot::State::EMPTY;
+            return true;
+        case ::android::FenceTime::Snapshot::State::FENCE:
+            t->state = HGraphicBufferProducer::FenceTimeSnapshot::State::FENCE;
+            return wrapAs(&t->fence, nh, *l.fence);
+        case ::android::FenceTime::Snapshot::State::SIGNAL_TIME:
+            t->state = HGraphicBufferProducer::FenceTimeSnapshot::State::SIGNAL_TIME;
+            t->signalTimeNs = l.signalTime;
+            return true;
+    }
+    return false;
+}
+
+/**
+ * \brief Convert `HGraphicBufferProducer::FenceTimeSnapshot` to
+ * `::android::FenceTime::Snapshot`.
+ *
+ * \param[out] l The destination `::android::FenceTime::Snapshot`.
+ * \param[in] t The source `HGraphicBufferProducer::FenceTimeSnapshot`.
+ *
+ * If \p t contains a valid file descriptor, it will be duplicated.
+ */
+// convert: FenceTimeSnapshot -> FenceTime::Snapshot
+bool convertTo(::android::FenceTime::Snapshot* l,
+        HGraphicBufferProducer::FenceTimeSnapshot const& t) {
+    switch (t.state) {
+        case HGraphicBufferProducer::FenceTimeSnapshot::State::EMPTY:
+            *l = ::android::FenceTime::Snapshot();
+            return true;
+        case HGraphicBufferProducer::FenceTimeSnapshot::State::FENCE: {
+            sp<Fence> fence = new Fence();
+            if (!convertTo(fence.get(), t.fence)) {
+                return false;
+            }
+            *l = ::android::FenceTime::Snapshot(fence);
+            return true;
+        }
+        case HGraphicBufferProducer::FenceTimeSnapshot::State::SIGNAL_TIME:
+            *l = ::android::FenceTime::Snapshot(t.signalTimeNs);
+            return true;
+    }
+    return false;
+}
+
 // Ref: frameworks/native/libs/gui/FrameTimestamps.cpp: FrameEventsDelta
 
 /**
@@ -938,6 +999,129 @@ status_t flatten(
     return NO_ERROR;
 }
 
+/**
+ * \brief Copies frame event deltas field by field to and from their HIDL
+ * counterparts.
+ *
+ * The native types are flattened in a compact encoding that the HIDL types do
+ * not follow, so their fields are accessed directly as a friend instead.
+ */
+class FrameEventHistoryDeltaConverter {
+public:
+    static bool wrapAs(HGraphicBufferProducer::FrameEventHistoryDelta* t,
+            std::vector<std::vector<native_handle_t*> >* nh,
+            ::android::FrameEventHistoryDelta const& l);
+    static bool convertTo(::android::FrameEventHistoryDelta* l,
+            HGraphicBufferProducer::FrameEventHistoryDelta const& t);
+
+private:
+    static bool wrapAs(HGraphicBufferProducer::FrameEventsDelta* t,
+            std::vector<native_handle_t*>* nh,
+            ::android::FrameEventsDelta const& l);
+    static bool convertTo(::android::FrameEventsDelta* l,
+            HGraphicBufferProducer::FrameEventsDelta const& t);
+};
+
+bool FrameEventHistoryDeltaConverter::wrapAs(
+        HGraphicBufferProducer::FrameEventsDelta* t,
+        std::vector<native_handle_t*>* nh,
+        ::android::FrameEventsDelta const& l) {
+    t->frameNumber = l.mFrameNumber;
+    t->index = static_cast<uint32_t>(l.mIndex);
+    t->addPostCompositeCalled = l.mAddPostCompositeCalled;
+    t->addRetireCalled = false;
+    t->addReleaseCalled = l.mAddReleaseCalled;
+    t->postedTimeNs = l.mPostedTime;
+    t->requestedPresentTimeNs = l.mRequestedPresentTime;
+    t->latchTimeNs = l.mLatchTime;
+    t->firstRefreshStartTimeNs = l.mFirstRefreshStartTime;
+    t->lastRefreshStartTimeNs = l.mLastRefreshStartTime;
+    t->dequeueReadyTime = l.mDequeueReadyTime;
+
+    // Display retire fences are no longer produced.
+    nh->assign(4, nullptr);
+    t->displayRetireFence.state =
+            HGraphicBufferProducer::FenceTimeSnapshot::State::EMPTY;
+    return ::android::conversion::wrapAs(&t->gpuCompositionDoneFence,
+                    &(*nh)[0], l.mGpuCompositionDoneFence) &&
+            ::android::conversion::wrapAs(&t->displayPresentFence,
+                    &(*nh)[1], l.mDisplayPresentFence) &&
+            ::android::conversion::wrapAs(&t->releaseFence,
+                    &(*nh)[3], l.mReleaseFence);
+}
+
+bool FrameEventHistoryDeltaConverter::wrapAs(
+        HGraphicBufferProducer::FrameEventHistoryDelta* t,
+        std::vector<std::vector<native_handle_t*> >* nh,
+        ::android::FrameEventHistoryDelta const& l) {
+    t->compositorTiming.deadlineNs = l.mCompositorTiming.deadline;
+    t->compositorTiming.intervalNs = l.mCompositorTiming.interval;
+    t->compositorTiming.presentLatencyNs = l.mCompositorTiming.presentLatency;
+
+    t->deltas.resize(l.mDeltas.size());
+    nh->resize(l.mDeltas.size());
+    for (size_t deltaIndex = 0; deltaIndex < l.mDeltas.size(); ++deltaIndex) {
+        if (!wrapAs(&t->deltas[deltaIndex], &(*nh)[deltaIndex],
+                l.mDeltas[deltaIndex])) {
+            for (auto& nhA : *nh) {
+                for (auto& handle : nhA) {
+                    if (handle != nullptr) {
+                        native_handle_delete(handle);
+                        handle = nullptr;
+                    }
+                }
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FrameEventHistoryDeltaConverter::convertTo(
+        ::android::FrameEventsDelta* l,
+        HGraphicBufferProducer::FrameEventsDelta const& t) {
+    if (t.index >= ::android::FrameEventHistory::MAX_FRAME_HISTORY) {
+        return false;
+    }
+    l->mIndex = t.index;
+    l->mFrameNumber = t.frameNumber;
+    l->mAddPostCompositeCalled = t.addPostCompositeCalled;
+    l->mAddReleaseCalled = t.addReleaseCalled;
+    l->mPostedTime = t.postedTimeNs;
+    l->mRequestedPresentTime = t.requestedPresentTimeNs;
+    l->mLatchTime = t.latchTimeNs;
+    l->mFirstRefreshStartTime = t.firstRefreshStartTimeNs;
+    l->mLastRefreshStartTime = t.lastRefreshStartTimeNs;
+    l->mDequeueReadyTime = t.dequeueReadyTime;
+    return ::android::conversion::convertTo(&l->mGpuCompositionDoneFence,
+                    t.gpuCompositionDoneFence) &&
+            ::android::conversion::convertTo(&l->mDisplayPresentFence,
+                    t.displayPresentFence) &&
+            ::android::conversion::convertTo(&l->mReleaseFence,
+                    t.releaseFence);
+}
+
+bool FrameEventHistoryDeltaConverter::convertTo(
+        ::android::FrameEventHistoryDelta* l,
+        HGraphicBufferProducer::FrameEventHistoryDelta const& t) {
+    if (t.deltas.size() > ::android::FrameEventHistory::MAX_FRAME_HISTORY) {
+        return false;
+    }
+
+    std::vector<::android::FrameEventsDelta> deltas(t.deltas.size());
+    for (size_t deltaIndex = 0; deltaIndex < t.deltas.size(); ++deltaIndex) {
+        if (!convertTo(&deltas[deltaIndex], t.deltas[deltaIndex])) {
+            return false;
+        }
+    }
+
+    l->mDeltas = std::move(deltas);
+    l->mCompositorTiming.deadline = t.compositorTiming.deadlineNs;
+    l->mCompositorTiming.interval = t.compositorTiming.intervalNs;
+    l->mCompositorTiming.presentLatency = t.compositorTiming.presentLatencyNs;
+    return true;
+}
+
 /**
  * \brief Wrap `::android::FrameEventHistoryData` in
  * `HGraphicBufferProducer::FrameEventHistoryDelta`.
@@ -955,38 +1139,7 @@ status_t flatten(
 bool wrapAs(HGraphicBufferProducer::FrameEventHistoryDelta* t,
         std::vector<std::vector<native_handle_t*> >* nh,
         ::android::FrameEventHistoryDelta const& l) {
-
-    size_t const baseSize = l.getFlattenedSize();
-    std::unique_ptr<uint8_t[]> baseBuffer(
-            new (std::nothrow) uint8_t[baseSize]);
-    if (!baseBuffer) {
-        return false;
-    }
-
-    size_t const baseNumFds = l.getFdCount();
-    std::unique_ptr<int[]> baseFds(
-            new (std::nothrow) int[baseNumFds]);
-    if (!baseFds) {
-        return false;
-    }
-
-    void* buffer = static_cast<void*>(baseBuffer.get());
-    size_t size = baseSize;
-    int* fds = baseFds.get();
-    size_t numFds = baseNumFds;
-    if (l.flatten(buffer, size, fds, numFds) != NO_ERROR) {
-        return false;
-    }
-
-    void const* constBuffer = static_cast<void const*>(baseBuffer.get());
-    size = baseSize;
-    int const* constFds = static_cast<int const*>(baseFds.get());
-    numFds = baseNumFds;
-    if (unflatten(t, nh, constBuffer, size, constFds, numFds) != NO_ERROR) {
-        return false;
-    }
-
-    return true;
+    return FrameEventHistoryDeltaConverter::wrapAs(t, nh, l);
 }
 
 /**
@@ -1001,38 +1154,7 @@ bool wrapAs(HGraphicBufferProducer::FrameEventHistoryDelta* t,
 bool convertTo(
         ::android::FrameEventHistoryDelta* l,
         HGraphicBufferProducer::FrameEventHistoryDelta const& t) {
-
-    size_t const baseSize = getFlattenedSize(t);
-    std::unique_ptr<uint8_t[]> baseBuffer(
-            new (std::nothrow) uint8_t[baseSize]);
-    if (!baseBuffer) {
-        return false;
-    }
-
-    size_t const baseNumFds = getFdCount(t);
-    std::unique_ptr<int[]> baseFds(
-            new (std::nothrow) int[baseNumFds]);
-    if (!baseFds) {
-        return false;
-    }
-
-    void* buffer = static_cast<void*>(baseBuffer.get());
-    size_t size = baseSize;
-    int* fds = static_cast<int*>(baseFds.get());
-    size_t numFds = baseNumFds;
-    if (flatten(t, buffer, size, fds, numFds) != NO_ERROR) {
-        return false;
-    }
-
-    void const* constBuffer = static_cast<void const*>(baseBuffer.get());
-    size = baseSize;
-    int const* constFds = static_cast<int const*>(baseFds.get());
-    numFds = baseNumFds;
-    if (l->unflatten(constBuffer, size, constFds, numFds) != NO_ERROR) {
-        return false;
-    }
-
-    return true;
+    return FrameEventHistoryDeltaConverter::convertTo(l, t);
 }
 
 // Ref: frameworks/native/libs/ui/Region.cpp
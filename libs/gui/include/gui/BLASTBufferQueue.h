@@ -83,6 +83,25 @@ public:
 
     void update(const sp<SurfaceControl>& surface, int width, int height);
 
+    // How buffers are submitted to SurfaceFlinger.
+    enum class PacingPolicy {
+        // One transaction in flight at a time, presented as soon as possible.
+        Default,
+        // Up to THROUGHPUT_MAX_ACQUIRED_BUFFERS transactions in flight, for producers that
+        // render ahead, such as video and games. Frames submitted behind another one are given
+        // the present time of the following vsync, so that SurfaceFlinger does not apply both in
+        // the same frame and drop the first.
+        Throughput,
+        // One transaction in flight, and frames that queued up behind it are dropped in favor of
+        // the newest one, for producers that follow touch input.
+        LowLatency,
+    };
+    status_t setPacingPolicy(PacingPolicy policy);
+
+    // Dumps the pacing policy and stats, followed by the state of the BufferQueue, for the owner
+    // of the BLASTBufferQueue to include in its own dump.
+    void dump(std::string& result);
+
     virtual ~BLASTBufferQueue() = default;
 
 private:
@@ -94,8 +113,25 @@ private:
 
     void processNextBufferLocked(bool useNextTransaction) REQUIRES(mMutex);
     Rect computeCrop(const BufferItem& item);
+    // Returns when a frame submitted now should be presented, or 0 to present it as soon as
+    // possible. Sets outExpectedPresentTime to when it is expected to be presented, or 0 if it
+    // is not paced.
+    nsecs_t computePacedPresentTimeLocked(nsecs_t* outExpectedPresentTime) REQUIRES(mMutex);
+
+    struct SubmittedFrame {
+        nsecs_t submitTime = 0;
+        nsecs_t expectedPresentTime = 0;
+    };
+    // Updates the stats and the pacing of the frames in flight from the latch time and present
+    // fence reported by the transaction callback of the oldest submitted frame.
+    void updatePacingLocked(nsecs_t latchTime, const sp<Fence>& presentFence) REQUIRES(mMutex);
+    // Paces the frames submitted after the given one from when it was presented, if it was
+    // presented later than expected. Returns whether it was.
+    bool followPresentTimeLocked(const SubmittedFrame& frame, nsecs_t presentTime,
+                                 size_t framesBehind) REQUIRES(mMutex);
 
     sp<SurfaceControl> mSurfaceControl;
+    std::string mName;
 
     std::mutex mMutex;
     std::condition_variable mCallbackCV;
@@ -103,10 +139,38 @@ private:
     // BufferQueue internally allows 1 more than
     // the max to be acquired
     static const int MAX_ACQUIRED_BUFFERS = 1;
+    static const int THROUGHPUT_MAX_ACQUIRED_BUFFERS = 2;
 
     int32_t mNumFrameAvailable GUARDED_BY(mMutex);
     int32_t mNumAcquired GUARDED_BY(mMutex);
 
+    PacingPolicy mPacingPolicy GUARDED_BY(mMutex) = PacingPolicy::Default;
+    int32_t mMaxAcquiredBuffers GUARDED_BY(mMutex) = MAX_ACQUIRED_BUFFERS;
+    // Vsync timing from the last transaction callback.
+    CompositorTiming mCompositorTiming GUARDED_BY(mMutex);
+    // When the last submitted frame is expected to be presented.
+    nsecs_t mLastExpectedPresentTime GUARDED_BY(mMutex) = 0;
+    // When each frame in mSubmitted was submitted and is expected to be presented.
+    std::queue<SubmittedFrame> mSubmittedFrames GUARDED_BY(mMutex);
+    // Present fence of the last callback, which usually has not signaled yet when the callback
+    // comes in, and the frame it presents.
+    sp<Fence> mLastPresentFence GUARDED_BY(mMutex);
+    SubmittedFrame mLastPresentedFrame GUARDED_BY(mMutex);
+
+    // Stats for dump.
+    uint64_t mSubmittedCount GUARDED_BY(mMutex) = 0;
+    // Frames released unpresented by the LowLatency policy.
+    uint64_t mDroppedCount GUARDED_BY(mMutex) = 0;
+    uint64_t mPacedCount GUARDED_BY(mMutex) = 0;
+    // Paced frames presented at least half a vsync later than expected.
+    uint64_t mLateCount GUARDED_BY(mMutex) = 0;
+    // The most transactions that were in flight at once.
+    size_t mMaxInFlight GUARDED_BY(mMutex) = 0;
+    uint64_t mLatchedCount GUARDED_BY(mMutex) = 0;
+    nsecs_t mTotalLatchLatency GUARDED_BY(mMutex) = 0;
+    uint64_t mPresentedCount GUARDED_BY(mMutex) = 0;
+    nsecs_t mTotalPresentLatency GUARDED_BY(mMutex) = 0;
+
     struct PendingReleaseItem {
         BufferItem item;
         sp<Fence> releaseFence;
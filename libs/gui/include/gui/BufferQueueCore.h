@@ -219,6 +219,13 @@ private:
     // synchronous mode.
     mutable std::condition_variable mDequeueCondition;
 
+    // mDequeueWaiters is the number of producer threads waiting on
+    // mDequeueCondition. Signaling a condition variable costs a futex syscall
+    // even when nobody waits on it, so queueBuffer, acquireBuffer and
+    // releaseBuffer only signal it when this is non-zero, and do so after
+    // unlocking mMutex so that the woken producer doesn't block on it again.
+    int mDequeueWaiters;
+
     // mDequeueBufferCannotBlock indicates whether dequeueBuffer is allowed to
     // block. This flag is set during connect when both the producer and
     // consumer are controlled by the application.
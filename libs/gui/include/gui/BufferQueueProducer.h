@@ -259,6 +259,9 @@ private:
     int mNextCallbackTicket; // Protected by mCore->mMutex
     int mCurrentCallbackTicket; // Protected by mCallbackMutex
     std::condition_variable mCallbackCondition;
+    // Number of producer threads waiting for their ticket, so that the
+    // condition is only signaled when another queueBuffer call waits on it.
+    int mCallbackWaiters; // Protected by mCallbackMutex
 
     // Sets how long dequeueBuffer or attachBuffer will block if a buffer or
     // slot is not yet available.
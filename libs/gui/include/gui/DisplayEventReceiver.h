@@ -26,6 +26,7 @@
 
 #include <binder/IInterface.h>
 #include <gui/ISurfaceComposer.h>
+#include <gui/VsyncTimeline.h>
 
 // ----------------------------------------------------------------------------
 
@@ -148,9 +149,19 @@ public:
      */
     status_t requestNextVsync();
 
+    /*
+     * getVsyncTimeline() reads the most recent VSYNC event from memory shared with
+     * SurfaceFlinger, along with the predicted period, without waiting for an event. Use
+     * VsyncTimeline::Snapshot::nextAfter() to predict upcoming events. Returns NOT_ENOUGH_DATA
+     * if no prediction is available, e.g. right after a refresh rate change, in which case
+     * requestNextVsync() should be used instead. The first call maps the shared memory.
+     */
+    status_t getVsyncTimeline(gui::VsyncTimeline::Snapshot* outSnapshot);
+
 private:
     sp<IDisplayEventConnection> mEventConnection;
     std::unique_ptr<gui::BitTube> mDataChannel;
+    std::unique_ptr<gui::VsyncTimeline> mVsyncTimeline;
 };
 
 // ----------------------------------------------------------------------------
@@ -24,6 +24,7 @@
 
 #include <array>
 #include <bitset>
+#include <utility>
 #include <vector>
 
 namespace android {
@@ -31,6 +32,10 @@ namespace android {
 struct FrameEvents;
 class FrameEventHistoryDelta;
 
+namespace conversion {
+class FrameEventHistoryDeltaConverter;
+} // namespace conversion
+
 
 // Identifiers for all the events that may be recorded or reported.
 enum class FrameEvent {
@@ -146,9 +151,15 @@ public:
     void updateSignalTimes();
 
 protected:
+    // The FenceTimes created while applying a delta, so that events that
+    // share a fence share its FenceTime and its signal time is only queried
+    // once.
+    using FenceTimeCache =
+            std::vector<std::pair<const Fence*, std::shared_ptr<FenceTime>>>;
+
     void applyFenceDelta(FenceTimeline* timeline,
             std::shared_ptr<FenceTime>* dst,
-            const FenceTime::Snapshot& src) const;
+            const FenceTime::Snapshot& src, FenceTimeCache* cache) const;
 
     // virtual for testing.
     virtual std::shared_ptr<FenceTime> createFenceTime(
@@ -163,6 +174,7 @@ protected:
     FenceTimeline mGpuCompositionDoneTimeline;
     FenceTimeline mPresentTimeline;
     FenceTimeline mReleaseTimeline;
+    FenceTimeline::Poller mFencePoller;
 };
 
 
@@ -240,12 +252,23 @@ private:
 
 
 // A single frame update from the consumer to producer that can be sent
-// through Binder.
+// through Binder as part of a FrameEventHistoryDelta.
 // Although this may be sent multiple times for the same frame as new
 // timestamps are set, Fences only need to be sent once.
-class FrameEventsDelta : public Flattenable<FrameEventsDelta> {
+class FrameEventsDelta {
 friend class ProducerFrameEventHistory;
+friend class conversion::FrameEventHistoryDeltaConverter;
 public:
+    // What the deltas of a FrameEventHistoryDelta that were already flattened
+    // or unflattened leave for the next one, which is encoded relative to
+    // them.
+    struct Codec {
+        uint64_t frameNumber{0};
+        nsecs_t timestamp{0};
+        // Fences already in the buffer, which later deltas refer to by index.
+        std::vector<sp<Fence>> fences;
+    };
+
     FrameEventsDelta() = default;
     FrameEventsDelta(size_t index,
             const FrameEvents& frameTimestamps,
@@ -258,17 +281,16 @@ public:
     FrameEventsDelta(const FrameEventsDelta& src) = delete;
     FrameEventsDelta& operator=(const FrameEventsDelta& src) = delete;
 
-    // Flattenable implementation
-    size_t getFlattenedSize() const;
-    size_t getFdCount() const;
-    status_t flatten(void*& buffer, size_t& size, int*& fds,
+    // Similar to Flattenable, but each call advances the codec past this
+    // delta, and getFlattenedSize() adds the file descriptors of this delta
+    // to fdCount.
+    size_t getFlattenedSize(Codec* codec, size_t* fdCount) const;
+    status_t flatten(Codec* codec, void*& buffer, size_t& size, int*& fds,
             size_t& count) const;
-    status_t unflatten(void const*& buffer, size_t& size, int const*& fds,
-            size_t& count);
+    status_t unflatten(Codec* codec, void const*& buffer, size_t& size,
+            int const*& fds, size_t& count);
 
 private:
-    static constexpr size_t minFlattenedSize();
-
     size_t mIndex{0};
     uint64_t mFrameNumber{0};
 
@@ -296,6 +318,16 @@ private:
             &fed->mReleaseFence
         }};
     }
+
+    template <typename ThisT>
+    static inline auto allTimestamps(ThisT fed) ->
+            std::array<decltype(&fed->mPostedTime), 6> {
+        return {{
+            &fed->mPostedTime, &fed->mRequestedPresentTime, &fed->mLatchTime,
+            &fed->mFirstRefreshStartTime, &fed->mLastRefreshStartTime,
+            &fed->mDequeueReadyTime
+        }};
+    }
 };
 
 
@@ -306,6 +338,7 @@ class FrameEventHistoryDelta
 
 friend class ConsumerFrameEventHistory;
 friend class ProducerFrameEventHistory;
+friend class conversion::FrameEventHistoryDeltaConverter;
 
 public:
     FrameEventHistoryDelta() = default;
@@ -328,6 +361,7 @@ public:
 
 private:
     static constexpr size_t minFlattenedSize();
+    size_t getFlattenedSize(size_t* fdCount) const;
 
     std::vector<FrameEventsDelta> mDeltas;
     CompositorTiming mCompositorTiming;
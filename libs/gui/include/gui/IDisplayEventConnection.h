@@ -27,6 +27,7 @@ namespace android {
 
 namespace gui {
 class BitTube;
+class VsyncTimeline;
 } // namespace gui
 
 class IDisplayEventConnection : public IInterface {
@@ -51,6 +52,12 @@ public:
      * requestNextVsync() schedules the next vsync event. It has no effect if the vsync rate is > 0.
      */
     virtual void requestNextVsync() = 0; // Asynchronous
+
+    /*
+     * getVsyncTimeline() maps the shared memory through which the VSYNC timeline of this
+     * connection's event thread is published into outTimeline.
+     */
+    virtual status_t getVsyncTimeline(gui::VsyncTimeline* outTimeline) = 0;
 };
 
 class BnDisplayEventConnection : public SafeBnInterface<IDisplayEventConnection> {
@@ -114,6 +114,10 @@ public:
     DECLARE_META_INTERFACE(TransactionCompletedListener)
 
     virtual void onTransactionCompleted(ListenerStats stats) = 0;
+
+    // Called when SurfaceFlinger evicts a buffer the process cached, because the process cached
+    // more buffers than the cache holds.
+    virtual void onBufferEvicted(uint64_t cacheId) = 0;
 };
 
 class BnTransactionCompletedListener : public SafeBnInterface<ITransactionCompletedListener> {
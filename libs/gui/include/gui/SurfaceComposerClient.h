@@ -653,6 +653,7 @@ public:
 
     // Overrides BnTransactionCompletedListener's onTransactionCompleted
     void onTransactionCompleted(ListenerStats stats) override;
+    void onBufferEvicted(uint64_t cacheId) override;
 };
 
 } // namespace android
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <android-base/unique_fd.h>
+#include <binder/Parcelable.h>
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace gui {
+
+/*
+ * Shared memory through which SurfaceFlinger publishes the VSYNC timeline of an event thread, so
+ * that clients that only need to know when upcoming VSYNC events are due can read it instead of
+ * waiting for the events. A single writer updates it under a seqlock, and readers map it
+ * read-only.
+ */
+class VsyncTimeline : public Parcelable {
+public:
+    struct Snapshot {
+        // The most recent VSYNC event: its ordinal, when it was dispatched and the VSYNC it
+        // targets, which is the deadline of the frame it starts.
+        uint32_t count = 0;
+        nsecs_t timestamp = 0;
+        nsecs_t expectedVSyncTimestamp = 0;
+        // Predicted VSYNC period. Events are dispatched once per period.
+        nsecs_t period = 0;
+
+        // Extrapolates the event that comes the given number of periods after this one.
+        Snapshot advancedBy(uint32_t periods) const;
+        // Extrapolates the first event dispatched after now.
+        Snapshot nextAfter(nsecs_t now) const;
+    };
+
+    // Creates an empty timeline, to unparcel into or to share a timeline with.
+    VsyncTimeline() = default;
+    ~VsyncTimeline() override;
+
+    VsyncTimeline(const VsyncTimeline&) = delete;
+    VsyncTimeline& operator=(const VsyncTimeline&) = delete;
+
+    // Creates a timeline that this process publishes to.
+    static std::unique_ptr<VsyncTimeline> create(const char* name);
+
+    status_t initCheck() const;
+
+    // Maps this timeline read-only into outTimeline.
+    status_t share(VsyncTimeline* outTimeline) const;
+
+    // Only valid on a timeline returned by create(), from a single thread at a time.
+    void publish(const Snapshot& snapshot);
+    // Tells readers that the timeline cannot be extrapolated until the next publish, e.g.
+    // because the period is changing.
+    void invalidate();
+
+    // Returns false if the timeline is not valid or keeps changing while being read, in which
+    // case clients should wait for a VSYNC event instead.
+    bool read(Snapshot* outSnapshot) const;
+
+    // Implements the Parcelable protocol. Parcels a duplicate of the file descriptor.
+    status_t writeToParcel(Parcel* parcel) const override;
+    status_t readFromParcel(const Parcel* parcel) override;
+
+private:
+    struct Data;
+
+    status_t map(base::unique_fd fd, bool writable);
+    void unmap();
+
+    base::unique_fd mFd;
+    Data* mData = nullptr;
+    bool mWritable = false;
+};
+
+} // namespace gui
+} // namespace android
@@ -408,6 +408,32 @@ status_t unflatten(
         HGraphicBufferProducer::FenceTimeSnapshot* t, native_handle_t** nh,
         void const*& buffer, size_t& size, int const*& fds, size_t& numFds);
 
+/**
+ * \brief Wrap `::android::FenceTime::Snapshot` in
+ * `HGraphicBufferProducer::FenceTimeSnapshot`.
+ *
+ * \param[out] t The wrapper of type `HGraphicBufferProducer::FenceTimeSnapshot`.
+ * \param[out] nh The native handle pointed to by \p t, or `nullptr`.
+ * \param[in] l The source `::android::FenceTime::Snapshot`.
+ *
+ * On success, \p nh will be either `nullptr` or a newly created native handle,
+ * which must be deleted manually with `native_handle_delete()` afterwards.
+ */
+bool wrapAs(HGraphicBufferProducer::FenceTimeSnapshot* t,
+        native_handle_t** nh, ::android::FenceTime::Snapshot const& l);
+
+/**
+ * \brief Convert `HGraphicBufferProducer::FenceTimeSnapshot` to
+ * `::android::FenceTime::Snapshot`.
+ *
+ * \param[out] l The destination `::android::FenceTime::Snapshot`.
+ * \param[in] t The source `HGraphicBufferProducer::FenceTimeSnapshot`.
+ *
+ * If \p t contains a valid file descriptor, it will be duplicated.
+ */
+bool convertTo(::android::FenceTime::Snapshot* l,
+        HGraphicBufferProducer::FenceTimeSnapshot const& t);
+
 // Ref: frameworks/native/libs/gui/FrameTimestamps.cpp: FrameEventsDelta
 
 /**
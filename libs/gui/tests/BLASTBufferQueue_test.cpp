@@ -68,6 +68,65 @@ public:
         return mBlastBufferQueueAdapter->mSurfaceControl;
     }
 
+    status_t setPacingPolicy(BLASTBufferQueue::PacingPolicy policy) {
+        return mBlastBufferQueueAdapter->setPacingPolicy(policy);
+    }
+
+    uint64_t getDroppedCount() {
+        std::lock_guard lock{mBlastBufferQueueAdapter->mMutex};
+        return mBlastBufferQueueAdapter->mDroppedCount;
+    }
+
+    size_t getMaxInFlight() {
+        std::lock_guard lock{mBlastBufferQueueAdapter->mMutex};
+        return mBlastBufferQueueAdapter->mMaxInFlight;
+    }
+
+    // Returns the paced present times of frames submitted back to back, each behind the ones
+    // before it, as if the last callback had reported timing. The frames stay in flight.
+    std::vector<nsecs_t> submitPacedFrames(const CompositorTiming& timing, size_t count) {
+        std::lock_guard lock{mBlastBufferQueueAdapter->mMutex};
+        mBlastBufferQueueAdapter->mCompositorTiming = timing;
+        std::vector<nsecs_t> presentTimes;
+        for (size_t i = 0; i < count; i++) {
+            nsecs_t expectedPresentTime = 0;
+            presentTimes.push_back(
+                    mBlastBufferQueueAdapter->computePacedPresentTimeLocked(&expectedPresentTime));
+            mBlastBufferQueueAdapter->mSubmitted.push(BufferItem());
+            mBlastBufferQueueAdapter->mSubmittedFrames.push({systemTime(), expectedPresentTime});
+        }
+        return presentTimes;
+    }
+
+    // Completes the oldest frame in flight as if it was latched at the given time.
+    void latchFrame(nsecs_t latchTime) {
+        std::lock_guard lock{mBlastBufferQueueAdapter->mMutex};
+        mBlastBufferQueueAdapter->updatePacingLocked(latchTime, Fence::NO_FENCE);
+        mBlastBufferQueueAdapter->mSubmitted.pop();
+    }
+
+    void clearSubmittedFrames() {
+        std::lock_guard lock{mBlastBufferQueueAdapter->mMutex};
+        while (!mBlastBufferQueueAdapter->mSubmitted.empty()) {
+            mBlastBufferQueueAdapter->mSubmitted.pop();
+        }
+        while (!mBlastBufferQueueAdapter->mSubmittedFrames.empty()) {
+            mBlastBufferQueueAdapter->mSubmittedFrames.pop();
+        }
+    }
+
+    std::vector<nsecs_t> computePacedPresentTimes(const CompositorTiming& timing, size_t count) {
+        auto presentTimes = submitPacedFrames(timing, count);
+        clearSubmittedFrames();
+        return presentTimes;
+    }
+
+    std::string dump() {
+        std::string result;
+        mBlastBufferQueueAdapter->dump(result);
+        return result;
+    }
+
     void waitForCallbacks() {
         std::unique_lock lock{mBlastBufferQueueAdapter->mMutex};
         while (mBlastBufferQueueAdapter->mSubmitted.size() > 0) {
@@ -134,6 +193,28 @@ protected:
         producer = igbProducer;
     }
 
+    void queueFrames(const sp<IGraphicBufferProducer>& igbProducer, int count) {
+        for (int i = 0; i < count; i++) {
+            int slot;
+            sp<Fence> fence;
+            sp<GraphicBuffer> buf;
+            auto ret = igbProducer->dequeueBuffer(&slot, &fence, mDisplayWidth, mDisplayHeight,
+                                                  PIXEL_FORMAT_RGBA_8888,
+                                                  GRALLOC_USAGE_SW_WRITE_OFTEN, nullptr, nullptr);
+            ASSERT_GE(ret, 0);
+            if (ret & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+                ASSERT_EQ(OK, igbProducer->requestBuffer(slot, &buf));
+            }
+            IGraphicBufferProducer::QueueBufferOutput qbOutput;
+            IGraphicBufferProducer::QueueBufferInput input(systemTime(), false,
+                                                           HAL_DATASPACE_UNKNOWN,
+                                                           Rect(mDisplayWidth, mDisplayHeight),
+                                                           NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                           Fence::NO_FENCE);
+            ASSERT_EQ(NO_ERROR, igbProducer->queueBuffer(slot, input, &qbOutput));
+        }
+    }
+
     void fillBuffer(uint32_t* bufData, Rect rect, uint32_t stride, uint8_t r, uint8_t g,
                     uint8_t b) {
         for (uint32_t row = rect.top; row < rect.bottom; row++) {
@@ -350,6 +431,98 @@ TEST_F(BLASTBufferQueueTest, TripleBuffering) {
     adapter.waitForCallbacks();
 }
 
+TEST_F(BLASTBufferQueueTest, PacingPolicyLowLatencyDropsFrames) {
+    BLASTBufferQueueHelper adapter(mSurfaceControl, mDisplayWidth, mDisplayHeight);
+    ASSERT_EQ(NO_ERROR, adapter.setPacingPolicy(BLASTBufferQueue::PacingPolicy::LowLatency));
+    sp<IGraphicBufferProducer> igbProducer;
+    setUpProducer(adapter, igbProducer);
+
+    // Queues frames much faster than SurfaceFlinger presents them.
+    ASSERT_NO_FATAL_FAILURE(queueFrames(igbProducer, 30));
+    adapter.waitForCallbacks();
+
+    EXPECT_GT(adapter.getDroppedCount(), 0u);
+    EXPECT_EQ(1u, adapter.getMaxInFlight());
+}
+
+TEST_F(BLASTBufferQueueTest, PacingPolicyThroughputCapsInFlight) {
+    BLASTBufferQueueHelper adapter(mSurfaceControl, mDisplayWidth, mDisplayHeight);
+    ASSERT_EQ(NO_ERROR, adapter.setPacingPolicy(BLASTBufferQueue::PacingPolicy::Throughput));
+    sp<IGraphicBufferProducer> igbProducer;
+    setUpProducer(adapter, igbProducer);
+
+    ASSERT_NO_FATAL_FAILURE(queueFrames(igbProducer, 30));
+    adapter.waitForCallbacks();
+
+    EXPECT_EQ(0u, adapter.getDroppedCount());
+    EXPECT_EQ(2u, adapter.getMaxInFlight());
+}
+
+TEST_F(BLASTBufferQueueTest, PacingPolicyThroughputSpacesPresentTimes) {
+    BLASTBufferQueueHelper adapter(mSurfaceControl, mDisplayWidth, mDisplayHeight);
+    ASSERT_EQ(NO_ERROR, adapter.setPacingPolicy(BLASTBufferQueue::PacingPolicy::Throughput));
+
+    CompositorTiming timing;
+    timing.interval = 16'666'667;
+    timing.deadline = systemTime() + timing.interval / 2;
+    timing.presentLatency = timing.interval;
+    const auto presentTimes = adapter.computePacedPresentTimes(timing, 4);
+
+    // The first frame has nothing to be paced behind.
+    ASSERT_EQ(4u, presentTimes.size());
+    EXPECT_EQ(0, presentTimes[0]);
+    EXPECT_GT(presentTimes[1], timing.deadline);
+    EXPECT_EQ(timing.interval, presentTimes[2] - presentTimes[1]);
+    EXPECT_EQ(timing.interval, presentTimes[3] - presentTimes[2]);
+}
+
+TEST_F(BLASTBufferQueueTest, PacingPolicyThroughputFollowsLateFrames) {
+    BLASTBufferQueueHelper adapter(mSurfaceControl, mDisplayWidth, mDisplayHeight);
+    ASSERT_EQ(NO_ERROR, adapter.setPacingPolicy(BLASTBufferQueue::PacingPolicy::Throughput));
+
+    CompositorTiming timing;
+    timing.interval = 16'666'667;
+    timing.deadline = systemTime() + timing.interval / 2;
+    timing.presentLatency = timing.interval;
+    const auto presentTimes = adapter.submitPacedFrames(timing, 2);
+    ASSERT_EQ(2u, presentTimes.size());
+
+    // The first frame is latched two vsyncs after the one it was expected for, so the frame
+    // behind it and the next one submitted move back by as much.
+    adapter.latchFrame(timing.deadline + 2 * timing.interval - 1000);
+    const auto nextPresentTimes = adapter.submitPacedFrames(timing, 1);
+    adapter.clearSubmittedFrames();
+
+    ASSERT_EQ(1u, nextPresentTimes.size());
+    EXPECT_EQ(3 * timing.interval, nextPresentTimes[0] - presentTimes[1]);
+}
+
+TEST_F(BLASTBufferQueueTest, PacingPolicyInDump) {
+    BLASTBufferQueueHelper adapter(mSurfaceControl, mDisplayWidth, mDisplayHeight);
+    ASSERT_EQ(NO_ERROR, adapter.setPacingPolicy(BLASTBufferQueue::PacingPolicy::LowLatency));
+    sp<IGraphicBufferProducer> igbProducer;
+    setUpProducer(adapter, igbProducer);
+
+    ASSERT_NO_FATAL_FAILURE(queueFrames(igbProducer, 5));
+    adapter.waitForCallbacks();
+
+    const std::string result = adapter.dump();
+    EXPECT_NE(std::string::npos, result.find("pacing policy low latency"));
+    EXPECT_NE(std::string::npos, result.find("submitted "));
+}
+
+TEST_F(BLASTBufferQueueTest, PacingPolicyDefaultIsNotPaced) {
+    BLASTBufferQueueHelper adapter(mSurfaceControl, mDisplayWidth, mDisplayHeight);
+
+    CompositorTiming timing;
+    timing.interval = 16'666'667;
+    timing.deadline = systemTime() + timing.interval / 2;
+    timing.presentLatency = timing.interval;
+    for (nsecs_t presentTime : adapter.computePacedPresentTimes(timing, 3)) {
+        EXPECT_EQ(0, presentTime);
+    }
+}
+
 TEST_F(BLASTBufferQueueTest, SetCrop_Item) {
     uint8_t r = 255;
     uint8_t g = 0;
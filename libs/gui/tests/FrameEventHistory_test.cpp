@@ -0,0 +1,179 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FrameEventHistory_test"
+
+#include <fcntl.h>
+
+#include <gtest/gtest.h>
+
+#include <binder/Parcel.h>
+#include <gui/FrameTimestamps.h>
+#include <gui/bufferqueue/1.0/Conversion.h>
+
+namespace android {
+namespace test {
+
+constexpr nsecs_t kStartTime = 123456789012345;
+constexpr nsecs_t kPeriod = 16666667;
+
+class FrameEventHistoryDeltaTest : public ::testing::Test {
+protected:
+    nsecs_t getPostedTime(uint64_t frameNumber) const {
+        return kStartTime + static_cast<nsecs_t>(frameNumber) * kPeriod;
+    }
+
+    void queueAndComposite(uint64_t frameNumber,
+                           const std::shared_ptr<FenceTime>& gpuCompositionDone,
+                           const std::shared_ptr<FenceTime>& displayPresent) {
+        const nsecs_t postedTime = getPostedTime(frameNumber);
+        mConsumer.addQueue({frameNumber, postedTime, postedTime + 5, FenceTime::NO_FENCE});
+        mConsumer.addLatch(frameNumber, postedTime + 1000000);
+        mConsumer.addPreComposition(frameNumber, postedTime + 2000000);
+        mConsumer.addPostComposition(frameNumber, gpuCompositionDone, displayPresent,
+                                     {postedTime, kPeriod, kPeriod});
+    }
+
+    void roundTrip() {
+        FrameEventHistoryDelta delta;
+        mConsumer.getAndResetDelta(&delta);
+        Parcel parcel;
+        ASSERT_EQ(NO_ERROR, parcel.write(delta));
+        parcel.setDataPosition(0);
+        FrameEventHistoryDelta result;
+        ASSERT_EQ(NO_ERROR, parcel.read(result));
+        EXPECT_EQ(parcel.dataSize(), parcel.dataPosition());
+        mProducer.applyDelta(result);
+    }
+
+    ConsumerFrameEventHistory mConsumer;
+    ProducerFrameEventHistory mProducer;
+};
+
+TEST_F(FrameEventHistoryDeltaTest, TimestampsRoundTrip) {
+    queueAndComposite(1, std::make_shared<FenceTime>(getPostedTime(1) + 3000000),
+                      std::make_shared<FenceTime>(getPostedTime(1) + 4000000));
+    mConsumer.addRelease(1, getPostedTime(1) + 5000000,
+                         std::make_shared<FenceTime>(Fence::SIGNAL_TIME_INVALID));
+    const nsecs_t postedTime = getPostedTime(2);
+    mConsumer.addQueue({2, postedTime, postedTime + 5, FenceTime::NO_FENCE});
+    roundTrip();
+
+    const FrameEvents* first = mProducer.getFrame(1);
+    ASSERT_NE(nullptr, first);
+    EXPECT_EQ(getPostedTime(1), first->postedTime);
+    EXPECT_EQ(getPostedTime(1) + 5, first->requestedPresentTime);
+    EXPECT_EQ(getPostedTime(1) + 1000000, first->latchTime);
+    EXPECT_EQ(getPostedTime(1) + 2000000, first->firstRefreshStartTime);
+    EXPECT_EQ(getPostedTime(1) + 2000000, first->lastRefreshStartTime);
+    EXPECT_EQ(getPostedTime(1) + 5000000, first->dequeueReadyTime);
+    EXPECT_TRUE(first->addPostCompositeCalled);
+    EXPECT_TRUE(first->addReleaseCalled);
+    EXPECT_EQ(getPostedTime(1) + 3000000, first->gpuCompositionDoneFence->getCachedSignalTime());
+    EXPECT_EQ(getPostedTime(1) + 4000000, first->displayPresentFence->getCachedSignalTime());
+    EXPECT_FALSE(first->releaseFence->isValid());
+
+    const FrameEvents* second = mProducer.getFrame(2);
+    ASSERT_NE(nullptr, second);
+    EXPECT_EQ(postedTime, second->postedTime);
+    EXPECT_EQ(FrameEvents::TIMESTAMP_PENDING, second->latchTime);
+    EXPECT_EQ(FrameEvents::TIMESTAMP_PENDING, second->dequeueReadyTime);
+    EXPECT_FALSE(second->addPostCompositeCalled);
+}
+
+TEST_F(FrameEventHistoryDeltaTest, SharedFenceIsSentOnce) {
+    const sp<Fence> fence = new Fence(open("/dev/null", O_RDONLY | O_CLOEXEC));
+    ASSERT_TRUE(fence->isValid());
+    const auto fenceTime = std::make_shared<FenceTime>(fence);
+
+    queueAndComposite(1, FenceTime::NO_FENCE, FenceTime::NO_FENCE);
+    queueAndComposite(2, fenceTime, FenceTime::NO_FENCE);
+    mConsumer.addRelease(1, getPostedTime(2) + 5000000, std::shared_ptr<FenceTime>(fenceTime));
+
+    FrameEventHistoryDelta delta;
+    mConsumer.getAndResetDelta(&delta);
+    EXPECT_EQ(1u, delta.getFdCount());
+    Parcel parcel;
+    ASSERT_EQ(NO_ERROR, parcel.write(delta));
+    parcel.setDataPosition(0);
+    FrameEventHistoryDelta result;
+    ASSERT_EQ(NO_ERROR, parcel.read(result));
+    mProducer.applyDelta(result);
+
+    const FrameEvents* first = mProducer.getFrame(1);
+    const FrameEvents* second = mProducer.getFrame(2);
+    ASSERT_NE(nullptr, first);
+    ASSERT_NE(nullptr, second);
+    EXPECT_TRUE(first->releaseFence->isValid());
+    EXPECT_EQ(first->releaseFence, second->gpuCompositionDoneFence);
+}
+
+TEST_F(FrameEventHistoryDeltaTest, TimestampsRoundTripThroughHidl) {
+    const sp<Fence> fence = new Fence(open("/dev/null", O_RDONLY | O_CLOEXEC));
+    ASSERT_TRUE(fence->isValid());
+
+    const nsecs_t postedTime = getPostedTime(1);
+    mConsumer.addQueue({1, postedTime, postedTime + 5, FenceTime::NO_FENCE});
+    mConsumer.addLatch(1, postedTime + 1000000);
+    mConsumer.addPreComposition(1, postedTime + 2000000);
+    mConsumer.addPostComposition(1, std::make_shared<FenceTime>(fence),
+                                 std::make_shared<FenceTime>(postedTime + 4000000),
+                                 {postedTime, 2 * kPeriod, 3 * kPeriod});
+    mConsumer.addRelease(1, postedTime + 5000000,
+                         std::make_shared<FenceTime>(Fence::SIGNAL_TIME_INVALID));
+
+    FrameEventHistoryDelta delta;
+    mConsumer.getAndResetDelta(&delta);
+    conversion::HGraphicBufferProducer::FrameEventHistoryDelta hidlDelta;
+    std::vector<std::vector<native_handle_t*>> nh;
+    ASSERT_TRUE(conversion::wrapAs(&hidlDelta, &nh, delta));
+    ASSERT_EQ(1u, hidlDelta.deltas.size());
+    EXPECT_EQ(1u, hidlDelta.deltas[0].frameNumber);
+    EXPECT_EQ(postedTime, hidlDelta.deltas[0].postedTimeNs);
+    EXPECT_EQ(postedTime + 1000000, hidlDelta.deltas[0].latchTimeNs);
+    EXPECT_EQ(3 * kPeriod, hidlDelta.compositorTiming.presentLatencyNs);
+
+    FrameEventHistoryDelta result;
+    const bool converted = conversion::convertTo(&result, hidlDelta);
+    for (const auto& nhA : nh) {
+        for (native_handle_t* handle : nhA) {
+            if (handle != nullptr) {
+                native_handle_delete(handle);
+            }
+        }
+    }
+    ASSERT_TRUE(converted);
+    mProducer.applyDelta(result);
+
+    const FrameEvents* frame = mProducer.getFrame(1);
+    ASSERT_NE(nullptr, frame);
+    EXPECT_EQ(postedTime, frame->postedTime);
+    EXPECT_EQ(postedTime + 5, frame->requestedPresentTime);
+    EXPECT_EQ(postedTime + 1000000, frame->latchTime);
+    EXPECT_EQ(postedTime + 2000000, frame->firstRefreshStartTime);
+    EXPECT_EQ(postedTime + 2000000, frame->lastRefreshStartTime);
+    EXPECT_EQ(postedTime + 5000000, frame->dequeueReadyTime);
+    EXPECT_TRUE(frame->addPostCompositeCalled);
+    EXPECT_TRUE(frame->addReleaseCalled);
+    EXPECT_TRUE(frame->gpuCompositionDoneFence->isValid());
+    EXPECT_EQ(postedTime + 4000000, frame->displayPresentFence->getCachedSignalTime());
+    EXPECT_FALSE(frame->releaseFence->isValid());
+    EXPECT_EQ(2 * kPeriod, mProducer.getCompositeInterval());
+    EXPECT_EQ(3 * kPeriod, mProducer.getCompositeToPresentLatency());
+}
+
+} // namespace test
+} // namespace android
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerState_test"
+
+#include <gtest/gtest.h>
+
+#include <binder/Binder.h>
+#include <binder/Parcel.h>
+#include <gui/LayerState.h>
+
+namespace android {
+namespace test {
+
+layer_state_t roundTrip(const layer_state_t& state) {
+    Parcel parcel;
+    EXPECT_EQ(NO_ERROR, state.write(parcel));
+    parcel.setDataPosition(0);
+    layer_state_t result;
+    EXPECT_EQ(NO_ERROR, result.read(parcel));
+    EXPECT_EQ(parcel.dataSize(), parcel.dataPosition());
+    return result;
+}
+
+TEST(LayerStateTest, ChangedFieldsRoundTrip) {
+    layer_state_t state;
+    state.surface = new BBinder();
+    state.what = layer_state_t::ePositionChanged | layer_state_t::eAlphaChanged |
+            layer_state_t::eMatrixChanged | layer_state_t::eCropChanged |
+            layer_state_t::eColorTransformChanged | layer_state_t::eFrameRateChanged;
+    state.x = 10.0f;
+    state.y = 20.0f;
+    state.alpha = 0.5f;
+    state.matrix = {2.0f, 0.0f, 0.0f, 2.0f};
+    state.crop = Rect(1, 2, 3, 4);
+    state.colorTransform = mat4::scale(vec4(0.5f, 0.5f, 0.5f, 1.0f));
+    state.frameRate = 60.0f;
+    state.frameRateCompatibility = ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE;
+
+    const layer_state_t result = roundTrip(state);
+    EXPECT_EQ(state.surface, result.surface);
+    EXPECT_EQ(state.what, result.what);
+    EXPECT_EQ(10.0f, result.x);
+    EXPECT_EQ(20.0f, result.y);
+    EXPECT_EQ(0.5f, result.alpha);
+    EXPECT_EQ(2.0f, result.matrix.dsdx);
+    EXPECT_EQ(2.0f, result.matrix.dsdy);
+    EXPECT_EQ(Rect(1, 2, 3, 4), result.crop);
+    EXPECT_EQ(0.5f, result.colorTransform[0][0]);
+    EXPECT_EQ(1.0f, result.colorTransform[3][3]);
+    EXPECT_EQ(60.0f, result.frameRate);
+    EXPECT_EQ(ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE, result.frameRateCompatibility);
+}
+
+TEST(LayerStateTest, UnchangedFieldsAreNotWritten) {
+    layer_state_t state;
+    state.what = layer_state_t::eAlphaChanged;
+    state.alpha = 0.5f;
+    // Not marked as changed, so neither sent nor read back.
+    state.x = 10.0f;
+    state.transparentRegion = Region(Rect(100, 100));
+
+    Parcel alphaOnly;
+    state.write(alphaOnly);
+    state.what |= layer_state_t::ePositionChanged | layer_state_t::eTransparentRegionChanged;
+    Parcel withPosition;
+    state.write(withPosition);
+    EXPECT_LT(alphaOnly.dataSize(), withPosition.dataSize());
+
+    state.what = layer_state_t::eAlphaChanged;
+    const layer_state_t result = roundTrip(state);
+    EXPECT_EQ(0.5f, result.alpha);
+    EXPECT_EQ(0.0f, result.x);
+    EXPECT_TRUE(result.transparentRegion.isEmpty());
+}
+
+TEST(LayerStateTest, CachedBufferKeepsAcquireFence) {
+    layer_state_t state;
+    state.what = layer_state_t::eCachedBufferChanged;
+    state.cachedBuffer.id = 42;
+    state.acquireFence = Fence::NO_FENCE;
+
+    const layer_state_t result = roundTrip(state);
+    EXPECT_EQ(42u, result.cachedBuffer.id);
+    ASSERT_NE(nullptr, result.acquireFence);
+    EXPECT_EQ(nullptr, result.buffer);
+}
+
+TEST(LayerStateTest, ListenersAlwaysRoundTrip) {
+    layer_state_t state;
+    state.listeners.emplace_back(new BBinder(), std::vector<CallbackId>{1, 2});
+
+    const layer_state_t result = roundTrip(state);
+    ASSERT_EQ(1u, result.listeners.size());
+    EXPECT_EQ(state.listeners[0].transactionCompletedListener,
+              result.listeners[0].transactionCompletedListener);
+    EXPECT_EQ((std::vector<CallbackId>{1, 2}), result.listeners[0].callbackIds);
+}
+
+} // namespace test
+} // namespace android
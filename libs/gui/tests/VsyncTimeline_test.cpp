@@ -0,0 +1,91 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VsyncTimeline_test"
+
+#include <gtest/gtest.h>
+
+#include <binder/Parcel.h>
+#include <gui/VsyncTimeline.h>
+
+namespace android {
+namespace test {
+
+using gui::VsyncTimeline;
+
+constexpr nsecs_t kPeriod = 16666666;
+
+TEST(VsyncTimelineTest, ReadersSeePublishedSnapshots) {
+    const auto timeline = VsyncTimeline::create("VsyncTimeline_test");
+    ASSERT_NE(nullptr, timeline);
+    ASSERT_EQ(NO_ERROR, timeline->initCheck());
+
+    VsyncTimeline reader;
+    EXPECT_EQ(NO_INIT, reader.initCheck());
+    ASSERT_EQ(NO_ERROR, timeline->share(&reader));
+
+    VsyncTimeline::Snapshot snapshot;
+    EXPECT_FALSE(reader.read(&snapshot));
+
+    timeline->publish({7, 1000, 5000, kPeriod});
+    ASSERT_TRUE(reader.read(&snapshot));
+    EXPECT_EQ(7u, snapshot.count);
+    EXPECT_EQ(1000, snapshot.timestamp);
+    EXPECT_EQ(5000, snapshot.expectedVSyncTimestamp);
+    EXPECT_EQ(kPeriod, snapshot.period);
+
+    timeline->invalidate();
+    EXPECT_FALSE(reader.read(&snapshot));
+
+    timeline->publish({8, 1000 + kPeriod, 5000 + kPeriod, kPeriod});
+    ASSERT_TRUE(reader.read(&snapshot));
+    EXPECT_EQ(8u, snapshot.count);
+}
+
+TEST(VsyncTimelineTest, ParceledTimelineIsShared) {
+    const auto timeline = VsyncTimeline::create("VsyncTimeline_test");
+    ASSERT_NE(nullptr, timeline);
+
+    Parcel parcel;
+    ASSERT_EQ(NO_ERROR, timeline->writeToParcel(&parcel));
+    parcel.setDataPosition(0);
+    VsyncTimeline reader;
+    ASSERT_EQ(NO_ERROR, reader.readFromParcel(&parcel));
+
+    timeline->publish({1, 1000, 5000, kPeriod});
+    VsyncTimeline::Snapshot snapshot;
+    ASSERT_TRUE(reader.read(&snapshot));
+    EXPECT_EQ(1u, snapshot.count);
+}
+
+TEST(VsyncTimelineTest, NextAfterExtrapolatesWholePeriods) {
+    const VsyncTimeline::Snapshot snapshot{10, 1000, 5000, kPeriod};
+
+    // Nothing to extrapolate before the snapshot's own event.
+    EXPECT_EQ(10u, snapshot.nextAfter(999).count);
+
+    const auto next = snapshot.nextAfter(1000);
+    EXPECT_EQ(11u, next.count);
+    EXPECT_EQ(1000 + kPeriod, next.timestamp);
+    EXPECT_EQ(5000 + kPeriod, next.expectedVSyncTimestamp);
+
+    const auto later = snapshot.nextAfter(1000 + 3 * kPeriod + 1);
+    EXPECT_EQ(14u, later.count);
+    EXPECT_EQ(1000 + 4 * kPeriod, later.timestamp);
+}
+
+} // namespace test
+} // namespace android
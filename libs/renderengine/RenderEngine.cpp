@@ -17,8 +17,10 @@
 #include <renderengine/RenderEngine.h>
 
 #include <cutils/properties.h>
+#include <hardware/gralloc.h>
 #include <log/log.h>
 #include <private/gui/SyncFeatures.h>
+#include "cpu/CpuRenderEngine.h"
 #include "gl/GLESRenderEngine.h"
 
 namespace android {
@@ -31,6 +33,10 @@ std::unique_ptr<impl::RenderEngine> RenderEngine::create(const RenderEngineCreat
         ALOGD("RenderEngine GLES Backend");
         return renderengine::gl::GLESRenderEngine::create(args);
     }
+    if (strcmp(prop, "cpu") == 0) {
+        ALOGD("RenderEngine CPU Backend");
+        return renderengine::cpu::CpuRenderEngine::create(args);
+    }
     ALOGE("UNKNOWN BackendType: %s, create GLES RenderEngine.", prop);
     return renderengine::gl::GLESRenderEngine::create(args);
 }
@@ -51,6 +57,10 @@ bool RenderEngine::useWaitSync() const {
     return SyncFeatures::getInstance().useWaitSync();
 }
 
+uint64_t RenderEngine::getOutputBufferUsage() const {
+    return GRALLOC_USAGE_HW_RENDER;
+}
+
 } // namespace impl
 } // namespace renderengine
 } // namespace android
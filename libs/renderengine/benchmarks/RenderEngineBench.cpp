@@ -0,0 +1,183 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <renderengine/RenderEngine.h>
+#include <sync/sync.h>
+#include <ui/PixelFormat.h>
+
+#include "../cpu/CpuRenderEngine.h"
+#include "../gl/GLESRenderEngine.h"
+#include "../gl/GLShadowVertexGenerator.h"
+
+namespace android {
+namespace {
+
+constexpr uint32_t kWidth = 1080;
+constexpr uint32_t kHeight = 2340;
+
+renderengine::RenderEngineCreationArgs creationArgs() {
+    return renderengine::RenderEngineCreationArgs::Builder()
+            .setPixelFormat(static_cast<int>(ui::PixelFormat::RGBA_8888))
+            .setImageCacheSize(1)
+            .setUseColorManagerment(false)
+            .setContextPriority(renderengine::RenderEngine::ContextPriority::MEDIUM)
+            .build();
+}
+
+sp<GraphicBuffer> allocateBuffer(uint64_t usage, const char* name) {
+    return new GraphicBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                             GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN | usage,
+                             name);
+}
+
+// Draws state.range(0) full screen layers, alternating between translucent buffers and
+// translucent colors with rounded corners, which is the expensive case for both backends.
+void drawLayers(benchmark::State& state, renderengine::RenderEngine& engine) {
+    const auto output = allocateBuffer(GRALLOC_USAGE_HW_RENDER, "output");
+    const auto source = allocateBuffer(GRALLOC_USAGE_HW_TEXTURE, "input");
+    uint32_t* pixels;
+    source->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, reinterpret_cast<void**>(&pixels));
+    std::fill_n(pixels, source->getStride() * kHeight, 0x80402010);
+    source->unlock();
+
+    renderengine::DisplaySettings display;
+    display.physicalDisplay = Rect(kWidth, kHeight);
+    display.clip = Rect(kWidth, kHeight);
+
+    const FloatRect bounds(0, 0, kWidth, kHeight);
+    std::vector<renderengine::LayerSettings> layers(state.range(0));
+    for (size_t i = 0; i < layers.size(); i++) {
+        auto& layer = layers[i];
+        layer.geometry.boundaries = bounds;
+        layer.alpha = 0.5f;
+        if (i % 2 == 0) {
+            layer.source.buffer.buffer = source;
+            engine.genTextures(1, &layer.source.buffer.textureName);
+        } else {
+            layer.source.solidColor = half3(0.0f, 0.5f, 1.0f);
+            layer.geometry.roundedCornersRadius = 40.0f;
+            layer.geometry.roundedCornersCrop = bounds;
+        }
+    }
+    std::vector<const renderengine::LayerSettings*> layerPointers;
+    for (const auto& layer : layers) {
+        layerPointers.push_back(&layer);
+    }
+
+    for (auto _ : state) {
+        base::unique_fd fence;
+        engine.drawLayers(display, layerPointers, output->getNativeBuffer(), true,
+                          base::unique_fd(), &fence);
+        if (fence.get() >= 0) {
+            sync_wait(fence.get(), -1);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_DrawLayersCpu(benchmark::State& state) {
+    const auto engine = renderengine::cpu::CpuRenderEngine::create(creationArgs());
+    drawLayers(state, *engine);
+}
+BENCHMARK(BM_DrawLayersCpu)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+void BM_DrawLayersGles(benchmark::State& state) {
+    const auto engine = renderengine::gl::GLESRenderEngine::create(creationArgs());
+    drawLayers(state, *engine);
+}
+BENCHMARK(BM_DrawLayersGles)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+renderengine::ShadowSettings shadowSettings() {
+    renderengine::ShadowSettings shadow;
+    shadow.ambientColor = {0.0f, 0.0f, 0.0f, 0.039f};
+    shadow.spotColor = {0.0f, 0.0f, 0.0f, 0.19f};
+    shadow.lightPos = vec3(kWidth / 2.0f, 0.0f, 1500.0f);
+    shadow.lightRadius = 800.0f;
+    shadow.length = 24.0f;
+    shadow.casterIsTranslucent = false;
+    return shadow;
+}
+
+// Measures the tessellation that GLShadowMeshCache saves for a shadow that does not change.
+void BM_ShadowTessellation(benchmark::State& state) {
+    const FloatRect caster(100, 200, kWidth - 100, 800);
+    const auto shadow = shadowSettings();
+    for (auto _ : state) {
+        const renderengine::gl::GLShadowVertexGenerator generator(caster, 40.0f,
+                                                                  shadow.length / 2.0f,
+                                                                  shadow.casterIsTranslucent,
+                                                                  shadow.ambientColor,
+                                                                  shadow.spotColor,
+                                                                  shadow.lightPos,
+                                                                  shadow.lightRadius);
+        renderengine::Mesh mesh = renderengine::Mesh::Builder()
+                                          .setPrimitive(renderengine::Mesh::TRIANGLES)
+                                          .setVertices(generator.getVertexCount(), 2 /* size */)
+                                          .setShadowAttrs()
+                                          .setIndices(generator.getIndexCount())
+                                          .build();
+        auto position = mesh.getPositionArray<vec2>();
+        auto shadowColor = mesh.getShadowColorArray<vec4>();
+        auto shadowParams = mesh.getShadowParamsArray<vec3>();
+        generator.fillVertices(position, shadowColor, shadowParams);
+        generator.fillIndices(mesh.getIndicesArray());
+        benchmark::DoNotOptimize(mesh.getIndexCount());
+    }
+}
+BENCHMARK(BM_ShadowTessellation);
+
+// Draws state.range(0) layers casting shadows that stay the same from frame to frame.
+void BM_DrawShadowsGles(benchmark::State& state) {
+    const auto engine = renderengine::gl::GLESRenderEngine::create(creationArgs());
+    const auto output = allocateBuffer(GRALLOC_USAGE_HW_RENDER, "output");
+
+    renderengine::DisplaySettings display;
+    display.physicalDisplay = Rect(kWidth, kHeight);
+    display.clip = Rect(kWidth, kHeight);
+
+    std::vector<renderengine::LayerSettings> layers(state.range(0));
+    for (size_t i = 0; i < layers.size(); i++) {
+        auto& layer = layers[i];
+        const float top = 100.0f + 200.0f * i;
+        layer.geometry.boundaries = FloatRect(100, top, kWidth - 100, top + 150);
+        layer.geometry.roundedCornersRadius = 40.0f;
+        layer.alpha = 1.0f;
+        layer.source.solidColor = half3(1.0f, 1.0f, 1.0f);
+        layer.shadow = shadowSettings();
+    }
+    std::vector<const renderengine::LayerSettings*> layerPointers;
+    for (const auto& layer : layers) {
+        layerPointers.push_back(&layer);
+    }
+
+    for (auto _ : state) {
+        base::unique_fd fence;
+        engine->drawLayers(display, layerPointers, output->getNativeBuffer(), true,
+                           base::unique_fd(), &fence);
+        if (fence.get() >= 0) {
+            sync_wait(fence.get(), -1);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DrawShadowsGles)->Arg(1)->Arg(4)->Arg(8);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
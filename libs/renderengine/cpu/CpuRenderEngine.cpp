@@ -0,0 +1,284 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#undef LOG_TAG
+#define LOG_TAG "RenderEngine"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "CpuRenderEngine.h"
+
+#include <cinttypes>
+#include <cmath>
+
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+#include <sync/sync.h>
+#include <ui/GraphicBuffer.h>
+#include <ui/Region.h>
+#include <utils/Trace.h>
+
+namespace android {
+namespace renderengine {
+namespace cpu {
+
+using base::StringAppendF;
+
+namespace {
+
+bool isSupportedFormat(PixelFormat format) {
+    return format == PIXEL_FORMAT_RGBA_8888 || format == PIXEL_FORMAT_RGBX_8888;
+}
+
+// Returns true if the pixels of buffer can be sampled on the CPU.
+bool isReadable(const sp<GraphicBuffer>& buffer) {
+    return isSupportedFormat(buffer->getPixelFormat()) &&
+            (buffer->getUsage() & GRALLOC_USAGE_SW_READ_MASK) != 0;
+}
+
+// Locks buffer for CPU access, and unlocks it when going out of scope.
+class LockedBuffer {
+public:
+    LockedBuffer(const sp<GraphicBuffer>& buffer, uint32_t usage) : mBuffer(buffer) {
+        const PixelFormat format = buffer->getPixelFormat();
+        if (!isSupportedFormat(format)) {
+            ALOGE("Unsupported pixel format %d for CPU composition", format);
+            mStatus = BAD_VALUE;
+            return;
+        }
+
+        void* pixels = nullptr;
+        mStatus = buffer->lock(usage, &pixels);
+        if (mStatus != NO_ERROR) {
+            ALOGE("Failed to lock buffer %" PRIu64 " for CPU composition: %d", buffer->getId(),
+                  mStatus);
+            return;
+        }
+        mPixels.pixels = static_cast<uint32_t*>(pixels);
+        mPixels.width = static_cast<int32_t>(buffer->getWidth());
+        mPixels.height = static_cast<int32_t>(buffer->getHeight());
+        mPixels.stride = static_cast<int32_t>(buffer->getStride());
+        mPixels.opaque = format == PIXEL_FORMAT_RGBX_8888;
+    }
+
+    ~LockedBuffer() {
+        if (mStatus == NO_ERROR) {
+            mBuffer->unlock();
+        }
+    }
+
+    status_t getStatus() const { return mStatus; }
+    const PixelBuffer& getPixels() const { return mPixels; }
+
+private:
+    const sp<GraphicBuffer> mBuffer;
+    status_t mStatus = NO_ERROR;
+    PixelBuffer mPixels;
+};
+
+} // namespace
+
+std::unique_ptr<CpuRenderEngine> CpuRenderEngine::create(const RenderEngineCreationArgs& args) {
+    return std::make_unique<CpuRenderEngine>(args);
+}
+
+CpuRenderEngine::CpuRenderEngine(const RenderEngineCreationArgs& args)
+      : renderengine::impl::RenderEngine(args), mRasterizer(args.useColorManagement) {}
+
+CpuRenderEngine::~CpuRenderEngine() = default;
+
+void CpuRenderEngine::genTextures(size_t count, uint32_t* names) {
+    // Texture names are only used as handles by callers, so any unique value works.
+    for (size_t i = 0; i < count; i++) {
+        names[i] = mNextTextureName++;
+    }
+}
+
+size_t CpuRenderEngine::getMaxTextureSize() const {
+    return 16384;
+}
+
+size_t CpuRenderEngine::getMaxViewportDims() const {
+    return 16384;
+}
+
+uint64_t CpuRenderEngine::getOutputBufferUsage() const {
+    return GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+}
+
+mat4 CpuRenderEngine::getDisplayTransform(const DisplaySettings& display) {
+    // This is the same transform that GLESRenderEngine::handleRoundedCorners computes:
+    // translate the clip to the origin, rotate it by the orientation, scale it to the physical
+    // display, and translate it to the physical display's top left corner.
+    const Rect& source = display.clip;
+    const Rect& destination = display.physicalDisplay;
+    const mat4 translateSource = mat4::translate(vec4(-source.left, -source.top, 0, 1));
+    mat4 rotation;
+    int displacementX = 0;
+    int displacementY = 0;
+    float sourceWidth = static_cast<float>(source.getWidth());
+    float sourceHeight = static_cast<float>(source.getHeight());
+    const float rot90InRadians = 2.0f * static_cast<float>(M_PI) / 4.0f;
+    switch (display.orientation) {
+        case ui::Transform::ROT_90:
+            rotation = mat4::rotate(rot90InRadians, vec3(0, 0, 1));
+            displacementX = source.getHeight();
+            std::swap(sourceHeight, sourceWidth);
+            break;
+        case ui::Transform::ROT_180:
+            rotation = mat4::rotate(rot90InRadians * 2.0f, vec3(0, 0, 1));
+            displacementY = source.getHeight();
+            displacementX = source.getWidth();
+            break;
+        case ui::Transform::ROT_270:
+            rotation = mat4::rotate(rot90InRadians * 3.0f, vec3(0, 0, 1));
+            displacementY = source.getWidth();
+            std::swap(sourceHeight, sourceWidth);
+            break;
+        default:
+            break;
+    }
+
+    // Rotations by multiples of 90 degrees should map pixels onto pixels exactly.
+    for (int column = 0; column < 2; column++) {
+        for (int row = 0; row < 2; row++) {
+            rotation[column][row] = std::round(rotation[column][row]);
+        }
+    }
+
+    const mat4 intermediateTranslation = mat4::translate(vec4(displacementX, displacementY, 0, 1));
+    const mat4 scale =
+            mat4::scale(vec4(destination.getWidth() / sourceWidth,
+                             destination.getHeight() / sourceHeight, 1, 1));
+    const mat4 translateDestination =
+            mat4::translate(vec4(destination.left, destination.top, 0, 1));
+    return translateDestination * scale * intermediateTranslation * rotation * translateSource;
+}
+
+status_t CpuRenderEngine::drawLayers(const DisplaySettings& display,
+                                     const std::vector<const LayerSettings*>& layers,
+                                     ANativeWindowBuffer* const buffer,
+                                     const bool /*useFramebufferCache*/,
+                                     base::unique_fd&& bufferFence, base::unique_fd* drawFence) {
+    ATRACE_CALL();
+    if (layers.empty()) {
+        ALOGV("Drawing empty layer stack");
+        return NO_ERROR;
+    }
+
+    if (bufferFence.get() >= 0) {
+        ATRACE_NAME("Waiting before draw");
+        sync_wait(bufferFence.get(), -1);
+    }
+
+    if (buffer == nullptr) {
+        ALOGE("No output buffer provided. Aborting CPU composition.");
+        return BAD_VALUE;
+    }
+
+    const sp<GraphicBuffer> outputBuffer = GraphicBuffer::from(buffer);
+    LockedBuffer output(outputBuffer, GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN);
+    if (output.getStatus() != NO_ERROR) {
+        return output.getStatus();
+    }
+
+    const status_t status = drawLayers(display, layers, output.getPixels());
+
+    // Everything has been written by the time the output buffer is unlocked, so there is
+    // nothing left for the caller to wait on.
+    if (drawFence != nullptr) {
+        drawFence->reset();
+    }
+    return status;
+}
+
+status_t CpuRenderEngine::drawLayers(const DisplaySettings& display,
+                                     const std::vector<const LayerSettings*>& layers,
+                                     const PixelBuffer& output) {
+    const nsecs_t start = systemTime();
+    Rect bounds = display.physicalDisplay;
+    if (display.damage.isValid() && !bounds.intersect(display.damage, &bounds)) {
+        bounds = Rect::EMPTY_RECT;
+    }
+    mRasterizer.begin(output, bounds, getDisplayTransform(display), display.colorTransform,
+                      display.outputDataspace);
+
+    // Clear the area being drawn, so that reused buffers do not keep ghost images.
+    mRasterizer.clear();
+
+    if (!display.clearRegion.isEmpty()) {
+        for (const Rect& rect : display.clearRegion) {
+            mRasterizer.fillRect(rect, half4(0.0f, 0.0f, 0.0f, 1.0f));
+        }
+    }
+
+    uint64_t skippedLayerCount = 0;
+    for (auto const layer : layers) {
+        if (layer->backgroundBlurRadius > 0) {
+            ALOGW("Background blur is not supported by CPU composition");
+        }
+
+        const sp<GraphicBuffer>& sourceBuffer = layer->source.buffer.buffer;
+        if (sourceBuffer == nullptr) {
+            mRasterizer.drawLayer(*layer, nullptr);
+            continue;
+        }
+
+        // Producers choose the format and usage of layer buffers, so the ones the CPU cannot
+        // sample are left out rather than failing the whole composition.
+        if (!isReadable(sourceBuffer)) {
+            ALOGV("Skipping buffer %" PRIu64 " with format %d and usage %" PRIx64,
+                  sourceBuffer->getId(), sourceBuffer->getPixelFormat(),
+                  sourceBuffer->getUsage());
+            skippedLayerCount++;
+            continue;
+        }
+
+        if (layer->source.buffer.fence != nullptr) {
+            layer->source.buffer.fence->waitForever("CpuRenderEngine::drawLayers");
+        }
+        LockedBuffer source(sourceBuffer, GRALLOC_USAGE_SW_READ_OFTEN);
+        if (source.getStatus() != NO_ERROR) {
+            skippedLayerCount++;
+            continue;
+        }
+        mRasterizer.drawLayer(*layer, &source.getPixels());
+    }
+
+    std::lock_guard lock(mStatsMutex);
+    mFrameCount++;
+    mLayerCount += layers.size();
+    mSkippedLayerCount += skippedLayerCount;
+    mTotalDrawTime += systemTime() - start;
+    return NO_ERROR;
+}
+
+void CpuRenderEngine::dump(std::string& result) {
+    std::lock_guard lock(mStatsMutex);
+    StringAppendF(&result, "RenderEngine CPU backend\n");
+    StringAppendF(&result,
+                  "  frames drawn: %" PRIu64 ", layers drawn: %" PRIu64
+                  ", layers skipped: %" PRIu64 "\n",
+                  mFrameCount, mLayerCount, mSkippedLayerCount);
+    if (mLayerCount > 0) {
+        StringAppendF(&result, "  average time per layer: %.1f us\n",
+                      mTotalDrawTime / 1000.0 / static_cast<double>(mLayerCount));
+    }
+}
+
+} // namespace cpu
+} // namespace renderengine
+} // namespace android
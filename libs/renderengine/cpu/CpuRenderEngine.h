@@ -0,0 +1,113 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <android-base/thread_annotations.h>
+#include <renderengine/Framebuffer.h>
+#include <renderengine/RenderEngine.h>
+#include <utils/Timers.h>
+
+#include "Rasterizer.h"
+
+namespace android {
+namespace renderengine {
+namespace cpu {
+
+// RenderEngine backend that composites on the CPU, without EGL or GLES. It is a fallback for
+// devices whose GPU driver is unusable, and lets composition run in headless tests.
+//
+// Output buffers must be RGBA_8888 or RGBX_8888 and allocated with the usage returned by
+// getOutputBufferUsage. Layer buffers are drawn only if they are RGBA_8888 or RGBX_8888 and were
+// allocated with a CPU read usage; other layer buffers, such as YUV video or buffers only the
+// GPU can read, are skipped. Background blur is not drawn.
+class CpuRenderEngine : public impl::RenderEngine {
+public:
+    static std::unique_ptr<CpuRenderEngine> create(const RenderEngineCreationArgs& args);
+
+    explicit CpuRenderEngine(const RenderEngineCreationArgs& args);
+    ~CpuRenderEngine() override;
+
+    void primeCache() const override {}
+    void dump(std::string& result) override EXCLUDES(mStatsMutex);
+
+    // Drawing completes before drawLayers returns, so there is never a fence to wait for.
+    bool useNativeFenceSync() const override { return false; }
+    bool useWaitSync() const override { return false; }
+
+    void genTextures(size_t count, uint32_t* names) override;
+    void deleteTextures(size_t, uint32_t const*) override {}
+    void bindExternalTextureImage(uint32_t, const Image&) override {}
+    status_t bindExternalTextureBuffer(uint32_t, const sp<GraphicBuffer>&,
+                                       const sp<Fence>&) override {
+        return NO_ERROR;
+    }
+    void cacheExternalTextureBuffer(const sp<GraphicBuffer>&) override {}
+    void unbindExternalTextureBuffer(uint64_t) override {}
+    status_t bindFrameBuffer(Framebuffer*) override { return NO_ERROR; }
+    void unbindFrameBuffer(Framebuffer*) override {}
+    bool cleanupPostRender(CleanupMode) override { return false; }
+
+    size_t getMaxTextureSize() const override;
+    size_t getMaxViewportDims() const override;
+    uint64_t getOutputBufferUsage() const override;
+
+    bool isProtected() const override { return false; }
+    bool supportsProtectedContent() const override { return false; }
+    bool useProtectedContext(bool useProtectedContext) override { return !useProtectedContext; }
+
+    status_t drawLayers(const DisplaySettings& display,
+                        const std::vector<const LayerSettings*>& layers,
+                        ANativeWindowBuffer* buffer, const bool useFramebufferCache,
+                        base::unique_fd&& bufferFence, base::unique_fd* drawFence) override;
+
+    // Draws layers into output, which may be plain memory rather than a locked gralloc buffer.
+    status_t drawLayers(const DisplaySettings& display,
+                        const std::vector<const LayerSettings*>& layers, const PixelBuffer& output)
+            EXCLUDES(mStatsMutex);
+
+protected:
+    Framebuffer* getFramebufferForDrawing() override { return &mFramebuffer; }
+
+private:
+    // Buffers are locked directly in drawLayers, so there is nothing to bind.
+    class CpuFramebuffer : public Framebuffer {
+    public:
+        bool setNativeWindowBuffer(ANativeWindowBuffer*, bool, const bool) override {
+            return true;
+        }
+    };
+
+    // Maps layer stack space onto the physical display, as GLES does with its projection.
+    static mat4 getDisplayTransform(const DisplaySettings& display);
+
+    CpuFramebuffer mFramebuffer;
+    Rasterizer mRasterizer;
+    std::atomic<uint32_t> mNextTextureName = 1;
+
+    std::mutex mStatsMutex;
+    uint64_t mFrameCount GUARDED_BY(mStatsMutex) = 0;
+    uint64_t mLayerCount GUARDED_BY(mStatsMutex) = 0;
+    nsecs_t mTotalDrawTime GUARDED_BY(mStatsMutex) = 0;
+    uint64_t mSkippedLayerCount GUARDED_BY(mStatsMutex) = 0;
+};
+
+} // namespace cpu
+} // namespace renderengine
+} // namespace android
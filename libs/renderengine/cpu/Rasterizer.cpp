@@ -0,0 +1,506 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <ui/ColorSpace.h>
+
+namespace android {
+namespace renderengine {
+namespace cpu {
+
+using ui::Dataspace;
+
+namespace {
+
+// The four channels of a pixel, in RGBA order. The compiler lowers operations on this type to
+// NEON or SSE instructions, depending on the target.
+using Color = float __attribute__((vector_size(4 * sizeof(float))));
+
+inline Color unpack(uint32_t pixel) {
+    const Color color = {static_cast<float>(pixel & 0xFF), static_cast<float>((pixel >> 8) & 0xFF),
+                         static_cast<float>((pixel >> 16) & 0xFF),
+                         static_cast<float>(pixel >> 24)};
+    return color * (1.0f / 255.0f);
+}
+
+inline uint32_t pack(Color color, bool opaque) {
+    color = color * 255.0f + 0.5f;
+    uint32_t pixel = 0;
+    for (int channel = 0; channel < 4; channel++) {
+        const float value = std::clamp(color[channel], 0.0f, 255.0f);
+        pixel |= static_cast<uint32_t>(value) << (channel * 8);
+    }
+    return opaque ? pixel | 0xFF000000 : pixel;
+}
+
+inline Color toColor(const vec4& v) {
+    return Color{v.r, v.g, v.b, v.a};
+}
+
+// Premultiplied source-over blending.
+inline Color blend(Color source, Color destination) {
+    return source + destination * (1.0f - source[3]);
+}
+
+// The 2D part of a mat4, for mapping points in the z = 0 plane.
+struct Affine {
+    float a = 1.0f, b = 0.0f, c = 0.0f, d = 1.0f, tx = 0.0f, ty = 0.0f;
+
+    static Affine from(const mat4& m) {
+        return {m[0][0], m[0][1], m[1][0], m[1][1], m[3][0], m[3][1]};
+    }
+
+    vec2 map(float x, float y) const { return vec2(a * x + c * y + tx, b * x + d * y + ty); }
+
+    Affine invert() const {
+        const float determinant = a * d - b * c;
+        if (determinant == 0.0f) {
+            return {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        }
+        const float inverse = 1.0f / determinant;
+        Affine result = {d * inverse, -b * inverse, -c * inverse, a * inverse, 0.0f, 0.0f};
+        result.tx = -(result.a * tx + result.c * ty);
+        result.ty = -(result.b * tx + result.d * ty);
+        return result;
+    }
+
+    bool isAxisAligned() const { return b == 0.0f && c == 0.0f; }
+
+    FloatRect mapRect(const FloatRect& rect) const {
+        const vec2 corners[] = {map(rect.left, rect.top), map(rect.right, rect.top),
+                                map(rect.left, rect.bottom), map(rect.right, rect.bottom)};
+        FloatRect result(corners[0].x, corners[0].y, corners[0].x, corners[0].y);
+        for (const vec2& corner : corners) {
+            result.left = std::min(result.left, corner.x);
+            result.top = std::min(result.top, corner.y);
+            result.right = std::max(result.right, corner.x);
+            result.bottom = std::max(result.bottom, corner.y);
+        }
+        return result;
+    }
+};
+
+// Returns the destination pixels whose centers may fall within rect.
+Rect coveredPixels(const FloatRect& rect, const Rect& bounds) {
+    Rect pixels(static_cast<int32_t>(std::floor(rect.left)),
+                static_cast<int32_t>(std::floor(rect.top)),
+                static_cast<int32_t>(std::ceil(rect.right)),
+                static_cast<int32_t>(std::ceil(rect.bottom)));
+    Rect result;
+    return pixels.intersect(bounds, &result) ? result : Rect::EMPTY_RECT;
+}
+
+// Signed distance from p to a rectangle with rounded corners; negative inside.
+inline float roundedRectDistance(vec2 p, vec2 center, vec2 halfSize, float radius) {
+    const float qx = std::abs(p.x - center.x) - halfSize.x + radius;
+    const float qy = std::abs(p.y - center.y) - halfSize.y + radius;
+    const float outside = std::hypot(std::max(qx, 0.0f), std::max(qy, 0.0f));
+    return outside + std::min(std::max(qx, qy), 0.0f) - radius;
+}
+
+// Matches applyCornerRadius() in the GLES fragment shader.
+inline float cornerCoverage(vec2 p, vec2 center, vec2 halfSize, float radius) {
+    const float qx = std::abs(p.x - center.x) - halfSize.x + radius;
+    const float qy = std::abs(p.y - center.y) - halfSize.y + radius;
+    const float plane = std::hypot(std::max(qx, 0.0f), std::max(qy, 0.0f));
+    return 1.0f - std::clamp(plane - radius, 0.0f, 1.0f);
+}
+
+inline float smoothstep(float edge0, float edge1, float x) {
+    const float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+float decode(float value, float gamma, bool srgb, bool smpte170m) {
+    if (srgb) {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    if (smpte170m) {
+        return value < 0.081f ? value / 4.5f : std::pow((value + 0.099f) / 1.099f, 1.0f / 0.45f);
+    }
+    return std::pow(value, gamma);
+}
+
+float encode(float value, float gamma, bool srgb, bool smpte170m) {
+    if (srgb) {
+        return value <= 0.0031308f ? value * 12.92f
+                                   : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+    if (smpte170m) {
+        return value < 0.018f ? value * 4.5f : 1.099f * std::pow(value, 0.45f) - 0.099f;
+    }
+    return std::pow(value, 1.0f / gamma);
+}
+
+const ColorSpace& getColorSpace(Dataspace dataspace) {
+    static const ColorSpace sSrgb(ColorSpace::sRGB());
+    static const ColorSpace sDisplayP3(ColorSpace::DisplayP3());
+    static const ColorSpace sBt2020(ColorSpace::BT2020());
+    switch (static_cast<Dataspace>(dataspace & Dataspace::STANDARD_MASK)) {
+        case Dataspace::STANDARD_DCI_P3:
+            return sDisplayP3;
+        case Dataspace::STANDARD_BT2020:
+        case Dataspace::STANDARD_BT2020_CONSTANT_LUMINANCE:
+            return sBt2020;
+        default:
+            return sSrgb;
+    }
+}
+
+} // namespace
+
+// Converts a color from the layer's dataspace to the output dataspace and applies the color
+// transforms, as the GLES fragment shader does. Disabled when it would not change anything.
+struct Rasterizer::ColorPipeline {
+    bool enabled = false;
+    const float* decodeTable = nullptr;
+    const float* encodeTable = nullptr;
+    // Columns of the color matrix; the last one is the offset.
+    Color columns[4];
+
+    Color apply(Color color, bool premultiplied) const {
+        if (!enabled) {
+            return color;
+        }
+        const float alpha = color[3];
+        if (premultiplied) {
+            color = alpha > 0.0f ? color / alpha : Color{};
+        }
+        Color linear = columns[3];
+        for (int channel = 0; channel < 3; channel++) {
+            const float value = std::clamp(color[channel], 0.0f, 1.0f);
+            linear += columns[channel] *
+                    decodeTable[static_cast<size_t>(value * (kDecodeTableSize - 1) + 0.5f)];
+        }
+        for (int channel = 0; channel < 3; channel++) {
+            const float value = std::clamp(linear[channel], 0.0f, 1.0f);
+            color[channel] =
+                    encodeTable[static_cast<size_t>(value * (kEncodeTableSize - 1) + 0.5f)];
+        }
+        color[3] = alpha;
+        return premultiplied ? color * Color{alpha, alpha, alpha, 1.0f} : color;
+    }
+};
+
+Rasterizer::Rasterizer(bool useColorManagement) : mUseColorManagement(useColorManagement) {
+    for (size_t i = 0; i < static_cast<size_t>(Transfer::COUNT); i++) {
+        const auto transfer = static_cast<Transfer>(i);
+        float gamma = 1.0f;
+        switch (transfer) {
+            case Transfer::GAMMA2_2:
+                gamma = 2.2f;
+                break;
+            case Transfer::GAMMA2_6:
+                gamma = 2.6f;
+                break;
+            case Transfer::GAMMA2_8:
+                gamma = 2.8f;
+                break;
+            default:
+                break;
+        }
+        const bool srgb = transfer == Transfer::SRGB;
+        const bool smpte170m = transfer == Transfer::SMPTE_170M;
+
+        for (size_t j = 0; j < kDecodeTableSize; j++) {
+            mDecodeTables[i][j] = decode(j / float(kDecodeTableSize - 1), gamma, srgb, smpte170m);
+        }
+        mEncodeTables[i].resize(kEncodeTableSize);
+        for (size_t j = 0; j < kEncodeTableSize; j++) {
+            mEncodeTables[i][j] = encode(j / float(kEncodeTableSize - 1), gamma, srgb, smpte170m);
+        }
+    }
+}
+
+Rasterizer::Transfer Rasterizer::getTransfer(Dataspace dataspace) {
+    switch (static_cast<Dataspace>(dataspace & Dataspace::TRANSFER_MASK)) {
+        case Dataspace::TRANSFER_LINEAR:
+            return Transfer::LINEAR;
+        case Dataspace::TRANSFER_SMPTE_170M:
+            return Transfer::SMPTE_170M;
+        case Dataspace::TRANSFER_GAMMA2_2:
+            return Transfer::GAMMA2_2;
+        case Dataspace::TRANSFER_GAMMA2_6:
+            return Transfer::GAMMA2_6;
+        case Dataspace::TRANSFER_GAMMA2_8:
+            return Transfer::GAMMA2_8;
+        default:
+            // HDR transfer functions are not supported, and are treated as sRGB.
+            return Transfer::SRGB;
+    }
+}
+
+Rasterizer::ColorPipeline Rasterizer::getColorPipeline(const LayerSettings& layer) const {
+    ColorPipeline pipeline;
+    mat4 matrix = mColorTransform * layer.colorTransform;
+    Transfer inputTransfer = Transfer::SRGB;
+    Transfer outputTransfer = Transfer::SRGB;
+    if (mUseColorManagement) {
+        const ColorSpace& input = getColorSpace(layer.sourceDataspace);
+        const ColorSpace& output = getColorSpace(mOutputDataspace);
+        if (&input != &output) {
+            matrix = matrix * mat4(output.getXYZtoRGB() * input.getRGBtoXYZ());
+        }
+        inputTransfer = getTransfer(layer.sourceDataspace);
+        outputTransfer = getTransfer(mOutputDataspace);
+    }
+
+    pipeline.enabled = matrix != mat4() || inputTransfer != outputTransfer;
+    pipeline.decodeTable = mDecodeTables[static_cast<size_t>(inputTransfer)].data();
+    pipeline.encodeTable = mEncodeTables[static_cast<size_t>(outputTransfer)].data();
+    for (int column = 0; column < 4; column++) {
+        pipeline.columns[column] = toColor(matrix[column]);
+    }
+    pipeline.columns[3][3] = 0.0f;
+    return pipeline;
+}
+
+void Rasterizer::begin(const PixelBuffer& destination, const Rect& bounds,
+                       const mat4& displayTransform, const mat4& colorTransform,
+                       Dataspace outputDataspace) {
+    mDestination = destination;
+    if (!bounds.intersect(Rect(destination.width, destination.height), &mBounds)) {
+        mBounds = Rect::EMPTY_RECT;
+    }
+    mDisplayTransform = displayTransform;
+    mColorTransform = colorTransform;
+    mOutputDataspace = outputDataspace;
+}
+
+void Rasterizer::clear() {
+    const uint32_t transparent = pack(Color{}, mDestination.opaque);
+    for (int32_t y = mBounds.top; y < mBounds.bottom; y++) {
+        uint32_t* row = mDestination.pixels + y * mDestination.stride;
+        std::fill(row + mBounds.left, row + mBounds.right, transparent);
+    }
+}
+
+void Rasterizer::fillRect(const Rect& rect, const half4& color) {
+    const FloatRect mapped = Affine::from(mDisplayTransform).mapRect(rect.toFloatRect());
+    const Rect pixels(static_cast<int32_t>(std::lround(mapped.left)),
+                      static_cast<int32_t>(std::lround(mapped.top)),
+                      static_cast<int32_t>(std::lround(mapped.right)),
+                      static_cast<int32_t>(std::lround(mapped.bottom)));
+    Rect area;
+    if (!pixels.intersect(mBounds, &area)) {
+        return;
+    }
+    const uint32_t value = pack(Color{color.r, color.g, color.b, color.a}, mDestination.opaque);
+    for (int32_t y = area.top; y < area.bottom; y++) {
+        uint32_t* row = mDestination.pixels + y * mDestination.stride;
+        std::fill(row + area.left, row + area.right, value);
+    }
+}
+
+void Rasterizer::drawLayer(const LayerSettings& layer, const PixelBuffer* source) {
+    const mat4 layerToDestination = mDisplayTransform * layer.geometry.positionTransform;
+    if (layer.shadow.length > 0.0f) {
+        // As with GLES, a layer casting a shadow only draws its shadow.
+        drawShadow(layer, layerToDestination);
+        return;
+    }
+
+    const Affine transform = Affine::from(layerToDestination);
+    const FloatRect& boundaries = layer.geometry.boundaries;
+    const Rect area = coveredPixels(transform.mapRect(boundaries), mBounds);
+    if (area.isEmpty()) {
+        return;
+    }
+    const Affine inverse = transform.invert();
+
+    const ColorPipeline pipeline = getColorPipeline(layer);
+    const bool hasBuffer = source != nullptr && source->pixels != nullptr;
+    const Buffer& buffer = layer.source.buffer;
+    const bool premultiplied = !hasBuffer || buffer.usePremultipliedAlpha;
+    const float alpha = layer.alpha;
+    const bool blending = !layer.disableBlending;
+
+    const float radius = layer.geometry.roundedCornersRadius;
+    const FloatRect& crop = layer.geometry.roundedCornersCrop;
+    const vec2 cropCenter((crop.left + crop.right) / 2.0f, (crop.top + crop.bottom) / 2.0f);
+    const vec2 cropHalfSize(crop.getWidth() / 2.0f, crop.getHeight() / 2.0f);
+
+    // Solid colors are the same everywhere, so run them through the pipeline once.
+    const half3& solidColor = layer.source.solidColor;
+    const Color solid = pipeline.apply(Color{solidColor.r * alpha, solidColor.g * alpha,
+                                             solidColor.b * alpha, alpha},
+                                       true);
+
+    if (!hasBuffer && radius <= 0.0f && transform.isAxisAligned()) {
+        // Axis aligned solid rectangles cover whole spans of pixels.
+        const FloatRect mapped = transform.mapRect(boundaries);
+        const Rect pixels(static_cast<int32_t>(std::lround(mapped.left)),
+                          static_cast<int32_t>(std::lround(mapped.top)),
+                          static_cast<int32_t>(std::lround(mapped.right)),
+                          static_cast<int32_t>(std::lround(mapped.bottom)));
+        Rect span;
+        if (!pixels.intersect(mBounds, &span)) {
+            return;
+        }
+        const uint32_t value = pack(solid, mDestination.opaque);
+        for (int32_t y = span.top; y < span.bottom; y++) {
+            uint32_t* row = mDestination.pixels + y * mDestination.stride;
+            if (!blending || solid[3] >= 1.0f) {
+                std::fill(row + span.left, row + span.right, value);
+                continue;
+            }
+            for (int32_t x = span.left; x < span.right; x++) {
+                row[x] = pack(blend(solid, unpack(row[x])), mDestination.opaque);
+            }
+        }
+        return;
+    }
+
+    // Maps layer coordinates to texel coordinates, like the texture coordinates of the GLES
+    // mesh followed by the texture transform.
+    Affine texelTransform;
+    if (hasBuffer) {
+        const mat4 toTexels = mat4::scale(vec4(source->width, source->height, 1.0f, 1.0f)) *
+                buffer.textureTransform *
+                mat4::scale(vec4(1.0f / boundaries.getWidth(), 1.0f / boundaries.getHeight(),
+                                 1.0f, 1.0f)) *
+                mat4::translate(vec4(-boundaries.left, -boundaries.top, 0.0f, 1.0f));
+        texelTransform = Affine::from(toTexels);
+    }
+
+    const auto texel = [source](int32_t x, int32_t y) {
+        x = std::clamp(x, 0, source->width - 1);
+        y = std::clamp(y, 0, source->height - 1);
+        return unpack(source->pixels[y * source->stride + x]);
+    };
+
+    for (int32_t y = area.top; y < area.bottom; y++) {
+        uint32_t* row = mDestination.pixels + y * mDestination.stride;
+        for (int32_t x = area.left; x < area.right; x++) {
+            const vec2 p = inverse.map(x + 0.5f, y + 0.5f);
+            if (p.x < boundaries.left || p.x >= boundaries.right || p.y < boundaries.top ||
+                p.y >= boundaries.bottom) {
+                continue;
+            }
+
+            Color color = solid;
+            if (hasBuffer) {
+                const vec2 t = texelTransform.map(p.x, p.y);
+                if (buffer.useTextureFiltering) {
+                    const float u = t.x - 0.5f;
+                    const float v = t.y - 0.5f;
+                    const int32_t u0 = static_cast<int32_t>(std::floor(u));
+                    const int32_t v0 = static_cast<int32_t>(std::floor(v));
+                    const float fu = u - u0;
+                    const float fv = v - v0;
+                    const Color top = texel(u0, v0) * (1.0f - fu) + texel(u0 + 1, v0) * fu;
+                    const Color bottom =
+                            texel(u0, v0 + 1) * (1.0f - fu) + texel(u0 + 1, v0 + 1) * fu;
+                    color = top * (1.0f - fv) + bottom * fv;
+                } else {
+                    color = texel(static_cast<int32_t>(std::floor(t.x)),
+                                  static_cast<int32_t>(std::floor(t.y)));
+                }
+                if (buffer.isOpaque) {
+                    color[3] = 1.0f;
+                }
+                if (premultiplied) {
+                    color *= alpha;
+                } else {
+                    color[3] *= alpha;
+                }
+                color = pipeline.apply(color, premultiplied && !buffer.isOpaque);
+            }
+
+            if (radius > 0.0f) {
+                const float coverage = cornerCoverage(p, cropCenter, cropHalfSize, radius);
+                if (premultiplied) {
+                    color *= coverage;
+                } else {
+                    color[3] *= coverage;
+                }
+            }
+
+            if (blending) {
+                const Color destination = unpack(row[x]);
+                color = premultiplied ? blend(color, destination)
+                                      : color * color[3] + destination * (1.0f - color[3]);
+            }
+            row[x] = pack(color, mDestination.opaque);
+        }
+    }
+}
+
+void Rasterizer::drawShadow(const LayerSettings& layer, const mat4& layerToDestination) {
+    const ShadowSettings& shadow = layer.shadow;
+    const FloatRect& caster = layer.geometry.boundaries;
+    const float radius = std::min(layer.geometry.roundedCornersRadius,
+                                  std::min(caster.getWidth(), caster.getHeight()) / 2.0f);
+    const vec2 center((caster.left + caster.right) / 2.0f, (caster.top + caster.bottom) / 2.0f);
+    const vec2 halfSize(caster.getWidth() / 2.0f, caster.getHeight() / 2.0f);
+
+    // The spot shadow is the caster projected away from the light onto a plane shadow.length
+    // below it, blurred by the size of the light.
+    const float lightHeight = std::max(shadow.lightPos.z - shadow.length, 1.0f);
+    const float projection = shadow.length / lightHeight;
+    const vec2 spotOffset((center.x - shadow.lightPos.x) * projection,
+                          (center.y - shadow.lightPos.y) * projection);
+    const float spotBlur = std::max(shadow.lightRadius * projection, 1.0f);
+
+    const float extent = shadow.length + spotBlur + std::max(std::abs(spotOffset.x),
+                                                               std::abs(spotOffset.y));
+    const FloatRect shadowBounds(caster.left - extent, caster.top - extent, caster.right + extent,
+                                 caster.bottom + extent);
+
+    const Affine transform = Affine::from(layerToDestination);
+    const Rect area = coveredPixels(transform.mapRect(shadowBounds), mBounds);
+    if (area.isEmpty()) {
+        return;
+    }
+    const Affine inverse = transform.invert();
+
+    // Shadow colors are already premultiplied, and only go through the display color transform.
+    LayerSettings settings;
+    settings.sourceDataspace = mOutputDataspace;
+    const ColorPipeline pipeline = getColorPipeline(settings);
+    const Color ambientColor = pipeline.apply(toColor(shadow.ambientColor), true);
+    const Color spotColor = pipeline.apply(toColor(shadow.spotColor), true);
+
+    for (int32_t y = area.top; y < area.bottom; y++) {
+        uint32_t* row = mDestination.pixels + y * mDestination.stride;
+        for (int32_t x = area.left; x < area.right; x++) {
+            const vec2 p = inverse.map(x + 0.5f, y + 0.5f);
+            const float distance = roundedRectDistance(p, center, halfSize, radius);
+            if (distance < 0.0f && !shadow.casterIsTranslucent) {
+                continue;
+            }
+
+            const float ambient = 1.0f - smoothstep(0.0f, shadow.length, distance);
+            const vec2 spotPosition(p.x - spotOffset.x, p.y - spotOffset.y);
+            const float spotDistance = roundedRectDistance(spotPosition, center, halfSize, radius);
+            const float spot = 1.0f - smoothstep(-spotBlur, spotBlur, spotDistance);
+
+            const Color color = ambientColor * ambient + spotColor * spot;
+            if (color[3] <= 0.0f) {
+                continue;
+            }
+            row[x] = pack(blend(color, unpack(row[x])), mDestination.opaque);
+        }
+    }
+}
+
+} // namespace cpu
+} // namespace renderengine
+} // namespace android
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <math/mat4.h>
+#include <math/vec4.h>
+#include <renderengine/LayerSettings.h>
+#include <ui/GraphicTypes.h>
+#include <ui/Rect.h>
+
+namespace android {
+namespace renderengine {
+namespace cpu {
+
+// The pixels of an RGBA_8888 or RGBX_8888 image, locked for CPU access.
+struct PixelBuffer {
+    uint32_t* pixels = nullptr;
+    int32_t width = 0;
+    int32_t height = 0;
+    // Distance between rows, in pixels.
+    int32_t stride = 0;
+    // True if the alpha channel is ignored, as for RGBX_8888.
+    bool opaque = false;
+};
+
+// Rasterizer draws layers into a PixelBuffer on the CPU. Colors are processed a pixel at a time,
+// with the four channels of a pixel held in one vector register.
+class Rasterizer {
+public:
+    explicit Rasterizer(bool useColorManagement);
+
+    // Starts drawing into destination. Nothing outside of bounds, in destination coordinates, is
+    // touched. displayTransform maps layer stack space onto the destination, and colorTransform
+    // is applied to every layer in linear space.
+    void begin(const PixelBuffer& destination, const Rect& bounds, const mat4& displayTransform,
+               const mat4& colorTransform, ui::Dataspace outputDataspace);
+
+    // Clears everything within the bounds to transparent black.
+    void clear();
+
+    // Fills rect, in layer stack space, with color without blending.
+    void fillRect(const Rect& rect, const half4& color);
+
+    // Blends layer over what was drawn before. If the layer has a buffer, source holds its
+    // pixels.
+    void drawLayer(const LayerSettings& layer, const PixelBuffer* source);
+
+private:
+    enum class Transfer { LINEAR, SRGB, SMPTE_170M, GAMMA2_2, GAMMA2_6, GAMMA2_8, COUNT };
+    static constexpr size_t kDecodeTableSize = 256;
+    static constexpr size_t kEncodeTableSize = 4096;
+
+    struct ColorPipeline;
+
+    static Transfer getTransfer(ui::Dataspace dataspace);
+    ColorPipeline getColorPipeline(const LayerSettings& layer) const;
+    void drawShadow(const LayerSettings& layer, const mat4& layerToDestination);
+
+    const bool mUseColorManagement;
+
+    // Maps 8 bit encoded values to linear values, for each transfer function.
+    std::array<std::array<float, kDecodeTableSize>, static_cast<size_t>(Transfer::COUNT)>
+            mDecodeTables;
+    // Maps linear values to encoded values, for each transfer function.
+    std::array<std::vector<float>, static_cast<size_t>(Transfer::COUNT)> mEncodeTables;
+
+    PixelBuffer mDestination;
+    Rect mBounds = Rect::EMPTY_RECT;
+    mat4 mDisplayTransform;
+    mat4 mColorTransform;
+    ui::Dataspace mOutputDataspace = ui::Dataspace::UNKNOWN;
+};
+
+} // namespace cpu
+} // namespace renderengine
+} // namespace android
@@ -19,11 +19,15 @@
 #define LOG_TAG "RenderEngine"
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
+#include <pthread.h>
 #include <sched.h>
+#include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <future>
 #include <sstream>
 #include <unordered_set>
+#include <utility>
 
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
@@ -46,8 +50,8 @@
 #include "GLExtensions.h"
 #include "GLFramebuffer.h"
 #include "GLImage.h"
-#include "GLShadowVertexGenerator.h"
 #include "Program.h"
+#include "ProgramBinaryCache.h"
 #include "ProgramCache.h"
 #include "filters/BlurFilter.h"
 
@@ -256,6 +260,21 @@ std::unique_ptr<GLESRenderEngine> GLESRenderEngine::create(const RenderEngineCre
     extensions.initWithGLStrings(glGetString(GL_VENDOR), glGetString(GL_RENDERER),
                                  glGetString(GL_VERSION), glGetString(GL_EXTENSIONS));
 
+    // Start reading program binaries from the previous boot now, so that they are ready by the
+    // time the program cache is primed.
+    if (extensions.hasProgramBinary()) {
+        char path[PROPERTY_VALUE_MAX];
+        property_get(PROPERTY_DEBUG_RENDERENGINE_PROGRAM_BINARY_CACHE, path,
+                     ProgramBinaryCache::kDefaultPath);
+        if (path[0] != '\0') {
+            ProgramCache::getInstance().setBinaryCache(std::make_unique<ProgramBinaryCache>(
+                    path,
+                    ProgramBinaryCache::getDriverFingerprint(extensions.getVendor(),
+                                                             extensions.getRenderer(),
+                                                             extensions.getVersion())));
+        }
+    }
+
     EGLSurface protectedDummy = EGL_NO_SURFACE;
     if (protectedContext != EGL_NO_CONTEXT && !extensions.hasSurfacelessContext()) {
         protectedDummy = createDummyEglPbufferSurface(display, config, args.pixelFormat,
@@ -352,6 +371,8 @@ GLESRenderEngine::GLESRenderEngine(const RenderEngineCreationArgs& args, EGLDisp
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    // Programs may be linked on the priming context, whose vertex attribute state is not shared.
+    glEnableVertexAttribArray(Program::position);
 
     // Initialize protected EGL Context.
     if (mProtectedEGLContext != EGL_NO_CONTEXT) {
@@ -360,6 +381,7 @@ GLESRenderEngine::GLESRenderEngine(const RenderEngineCreationArgs& args, EGLDisp
         ALOGE_IF(!success, "can't make protected context current");
         glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glEnableVertexAttribArray(Program::position);
         success = eglMakeCurrent(display, mDummySurface, mDummySurface, mEGLContext);
         LOG_ALWAYS_FATAL_IF(!success, "can't make default context current");
     }
@@ -401,6 +423,12 @@ GLESRenderEngine::GLESRenderEngine(const RenderEngineCreationArgs& args, EGLDisp
         mFlushTracer = std::make_unique<FlushTracer>(this);
     }
 
+    property_get(PROPERTY_DEBUG_RENDERENGINE_IMAGE_CACHE_BUDGET, value, "512");
+    {
+        std::lock_guard<std::mutex> lock(mRenderingMutex);
+        mImageCacheBudget = static_cast<size_t>(atoi(value)) * 1024 * 1024;
+    }
+
     if (args.supportsBackgroundBlur) {
         mBlurFilter = new BlurFilter(*this);
         checkErrors("BlurFilter creation");
@@ -408,6 +436,7 @@ GLESRenderEngine::GLESRenderEngine(const RenderEngineCreationArgs& args, EGLDisp
 
     mImageManager = std::make_unique<ImageManager>(this);
     mImageManager->initThread();
+    initPrimingThread();
     mDrawingBuffer = createFramebuffer();
     sp<GraphicBuffer> buf =
             new GraphicBuffer(1, 1, PIXEL_FORMAT_RGBA_8888, 1,
@@ -429,19 +458,21 @@ GLESRenderEngine::GLESRenderEngine(const RenderEngineCreationArgs& args, EGLDisp
 }
 
 GLESRenderEngine::~GLESRenderEngine() {
+    destroyPrimingThread();
     // Destroy the image manager first.
     mImageManager = nullptr;
     std::lock_guard<std::mutex> lock(mRenderingMutex);
     unbindFrameBuffer(mDrawingBuffer.get());
     mDrawingBuffer = nullptr;
     while (!mFramebufferImageCache.empty()) {
-        EGLImageKHR expired = mFramebufferImageCache.front().second;
+        EGLImageKHR expired = mFramebufferImageCache.front().image;
         mFramebufferImageCache.pop_front();
         eglDestroyImageKHR(mEGLDisplay, expired);
         DEBUG_EGL_IMAGE_TRACKER_DESTROY();
     }
     eglDestroyImageKHR(mEGLDisplay, mPlaceholderImage);
     mImageCache.clear();
+    mShadowMeshCache.clear();
     eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglTerminate(mEGLDisplay);
 }
@@ -458,10 +489,76 @@ Framebuffer* GLESRenderEngine::getFramebufferForDrawing() {
     return mDrawingBuffer.get();
 }
 
+void GLESRenderEngine::initPrimingThread() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get(PROPERTY_DEBUG_RENDERENGINE_BACKGROUND_PRIMING, value, "1");
+    if (!atoi(value)) {
+        return;
+    }
+
+    mPrimingContext = createEglContext(mEGLDisplay, mEGLConfig, mEGLContext,
+                                       /*useContextPriority*/ false, Protection::UNPROTECTED);
+    if (mPrimingContext == EGL_NO_CONTEXT) {
+        ALOGW("Can't create program priming context, priming on the render thread");
+        return;
+    }
+    if (!GLExtensions::getInstance().hasSurfacelessContext()) {
+        mPrimingSurface = createDummyEglPbufferSurface(mEGLDisplay, mEGLConfig, mArgs.pixelFormat,
+                                                       Protection::UNPROTECTED);
+        if (mPrimingSurface == EGL_NO_SURFACE) {
+            ALOGW("Can't create program priming pbuffer, priming on the render thread");
+            destroyPrimingThread();
+            return;
+        }
+    }
+
+    std::promise<bool> started;
+    std::future<bool> isStarted = started.get_future();
+    mPrimingThread = std::thread([this, started = std::move(started)]() mutable {
+        const bool current =
+                eglMakeCurrent(mEGLDisplay, mPrimingSurface, mPrimingSurface, mPrimingContext);
+        if (current) {
+            ProgramCache::getInstance().startPrimer(mEGLContext);
+        }
+        started.set_value(current);
+        if (!current) {
+            return;
+        }
+        ProgramCache::getInstance().runPrimer();
+        eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    });
+    pthread_setname_np(mPrimingThread.native_handle(), "ProgramPrimer");
+
+    if (!isStarted.get()) {
+        ALOGW("Can't make program priming context current, priming on the render thread");
+        destroyPrimingThread();
+    }
+}
+
+void GLESRenderEngine::destroyPrimingThread() {
+    if (mPrimingThread.joinable()) {
+        ProgramCache::getInstance().stopPrimer();
+        mPrimingThread.join();
+    }
+    if (mPrimingSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(mEGLDisplay, mPrimingSurface);
+        mPrimingSurface = EGL_NO_SURFACE;
+    }
+    if (mPrimingContext != EGL_NO_CONTEXT) {
+        eglDestroyContext(mEGLDisplay, mPrimingContext);
+        mPrimingContext = EGL_NO_CONTEXT;
+    }
+}
+
 void GLESRenderEngine::primeCache() const {
-    ProgramCache::getInstance().primeCache(mInProtectedContext ? mProtectedEGLContext : mEGLContext,
-                                           mArgs.useColorManagement,
-                                           mArgs.precacheToneMapperShaderOnly);
+    // Programs are cached per context, and the primer only fills the cache of mEGLContext.
+    ProgramCache& cache = ProgramCache::getInstance();
+    if (mInProtectedContext ||
+        !cache.primeCacheInBackground(mEGLContext, mArgs.useColorManagement,
+                                      mArgs.precacheToneMapperShaderOnly)) {
+        cache.primeCache(mInProtectedContext ? mProtectedEGLContext : mEGLContext,
+                         mArgs.useColorManagement, mArgs.precacheToneMapperShaderOnly);
+    }
 }
 
 base::unique_fd GLESRenderEngine::flush() {
@@ -594,11 +691,20 @@ void GLESRenderEngine::fillRegionWithColor(const Region& region, float red, floa
 }
 
 void GLESRenderEngine::setScissor(const Rect& region) {
-    glScissor(region.left, region.top, region.getWidth(), region.getHeight());
+    Rect scissor = region;
+    if (mDamage.isValid()) {
+        region.intersect(mDamage, &scissor);
+    }
+    glScissor(scissor.left, scissor.top, scissor.getWidth(), scissor.getHeight());
     glEnable(GL_SCISSOR_TEST);
 }
 
 void GLESRenderEngine::disableScissor() {
+    if (mDamage.isValid()) {
+        // Keep drawing within the part of the framebuffer being redrawn.
+        glScissor(mDamage.left, mDamage.top, mDamage.getWidth(), mDamage.getHeight());
+        return;
+    }
     glDisable(GL_SCISSOR_TEST);
 }
 
@@ -638,6 +744,11 @@ status_t GLESRenderEngine::bindExternalTextureBuffer(uint32_t texName,
         std::lock_guard<std::mutex> lock(mRenderingMutex);
         auto cachedImage = mImageCache.find(buffer->getId());
         found = (cachedImage != mImageCache.end());
+        if (found) {
+            cachedImage->second.lastUsedFrame = mImageCacheFrame;
+        } else {
+            mImageCacheMisses++;
+        }
     }
 
     // If we couldn't find the image in the cache at this time, then either
@@ -666,7 +777,7 @@ status_t GLESRenderEngine::bindExternalTextureBuffer(uint32_t texName,
             return NO_INIT;
         }
 
-        bindExternalTextureImage(texName, *cachedImage->second);
+        bindExternalTextureImage(texName, *cachedImage->second.image);
         mTextureView.insert_or_assign(texName, buffer->getId());
     }
 
@@ -738,7 +849,11 @@ status_t GLESRenderEngine::cacheExternalTextureBufferInternal(const sp<GraphicBu
             // so bail out if another thread won.
             return NO_ERROR;
         }
-        mImageCache.insert(std::make_pair(buffer->getId(), std::move(newImage)));
+        CachedImage& cachedImage = mImageCache[buffer->getId()];
+        cachedImage.image = std::move(newImage);
+        cachedImage.size = getBufferSize(*buffer);
+        cachedImage.lastUsedFrame = mImageCacheFrame;
+        mImageCacheBytes += cachedImage.size;
     }
 
     return NO_ERROR;
@@ -765,7 +880,8 @@ void GLESRenderEngine::unbindExternalTextureBufferInternal(uint64_t bufferId) {
             ALOGV("Destroying image for buffer: %" PRIu64, bufferId);
             // Move the buffer out of cache first, so that we can destroy
             // without holding the cache's lock.
-            image = std::move(cachedImage->second);
+            image = std::move(cachedImage->second.image);
+            mImageCacheBytes -= cachedImage->second.size;
             mImageCache.erase(bufferId);
             return;
         }
@@ -773,6 +889,76 @@ void GLESRenderEngine::unbindExternalTextureBufferInternal(uint64_t bufferId) {
     ALOGV("Failed to find image for buffer: %" PRIu64, bufferId);
 }
 
+void GLESRenderEngine::cacheImagesForLayers(const std::vector<const LayerSettings*>& layers) {
+    std::vector<sp<GraphicBuffer>> missing;
+    {
+        std::lock_guard<std::mutex> lock(mRenderingMutex);
+        mImageCacheFrame++;
+        for (const auto layer : layers) {
+            const sp<GraphicBuffer>& buffer = layer->source.buffer.buffer;
+            if (buffer == nullptr) {
+                continue;
+            }
+            const auto cachedImage = mImageCache.find(buffer->getId());
+            if (cachedImage != mImageCache.end()) {
+                cachedImage->second.lastUsedFrame = mImageCacheFrame;
+            } else {
+                missing.push_back(buffer);
+            }
+        }
+        mImageCacheMisses += missing.size();
+    }
+
+    // Otherwise, bindExternalTextureBuffer would wait for the ImageManager once per buffer.
+    if (!missing.empty()) {
+        ATRACE_NAME("Caching missing images");
+        mImageManager->cache(missing);
+    }
+}
+
+void GLESRenderEngine::trimImageCache() {
+    std::vector<std::unique_ptr<Image>> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mRenderingMutex);
+        if (mImageCacheBudget == 0 || mImageCacheBytes <= mImageCacheBudget) {
+            return;
+        }
+        ATRACE_CALL();
+
+        std::vector<std::pair<uint64_t, uint64_t>> candidates;
+        for (const auto& [id, cachedImage] : mImageCache) {
+            if (cachedImage.lastUsedFrame + kImageCacheProtectedFrames <= mImageCacheFrame) {
+                candidates.emplace_back(cachedImage.lastUsedFrame, id);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        for (const auto& [lastUsedFrame, id] : candidates) {
+            if (mImageCacheBytes <= mImageCacheBudget) {
+                break;
+            }
+            const auto cachedImage = mImageCache.find(id);
+            ALOGV("Evicting image for buffer: %" PRIu64, id);
+            evicted.push_back(std::move(cachedImage->second.image));
+            mImageCacheBytes -= cachedImage->second.size;
+            mImageCacheEvictions++;
+            mImageCacheEvictedBytes += cachedImage->second.size;
+            mImageCache.erase(cachedImage);
+        }
+        ALOGV_IF(mImageCacheBytes > mImageCacheBudget,
+                 "Images in use exceed the image cache budget: %zu > %zu bytes", mImageCacheBytes,
+                 mImageCacheBudget);
+    }
+    // The images are destroyed here, without holding the lock.
+}
+
+size_t GLESRenderEngine::getBufferSize(const GraphicBuffer& buffer) {
+    // YUV formats report no bytes per pixel. Assume two, which covers 8-bit 4:2:0 and 4:2:2.
+    const uint32_t bpp = bytesPerPixel(buffer.getPixelFormat());
+    return static_cast<size_t>(buffer.getStride()) * buffer.getHeight() * (bpp > 0 ? bpp : 2) *
+            buffer.getLayerCount();
+}
+
 FloatRect GLESRenderEngine::setupLayerCropping(const LayerSettings& layer, Mesh& mesh) {
     // Translate win by the rounded corners rect coordinates, to have all values in
     // layer coordinate space.
@@ -939,6 +1125,7 @@ bool GLESRenderEngine::cleanupPostRender(CleanupMode mode) {
         {
             std::lock_guard<std::mutex> lock(mRenderingMutex);
             mImageCache.clear();
+            mImageCacheBytes = 0;
         }
     }
 
@@ -994,9 +1181,13 @@ EGLImageKHR GLESRenderEngine::createFramebufferImageIfNeeded(ANativeWindowBuffer
     sp<GraphicBuffer> graphicBuffer = GraphicBuffer::from(nativeBuffer);
     if (useFramebufferCache) {
         std::lock_guard<std::mutex> lock(mFramebufferImageCacheMutex);
-        for (const auto& image : mFramebufferImageCache) {
-            if (image.first == graphicBuffer->getId()) {
-                return image.second;
+        for (auto it = mFramebufferImageCache.begin(); it != mFramebufferImageCache.end(); it++) {
+            if (it->bufferId == graphicBuffer->getId()) {
+                // Move the image to the back, so that the least recently used one is evicted.
+                const FramebufferImage image = *it;
+                mFramebufferImageCache.erase(it);
+                mFramebufferImageCache.push_back(image);
+                return image.image;
             }
         }
     }
@@ -1011,12 +1202,15 @@ EGLImageKHR GLESRenderEngine::createFramebufferImageIfNeeded(ANativeWindowBuffer
         if (image != EGL_NO_IMAGE_KHR) {
             std::lock_guard<std::mutex> lock(mFramebufferImageCacheMutex);
             if (mFramebufferImageCache.size() >= mFramebufferImageCacheSize) {
-                EGLImageKHR expired = mFramebufferImageCache.front().second;
-                mFramebufferImageCache.pop_front();
-                eglDestroyImageKHR(mEGLDisplay, expired);
+                const FramebufferImage& expired = mFramebufferImageCache.front();
+                eglDestroyImageKHR(mEGLDisplay, expired.image);
                 DEBUG_EGL_IMAGE_TRACKER_DESTROY();
+                mFramebufferImageCacheBytes -= expired.size;
+                mFramebufferImageCache.pop_front();
             }
-            mFramebufferImageCache.push_back({graphicBuffer->getId(), image});
+            const size_t size = getBufferSize(*graphicBuffer);
+            mFramebufferImageCache.push_back({graphicBuffer->getId(), image, size});
+            mFramebufferImageCacheBytes += size;
         }
     }
 
@@ -1051,6 +1245,12 @@ status_t GLESRenderEngine::drawLayers(const DisplaySettings& display,
         return BAD_VALUE;
     }
 
+    cacheImagesForLayers(layers);
+    {
+        std::lock_guard<std::mutex> lock(mRenderingMutex);
+        mShadowMeshCache.onFrameStarted();
+    }
+
     std::unique_ptr<BindNativeBufferAsFramebuffer> fbo;
     // Gathering layers that requested blur, we'll need them to decide when to render to an
     // offscreen buffer, and when to render to the native buffer.
@@ -1085,8 +1285,15 @@ status_t GLESRenderEngine::drawLayers(const DisplaySettings& display,
         }
     }
 
+    // Blurs sample everything drawn below them, so they always redraw the whole buffer.
+    mDamage = blurLayersSize == 0 ? display.damage : Rect::INVALID_RECT;
+    if (mDamage.isValid()) {
+        setScissor(mDamage);
+    }
+
     // clear the entire buffer, sometimes when we reuse buffers we'd persist
-    // ghost images otherwise.
+    // ghost images otherwise. When only part of the buffer is redrawn, the scissor
+    // limits this to the damaged part.
     // we also require a full transparent framebuffer for overlays. This is
     // probably not quite efficient on all GPUs, since we could filter out
     // opaque layers.
@@ -1223,6 +1430,11 @@ status_t GLESRenderEngine::drawLayers(const DisplaySettings& display,
         }
     }
 
+    if (mDamage.isValid()) {
+        mDamage = Rect::INVALID_RECT;
+        disableScissor();
+    }
+
     if (drawFence != nullptr) {
         *drawFence = flush();
     }
@@ -1336,31 +1548,48 @@ void GLESRenderEngine::setupCornerRadiusCropSize(float width, float height) {
     mState.cropSize = half2(width, height);
 }
 
-void GLESRenderEngine::drawMesh(const Mesh& mesh) {
+void GLESRenderEngine::drawMesh(const Mesh& mesh, const GLVertexBuffer* vertexBuffer,
+                                const GLVertexBuffer* indexBuffer) {
     ATRACE_CALL();
+    // With a vertex buffer bound, attribute pointers are byte offsets into it.
+    const auto attribute = [&](const float* data) -> const void* {
+        if (vertexBuffer == nullptr) {
+            return data;
+        }
+        return reinterpret_cast<const void*>((data - mesh.getPositions()) * sizeof(float));
+    };
+    if (vertexBuffer != nullptr) {
+        vertexBuffer->bind();
+    }
+
     if (mesh.getTexCoordsSize()) {
         glEnableVertexAttribArray(Program::texCoords);
         glVertexAttribPointer(Program::texCoords, mesh.getTexCoordsSize(), GL_FLOAT, GL_FALSE,
-                              mesh.getByteStride(), mesh.getTexCoords());
+                              mesh.getByteStride(), attribute(mesh.getTexCoords()));
     }
 
     glVertexAttribPointer(Program::position, mesh.getVertexSize(), GL_FLOAT, GL_FALSE,
-                          mesh.getByteStride(), mesh.getPositions());
+                          mesh.getByteStride(), attribute(mesh.getPositions()));
 
     if (mState.cornerRadius > 0.0f) {
         glEnableVertexAttribArray(Program::cropCoords);
         glVertexAttribPointer(Program::cropCoords, mesh.getVertexSize(), GL_FLOAT, GL_FALSE,
-                              mesh.getByteStride(), mesh.getCropCoords());
+                              mesh.getByteStride(), attribute(mesh.getCropCoords()));
     }
 
     if (mState.drawShadows) {
         glEnableVertexAttribArray(Program::shadowColor);
         glVertexAttribPointer(Program::shadowColor, mesh.getShadowColorSize(), GL_FLOAT, GL_FALSE,
-                              mesh.getByteStride(), mesh.getShadowColor());
+                              mesh.getByteStride(), attribute(mesh.getShadowColor()));
 
         glEnableVertexAttribArray(Program::shadowParams);
         glVertexAttribPointer(Program::shadowParams, mesh.getShadowParamsSize(), GL_FLOAT, GL_FALSE,
-                              mesh.getByteStride(), mesh.getShadowParams());
+                              mesh.getByteStride(), attribute(mesh.getShadowParams()));
+    }
+
+    // The attributes keep referring to the buffer once it is unbound.
+    if (vertexBuffer != nullptr) {
+        vertexBuffer->unbind();
     }
 
     Description managedState = mState;
@@ -1465,7 +1694,11 @@ void GLESRenderEngine::drawMesh(const Mesh& mesh) {
     ProgramCache::getInstance().useProgram(mInProtectedContext ? mProtectedEGLContext : mEGLContext,
                                            managedState);
 
-    if (mState.drawShadows) {
+    if (mState.drawShadows && indexBuffer != nullptr) {
+        indexBuffer->bind();
+        glDrawElements(mesh.getPrimitive(), mesh.getIndexCount(), GL_UNSIGNED_SHORT, nullptr);
+        indexBuffer->unbind();
+    } else if (mState.drawShadows) {
         glDrawElements(mesh.getPrimitive(), mesh.getIndexCount(), GL_UNSIGNED_SHORT,
                        mesh.getIndices());
     } else {
@@ -1517,24 +1750,34 @@ void GLESRenderEngine::dump(std::string& result) {
                   cache.getSize(mEGLContext));
     StringAppendF(&result, "RenderEngine program cache size for protected context: %zu\n",
                   cache.getSize(mProtectedEGLContext));
+    cache.dump(result);
     StringAppendF(&result, "RenderEngine last dataspace conversion: (%s) to (%s)\n",
                   dataspaceDetails(static_cast<android_dataspace>(mDataSpace)).c_str(),
                   dataspaceDetails(static_cast<android_dataspace>(mOutputDataSpace)).c_str());
     {
         std::lock_guard<std::mutex> lock(mRenderingMutex);
-        StringAppendF(&result, "RenderEngine image cache size: %zu\n", mImageCache.size());
+        mShadowMeshCache.dump(result);
+        StringAppendF(&result,
+                      "RenderEngine image cache size: %zu (%.1f MiB, budget %.1f MiB), "
+                      "misses: %zu, evicted: %zu (%.1f MiB)\n",
+                      mImageCache.size(), mImageCacheBytes / 1048576.0,
+                      mImageCacheBudget / 1048576.0, mImageCacheMisses, mImageCacheEvictions,
+                      mImageCacheEvictedBytes / 1048576.0);
         StringAppendF(&result, "Dumping buffer ids...\n");
-        for (const auto& [id, unused] : mImageCache) {
-            StringAppendF(&result, "0x%" PRIx64 "\n", id);
+        for (const auto& [id, cachedImage] : mImageCache) {
+            StringAppendF(&result, "0x%" PRIx64 " %.1f KiB, last used %" PRIu64 " frames ago\n",
+                          id, cachedImage.size / 1024.0,
+                          mImageCacheFrame - cachedImage.lastUsedFrame);
         }
     }
     {
         std::lock_guard<std::mutex> lock(mFramebufferImageCacheMutex);
-        StringAppendF(&result, "RenderEngine framebuffer image cache size: %zu\n",
-                      mFramebufferImageCache.size());
+        StringAppendF(&result, "RenderEngine framebuffer image cache size: %zu (%.1f MiB)\n",
+                      mFramebufferImageCache.size(), mFramebufferImageCacheBytes / 1048576.0);
         StringAppendF(&result, "Dumping buffer ids...\n");
-        for (const auto& [id, unused] : mFramebufferImageCache) {
-            StringAppendF(&result, "0x%" PRIx64 "\n", id);
+        for (const auto& image : mFramebufferImageCache) {
+            StringAppendF(&result, "0x%" PRIx64 " %.1f KiB\n", image.bufferId,
+                          image.size / 1024.0);
         }
     }
 }
@@ -1675,11 +1918,21 @@ std::optional<uint64_t> GLESRenderEngine::getBufferIdForTextureNameForTesting(ui
 bool GLESRenderEngine::isFramebufferImageCachedForTesting(uint64_t bufferId) {
     std::lock_guard<std::mutex> lock(mFramebufferImageCacheMutex);
     return std::any_of(mFramebufferImageCache.cbegin(), mFramebufferImageCache.cend(),
-                       [=](std::pair<uint64_t, EGLImageKHR> image) {
-                           return image.first == bufferId;
+                       [=](const FramebufferImage& image) {
+                           return image.bufferId == bufferId;
                        });
 }
 
+size_t GLESRenderEngine::setImageCacheBudgetForTesting(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mRenderingMutex);
+    return std::exchange(mImageCacheBudget, bytes);
+}
+
+size_t GLESRenderEngine::getShadowMeshCacheHitCountForTesting() {
+    std::lock_guard<std::mutex> lock(mRenderingMutex);
+    return mShadowMeshCache.getHitCount();
+}
+
 // FlushTracer implementation
 GLESRenderEngine::FlushTracer::FlushTracer(GLESRenderEngine* engine) : mEngine(engine) {
     mThread = std::thread(&GLESRenderEngine::FlushTracer::loop, this);
@@ -1739,29 +1992,20 @@ void GLESRenderEngine::handleShadow(const FloatRect& casterRect, float casterCor
                                     const ShadowSettings& settings) {
     ATRACE_CALL();
     const float casterZ = settings.length / 2.0f;
-    const GLShadowVertexGenerator shadows(casterRect, casterCornerRadius, casterZ,
-                                          settings.casterIsTranslucent, settings.ambientColor,
-                                          settings.spotColor, settings.lightPos,
-                                          settings.lightRadius);
-
-    // setup mesh for both shadows
-    Mesh mesh = Mesh::Builder()
-                        .setPrimitive(Mesh::TRIANGLES)
-                        .setVertices(shadows.getVertexCount(), 2 /* size */)
-                        .setShadowAttrs()
-                        .setIndices(shadows.getIndexCount())
-                        .build();
-
-    Mesh::VertexArray<vec2> position = mesh.getPositionArray<vec2>();
-    Mesh::VertexArray<vec4> shadowColor = mesh.getShadowColorArray<vec4>();
-    Mesh::VertexArray<vec3> shadowParams = mesh.getShadowParamsArray<vec3>();
-    shadows.fillVertices(position, shadowColor, shadowParams);
-    shadows.fillIndices(mesh.getIndicesArray());
+    // The cached shadow is only evicted by onFrameStarted() at the start of a later frame, so it
+    // can be drawn after the lock is released.
+    const GLShadowMeshCache::Shadow* shadow;
+    {
+        std::lock_guard<std::mutex> lock(mRenderingMutex);
+        shadow = &mShadowMeshCache.get(casterRect, casterCornerRadius, casterZ,
+                                       settings.casterIsTranslucent, settings.ambientColor,
+                                       settings.spotColor, settings.lightPos, settings.lightRadius);
+    }
 
     mState.cornerRadius = 0.0f;
     mState.drawShadows = true;
     setupLayerTexturing(mShadowTexture.getTexture());
-    drawMesh(mesh);
+    drawMesh(shadow->mesh, &shadow->vertices, &shadow->indices);
     mState.drawShadows = false;
 }
 
@@ -31,11 +31,18 @@
 #include <renderengine/RenderEngine.h>
 #include <renderengine/private/Description.h>
 #include <sys/types.h>
+#include "GLShadowMeshCache.h"
 #include "GLShadowTexture.h"
 #include "ImageManager.h"
 
 #define EGL_NO_CONFIG ((EGLConfig)0)
 
+/**
+ * Budget in MiB for the EGLImages of external texture buffers. When it is exceeded, the least
+ * recently used images are destroyed in the background. 0 removes the limit.
+ */
+#define PROPERTY_DEBUG_RENDERENGINE_IMAGE_CACHE_BUDGET "debug.renderengine.image_cache_budget_mb"
+
 namespace android {
 
 namespace renderengine {
@@ -100,6 +107,9 @@ public:
     std::shared_ptr<ImageManager::Barrier> cacheExternalTextureBufferForTesting(
             const sp<GraphicBuffer>& buffer);
     std::shared_ptr<ImageManager::Barrier> unbindExternalTextureBufferForTesting(uint64_t bufferId);
+    // Overrides PROPERTY_DEBUG_RENDERENGINE_IMAGE_CACHE_BUDGET, and returns the previous budget.
+    size_t setImageCacheBudgetForTesting(size_t bytes) EXCLUDES(mRenderingMutex);
+    size_t getShadowMeshCacheHitCountForTesting() EXCLUDES(mRenderingMutex);
 
 protected:
     Framebuffer* getFramebufferForDrawing() override;
@@ -125,6 +135,10 @@ private:
                                                    int hwcFormat, Protection protection);
     std::unique_ptr<Framebuffer> createFramebuffer();
     std::unique_ptr<Image> createImage();
+    // Starts the thread that primes ProgramCache for mEGLContext, unless disabled or the
+    // priming context cannot be created.
+    void initPrimingThread();
+    void destroyPrimingThread();
     void checkErrors() const;
     void checkErrors(const char* tag) const;
     void setScissor(const Rect& region);
@@ -133,6 +147,15 @@ private:
     status_t cacheExternalTextureBufferInternal(const sp<GraphicBuffer>& buffer)
             EXCLUDES(mRenderingMutex);
     void unbindExternalTextureBufferInternal(uint64_t bufferId) EXCLUDES(mRenderingMutex);
+    // Creates the images missing for the layers' buffers in one request to the ImageManager,
+    // and marks the cached ones as used.
+    void cacheImagesForLayers(const std::vector<const LayerSettings*>& layers)
+            EXCLUDES(mRenderingMutex);
+    // Destroys the least recently used images until mImageCache fits its budget, sparing
+    // images used by the last kImageCacheProtectedFrames calls to drawLayers.
+    void trimImageCache() EXCLUDES(mRenderingMutex);
+    // Estimates the memory backing buffer.
+    static size_t getBufferSize(const GraphicBuffer& buffer);
 
     // A data space is considered HDR data space if it has BT2020 color space
     // with PQ or HLG transfer function.
@@ -159,7 +182,7 @@ private:
     void clearWithColor(float red, float green, float blue, float alpha);
     void fillRegionWithColor(const Region& region, float red, float green, float blue, float alpha);
     void handleShadow(const FloatRect& casterRect, float casterCornerRadius,
-                      const ShadowSettings& shadowSettings);
+                      const ShadowSettings& shadowSettings) EXCLUDES(mRenderingMutex);
     void setupLayerBlending(bool premultipliedAlpha, bool opaque, bool disableTexture,
                             const half4& color, float cornerRadius);
     void setupLayerTexturing(const Texture& texture);
@@ -176,7 +199,10 @@ private:
     void setDisplayMaxLuminance(const float maxLuminance);
 
     // drawing
-    void drawMesh(const Mesh& mesh);
+    // When vertexBuffer is set, the attributes of mesh are read from it instead of from client
+    // memory, at the same offsets from mesh.getPositions(). Likewise for indexBuffer.
+    void drawMesh(const Mesh& mesh, const GLVertexBuffer* vertexBuffer = nullptr,
+                  const GLVertexBuffer* indexBuffer = nullptr);
 
     EGLDisplay mEGLDisplay;
     EGLConfig mEGLConfig;
@@ -184,12 +210,22 @@ private:
     EGLSurface mDummySurface;
     EGLContext mProtectedEGLContext;
     EGLSurface mProtectedDummySurface;
+    // Shares objects with mEGLContext, so that programs primed on mPrimingThread can be used
+    // for rendering.
+    EGLContext mPrimingContext = EGL_NO_CONTEXT;
+    EGLSurface mPrimingSurface = EGL_NO_SURFACE;
+    std::thread mPrimingThread;
     GLint mMaxViewportDims[2];
     GLint mMaxTextureSize;
     GLuint mVpWidth;
     GLuint mVpHeight;
+    // Part of the framebuffer redrawn by the current drawLayers call, or INVALID_RECT if all of
+    // it is. Scissors set while drawing are clipped to it.
+    Rect mDamage = Rect::INVALID_RECT;
     Description mState;
     GLShadowTexture mShadowTexture;
+    // Guarded so that dump() can read it while drawLayers() updates it.
+    GLShadowMeshCache mShadowMeshCache GUARDED_BY(mRenderingMutex);
 
     mat4 mSrgbToXyz;
     mat4 mDisplayP3ToXyz;
@@ -211,9 +247,16 @@ private:
     // the last recently used buffer should be kicked out.
     uint32_t mFramebufferImageCacheSize = 0;
 
-    // Cache of output images, keyed by corresponding GraphicBuffer ID.
-    std::deque<std::pair<uint64_t, EGLImageKHR>> mFramebufferImageCache
-            GUARDED_BY(mFramebufferImageCacheMutex);
+    struct FramebufferImage {
+        uint64_t bufferId;
+        EGLImageKHR image;
+        size_t size;
+    };
+
+    // Cache of output images, keyed by corresponding GraphicBuffer ID, ordered from least to
+    // most recently used.
+    std::deque<FramebufferImage> mFramebufferImageCache GUARDED_BY(mFramebufferImageCacheMutex);
+    size_t mFramebufferImageCacheBytes GUARDED_BY(mFramebufferImageCacheMutex) = 0;
     // The only reason why we have this mutex is so that we don't segfault when
     // dumping info.
     std::mutex mFramebufferImageCacheMutex;
@@ -228,8 +271,25 @@ private:
     // supports sRGB, DisplayP3 color spaces.
     const bool mUseColorManagement = false;
 
+    struct CachedImage {
+        std::unique_ptr<Image> image;
+        size_t size = 0;
+        // Value of mImageCacheFrame when the image was last used.
+        uint64_t lastUsedFrame = 0;
+    };
+
+    static constexpr uint64_t kImageCacheProtectedFrames = 2;
+
     // Cache of GL images that we'll store per GraphicBuffer ID
-    std::unordered_map<uint64_t, std::unique_ptr<Image>> mImageCache GUARDED_BY(mRenderingMutex);
+    std::unordered_map<uint64_t, CachedImage> mImageCache GUARDED_BY(mRenderingMutex);
+    size_t mImageCacheBytes GUARDED_BY(mRenderingMutex) = 0;
+    size_t mImageCacheBudget GUARDED_BY(mRenderingMutex) = 0;
+    // Counts calls to drawLayers, to order cached images by use.
+    uint64_t mImageCacheFrame GUARDED_BY(mRenderingMutex) = 0;
+    // Stats for dumpsys.
+    size_t mImageCacheMisses GUARDED_BY(mRenderingMutex) = 0;
+    size_t mImageCacheEvictions GUARDED_BY(mRenderingMutex) = 0;
+    size_t mImageCacheEvictedBytes GUARDED_BY(mRenderingMutex) = 0;
     std::unordered_map<uint32_t, std::optional<uint64_t>> mTextureView;
 
     // Mutex guarding rendering operations, so that:
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "GLShadowMeshCache.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <utils/Trace.h>
+
+#include "GLShadowVertexGenerator.h"
+
+namespace android {
+namespace renderengine {
+namespace gl {
+
+namespace {
+
+void hashCombine(size_t& seed, float value) {
+    seed ^= std::hash<float>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+} // namespace
+
+bool GLShadowMeshCache::Key::operator==(const Key& other) const {
+    return casterRect == other.casterRect && casterCornerRadius == other.casterCornerRadius &&
+            casterZ == other.casterZ && casterIsTranslucent == other.casterIsTranslucent &&
+            ambientColor == other.ambientColor && spotColor == other.spotColor &&
+            lightPosition == other.lightPosition && lightRadius == other.lightRadius;
+}
+
+size_t GLShadowMeshCache::KeyHash::operator()(const Key& key) const {
+    size_t seed = 0;
+    hashCombine(seed, key.casterRect.left);
+    hashCombine(seed, key.casterRect.top);
+    hashCombine(seed, key.casterRect.right);
+    hashCombine(seed, key.casterRect.bottom);
+    hashCombine(seed, key.casterCornerRadius);
+    hashCombine(seed, key.casterZ);
+    hashCombine(seed, key.casterIsTranslucent ? 1.0f : 0.0f);
+    for (size_t i = 0; i < 4; i++) {
+        hashCombine(seed, key.ambientColor[i]);
+        hashCombine(seed, key.spotColor[i]);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        hashCombine(seed, key.lightPosition[i]);
+    }
+    hashCombine(seed, key.lightRadius);
+    return seed;
+}
+
+const GLShadowMeshCache::Shadow& GLShadowMeshCache::get(const FloatRect& casterRect,
+                                                        float casterCornerRadius, float casterZ,
+                                                        bool casterIsTranslucent,
+                                                        const vec4& ambientColor,
+                                                        const vec4& spotColor,
+                                                        const vec3& lightPosition,
+                                                        float lightRadius) {
+    const Key key{casterRect,   casterCornerRadius, casterZ,       casterIsTranslucent,
+                  ambientColor, spotColor,          lightPosition, lightRadius};
+    auto it = mShadows.find(key);
+    if (it != mShadows.end()) {
+        mHitCount++;
+        it->second->lastUsedFrame = mFrame;
+        return *it->second;
+    }
+
+    ATRACE_CALL();
+    const nsecs_t start = systemTime();
+    const GLShadowVertexGenerator generator(casterRect, casterCornerRadius, casterZ,
+                                            casterIsTranslucent, ambientColor, spotColor,
+                                            lightPosition, lightRadius);
+    auto shadow = std::make_unique<Shadow>(Mesh::Builder()
+                                                   .setPrimitive(Mesh::TRIANGLES)
+                                                   .setVertices(generator.getVertexCount(),
+                                                                2 /* size */)
+                                                   .setShadowAttrs()
+                                                   .setIndices(generator.getIndexCount()));
+    Mesh::VertexArray<vec2> position = shadow->mesh.getPositionArray<vec2>();
+    Mesh::VertexArray<vec4> shadowColor = shadow->mesh.getShadowColorArray<vec4>();
+    Mesh::VertexArray<vec3> shadowParams = shadow->mesh.getShadowParamsArray<vec3>();
+    generator.fillVertices(position, shadowColor, shadowParams);
+    generator.fillIndices(shadow->mesh.getIndicesArray());
+
+    const Mesh& mesh = shadow->mesh;
+    shadow->vertices.allocateBuffers(mesh.getPositions(),
+                                     mesh.getVertexCount() * mesh.getStride());
+    shadow->indices.allocateBuffers(mesh.getIndices(), mesh.getIndexCount());
+    shadow->lastUsedFrame = mFrame;
+    mMissCount++;
+    mTessellationTime += systemTime() - start;
+
+    // Make room first, so that the new mesh is never evicted.
+    evict(0, kMaxMeshes - 1);
+    return *mShadows.emplace(key, std::move(shadow)).first->second;
+}
+
+void GLShadowMeshCache::onFrameStarted() {
+    mFrame++;
+    if (mFrame > kMaxUnusedFrames) {
+        evict(mFrame - kMaxUnusedFrames, kMaxMeshes);
+    }
+}
+
+void GLShadowMeshCache::evict(uint64_t minLastUsedFrame, size_t maxMeshes) {
+    for (auto it = mShadows.begin(); it != mShadows.end();) {
+        if (it->second->lastUsedFrame < minLastUsedFrame) {
+            it = mShadows.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    while (mShadows.size() > maxMeshes) {
+        mShadows.erase(std::min_element(mShadows.begin(), mShadows.end(),
+                                        [](const auto& lhs, const auto& rhs) {
+                                            return lhs.second->lastUsedFrame <
+                                                    rhs.second->lastUsedFrame;
+                                        }));
+    }
+}
+
+void GLShadowMeshCache::clear() {
+    mShadows.clear();
+}
+
+void GLShadowMeshCache::dump(std::string& result) const {
+    size_t vertexCount = 0;
+    for (const auto& [key, shadow] : mShadows) {
+        vertexCount += shadow->mesh.getVertexCount();
+    }
+    base::StringAppendF(&result,
+                        "Shadow mesh cache: %zu meshes (%zu vertices), hits: %zu, misses: %zu, "
+                        "tessellation time: %.2f ms\n",
+                        mShadows.size(), vertexCount, mHitCount, mMissCount,
+                        mTessellationTime / 1e6);
+}
+
+} // namespace gl
+} // namespace renderengine
+} // namespace android
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <math/vec4.h>
+#include <renderengine/Mesh.h>
+#include <ui/FloatRect.h>
+#include <utils/Timers.h>
+
+#include "GLVertexBuffer.h"
+
+namespace android {
+namespace renderengine {
+namespace gl {
+
+/**
+ * Caches shadow meshes generated by GLShadowVertexGenerator, uploaded to vertex and index
+ * buffers, so that shadows that do not change between frames are neither tessellated nor
+ * uploaded again.
+ *
+ * Meshes are keyed by every parameter of the tessellation, so any change to the caster
+ * geometry or the light produces a new mesh. Meshes that are not used for kMaxUnusedFrames
+ * frames are dropped, as are the least recently used ones past kMaxMeshes.
+ *
+ * Must be used with the GL context current.
+ */
+class GLShadowMeshCache {
+public:
+    struct Shadow {
+        Shadow(const Mesh::Builder& builder) : mesh(builder.build()) {}
+
+        // Layout of the buffers. Attribute pointers are offsets from mesh.getPositions().
+        Mesh mesh;
+        GLVertexBuffer vertices{GL_ARRAY_BUFFER};
+        GLVertexBuffer indices{GL_ELEMENT_ARRAY_BUFFER};
+        uint64_t lastUsedFrame = 0;
+    };
+
+    // Returns the mesh for the shadows of a caster, generating it if needed.
+    const Shadow& get(const FloatRect& casterRect, float casterCornerRadius, float casterZ,
+                      bool casterIsTranslucent, const vec4& ambientColor, const vec4& spotColor,
+                      const vec3& lightPosition, float lightRadius);
+
+    // Called at the start of every frame, to drop meshes that are no longer drawn.
+    void onFrameStarted();
+    void clear();
+
+    size_t getHitCount() const { return mHitCount; }
+    void dump(std::string& result) const;
+
+private:
+    static constexpr size_t kMaxMeshes = 32;
+    static constexpr uint64_t kMaxUnusedFrames = 16;
+
+    struct Key {
+        FloatRect casterRect;
+        float casterCornerRadius;
+        float casterZ;
+        bool casterIsTranslucent;
+        vec4 ambientColor;
+        vec4 spotColor;
+        vec3 lightPosition;
+        float lightRadius;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    void evict(uint64_t minLastUsedFrame, size_t maxMeshes);
+
+    std::unordered_map<Key, std::unique_ptr<Shadow>, KeyHash> mShadows;
+    uint64_t mFrame = 0;
+
+    // Stats for dumpsys.
+    size_t mHitCount = 0;
+    size_t mMissCount = 0;
+    nsecs_t mTessellationTime = 0;
+};
+
+} // namespace gl
+} // namespace renderengine
+} // namespace android
@@ -27,7 +27,7 @@ namespace android {
 namespace renderengine {
 namespace gl {
 
-GLVertexBuffer::GLVertexBuffer() {
+GLVertexBuffer::GLVertexBuffer(GLenum target) : mTarget(target) {
     glGenBuffers(1, &mBufferName);
 }
 
@@ -38,16 +38,23 @@ GLVertexBuffer::~GLVertexBuffer() {
 void GLVertexBuffer::allocateBuffers(const GLfloat data[], const GLuint size) {
     ATRACE_CALL();
     bind();
-    glBufferData(GL_ARRAY_BUFFER, size * sizeof(GLfloat), data, GL_STATIC_DRAW);
+    glBufferData(mTarget, size * sizeof(GLfloat), data, GL_STATIC_DRAW);
+    unbind();
+}
+
+void GLVertexBuffer::allocateBuffers(const uint16_t data[], const GLuint size) {
+    ATRACE_CALL();
+    bind();
+    glBufferData(mTarget, size * sizeof(uint16_t), data, GL_STATIC_DRAW);
     unbind();
 }
 
 void GLVertexBuffer::bind() const {
-    glBindBuffer(GL_ARRAY_BUFFER, mBufferName);
+    glBindBuffer(mTarget, mBufferName);
 }
 
 void GLVertexBuffer::unbind() const {
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(mTarget, 0);
 }
 
 } // namespace gl
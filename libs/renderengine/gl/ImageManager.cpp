@@ -80,6 +80,30 @@ status_t ImageManager::cache(const sp<GraphicBuffer>& buffer) {
     return barrier->result;
 }
 
+void ImageManager::cache(const std::vector<sp<GraphicBuffer>>& buffers) {
+    if (buffers.empty()) {
+        return;
+    }
+    ATRACE_CALL();
+    // The queue is processed in order, so waiting for the last buffer waits for all of them.
+    // Failures are not reported here: they are handled when binding each buffer.
+    auto barrier = std::make_shared<Barrier>();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (size_t i = 0; i < buffers.size(); i++) {
+            const sp<GraphicBuffer>& buffer = buffers[i];
+            mQueue.push({QueueEntry::Operation::Insert, buffer, buffer->getId(),
+                         i + 1 == buffers.size() ? barrier : nullptr});
+        }
+        ATRACE_INT("ImageManagerQueueDepth", mQueue.size());
+    }
+    mCondition.notify_one();
+
+    std::lock_guard<std::mutex> lock(barrier->mutex);
+    barrier->condition.wait(barrier->mutex,
+                            [&]() REQUIRES(barrier->mutex) { return barrier->isOpen; });
+}
+
 void ImageManager::releaseAsync(uint64_t bufferId, const std::shared_ptr<Barrier>& barrier) {
     ATRACE_CALL();
     QueueEntry entry = {QueueEntry::Operation::Delete, nullptr, bufferId, barrier};
@@ -103,7 +127,7 @@ void ImageManager::threadMain() {
         run = mRunning;
     }
     while (run) {
-        QueueEntry entry;
+        std::queue<QueueEntry> entries;
         {
             std::lock_guard<std::mutex> lock(mMutex);
             mCondition.wait(mMutex,
@@ -116,27 +140,38 @@ void ImageManager::threadMain() {
                 break;
             }
 
-            entry = mQueue.front();
-            mQueue.pop();
-            ATRACE_INT("ImageManagerQueueDepth", mQueue.size());
+            // Take every queued operation at once, so that a frame's worth of buffers only
+            // costs a single wakeup.
+            std::swap(entries, mQueue);
+            ATRACE_INT("ImageManagerQueueDepth", 0);
         }
 
-        status_t result = NO_ERROR;
-        switch (entry.op) {
-            case QueueEntry::Operation::Delete:
-                mEngine->unbindExternalTextureBufferInternal(entry.bufferId);
-                break;
-            case QueueEntry::Operation::Insert:
-                result = mEngine->cacheExternalTextureBufferInternal(entry.buffer);
-                break;
-        }
-        if (entry.barrier != nullptr) {
-            {
-                std::lock_guard<std::mutex> entryLock(entry.barrier->mutex);
-                entry.barrier->result = result;
-                entry.barrier->isOpen = true;
+        bool inserted = false;
+        for (; !entries.empty(); entries.pop()) {
+            const QueueEntry& entry = entries.front();
+            status_t result = NO_ERROR;
+            switch (entry.op) {
+                case QueueEntry::Operation::Delete:
+                    mEngine->unbindExternalTextureBufferInternal(entry.bufferId);
+                    break;
+                case QueueEntry::Operation::Insert:
+                    result = mEngine->cacheExternalTextureBufferInternal(entry.buffer);
+                    inserted = true;
+                    break;
+            }
+            if (entry.barrier != nullptr) {
+                {
+                    std::lock_guard<std::mutex> entryLock(entry.barrier->mutex);
+                    entry.barrier->result = result;
+                    entry.barrier->isOpen = true;
+                }
+                entry.barrier->condition.notify_one();
             }
-            entry.barrier->condition.notify_one();
+        }
+
+        // Evict after opening the barriers, so that nobody waits for it.
+        if (inserted) {
+            mEngine->trimImageCache();
         }
     }
 
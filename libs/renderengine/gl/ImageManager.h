@@ -20,6 +20,7 @@
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <vector>
 
 #include <ui/GraphicBuffer.h>
 
@@ -46,6 +47,8 @@ public:
     void cacheAsync(const sp<GraphicBuffer>& buffer, const std::shared_ptr<Barrier>& barrier)
             EXCLUDES(mMutex);
     status_t cache(const sp<GraphicBuffer>& buffer);
+    // Creates images for all buffers in one pass of the background thread, and waits for them.
+    void cache(const std::vector<sp<GraphicBuffer>>& buffers);
     void releaseAsync(uint64_t bufferId, const std::shared_ptr<Barrier>& barrier) EXCLUDES(mMutex);
 
 private:
@@ -19,6 +19,8 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include <GLES2/gl2.h>
 #include <renderengine/private/Description.h>
 #include "ProgramCache.h"
@@ -54,6 +56,10 @@ public:
     };
 
     Program(const ProgramCache::Key& needs, const char* vertex, const char* fragment);
+    // Loads a program binary previously returned by getBinary. The program is not valid if the
+    // driver rejects the binary.
+    Program(const ProgramCache::Key& needs, GLenum binaryFormat,
+            const std::vector<uint8_t>& binary);
     ~Program() = default;
 
     /* whether this object is usable */
@@ -71,8 +77,12 @@ public:
     /* set-up uniforms from the description */
     void setUniforms(const Description& desc);
 
+    /* Retrieves the linked program binary, so that it can be loaded later */
+    bool getBinary(GLenum* binaryFormat, std::vector<uint8_t>* binary) const;
+
 private:
     GLuint buildShader(const char* source, GLenum type);
+    void initialize(GLuint programId);
 
     // whether the initialization succeeded
     bool mInitialized;
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "ProgramBinaryCache.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <utils/Trace.h>
+
+namespace android {
+namespace renderengine {
+namespace gl {
+
+namespace {
+
+// File layout, in native byte order:
+//   uint32_t magic, uint32_t version
+//   uint32_t fingerprint length, fingerprint bytes
+//   uint32_t entry count
+//   for each entry: uint32_t key, uint32_t format, uint32_t length, binary bytes
+//   uint32_t use count entries
+//   for each entry: uint32_t key, uint32_t use count
+constexpr uint32_t kMagic = 0x52504243; // 'RPBC'
+constexpr uint32_t kVersion = 2;
+
+void appendUint32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads consecutive values out of a file's contents, failing once past the end.
+class Reader {
+public:
+    explicit Reader(const std::string& data) : mData(data) {}
+
+    bool readUint32(uint32_t* value) {
+        if (mData.size() - mOffset < sizeof(*value)) {
+            return false;
+        }
+        memcpy(value, mData.data() + mOffset, sizeof(*value));
+        mOffset += sizeof(*value);
+        return true;
+    }
+
+    bool readBytes(size_t length, const char** bytes) {
+        if (mData.size() - mOffset < length) {
+            return false;
+        }
+        *bytes = mData.data() + mOffset;
+        mOffset += length;
+        return true;
+    }
+
+private:
+    const std::string& mData;
+    size_t mOffset = 0;
+};
+
+} // namespace
+
+ProgramBinaryCache::ProgramBinaryCache(std::string path, std::string fingerprint)
+      : mPath(std::move(path)), mFingerprint(std::move(fingerprint)) {
+    mThread = std::thread(&ProgramBinaryCache::run, this);
+}
+
+ProgramBinaryCache::~ProgramBinaryCache() {
+    {
+        std::lock_guard lock(mMutex);
+        mStopping = true;
+        mCondition.notify_all();
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void ProgramBinaryCache::run() {
+    load();
+    while (true) {
+        {
+            std::lock_guard lock(mMutex);
+            mCondition.wait(mMutex, [this]() REQUIRES(mMutex) {
+                return mSaveRequested || mStopping;
+            });
+            if (!mSaveRequested) {
+                return;
+            }
+            mSaveRequested = false;
+        }
+        save();
+    }
+}
+
+std::string ProgramBinaryCache::getDriverFingerprint(const char* vendor, const char* renderer,
+                                                     const char* version) {
+    // The vendor build covers the driver. The system build covers the shader sources that
+    // ProgramCache generates for each key, which a system-only update can change.
+    char vendorFingerprint[PROPERTY_VALUE_MAX];
+    property_get("ro.vendor.build.fingerprint", vendorFingerprint, "");
+    char systemFingerprint[PROPERTY_VALUE_MAX];
+    property_get("ro.build.fingerprint", systemFingerprint, "");
+    return base::StringPrintf("%s/%s/%s/%s/%s", vendor, renderer, version, vendorFingerprint,
+                              systemFingerprint);
+}
+
+void ProgramBinaryCache::load() {
+    ATRACE_CALL();
+    const nsecs_t start = systemTime();
+
+    std::unordered_map<uint32_t, Binary> binaries;
+    std::unordered_map<uint32_t, uint32_t> useCounts;
+    bool invalidated = false;
+    std::string contents;
+    if (base::ReadFileToString(mPath, &contents)) {
+        Reader reader(contents);
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint32_t fingerprintLength = 0;
+        const char* fingerprint = nullptr;
+        uint32_t count = 0;
+        if (!reader.readUint32(&magic) || magic != kMagic || !reader.readUint32(&version) ||
+            version != kVersion || !reader.readUint32(&fingerprintLength) ||
+            !reader.readBytes(fingerprintLength, &fingerprint) ||
+            mFingerprint.compare(0, std::string::npos, fingerprint, fingerprintLength) != 0 ||
+            !reader.readUint32(&count)) {
+            ALOGI("Discarding program binaries in %s written by another driver", mPath.c_str());
+            invalidated = true;
+            count = 0;
+        }
+
+        bool truncated = false;
+        for (uint32_t i = 0; i < count && !truncated; i++) {
+            uint32_t key = 0;
+            Binary binary;
+            uint32_t length = 0;
+            const char* data = nullptr;
+            if (!reader.readUint32(&key) || !reader.readUint32(&binary.format) ||
+                !reader.readUint32(&length) || !reader.readBytes(length, &data)) {
+                truncated = true;
+                break;
+            }
+            binary.data.assign(data, data + length);
+            binaries.emplace(key, std::move(binary));
+        }
+
+        uint32_t useCountCount = 0;
+        if (!invalidated && !truncated && reader.readUint32(&useCountCount)) {
+            for (uint32_t i = 0; i < useCountCount; i++) {
+                uint32_t key = 0;
+                uint32_t useCount = 0;
+                if (!reader.readUint32(&key) || !reader.readUint32(&useCount)) {
+                    truncated = true;
+                    break;
+                }
+                // Halve the counts of previous boots, rounding up so that a program used once
+                // is still primed next time.
+                useCounts.emplace(key, useCount / 2 + useCount % 2);
+            }
+        } else if (!invalidated) {
+            truncated = true;
+        }
+        ALOGW_IF(truncated, "Truncated program binary cache %s", mPath.c_str());
+    }
+
+    std::lock_guard lock(mMutex);
+    // Anything put while loading is newer than what is on disk.
+    for (auto& [key, binary] : binaries) {
+        mBinaries.emplace(key, std::move(binary));
+    }
+    for (const auto& [key, useCount] : useCounts) {
+        uint32_t& total = mUseCounts[key];
+        total = std::max(total, total + useCount);
+    }
+    mInvalidated = invalidated;
+    mDirty = mDirty || invalidated;
+    mLoadedCount = binaries.size();
+    mLoadTime = systemTime() - start;
+    mLoaded = true;
+    mCondition.notify_all();
+}
+
+std::optional<ProgramBinaryCache::Binary> ProgramBinaryCache::get(uint32_t key) {
+    std::lock_guard lock(mMutex);
+    mCondition.wait(mMutex, [this]() REQUIRES(mMutex) { return mLoaded; });
+    const auto it = mBinaries.find(key);
+    if (it == mBinaries.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void ProgramBinaryCache::put(uint32_t key, Binary binary) {
+    std::lock_guard lock(mMutex);
+    mBinaries[key] = std::move(binary);
+    mDirty = true;
+}
+
+bool ProgramBinaryCache::recordUse(uint32_t key) {
+    std::lock_guard lock(mMutex);
+    uint32_t& useCount = mUseCounts[key];
+    if (useCount == UINT32_MAX) {
+        return false;
+    }
+    useCount++;
+    if ((useCount & (useCount - 1)) != 0) {
+        return false;
+    }
+    mDirty = true;
+    return true;
+}
+
+std::vector<uint32_t> ProgramBinaryCache::getKeysByUse() {
+    std::vector<std::pair<uint32_t, uint32_t>> useCounts;
+    {
+        std::lock_guard lock(mMutex);
+        mCondition.wait(mMutex, [this]() REQUIRES(mMutex) { return mLoaded; });
+        useCounts.assign(mUseCounts.begin(), mUseCounts.end());
+    }
+    std::sort(useCounts.begin(), useCounts.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+    });
+
+    std::vector<uint32_t> keys;
+    keys.reserve(useCounts.size());
+    for (const auto& [key, useCount] : useCounts) {
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+void ProgramBinaryCache::save() {
+    ATRACE_CALL();
+    std::string contents;
+    {
+        std::lock_guard lock(mMutex);
+        mCondition.wait(mMutex, [this]() REQUIRES(mMutex) { return mLoaded; });
+        if (!mDirty) {
+            return;
+        }
+        appendUint32(contents, kMagic);
+        appendUint32(contents, kVersion);
+        appendUint32(contents, static_cast<uint32_t>(mFingerprint.size()));
+        contents.append(mFingerprint);
+        appendUint32(contents, static_cast<uint32_t>(mBinaries.size()));
+        for (const auto& [key, binary] : mBinaries) {
+            appendUint32(contents, key);
+            appendUint32(contents, binary.format);
+            appendUint32(contents, static_cast<uint32_t>(binary.data.size()));
+            contents.append(reinterpret_cast<const char*>(binary.data.data()),
+                            binary.data.size());
+        }
+        appendUint32(contents, static_cast<uint32_t>(mUseCounts.size()));
+        for (const auto& [key, useCount] : mUseCounts) {
+            appendUint32(contents, key);
+            appendUint32(contents, useCount);
+        }
+        mDirty = false;
+        mSaveCount++;
+    }
+
+    // Write to a temporary file first, so that a crash never leaves a partial cache behind.
+    const std::string temporaryPath = mPath + ".tmp";
+    if (!base::WriteStringToFile(contents, temporaryPath) ||
+        rename(temporaryPath.c_str(), mPath.c_str()) != 0) {
+        ALOGW("Failed to write program binary cache %s: %s", mPath.c_str(), strerror(errno));
+        unlink(temporaryPath.c_str());
+    }
+}
+
+void ProgramBinaryCache::requestSave() {
+    std::lock_guard lock(mMutex);
+    mSaveRequested = true;
+    mCondition.notify_all();
+}
+
+void ProgramBinaryCache::dump(std::string& result) {
+    std::lock_guard lock(mMutex);
+    base::StringAppendF(&result, "Program binary cache: %s\n", mPath.c_str());
+    if (!mLoaded) {
+        result.append("  loading\n");
+        return;
+    }
+    size_t bytes = 0;
+    for (const auto& [key, binary] : mBinaries) {
+        bytes += binary.data.size();
+    }
+    base::StringAppendF(&result,
+                        "  %zu binaries (%zu KiB), %zu loaded from disk in %.2f ms%s, "
+                        "saved %zu times, use counts for %zu programs\n",
+                        mBinaries.size(), bytes / 1024, mLoadedCount, mLoadTime / 1e6,
+                        mInvalidated ? " (invalidated by driver change)" : "", mSaveCount,
+                        mUseCounts.size());
+}
+
+} // namespace gl
+} // namespace renderengine
+} // namespace android
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <GLES2/gl2.h>
+#include <android-base/thread_annotations.h>
+#include <utils/Timers.h>
+
+/**
+ * Path of the file in which linked program binaries are persisted across boots. Setting it to
+ * an empty string disables the cache.
+ */
+#define PROPERTY_DEBUG_RENDERENGINE_PROGRAM_BINARY_CACHE "debug.renderengine.program_binary_cache"
+
+namespace android {
+namespace renderengine {
+namespace gl {
+
+/*
+ * Persists linked program binaries to disk, so that programs compiled during a previous boot
+ * can be loaded instead of compiled again. Binaries are only valid for the driver and the
+ * shader sources that produced them, so the whole file is discarded when the fingerprint of
+ * either changes.
+ *
+ * Also persists how often each program is used, so that the programs that matter most can be
+ * primed first on the next boot.
+ */
+class ProgramBinaryCache {
+public:
+    // The directory is created by surfaceflinger.rc. Its SELinux label and the rules that let
+    // surfaceflinger write to it are part of the platform policy in system/sepolicy.
+    static constexpr auto kDefaultPath = "/data/misc/surfaceflinger/renderengine_programs.bin";
+
+    struct Binary {
+        GLenum format = 0;
+        std::vector<uint8_t> data;
+    };
+
+    // Starts reading path on a background thread. fingerprint identifies the driver. The same
+    // thread writes the file when a save is requested, and finishes pending saves on destruction.
+    ProgramBinaryCache(std::string path, std::string fingerprint);
+    ~ProgramBinaryCache();
+
+    // Returns the binary stored for key, waiting for the file to be read if needed.
+    std::optional<Binary> get(uint32_t key) EXCLUDES(mMutex);
+    void put(uint32_t key, Binary binary) EXCLUDES(mMutex);
+
+    // Counts a use of the program for key. Never waits for the file to be read. Returns true
+    // when the counts changed enough to be worth saving, which happens every time a count
+    // reaches a power of two.
+    bool recordUse(uint32_t key) EXCLUDES(mMutex);
+    // Returns the keys of the programs used so far, most used first, waiting for the file to be
+    // read if needed. Counts from previous boots are halved on load, so that programs that are
+    // no longer used eventually drop out.
+    std::vector<uint32_t> getKeysByUse() EXCLUDES(mMutex);
+
+    // Writes the binaries and use counts to disk if they changed since the last save.
+    void save() EXCLUDES(mMutex);
+    // Asks the background thread to save. Never waits for the file to be read or written.
+    void requestSave() EXCLUDES(mMutex);
+
+    // Returns a fingerprint of the running driver and shader sources, built from the GL strings
+    // and the vendor and system build fingerprints.
+    static std::string getDriverFingerprint(const char* vendor, const char* renderer,
+                                            const char* version);
+
+    void dump(std::string& result) EXCLUDES(mMutex);
+
+private:
+    // Reads the file, then saves whenever requested until destruction.
+    void run() EXCLUDES(mMutex);
+    void load() EXCLUDES(mMutex);
+
+    const std::string mPath;
+    const std::string mFingerprint;
+
+    std::mutex mMutex;
+    std::condition_variable_any mCondition;
+    bool mLoaded GUARDED_BY(mMutex) = false;
+    bool mDirty GUARDED_BY(mMutex) = false;
+    bool mSaveRequested GUARDED_BY(mMutex) = false;
+    bool mStopping GUARDED_BY(mMutex) = false;
+    std::unordered_map<uint32_t, Binary> mBinaries GUARDED_BY(mMutex);
+    std::unordered_map<uint32_t, uint32_t> mUseCounts GUARDED_BY(mMutex);
+
+    // Stats for dumpsys.
+    bool mInvalidated GUARDED_BY(mMutex) = false;
+    size_t mLoadedCount GUARDED_BY(mMutex) = 0;
+    nsecs_t mLoadTime GUARDED_BY(mMutex) = 0;
+    size_t mSaveCount GUARDED_BY(mMutex) = 0;
+
+    std::thread mThread;
+};
+
+} // namespace gl
+} // namespace renderengine
+} // namespace android
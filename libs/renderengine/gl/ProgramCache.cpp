@@ -18,8 +18,11 @@
 
 #include "ProgramCache.h"
 
+#include <algorithm>
+
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <android-base/stringprintf.h>
 #include <log/log.h>
 #include <renderengine/private/Description.h>
 #include <utils/String8.h>
@@ -77,10 +80,9 @@ Formatter& dedent(Formatter& f) {
     return f;
 }
 
-void ProgramCache::primeCache(
-        EGLContext context, bool useColorManagement, bool toneMapperShaderOnly) {
-    auto& cache = mCaches[context];
-    uint32_t shaderCount = 0;
+std::vector<ProgramCache::Key> ProgramCache::getPrimeKeys(bool useColorManagement,
+                                                         bool toneMapperShaderOnly) {
+    std::vector<Key> keys;
 
     if (toneMapperShaderOnly) {
         Key shaderKey;
@@ -101,12 +103,9 @@ void ProgramCache::primeCache(
             // Cache Y410 input on or off
             shaderKey.set(Key::Y410_BT2020_MASK, (i & 2) ?
                     Key::Y410_BT2020_ON : Key::Y410_BT2020_OFF);
-            if (cache.count(shaderKey) == 0) {
-                cache.emplace(shaderKey, generateProgram(shaderKey));
-                shaderCount++;
-            }
+            keys.push_back(shaderKey);
         }
-        return;
+        return keys;
     }
 
     uint32_t keyMask = Key::BLEND_MASK | Key::OPACITY_MASK | Key::ALPHA_MASK | Key::TEXTURE_MASK
@@ -114,7 +113,6 @@ void ProgramCache::primeCache(
     // Prime the cache for all combinations of the above masks,
     // leaving off the experimental color matrix mask options.
 
-    nsecs_t timeBefore = systemTime();
     for (uint32_t keyVal = 0; keyVal <= keyMask; keyVal++) {
         Key shaderKey;
         shaderKey.set(keyMask, keyVal);
@@ -122,10 +120,7 @@ void ProgramCache::primeCache(
         if (tex != Key::TEXTURE_OFF && tex != Key::TEXTURE_EXT && tex != Key::TEXTURE_2D) {
             continue;
         }
-        if (cache.count(shaderKey) == 0) {
-            cache.emplace(shaderKey, generateProgram(shaderKey));
-            shaderCount++;
-        }
+        keys.push_back(shaderKey);
     }
 
     // Prime for sRGB->P3 conversion
@@ -146,16 +141,158 @@ void ProgramCache::primeCache(
 
             // Cache texture off option for window transition
             shaderKey.set(Key::TEXTURE_MASK, (i & 8) ? Key::TEXTURE_EXT : Key::TEXTURE_OFF);
-            if (cache.count(shaderKey) == 0) {
-                cache.emplace(shaderKey, generateProgram(shaderKey));
-                shaderCount++;
+            keys.push_back(shaderKey);
+        }
+    }
+    return keys;
+}
+
+void ProgramCache::primeCache(
+        EGLContext context, bool useColorManagement, bool toneMapperShaderOnly) {
+    uint32_t shaderCount = 0;
+    nsecs_t timeBefore = systemTime();
+    for (const Key& shaderKey : getPrimeKeys(useColorManagement, toneMapperShaderOnly)) {
+        {
+            std::lock_guard lock(mMutex);
+            if (mCaches[context].count(shaderKey) != 0) {
+                continue;
             }
         }
+        auto program = createProgram(shaderKey);
+        std::lock_guard lock(mMutex);
+        mCaches[context].emplace(shaderKey, std::move(program));
+        shaderCount++;
     }
 
     nsecs_t timeAfter = systemTime();
     float compileTimeMs = static_cast<float>(timeAfter - timeBefore) / 1.0E6;
     ALOGD("shader cache generated - %u shaders in %f ms\n", shaderCount, compileTimeMs);
+
+    if (mBinaryCache) {
+        mBinaryCache->requestSave();
+    }
+}
+
+bool ProgramCache::primeCacheInBackground(EGLContext context, bool useColorManagement,
+                                          bool toneMapperShaderOnly) {
+    std::lock_guard lock(mMutex);
+    if (!mPrimerRunning || context != mPrimerContext) {
+        return false;
+    }
+    // The primer reorders the queue by use once the binary cache is loaded.
+    for (const Key& shaderKey : getPrimeKeys(useColorManagement, toneMapperShaderOnly)) {
+        if (std::find(mPrimeQueue.begin(), mPrimeQueue.end(), shaderKey) == mPrimeQueue.end()) {
+            mPrimeQueue.push_back(shaderKey);
+        }
+    }
+    mCondition.notify_all();
+    return true;
+}
+
+void ProgramCache::startPrimer(EGLContext context) {
+    std::lock_guard lock(mMutex);
+    mPrimerRunning = true;
+    mPrimerContext = context;
+}
+
+void ProgramCache::stopPrimer() {
+    std::lock_guard lock(mMutex);
+    mPrimerRunning = false;
+    mPrimerContext = EGL_NO_CONTEXT;
+    mPrimeQueue.clear();
+    mCondition.notify_all();
+}
+
+bool ProgramCache::needsPriming(const Key& key) {
+    return mCaches[mPrimerContext].count(key) == 0 &&
+            std::find(mOnDemandKeys.begin(), mOnDemandKeys.end(), key) == mOnDemandKeys.end();
+}
+
+std::optional<ProgramCache::Key> ProgramCache::popPrimeKey(
+        const std::unordered_map<uint32_t, size_t>& ranks) {
+    while (!mPrimeQueue.empty()) {
+        auto best = mPrimeQueue.begin();
+        size_t bestRank = SIZE_MAX;
+        for (auto it = mPrimeQueue.begin(); it != mPrimeQueue.end(); it++) {
+            const auto rank = ranks.find(it->mKey);
+            if (rank != ranks.end() && rank->second < bestRank) {
+                best = it;
+                bestRank = rank->second;
+            }
+        }
+        const Key key = *best;
+        mPrimeQueue.erase(best);
+        if (needsPriming(key)) {
+            return key;
+        }
+    }
+    return std::nullopt;
+}
+
+void ProgramCache::runPrimer() {
+    ATRACE_CALL();
+    std::unordered_map<uint32_t, size_t> ranks;
+    bool ranked = mBinaryCache == nullptr;
+    while (true) {
+        std::optional<Key> key;
+        EGLContext context = EGL_NO_CONTEXT;
+        bool rank = false;
+        {
+            std::lock_guard lock(mMutex);
+            mPrimingKey.reset();
+            mCondition.notify_all();
+            mCondition.wait(mMutex, [this]() REQUIRES(mMutex) {
+                return !mPrimeQueue.empty() || !mPrimerRunning;
+            });
+            if (!mPrimerRunning) {
+                return;
+            }
+            context = mPrimerContext;
+            if (ranked) {
+                key = popPrimeKey(ranks);
+                mPrimingKey = key;
+            }
+            // Ranking waits for the binary cache to be read, so only do it once priming was
+            // requested.
+            rank = !ranked && !mPrimeQueue.empty();
+        }
+
+        if (rank) {
+            const std::vector<uint32_t> keysByUse = mBinaryCache->getKeysByUse();
+            std::lock_guard lock(mMutex);
+            for (size_t i = 0; i < keysByUse.size(); i++) {
+                ranks.emplace(keysByUse[i], i);
+                // Also prime programs used in previous boots that are not primed by default.
+                // Skip the ones the render thread already has, or is creating.
+                Key usedKey;
+                usedKey.mKey = keysByUse[i];
+                if (needsPriming(usedKey) &&
+                    std::find(mPrimeQueue.begin(), mPrimeQueue.end(), usedKey) ==
+                            mPrimeQueue.end()) {
+                    mPrimeQueue.push_back(usedKey);
+                }
+            }
+            ranked = true;
+            continue;
+        }
+
+        if (!key) {
+            continue;
+        }
+
+        const nsecs_t start = systemTime();
+        auto program = createProgram(*key);
+        // Objects are only guaranteed to be complete in other contexts of the share group once
+        // the commands that changed them have finished.
+        glFinish();
+        std::lock_guard lock(mMutex);
+        mCaches[context].emplace(*key, std::move(program));
+        mPrimedCount++;
+        mPrimeTime += systemTime() - start;
+        if (mPrimeQueue.empty() && mBinaryCache) {
+            mBinaryCache->requestSave();
+        }
+    }
 }
 
 ProgramCache::Key ProgramCache::computeKey(const Description& description) {
@@ -770,25 +907,118 @@ std::unique_ptr<Program> ProgramCache::generateProgram(const Key& needs) {
     return std::make_unique<Program>(needs, vs.string(), fs.string());
 }
 
+std::unique_ptr<Program> ProgramCache::createProgram(const Key& needs) {
+    nsecs_t time = systemTime();
+    if (mBinaryCache) {
+        if (const auto binary = mBinaryCache->get(needs.mKey)) {
+            auto program = std::make_unique<Program>(needs, binary->format, binary->data);
+            if (program->isValid()) {
+                std::lock_guard lock(mMutex);
+                mBinaryLoadCount++;
+                mBinaryLoadTime += systemTime() - time;
+                return program;
+            }
+        }
+    }
+
+    auto program = generateProgram(needs);
+    {
+        std::lock_guard lock(mMutex);
+        mCompileCount++;
+        mCompileTime += systemTime() - time;
+    }
+
+    ProgramBinaryCache::Binary binary;
+    if (mBinaryCache && program->getBinary(&binary.format, &binary.data)) {
+        mBinaryCache->put(needs.mKey, std::move(binary));
+    }
+    return program;
+}
+
+void ProgramCache::setBinaryCache(std::unique_ptr<ProgramBinaryCache> binaryCache) {
+    mBinaryCache = std::move(binaryCache);
+}
+
+void ProgramCache::dump(std::string& result) {
+    {
+        std::lock_guard lock(mMutex);
+        base::StringAppendF(&result,
+                            "Programs loaded from binaries: %zu in %.2f ms, compiled: %zu in "
+                            "%.2f ms\n",
+                            mBinaryLoadCount, mBinaryLoadTime / 1e6, mCompileCount,
+                            mCompileTime / 1e6);
+        base::StringAppendF(&result,
+                            "Programs primed in background: %zu in %.2f ms (%s, %zu queued), "
+                            "waited for %zu in %.2f ms, created on demand: %zu\n",
+                            mPrimedCount, mPrimeTime / 1e6,
+                            mPrimerRunning ? "running" : "stopped", mPrimeQueue.size(),
+                            mPrimerWaitCount, mPrimerWaitTime / 1e6, mOnDemandCount);
+    }
+    if (mBinaryCache) {
+        mBinaryCache->dump(result);
+    }
+}
+
+Program* ProgramCache::findProgram(EGLContext context, const Key& needs) {
+    std::lock_guard lock(mMutex);
+    if (context == mPrimerContext) {
+        if (mPrimingKey && *mPrimingKey == needs) {
+            ATRACE_NAME("Waiting for primed program");
+            const nsecs_t start = systemTime();
+            mCondition.wait(mMutex, [&]() REQUIRES(mMutex) {
+                return !mPrimingKey || !(*mPrimingKey == needs);
+            });
+            mPrimerWaitCount++;
+            mPrimerWaitTime += systemTime() - start;
+        } else {
+            // The primer has not reached this program yet, so creating it here is faster than
+            // waiting for it.
+            mPrimeQueue.erase(std::remove(mPrimeQueue.begin(), mPrimeQueue.end(), needs),
+                              mPrimeQueue.end());
+        }
+    }
+
+    auto& cache = mCaches[context];
+    const auto it = cache.find(needs);
+    if (it != cache.end()) {
+        return it->second.get();
+    }
+    // The caller creates the program, so keep the primer from queueing it again.
+    if (context == mPrimerContext) {
+        mOnDemandKeys.push_back(needs);
+    }
+    return nullptr;
+}
+
 void ProgramCache::useProgram(EGLContext context, const Description& description) {
     // generate the key for the shader based on the description
     Key needs(computeKey(description));
 
     // look-up the program in the cache
-    auto& cache = mCaches[context];
-    auto it = cache.find(needs);
-    if (it == cache.end()) {
+    Program* program = findProgram(context, needs);
+    bool save = false;
+    if (program == nullptr) {
         // we didn't find our program, so generate one...
         nsecs_t time = systemTime();
-        it = cache.emplace(needs, generateProgram(needs)).first;
+        auto created = createProgram(needs);
         time = systemTime() - time;
 
+        std::lock_guard lock(mMutex);
+        auto& cache = mCaches[context];
+        program = cache.emplace(needs, std::move(created)).first->second.get();
+        mOnDemandKeys.erase(std::remove(mOnDemandKeys.begin(), mOnDemandKeys.end(), needs),
+                            mOnDemandKeys.end());
+        mOnDemandCount++;
         ALOGV(">>> generated new program for context %p: needs=%08X, time=%u ms (%zu programs)",
               context, needs.mKey, uint32_t(ns2ms(time)), cache.size());
+        save = true;
+    }
+
+    if (mBinaryCache && (mBinaryCache->recordUse(needs.mKey) || save)) {
+        mBinaryCache->requestSave();
     }
 
     // here we have a suitable program for this description
-    std::unique_ptr<Program>& program = it->second;
     if (program->isValid()) {
         program->use();
         program->setUniforms(description);
@@ -17,14 +17,27 @@
 #ifndef SF_RENDER_ENGINE_PROGRAMCACHE_H
 #define SF_RENDER_ENGINE_PROGRAMCACHE_H
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
+#include <vector>
 
 #include <EGL/egl.h>
 #include <GLES2/gl2.h>
+#include <android-base/thread_annotations.h>
 #include <renderengine/private/Description.h>
 #include <utils/Singleton.h>
+#include <utils/Timers.h>
 #include <utils/TypeHelpers.h>
+#include "ProgramBinaryCache.h"
+
+/**
+ * Setting this to false primes programs on the render thread at boot, instead of on a
+ * dedicated thread with its own EGL context.
+ */
+#define PROPERTY_DEBUG_RENDERENGINE_BACKGROUND_PRIMING "debug.renderengine.background_priming"
 
 namespace android {
 
@@ -44,6 +57,10 @@ class Program;
  * Description. It's responsible for figuring out what to
  * generate from a Description.
  * It also maintains a cache of these Programs.
+ *
+ * Programs can be primed on a separate thread, whose EGL context shares objects with the
+ * rendering context. useProgram then only waits when the primer is busy with the very program
+ * it needs, and compiles programs the primer has not reached yet by itself.
  */
 class ProgramCache : public Singleton<ProgramCache> {
 public:
@@ -186,15 +203,48 @@ public:
     ~ProgramCache() = default;
 
     // Generate shaders to populate the cache
-    void primeCache(const EGLContext context, bool useColorManagement, bool toneMapperShaderOnly);
-
-    size_t getSize(const EGLContext context) { return mCaches[context].size(); }
+    void primeCache(const EGLContext context, bool useColorManagement, bool toneMapperShaderOnly)
+            EXCLUDES(mMutex);
+
+    // Queues the same shaders as primeCache for the primer, preceded by the ones used most
+    // during previous boots. Returns false if no primer runs for context.
+    bool primeCacheInBackground(const EGLContext context, bool useColorManagement,
+                                bool toneMapperShaderOnly) EXCLUDES(mMutex);
+
+    // Called on the primer thread, with a context sharing objects with context current.
+    // startPrimer makes programs primed by runPrimer available to context, and runPrimer
+    // processes the queue until stopPrimer is called.
+    void startPrimer(const EGLContext context) EXCLUDES(mMutex);
+    void runPrimer() EXCLUDES(mMutex);
+    void stopPrimer() EXCLUDES(mMutex);
+
+    size_t getSize(const EGLContext context) EXCLUDES(mMutex) {
+        std::lock_guard lock(mMutex);
+        return mCaches[context].size();
+    }
 
     // useProgram lookup a suitable program in the cache or generates one
     // if none can be found.
-    void useProgram(const EGLContext context, const Description& description);
+    void useProgram(const EGLContext context, const Description& description) EXCLUDES(mMutex);
+
+    // Loads programs from binaryCache instead of compiling them when possible, and adds
+    // newly compiled programs to it.
+    void setBinaryCache(std::unique_ptr<ProgramBinaryCache> binaryCache);
+
+    void dump(std::string& result) EXCLUDES(mMutex);
 
 private:
+    // loads the program for the Key from the binary cache, or generates it
+    std::unique_ptr<Program> createProgram(const Key& needs) EXCLUDES(mMutex);
+    // returns the cached program for the Key, waiting for the primer if it is creating it
+    Program* findProgram(const EGLContext context, const Key& needs) EXCLUDES(mMutex);
+    // pops the queued Key with the best rank that has no program yet
+    std::optional<Key> popPrimeKey(const std::unordered_map<uint32_t, size_t>& ranks)
+            REQUIRES(mMutex);
+    // returns true if the primer should create the program for the Key
+    bool needsPriming(const Key& key) REQUIRES(mMutex);
+    // lists the Keys primed at boot
+    static std::vector<Key> getPrimeKeys(bool useColorManagement, bool toneMapperShaderOnly);
     // compute a cache Key from a Description
     static Key computeKey(const Description& description);
     // Generate EOTF based from Key.
@@ -212,10 +262,35 @@ private:
     // generates the fragment shader from the Key
     static String8 generateFragmentShader(const Key& needs);
 
+    std::mutex mMutex;
+    std::condition_variable_any mCondition;
+
     // Key/Value map used for caching Programs. Currently the cache
     // is never shrunk (and the GL program objects are never deleted).
     std::unordered_map<EGLContext, std::unordered_map<Key, std::unique_ptr<Program>, Key::Hash>>
-            mCaches;
+            mCaches GUARDED_BY(mMutex);
+
+    // Set before any program is created, and never reset.
+    std::unique_ptr<ProgramBinaryCache> mBinaryCache;
+
+    // Primer state. Queued keys and the key being primed are for mPrimerContext.
+    bool mPrimerRunning GUARDED_BY(mMutex) = false;
+    EGLContext mPrimerContext GUARDED_BY(mMutex) = EGL_NO_CONTEXT;
+    std::vector<Key> mPrimeQueue GUARDED_BY(mMutex);
+    std::optional<Key> mPrimingKey GUARDED_BY(mMutex);
+    // Keys that useProgram is creating for mPrimerContext, and the primer must not create again.
+    std::vector<Key> mOnDemandKeys GUARDED_BY(mMutex);
+
+    // Stats for dumpsys.
+    size_t mBinaryLoadCount GUARDED_BY(mMutex) = 0;
+    nsecs_t mBinaryLoadTime GUARDED_BY(mMutex) = 0;
+    size_t mCompileCount GUARDED_BY(mMutex) = 0;
+    nsecs_t mCompileTime GUARDED_BY(mMutex) = 0;
+    size_t mPrimedCount GUARDED_BY(mMutex) = 0;
+    nsecs_t mPrimeTime GUARDED_BY(mMutex) = 0;
+    size_t mPrimerWaitCount GUARDED_BY(mMutex) = 0;
+    nsecs_t mPrimerWaitTime GUARDED_BY(mMutex) = 0;
+    size_t mOnDemandCount GUARDED_BY(mMutex) = 0;
 };
 
 } // namespace gl
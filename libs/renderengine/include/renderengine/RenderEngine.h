@@ -31,7 +31,8 @@
 #include <ui/Transform.h>
 
 /**
- * Allows to set RenderEngine backend to GLES (default) or Vulkan (NOT yet supported).
+ * Allows to set RenderEngine backend to GLES (default), CPU ("cpu") or Vulkan (NOT yet
+ * supported).
  */
 #define PROPERTY_DEBUG_RENDERENGINE_BACKEND "debug.renderengine.backend"
 
@@ -137,6 +138,10 @@ public:
 
     // ----- END DEPRECATED INTERFACE -----
 
+    // Returns the gralloc usage that buffers passed to drawLayers as output must be allocated
+    // with.
+    virtual uint64_t getOutputBufferUsage() const = 0;
+
     // ----- BEGIN NEW INTERFACE -----
 
     virtual bool isProtected() const = 0;
@@ -297,6 +302,7 @@ public:
 
     bool useNativeFenceSync() const override;
     bool useWaitSync() const override;
+    uint64_t getOutputBufferUsage() const override;
 
 protected:
     RenderEngine(const RenderEngineCreationArgs& args);
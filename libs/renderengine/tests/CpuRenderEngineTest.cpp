@@ -0,0 +1,267 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// TODO(b/129481165): remove the #pragma below and fix conversion issues
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+
+#include <gtest/gtest.h>
+#include <renderengine/RenderEngine.h>
+#include <ui/PixelFormat.h>
+#include "../cpu/CpuRenderEngine.h"
+
+namespace android {
+namespace {
+
+constexpr int DISPLAY_WIDTH = 64;
+constexpr int DISPLAY_HEIGHT = 128;
+
+// RGBA_8888 pixels, as read from memory in a little endian uint32_t.
+constexpr uint32_t kRed = 0xff0000ff;
+constexpr uint32_t kTransparent = 0;
+constexpr uint32_t kPoison = 0x12345678;
+
+struct CpuRenderEngineTest : public ::testing::Test {
+    CpuRenderEngineTest()
+          : mRE(renderengine::cpu::CpuRenderEngine::create(
+                    renderengine::RenderEngineCreationArgs::Builder()
+                            .setPixelFormat(static_cast<int>(ui::PixelFormat::RGBA_8888))
+                            .setUseColorManagerment(false)
+                            .build())),
+            mBuffer(allocateBuffer(DISPLAY_WIDTH, DISPLAY_HEIGHT, "output")) {}
+
+    static sp<GraphicBuffer> allocateBuffer(uint32_t width, uint32_t height, const char* name) {
+        return new GraphicBuffer(width, height, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                                 GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN,
+                                 name);
+    }
+
+    static renderengine::DisplaySettings fullscreenDisplay() {
+        renderengine::DisplaySettings settings;
+        settings.physicalDisplay = Rect(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        settings.clip = Rect(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        return settings;
+    }
+
+    static renderengine::LayerSettings solidLayer(const FloatRect& bounds, half3 color,
+                                                  float alpha) {
+        renderengine::LayerSettings layer;
+        layer.geometry.boundaries = bounds;
+        layer.source.solidColor = color;
+        layer.alpha = alpha;
+        return layer;
+    }
+
+    void draw(const renderengine::DisplaySettings& settings,
+              const std::vector<const renderengine::LayerSettings*>& layers) {
+        base::unique_fd fence;
+        ASSERT_EQ(NO_ERROR,
+                  mRE->drawLayers(settings, layers, mBuffer->getNativeBuffer(), true,
+                                  base::unique_fd(), &fence));
+        EXPECT_LT(fence.get(), 0);
+    }
+
+    // Draws into plain memory of the given size rather than into a gralloc buffer, and returns
+    // the pixels.
+    std::vector<uint32_t> drawToMemory(const renderengine::DisplaySettings& settings,
+                                       const std::vector<const renderengine::LayerSettings*>& layers,
+                                       int32_t width, int32_t height) {
+        std::vector<uint32_t> pixels(width * height, kPoison);
+        renderengine::cpu::PixelBuffer output;
+        output.pixels = pixels.data();
+        output.width = width;
+        output.height = height;
+        output.stride = width;
+        EXPECT_EQ(NO_ERROR, mRE->drawLayers(settings, layers, output));
+        return pixels;
+    }
+
+    void fillBuffer(const sp<GraphicBuffer>& buffer, const Rect& rect, uint32_t pixel) {
+        uint32_t* pixels;
+        buffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, reinterpret_cast<void**>(&pixels));
+        for (int32_t y = rect.top; y < rect.bottom; y++) {
+            std::fill_n(pixels + y * buffer->getStride() + rect.left, rect.getWidth(), pixel);
+        }
+        buffer->unlock();
+    }
+
+    void expectBufferColor(const Rect& rect, uint8_t r, uint8_t g, uint8_t b, uint8_t a,
+                           uint8_t tolerance = 0) {
+        uint8_t* pixels;
+        mBuffer->lock(GRALLOC_USAGE_SW_READ_OFTEN, reinterpret_cast<void**>(&pixels));
+        for (int32_t y = rect.top; y < rect.bottom; y++) {
+            for (int32_t x = rect.left; x < rect.right; x++) {
+                const uint8_t* src = pixels + (mBuffer->getStride() * y + x) * 4;
+                const uint8_t expected[4] = {r, g, b, a};
+                for (int channel = 0; channel < 4; channel++) {
+                    ASSERT_NEAR(expected[channel], src[channel], tolerance)
+                            << "pixel @ (" << x << ", " << y << "), channel " << channel;
+                }
+            }
+        }
+        mBuffer->unlock();
+    }
+
+    std::unique_ptr<renderengine::cpu::CpuRenderEngine> mRE;
+    sp<GraphicBuffer> mBuffer;
+};
+
+TEST_F(CpuRenderEngineTest, drawLayers_nullOutputBuffer) {
+    const auto layer = solidLayer(FloatRect(0, 0, 1, 1), half3(1.0f, 0.0f, 0.0f), 1.0f);
+    base::unique_fd fence;
+    EXPECT_EQ(BAD_VALUE,
+              mRE->drawLayers(fullscreenDisplay(), {&layer}, nullptr, true, base::unique_fd(),
+                              &fence));
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_fillsSolidColor) {
+    const auto layer = solidLayer(FloatRect(0, 0, DISPLAY_WIDTH / 2, DISPLAY_HEIGHT),
+                                  half3(1.0f, 0.0f, 0.0f), 1.0f);
+    draw(fullscreenDisplay(), {&layer});
+    expectBufferColor(Rect(DISPLAY_WIDTH / 2, DISPLAY_HEIGHT), 255, 0, 0, 255);
+    expectBufferColor(Rect(DISPLAY_WIDTH / 2, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT), 0, 0, 0, 0);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_blendsTranslucentLayer) {
+    const FloatRect bounds(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    const auto bottom = solidLayer(bounds, half3(0.0f, 0.0f, 1.0f), 1.0f);
+    const auto top = solidLayer(bounds, half3(1.0f, 0.0f, 0.0f), 0.5f);
+    draw(fullscreenDisplay(), {&bottom, &top});
+    expectBufferColor(Rect(DISPLAY_WIDTH, DISPLAY_HEIGHT), 128, 0, 128, 255, 1);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_appliesColorTransform) {
+    auto settings = fullscreenDisplay();
+    // Swaps the red and green channels.
+    settings.colorTransform[0] = vec4(0.0f, 1.0f, 0.0f, 0.0f);
+    settings.colorTransform[1] = vec4(1.0f, 0.0f, 0.0f, 0.0f);
+    const auto layer = solidLayer(FloatRect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT),
+                                  half3(1.0f, 0.0f, 0.0f), 1.0f);
+    draw(settings, {&layer});
+    expectBufferColor(Rect(DISPLAY_WIDTH, DISPLAY_HEIGHT), 0, 255, 0, 255, 1);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_roundsCorners) {
+    const FloatRect bounds(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    auto layer = solidLayer(bounds, half3(1.0f, 0.0f, 0.0f), 1.0f);
+    layer.geometry.roundedCornersRadius = 8.0f;
+    layer.geometry.roundedCornersCrop = bounds;
+    draw(fullscreenDisplay(), {&layer});
+    expectBufferColor(Rect(0, 0, 1, 1), 0, 0, 0, 0);
+    expectBufferColor(Rect(DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1, DISPLAY_WIDTH, DISPLAY_HEIGHT),
+                      0, 0, 0, 0);
+    expectBufferColor(Rect(8, 0, DISPLAY_WIDTH - 8, DISPLAY_HEIGHT), 255, 0, 0, 255);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_samplesBufferWithTextureTransform) {
+    // A 2x2 buffer with a red top left pixel and green everywhere else.
+    const auto source = allocateBuffer(2, 2, "input");
+    fillBuffer(source, Rect(2, 2), 0xff00ff00);
+    fillBuffer(source, Rect(1, 1), 0xff0000ff);
+
+    renderengine::LayerSettings layer;
+    layer.geometry.boundaries = FloatRect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    layer.source.buffer.buffer = source;
+    layer.alpha = 1.0f;
+    draw(fullscreenDisplay(), {&layer});
+    expectBufferColor(Rect(DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2), 255, 0, 0, 255);
+    expectBufferColor(Rect(DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2, DISPLAY_WIDTH, DISPLAY_HEIGHT),
+                      0, 255, 0, 255);
+
+    // Flipping the texture coordinates moves the red pixel to the bottom right.
+    layer.source.buffer.textureTransform =
+            mat4::translate(vec4(1.0f, 1.0f, 0.0f, 1.0f)) * mat4::scale(vec4(-1, -1, 1, 1));
+    draw(fullscreenDisplay(), {&layer});
+    expectBufferColor(Rect(DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2, DISPLAY_WIDTH, DISPLAY_HEIGHT),
+                      255, 0, 0, 255);
+    expectBufferColor(Rect(DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2), 0, 255, 0, 255);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_drawsIntoPlainMemory) {
+    renderengine::DisplaySettings settings;
+    settings.physicalDisplay = Rect(4, 2);
+    settings.clip = Rect(4, 2);
+    const auto layer = solidLayer(FloatRect(0, 0, 2, 2), half3(1.0f, 0.0f, 0.0f), 1.0f);
+    const auto pixels = drawToMemory(settings, {&layer}, 4, 2);
+    EXPECT_EQ((std::vector<uint32_t>{kRed, kRed, kTransparent, kTransparent,
+                                     kRed, kRed, kTransparent, kTransparent}),
+              pixels);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_rotatesDisplay) {
+    // A portrait layer stack shown on a landscape display. Rotating by 90 degrees clockwise
+    // moves the top of the layer stack to the right edge of the display.
+    renderengine::DisplaySettings settings;
+    settings.physicalDisplay = Rect(4, 2);
+    settings.clip = Rect(2, 4);
+    settings.orientation = ui::Transform::ROT_90;
+    const auto layer = solidLayer(FloatRect(0, 0, 2, 1), half3(1.0f, 0.0f, 0.0f), 1.0f);
+    const auto pixels = drawToMemory(settings, {&layer}, 4, 2);
+    EXPECT_EQ((std::vector<uint32_t>{kTransparent, kTransparent, kTransparent, kRed,
+                                     kTransparent, kTransparent, kTransparent, kRed}),
+              pixels);
+
+    settings.orientation = ui::Transform::ROT_270;
+    const auto rotatedPixels = drawToMemory(settings, {&layer}, 4, 2);
+    EXPECT_EQ((std::vector<uint32_t>{kRed, kTransparent, kTransparent, kTransparent,
+                                     kRed, kTransparent, kTransparent, kTransparent}),
+              rotatedPixels);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_skipsBuffersCpuCannotRead) {
+    renderengine::DisplaySettings settings;
+    settings.physicalDisplay = Rect(2, 1);
+    settings.clip = Rect(2, 1);
+    const auto background = solidLayer(FloatRect(0, 0, 2, 1), half3(1.0f, 0.0f, 0.0f), 1.0f);
+
+    // A buffer without storage has no format the CPU can read.
+    renderengine::LayerSettings unallocated;
+    unallocated.geometry.boundaries = FloatRect(0, 0, 2, 1);
+    unallocated.source.buffer.buffer = new GraphicBuffer();
+    unallocated.alpha = 1.0f;
+
+    const auto pixels = drawToMemory(settings, {&background, &unallocated}, 2, 1);
+    EXPECT_EQ((std::vector<uint32_t>{kRed, kRed}), pixels);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_skipsYuvBuffers) {
+    renderengine::LayerSettings layer;
+    layer.geometry.boundaries = FloatRect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    layer.source.buffer.buffer =
+            new GraphicBuffer(2, 2, HAL_PIXEL_FORMAT_YCBCR_420_888, 1,
+                              GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN, "yuv");
+    layer.alpha = 1.0f;
+    draw(fullscreenDisplay(), {&layer});
+    expectBufferColor(Rect(DISPLAY_WIDTH, DISPLAY_HEIGHT), 0, 0, 0, 0);
+}
+
+TEST_F(CpuRenderEngineTest, drawLayers_onlyDrawsDamage) {
+    fillBuffer(mBuffer, Rect(DISPLAY_WIDTH, DISPLAY_HEIGHT), 0xffff0000);
+
+    auto settings = fullscreenDisplay();
+    settings.damage = Rect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT / 2);
+    const auto layer = solidLayer(FloatRect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT),
+                                  half3(1.0f, 0.0f, 0.0f), 1.0f);
+    draw(settings, {&layer});
+    expectBufferColor(settings.damage, 255, 0, 0, 255);
+    expectBufferColor(Rect(0, DISPLAY_HEIGHT / 2, DISPLAY_WIDTH, DISPLAY_HEIGHT), 0, 0, 255, 255);
+}
+
+} // namespace
+} // namespace android
+
+// TODO(b/129481165): remove the #pragma below and fix conversion issues
+#pragma clang diagnostic pop // ignored "-Wconversion"
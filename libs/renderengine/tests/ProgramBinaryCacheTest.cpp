@@ -0,0 +1,132 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "../gl/ProgramBinaryCache.h"
+
+namespace android {
+namespace renderengine {
+namespace gl {
+namespace {
+
+constexpr auto kFingerprint = "vendor/renderer/version/build";
+
+ProgramBinaryCache::Binary makeBinary(GLenum format, std::vector<uint8_t> data) {
+    ProgramBinaryCache::Binary binary;
+    binary.format = format;
+    binary.data = std::move(data);
+    return binary;
+}
+
+TEST(ProgramBinaryCacheTest, missingFileIsEmpty) {
+    TemporaryDir dir;
+    ProgramBinaryCache cache(std::string(dir.path) + "/programs.bin", kFingerprint);
+    EXPECT_FALSE(cache.get(1).has_value());
+}
+
+TEST(ProgramBinaryCacheTest, binariesPersistAcrossInstances) {
+    TemporaryFile file;
+    {
+        ProgramBinaryCache cache(file.path, kFingerprint);
+        cache.put(1, makeBinary(7, {1, 2, 3}));
+        cache.put(2, makeBinary(8, {}));
+        cache.save();
+    }
+
+    ProgramBinaryCache cache(file.path, kFingerprint);
+    const auto first = cache.get(1);
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(7u, first->format);
+    EXPECT_EQ((std::vector<uint8_t>{1, 2, 3}), first->data);
+    const auto second = cache.get(2);
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(8u, second->format);
+    EXPECT_TRUE(second->data.empty());
+    EXPECT_FALSE(cache.get(3).has_value());
+}
+
+TEST(ProgramBinaryCacheTest, requestedSaveFinishesBeforeDestruction) {
+    TemporaryFile file;
+    {
+        ProgramBinaryCache cache(file.path, kFingerprint);
+        cache.put(1, makeBinary(7, {1, 2, 3}));
+        cache.requestSave();
+    }
+
+    ProgramBinaryCache cache(file.path, kFingerprint);
+    const auto binary = cache.get(1);
+    ASSERT_TRUE(binary.has_value());
+    EXPECT_EQ((std::vector<uint8_t>{1, 2, 3}), binary->data);
+}
+
+TEST(ProgramBinaryCacheTest, driverChangeInvalidatesBinaries) {
+    TemporaryFile file;
+    {
+        ProgramBinaryCache cache(file.path, kFingerprint);
+        cache.put(1, makeBinary(7, {1, 2, 3}));
+        cache.save();
+    }
+
+    ProgramBinaryCache cache(file.path, "vendor/renderer/version/updated");
+    EXPECT_FALSE(cache.get(1).has_value());
+}
+
+TEST(ProgramBinaryCacheTest, truncatedFileKeepsCompleteEntries) {
+    TemporaryFile file;
+    {
+        ProgramBinaryCache cache(file.path, kFingerprint);
+        cache.put(1, makeBinary(7, {1, 2, 3}));
+        cache.save();
+    }
+    std::string contents;
+    ASSERT_TRUE(base::ReadFileToString(file.path, &contents));
+    // Cut into the binary, past the empty list of use counts that follows it.
+    ASSERT_TRUE(base::WriteStringToFile(contents.substr(0, contents.size() - sizeof(uint32_t) - 1),
+                                        file.path));
+
+    ProgramBinaryCache cache(file.path, kFingerprint);
+    EXPECT_FALSE(cache.get(1).has_value());
+}
+
+TEST(ProgramBinaryCacheTest, useCountsPersistAcrossInstances) {
+    TemporaryFile file;
+    {
+        ProgramBinaryCache cache(file.path, kFingerprint);
+        EXPECT_TRUE(cache.recordUse(1));
+        EXPECT_TRUE(cache.recordUse(2));
+        EXPECT_TRUE(cache.recordUse(2));
+        EXPECT_FALSE(cache.recordUse(2));
+        EXPECT_TRUE(cache.recordUse(2));
+        EXPECT_TRUE(cache.recordUse(3));
+        EXPECT_TRUE(cache.recordUse(3));
+        EXPECT_EQ((std::vector<uint32_t>{2, 3, 1}), cache.getKeysByUse());
+        cache.save();
+    }
+
+    // Counts from the previous boot are halved, so recent uses weigh more.
+    ProgramBinaryCache cache(file.path, kFingerprint);
+    EXPECT_EQ((std::vector<uint32_t>{2, 1, 3}), cache.getKeysByUse());
+    cache.recordUse(3);
+    cache.recordUse(3);
+    EXPECT_EQ((std::vector<uint32_t>{3, 2, 1}), cache.getKeysByUse());
+}
+
+} // namespace
+} // namespace gl
+} // namespace renderengine
+} // namespace android
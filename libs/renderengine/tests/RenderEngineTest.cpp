@@ -1305,6 +1305,50 @@ TEST_F(RenderEngineTest, cacheExternalBuffer_cachesImages) {
     EXPECT_FALSE(sRE->isImageCachedForTesting(bufferId));
 }
 
+TEST_F(RenderEngineTest, cacheExternalBuffer_evictsLeastRecentlyUsedImages) {
+    const auto waitForBarrier = [](std::shared_ptr<renderengine::gl::ImageManager::Barrier>
+                                           barrier) {
+        std::lock_guard<std::mutex> lock(barrier->mutex);
+        ASSERT_TRUE(barrier->condition.wait_for(barrier->mutex, std::chrono::seconds(5),
+                                                [&]() REQUIRES(barrier->mutex) {
+                                                    return barrier->isOpen;
+                                                }));
+    };
+
+    sp<GraphicBuffer> first = allocateSourceBuffer(1, 1);
+    sp<GraphicBuffer> second = allocateSourceBuffer(1, 1);
+    sp<GraphicBuffer> third = allocateSourceBuffer(1, 1);
+    // Fits two of the buffers.
+    const size_t previousBudget =
+            sRE->setImageCacheBudgetForTesting(2 * first->getStride() * first->getHeight() * 4);
+    waitForBarrier(sRE->cacheExternalTextureBufferForTesting(first));
+    waitForBarrier(sRE->cacheExternalTextureBufferForTesting(second));
+
+    // Draw the second buffer, so that the first one becomes the least recently used.
+    renderengine::DisplaySettings settings;
+    settings.physicalDisplay = fullscreenRect();
+    settings.clip = fullscreenRect();
+    renderengine::LayerSettings layer;
+    layer.geometry.boundaries = fullscreenRect().toFloatRect();
+    layer.source.buffer.buffer = second;
+    sRE->genTextures(1, &layer.source.buffer.textureName);
+    mTexNames.push_back(layer.source.buffer.textureName);
+    layer.alpha = 1.0f;
+    invokeDraw(settings, {&layer}, mBuffer);
+    invokeDraw(settings, {&layer}, mBuffer);
+
+    waitForBarrier(sRE->cacheExternalTextureBufferForTesting(third));
+    // Images are evicted after the barrier opens, so wait for the next operation as well.
+    waitForBarrier(sRE->unbindExternalTextureBufferForTesting(0));
+    EXPECT_FALSE(sRE->isImageCachedForTesting(first->getId()));
+    EXPECT_TRUE(sRE->isImageCachedForTesting(second->getId()));
+    EXPECT_TRUE(sRE->isImageCachedForTesting(third->getId()));
+
+    sRE->setImageCacheBudgetForTesting(previousBudget);
+    sRE->unbindExternalTextureBuffer(second->getId());
+    sRE->unbindExternalTextureBuffer(third->getId());
+}
+
 TEST_F(RenderEngineTest, drawLayers_fillShadow_casterLayerMinSize) {
     const ubyte4 casterColor(255, 0, 0, 255);
     const ubyte4 backgroundColor(255, 255, 255, 255);
@@ -1339,6 +1383,26 @@ TEST_F(RenderEngineTest, drawLayers_fillShadow_casterColorLayer) {
     expectShadowColor(castingLayer, settings, casterColor, backgroundColor);
 }
 
+TEST_F(RenderEngineTest, drawLayers_fillShadow_reusesCachedMesh) {
+    const ubyte4 casterColor(255, 0, 0, 255);
+    const ubyte4 backgroundColor(255, 255, 255, 255);
+    const float shadowLength = 5.0f;
+    Rect casterBounds(DEFAULT_DISPLAY_WIDTH / 3.0f, DEFAULT_DISPLAY_HEIGHT / 3.0f);
+    casterBounds.offsetBy(shadowLength + 1, shadowLength + 1);
+    renderengine::LayerSettings castingLayer;
+    castingLayer.geometry.boundaries = casterBounds.toFloatRect();
+    castingLayer.alpha = 1.0f;
+    renderengine::ShadowSettings settings =
+            getShadowSettings(vec2(casterBounds.left, casterBounds.top), shadowLength,
+                              false /* casterIsTranslucent */);
+
+    drawShadow<ColorSourceVariant>(castingLayer, settings, casterColor, backgroundColor);
+    const size_t hitCount = sRE->getShadowMeshCacheHitCountForTesting();
+    drawShadow<ColorSourceVariant>(castingLayer, settings, casterColor, backgroundColor);
+    EXPECT_EQ(hitCount + 1, sRE->getShadowMeshCacheHitCountForTesting());
+    expectShadowColor(castingLayer, settings, casterColor, backgroundColor);
+}
+
 TEST_F(RenderEngineTest, drawLayers_fillShadow_casterOpaqueBufferLayer) {
     const ubyte4 casterColor(255, 0, 0, 255);
     const ubyte4 backgroundColor(255, 255, 255, 255);
@@ -16,6 +16,13 @@
 
 #include <ui/ColorSpace.h>
 
+#include <algorithm>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 using namespace std::placeholders;
 
 namespace android {
@@ -122,6 +129,7 @@ ColorSpace::ColorSpace(
         , mRGBtoXYZ(rgbToXYZ)
         , mXYZtoRGB(inverse(rgbToXYZ))
         , mParameters(parameters)
+        , mTransferType(TransferType::Parametric)
         , mOETF(toOETF(mParameters))
         , mEOTF(toEOTF(mParameters))
         , mClamper(std::move(clamper))
@@ -138,6 +146,7 @@ ColorSpace::ColorSpace(
         , mRGBtoXYZ(rgbToXYZ)
         , mXYZtoRGB(inverse(rgbToXYZ))
         , mParameters({gamma, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f})
+        , mTransferType(TransferType::Gamma)
         , mOETF(toOETF(gamma))
         , mEOTF(toEOTF(gamma))
         , mClamper(std::move(clamper))
@@ -172,6 +181,7 @@ ColorSpace::ColorSpace(
         , mRGBtoXYZ(computeXYZMatrix(primaries, whitePoint))
         , mXYZtoRGB(inverse(mRGBtoXYZ))
         , mParameters(parameters)
+        , mTransferType(TransferType::Parametric)
         , mOETF(toOETF(mParameters))
         , mEOTF(toEOTF(mParameters))
         , mClamper(std::move(clamper))
@@ -189,6 +199,7 @@ ColorSpace::ColorSpace(
         , mRGBtoXYZ(computeXYZMatrix(primaries, whitePoint))
         , mXYZtoRGB(inverse(mRGBtoXYZ))
         , mParameters({gamma, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f})
+        , mTransferType(TransferType::Gamma)
         , mOETF(toOETF(gamma))
         , mEOTF(toEOTF(gamma))
         , mClamper(std::move(clamper))
@@ -351,24 +362,177 @@ const ColorSpace ColorSpace::ACEScg() {
     };
 }
 
+void ColorSpace::fromLinear(float* values, size_t count) const noexcept {
+    // Same as the functions built by toOETF(), written out so that they can be
+    // inlined into the loops
+    switch (mTransferType) {
+        case TransferType::Gamma:
+            if (mParameters.g != 1.0f) {
+                const float exponent = 1.0f / mParameters.g;
+                for (size_t i = 0; i < count; i++) {
+                    values[i] = safePow(values[i], exponent);
+                }
+            }
+            break;
+        case TransferType::Parametric:
+            if (mParameters.e == 0.0f && mParameters.f == 0.0f) {
+                for (size_t i = 0; i < count; i++) {
+                    values[i] = rcpResponse(values[i], mParameters);
+                }
+            } else {
+                for (size_t i = 0; i < count; i++) {
+                    values[i] = rcpFullResponse(values[i], mParameters);
+                }
+            }
+            break;
+        case TransferType::Custom:
+            for (size_t i = 0; i < count; i++) {
+                values[i] = mOETF(values[i]);
+            }
+            break;
+    }
+}
+
+// LUTs are only cached up to this many bytes in total, which holds a few 64x64x64 LUTs
+static constexpr size_t LUT_CACHE_MAX_BYTES = 8 * 1024 * 1024;
+// Smaller LUTs are generated faster than threads can be started
+static constexpr size_t LUT_PARALLEL_MIN_ENTRIES = 32 * 32 * 32;
+static constexpr uint32_t LUT_MAX_THREADS = 4;
+
+struct LUTCacheEntry {
+    // Describes the source and destination color spaces. std::function can't be
+    // compared, so transfer functions are identified by their parameters, and
+    // clamping functions by their bounds
+    uint32_t size;
+    std::string names[2];
+    std::array<float, 2 * 19> values;
+    std::unique_ptr<float3[]> lut;
+
+    bool operator==(const LUTCacheEntry& other) const {
+        return size == other.size && names[0] == other.names[0] &&
+                names[1] == other.names[1] && values == other.values;
+    }
+};
+
+struct LUTCache {
+    std::mutex mutex;
+    // Most recently used first
+    std::list<LUTCacheEntry> entries;
+    size_t bytes = 0;
+};
+
+static LUTCache& getLUTCache() {
+    // Never destroyed, so that LUTs can be created while the process exits
+    static LUTCache* cache = new LUTCache();
+    return *cache;
+}
+
 std::unique_ptr<float3[]> ColorSpace::createLUT(uint32_t size, const ColorSpace& src,
                                                 const ColorSpace& dst) {
     size = clamp(size, 2u, 256u);
-    float m = 1.0f / float(size - 1);
+    const size_t count = size_t(size) * size * size;
+
+    const bool cacheable = src.mTransferType != TransferType::Custom &&
+            dst.mTransferType != TransferType::Custom;
+    LUTCacheEntry key{size, {src.mName, dst.mName}, {}, nullptr};
+    if (cacheable) {
+        float* values = key.values.data();
+        for (const ColorSpace* space : {&src, &dst}) {
+            for (size_t i = 0; i < 3; i++) {
+                for (size_t j = 0; j < 3; j++) {
+                    *values++ = space->mRGBtoXYZ[i][j];
+                }
+            }
+            const TransferParameters& p = space->mParameters;
+            for (float value : {p.g, p.a, p.b, p.c, p.d, p.e, p.f}) {
+                *values++ = value;
+            }
+            *values++ = static_cast<float>(space->mTransferType);
+            *values++ = space->mClamper(-std::numeric_limits<float>::max());
+            *values++ = space->mClamper(std::numeric_limits<float>::max());
+        }
 
-    std::unique_ptr<float3[]> lut(new float3[size * size * size]);
-    float3* data = lut.get();
+        LUTCache& cache = getLUTCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = std::find(cache.entries.begin(), cache.entries.end(), key);
+        if (it != cache.entries.end()) {
+            cache.entries.splice(cache.entries.begin(), cache.entries, it);
+            std::unique_ptr<float3[]> lut(new float3[count]);
+            std::copy_n(it->lut.get(), count, lut.get());
+            return lut;
+        }
+    }
+
+    std::unique_ptr<float3[]> lut(new float3[count]);
 
-    ColorSpaceConnector connector(src, dst);
+    // Every axis samples the same values, and the source transfer and clamping
+    // functions apply to each component separately, so decoding each value once
+    // is enough
+    float m = 1.0f / float(size - 1);
+    std::vector<float> linear(size);
+    for (uint32_t i = 0; i < size; i++) {
+        linear[i] = src.mEOTF(src.mClamper(static_cast<float>(i) * m));
+    }
 
-    for (uint32_t z = 0; z < size; z++) {
-        for (int32_t y = int32_t(size - 1); y >= 0; y--) {
+    const mat3 transform = ColorSpaceConnector(src, dst).getTransform();
+
+    // Converts rows [begin, end) of the LUT, each of them running along the X axis.
+    // The destination transfer function is applied to a whole row at once
+    auto convertRows = [&](uint32_t begin, uint32_t end) {
+        std::vector<float> r(size);
+        std::vector<float> g(size);
+        std::vector<float> b(size);
+        for (uint32_t row = begin; row < end; row++) {
+            const uint32_t z = row / size;
+            const uint32_t y = size - 1 - row % size; // the Y axis is flipped
+            // Only the red component changes along a row
+            const float3& red = transform[0];
+            const float3 gb = transform[1] * linear[y] + transform[2] * linear[z];
             for (uint32_t x = 0; x < size; x++) {
-                *data++ = connector.transform({
-                    static_cast<float>(x) * m,
-                    static_cast<float>(y) * m,
-                    static_cast<float>(z) * m,
-                });
+                r[x] = red.r * linear[x] + gb.r;
+                g[x] = red.g * linear[x] + gb.g;
+                b[x] = red.b * linear[x] + gb.b;
+            }
+            dst.fromLinear(r.data(), size);
+            dst.fromLinear(g.data(), size);
+            dst.fromLinear(b.data(), size);
+
+            float3* data = lut.get() + size_t(row) * size;
+            for (uint32_t x = 0; x < size; x++) {
+                data[x] = {dst.mClamper(r[x]), dst.mClamper(g[x]), dst.mClamper(b[x])};
+            }
+        }
+    };
+
+    const uint32_t rows = size * size;
+    uint32_t threadCount = 1;
+    if (count >= LUT_PARALLEL_MIN_ENTRIES) {
+        threadCount = clamp(std::thread::hardware_concurrency(), 1u, LUT_MAX_THREADS);
+    }
+    const uint32_t rowsPerThread = (rows + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+    for (uint32_t begin = rowsPerThread; begin < rows; begin += rowsPerThread) {
+        threads.emplace_back(convertRows, begin, std::min(begin + rowsPerThread, rows));
+    }
+    convertRows(0, rowsPerThread);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const size_t bytes = count * sizeof(float3);
+    if (cacheable && bytes <= LUT_CACHE_MAX_BYTES) {
+        key.lut.reset(new float3[count]);
+        std::copy_n(lut.get(), count, key.lut.get());
+
+        LUTCache& cache = getLUTCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (std::find(cache.entries.begin(), cache.entries.end(), key) == cache.entries.end()) {
+            cache.entries.push_front(std::move(key));
+            cache.bytes += bytes;
+            while (cache.bytes > LUT_CACHE_MAX_BYTES) {
+                const uint32_t evictedSize = cache.entries.back().size;
+                cache.bytes -= size_t(evictedSize) * evictedSize * evictedSize * sizeof(float3);
+                cache.entries.pop_back();
             }
         }
     }
@@ -376,6 +540,13 @@ std::unique_ptr<float3[]> ColorSpace::createLUT(uint32_t size, const ColorSpace&
     return lut;
 }
 
+void ColorSpace::purgeLUTCache() {
+    LUTCache& cache = getLUTCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries.clear();
+    cache.bytes = 0;
+}
+
 static const float2 ILLUMINANT_D50_XY = {0.34567f, 0.35850f};
 static const float3 ILLUMINANT_D50_XYZ = {0.964212f, 1.0f, 0.825188f};
 static const mat3 BRADFORD = mat3{
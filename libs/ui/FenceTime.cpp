@@ -21,8 +21,11 @@
 #include <cutils/compiler.h>  // For CC_[UN]LIKELY
 #include <utils/Log.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <cerrno>
 #include <memory>
 
 namespace android {
@@ -165,6 +168,14 @@ FenceTime::Snapshot FenceTime::getSnapshot() const {
     return Snapshot(mFence);
 }
 
+sp<Fence> FenceTime::getPendingFence() const {
+    if (mSignalTime.load(std::memory_order_relaxed) != Fence::SIGNAL_TIME_PENDING) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFence;
+}
+
 // For tests only. If forceValidForTest is true, then getSignalTime will
 // never return SIGNAL_TIME_INVALID and isValid will always return true.
 FenceTime::FenceTime(const sp<Fence>& fence, bool forceValidForTest)
@@ -259,6 +270,52 @@ status_t FenceTime::Snapshot::unflatten(
 // ============================================================================
 // FenceTimeline
 // ============================================================================
+void FenceTimeline::Poller::updateSignalTimes(std::initializer_list<FenceTimeline*> timelines) {
+    update(timelines);
+}
+
+void FenceTimeline::Poller::updateSignalTimes(const std::vector<FenceTimeline*>& timelines) {
+    update(timelines);
+}
+
+template <typename Timelines>
+void FenceTimeline::Poller::update(const Timelines& timelines) {
+    for (const FenceTimeline* timeline : timelines) {
+        timeline->getPendingFences(this);
+    }
+    poll();
+    size_t begin = 0;
+    size_t i = 0;
+    for (FenceTimeline* timeline : timelines) {
+        timeline->removeSignaledFences(*this, begin, mTimelineEnds[i]);
+        begin = mTimelineEnds[i++];
+    }
+    clear();
+}
+
+// Polling a fence is cheaper than querying its signal time, and every fence
+// is polled in the same system call.
+void FenceTimeline::Poller::poll() {
+    if (mFds.empty()) {
+        return;
+    }
+    if (::poll(mFds.data(), mFds.size(), 0) < 0) {
+        ALOGE("updateSignalTimes: poll failed: %s", strerror(errno));
+        // Query the signal time of every fence instead.
+        for (pollfd& fd : mFds) {
+            fd.revents = POLLIN;
+        }
+    }
+}
+
+// Keeps the capacity of the buffers, but not the references to the fences.
+void FenceTimeline::Poller::clear() {
+    mFenceTimes.clear();
+    mFences.clear();
+    mFds.clear();
+    mTimelineEnds.clear();
+}
+
 void FenceTimeline::push(const std::shared_ptr<FenceTime>& fence) {
     std::lock_guard<std::mutex> lock(mMutex);
     while (mQueue.size() >= MAX_ENTRIES) {
@@ -273,29 +330,71 @@ void FenceTimeline::push(const std::shared_ptr<FenceTime>& fence) {
             // we are removing it from the timeline.
             front->getSignalTime();
         }
-        mQueue.pop();
+        mQueue.pop_front();
     }
-    mQueue.push(fence);
+    mQueue.push_back(fence);
 }
 
 void FenceTimeline::updateSignalTimes() {
+    Poller poller;
+    poller.updateSignalTimes({this});
+}
+
+void FenceTimeline::getPendingFences(Poller* poller) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& weakFence : mQueue) {
+        std::shared_ptr<FenceTime> fenceTime = weakFence.lock();
+        if (!fenceTime) {
+            continue;
+        }
+        sp<Fence> fence = fenceTime->getPendingFence();
+        if (fence.get() == nullptr) {
+            continue;
+        }
+        // Invalid file descriptors are ignored by poll, so this fence is
+        // never found signaled here. Neither it nor the fences behind it can
+        // be removed, and the fences forced valid for tests are never
+        // queried.
+        if (fence->get() < 0) {
+            break;
+        }
+        poller->mFds.push_back({fence->get(), POLLIN, 0});
+        poller->mFenceTimes.push_back(std::move(fenceTime));
+        poller->mFences.push_back(std::move(fence));
+    }
+    poller->mTimelineEnds.push_back(poller->mFenceTimes.size());
+}
+
+void FenceTimeline::removeSignaledFences(const Poller& poller, size_t begin, size_t end) {
     std::lock_guard<std::mutex> lock(mMutex);
+    // Fences are polled in the order of the queue, so the polled fence of the
+    // front of the queue, if any, is at or after index.
+    size_t index = begin;
     while (!mQueue.empty()) {
         std::shared_ptr<FenceTime> fence = mQueue.front().lock();
         if (!fence) {
             // The shared_ptr no longer exists and no one cares about the
             // timestamp anymore.
-            mQueue.pop();
+            mQueue.pop_front();
             continue;
-        } else if (fence->getSignalTime() != Fence::SIGNAL_TIME_PENDING) {
+        } else if (fence->getCachedSignalTime() != Fence::SIGNAL_TIME_PENDING) {
+            // The signal time is already known, e.g. from another timeline.
+            mQueue.pop_front();
+            continue;
+        }
+        while (index < end && poller.mFenceTimes[index] != fence) {
+            index++;
+        }
+        if (index < end && poller.mFds[index].revents != 0 &&
+            fence->getSignalTime() != Fence::SIGNAL_TIME_PENDING) {
             // The fence has signaled and we've removed the sp<Fence> ref.
-            mQueue.pop();
+            mQueue.pop_front();
+            index++;
             continue;
-        } else {
-            // The fence didn't signal yet. Break since the later ones
-            // shouldn't have signaled either.
-            break;
         }
+        // The fence didn't signal yet, or was pushed after the poll.
+        // Break since the later ones shouldn't have signaled either.
+        break;
     }
 }
 
@@ -250,10 +250,26 @@ public:
     // axis is thus already flipped
     // The source color space must define its values in the domain [0..1]
     // The generated LUT transforms from gamma space to gamma space
+    // Large LUTs are generated on several threads, so the transfer and clamping
+    // functions must be safe to call concurrently. LUTs between color spaces whose
+    // transfer functions are defined by a gamma or by transfer parameters are kept
+    // in a process-wide cache, so generating the same LUT again only costs a copy
     static std::unique_ptr<float3[]> createLUT(uint32_t size, const ColorSpace& src,
                                                const ColorSpace& dst);
 
+    // Releases the LUTs cached by createLUT()
+    static void purgeLUTCache();
+
 private:
+    // How the transfer functions were specified. Gamma and Parametric transfer
+    // functions are fully described by mParameters, which lets createLUT()
+    // evaluate them without going through std::function, and cache the result
+    enum class TransferType {
+        Custom,
+        Gamma,
+        Parametric,
+    };
+
     static constexpr mat3 computeXYZMatrix(
             const std::array<float2, 3>& primaries, const float2& whitePoint);
 
@@ -261,12 +277,16 @@ private:
         return v;
     }
 
+    // Encodes count values in place, like fromLinear() does for each component
+    void fromLinear(float* values, size_t count) const noexcept;
+
     std::string mName;
 
     mat3 mRGBtoXYZ;
     mat3 mXYZtoRGB;
 
     TransferParameters mParameters;
+    TransferType mTransferType = TransferType::Custom;
     transfer_function mOETF;
     transfer_function mEOTF;
     clamping_function mClamper;
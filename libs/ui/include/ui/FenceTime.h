@@ -22,19 +22,26 @@
 #include <utils/Mutex.h>
 #include <utils/Timers.h>
 
+#include <poll.h>
+
 #include <atomic>
+#include <deque>
+#include <initializer_list>
 #include <mutex>
 #include <queue>
 #include <unordered_map>
+#include <vector>
 
 namespace android {
 
+class FenceTimeline;
 class FenceToFenceTimeMap;
 
 // A wrapper around fence that only implements isValid and getSignalTime.
 // It automatically closes the fence in a thread-safe manner once the signal
 // time is known.
 class FenceTime {
+friend class FenceTimeline;
 friend class FenceToFenceTimeMap;
 public:
     // An atomic snapshot of the FenceTime that is flattenable.
@@ -125,6 +132,9 @@ private:
         FORCED_VALID_FOR_TEST,
     };
 
+    // Returns the fence to poll if the signal time isn't known yet, or null.
+    sp<Fence> getPendingFence() const;
+
     const State mState{State::INVALID};
 
     // mMutex guards mFence and mSignalTime.
@@ -149,18 +159,58 @@ private:
 // if FenceTimeline did nothing. i.e. they should eventually call
 // Fence::getSignalTime(), not only Fence::getCachedSignalTime().
 //
+// updateSignalTimes() polls all the pending fences of the timeline at once,
+// and only queries the signal time of those that have signaled, so a
+// pending fence costs no more than its share of a single poll. Several
+// timelines can be updated with a single poll, too.
+//
 // push() and updateSignalTimes() are safe to call simultaneously from
 // different threads.
 class FenceTimeline {
 public:
     static constexpr size_t MAX_ENTRIES = 64;
 
+    // Updates several timelines at once, polling the pending fences of all of
+    // them in one system call. Its buffers are reused from one update to the
+    // next, so keep it around rather than creating one per update.
+    //
+    // Not thread safe.
+    class Poller {
+    public:
+        void updateSignalTimes(std::initializer_list<FenceTimeline*> timelines);
+        void updateSignalTimes(const std::vector<FenceTimeline*>& timelines);
+
+    private:
+        friend class FenceTimeline;
+
+        template <typename Timelines>
+        void update(const Timelines& timelines);
+
+        // Finds out which fences have signaled without querying their signal
+        // times.
+        void poll();
+        void clear();
+
+        // The fences whose signal time isn't known yet, in the order of the
+        // timelines and of the fences in each timeline.
+        std::vector<std::shared_ptr<FenceTime>> mFenceTimes;
+        // Holds the fences so that their file descriptors stay open until
+        // they are polled.
+        std::vector<sp<Fence>> mFences;
+        std::vector<pollfd> mFds;
+        // The end of the fences of each timeline in the vectors above.
+        std::vector<size_t> mTimelineEnds;
+    };
+
     void push(const std::shared_ptr<FenceTime>& fence);
     void updateSignalTimes();
 
 private:
+    void getPendingFences(Poller* poller) const;
+    void removeSignaledFences(const Poller& poller, size_t begin, size_t end);
+
     mutable std::mutex mMutex;
-    std::queue<std::weak_ptr<FenceTime>> mQueue GUARDED_BY(mMutex);
+    std::deque<std::weak_ptr<FenceTime>> mQueue GUARDED_BY(mMutex);
 };
 
 // Used by test code to create or get FenceTimes for a given Fence.
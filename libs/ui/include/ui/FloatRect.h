@@ -29,6 +29,8 @@ public:
     float getWidth() const { return right - left; }
     float getHeight() const { return bottom - top; }
 
+    bool isEmpty() const { return getWidth() <= 0 || getHeight() <= 0; }
+
     FloatRect intersect(const FloatRect& other) const {
         FloatRect intersection = {
             // Inline to avoid tromping on other min/max defines or adding a
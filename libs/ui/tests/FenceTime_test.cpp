@@ -0,0 +1,137 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FenceTimeTest"
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <ui/FenceTime.h>
+
+namespace android {
+namespace ui {
+namespace {
+
+// Stands in for a sync file, which cannot be created by tests: poll reports
+// it as signaled once written to. Querying its signal time fails, which
+// FenceTime caches as SIGNAL_TIME_INVALID.
+class FakeFence {
+public:
+    FakeFence() {
+        int fds[2];
+        EXPECT_EQ(0, pipe(fds));
+        mReadFd = fds[0];
+        mWriteFd = fds[1];
+        mFenceTime = std::make_shared<FenceTime>(new Fence(mReadFd));
+    }
+
+    ~FakeFence() { close(mWriteFd); }
+
+    void signal() { EXPECT_EQ(1, write(mWriteFd, "s", 1)); }
+
+    bool isCached() const {
+        return mFenceTime->getCachedSignalTime() != Fence::SIGNAL_TIME_PENDING;
+    }
+
+    const std::shared_ptr<FenceTime>& get() const { return mFenceTime; }
+
+private:
+    int mReadFd = -1;
+    int mWriteFd = -1;
+    std::shared_ptr<FenceTime> mFenceTime;
+};
+
+TEST(FenceTimelineTest, pendingFencesAreNotQueried) {
+    FakeFence first;
+    FakeFence second;
+    FenceTimeline timeline;
+    timeline.push(first.get());
+    timeline.push(second.get());
+
+    timeline.updateSignalTimes();
+    EXPECT_FALSE(first.isCached());
+    EXPECT_FALSE(second.isCached());
+
+    first.signal();
+    timeline.updateSignalTimes();
+    EXPECT_TRUE(first.isCached());
+    EXPECT_FALSE(second.isCached());
+}
+
+TEST(FenceTimelineTest, fencesAfterAPendingFenceAreNotQueried) {
+    FakeFence first;
+    FakeFence second;
+    FenceTimeline timeline;
+    timeline.push(first.get());
+    timeline.push(second.get());
+
+    second.signal();
+    timeline.updateSignalTimes();
+    EXPECT_FALSE(first.isCached());
+    EXPECT_FALSE(second.isCached());
+
+    first.signal();
+    timeline.updateSignalTimes();
+    EXPECT_TRUE(first.isCached());
+    EXPECT_TRUE(second.isCached());
+}
+
+TEST(FenceTimelineTest, timelinesAreUpdatedTogether) {
+    FakeFence first;
+    FakeFence second;
+    FenceTimeline firstTimeline;
+    FenceTimeline secondTimeline;
+    firstTimeline.push(first.get());
+    secondTimeline.push(second.get());
+
+    first.signal();
+    second.signal();
+    FenceTimeline::Poller poller;
+    poller.updateSignalTimes({&firstTimeline, &secondTimeline});
+    EXPECT_TRUE(first.isCached());
+    EXPECT_TRUE(second.isCached());
+}
+
+TEST(FenceTimelineTest, pollerIsReusedAcrossUpdates) {
+    FakeFence first;
+    FakeFence second;
+    FakeFence third;
+    FenceTimeline firstTimeline;
+    FenceTimeline secondTimeline;
+    firstTimeline.push(first.get());
+    firstTimeline.push(second.get());
+    secondTimeline.push(third.get());
+    std::vector<FenceTimeline*> timelines = {&firstTimeline, &secondTimeline};
+    FenceTimeline::Poller poller;
+
+    third.signal();
+    poller.updateSignalTimes(timelines);
+    EXPECT_FALSE(first.isCached());
+    EXPECT_TRUE(third.isCached());
+
+    first.signal();
+    poller.updateSignalTimes(timelines);
+    EXPECT_TRUE(first.isCached());
+    EXPECT_FALSE(second.isCached());
+
+    second.signal();
+    poller.updateSignalTimes(timelines);
+    EXPECT_TRUE(second.isCached());
+}
+
+} // namespace
+} // namespace ui
+} // namespace android
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <ui/ColorSpace.h>
+
+namespace android {
+namespace {
+
+// Generates state.range(0)^3 LUTs without the cache, the cost paid the first time a display
+// switches color modes.
+void BM_CreateLUT(benchmark::State& state, const ColorSpace& src, const ColorSpace& dst) {
+    const auto size = static_cast<uint32_t>(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        ColorSpace::purgeLUTCache();
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(ColorSpace::createLUT(size, src, dst));
+    }
+    state.SetItemsProcessed(state.iterations() * size * size * size);
+}
+BENCHMARK_CAPTURE(BM_CreateLUT, sRGBToDisplayP3, ColorSpace::sRGB(), ColorSpace::DisplayP3())
+        ->Arg(17)->Arg(33)->Arg(65);
+BENCHMARK_CAPTURE(BM_CreateLUT, AdobeRGBToLinearSRGB, ColorSpace::AdobeRGB(),
+                  ColorSpace::linearExtendedSRGB())
+        ->Arg(17)->Arg(33)->Arg(65);
+BENCHMARK_CAPTURE(BM_CreateLUT, ExtendedSRGBToBT2020, ColorSpace::extendedSRGB(),
+                  ColorSpace::BT2020())
+        ->Arg(17)->Arg(33)->Arg(65);
+
+// Creates the same LUT over and over, which is served by the cache.
+void BM_CreateCachedLUT(benchmark::State& state) {
+    const auto size = static_cast<uint32_t>(state.range(0));
+    const ColorSpace src = ColorSpace::sRGB();
+    const ColorSpace dst = ColorSpace::DisplayP3();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ColorSpace::createLUT(size, src, dst));
+    }
+    state.SetItemsProcessed(state.iterations() * size * size * size);
+}
+BENCHMARK(BM_CreateCachedLUT)->Arg(17)->Arg(33)->Arg(65);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -180,4 +180,53 @@ TEST_F(ColorSpaceTest, LUT) {
 
 }
 
+static void expectLUTMatchesConnector(uint32_t size, const ColorSpace& src,
+                                      const ColorSpace& dst) {
+    auto lut = ColorSpace::createLUT(size, src, dst);
+    ASSERT_TRUE(lut != nullptr);
+
+    ColorSpaceConnector connector(src, dst);
+    float m = 1.0f / float(size - 1);
+    for (uint32_t z = 0; z < size; z++) {
+        for (uint32_t y = 0; y < size; y++) {
+            for (uint32_t x = 0; x < size; x++) {
+                float3 expected = connector.transform({x * m, y * m, z * m});
+                float3 r = lut.get()[z * size * size + (size - 1 - y) * size + x];
+                ASSERT_TRUE(all(lessThan(abs(r - expected), float3{1e-6f})))
+                        << src.getName() << " to " << dst.getName() << " at " << x << ", "
+                        << y << ", " << z;
+            }
+        }
+    }
+}
+
+TEST_F(ColorSpaceTest, LUTMatchesConnector) {
+    // Parametric transfer functions
+    expectLUTMatchesConnector(17, ColorSpace::sRGB(), ColorSpace::DisplayP3());
+    expectLUTMatchesConnector(17, ColorSpace::BT2020(), ColorSpace::ProPhotoRGB());
+    // Gamma transfer functions
+    expectLUTMatchesConnector(17, ColorSpace::AdobeRGB(), ColorSpace::DCIP3());
+    expectLUTMatchesConnector(17, ColorSpace::DisplayP3(), ColorSpace::linearExtendedSRGB());
+    // Custom transfer functions
+    expectLUTMatchesConnector(17, ColorSpace::extendedSRGB(), ColorSpace::linearSRGB());
+    // Large enough to be generated on several threads
+    expectLUTMatchesConnector(33, ColorSpace::sRGB(), ColorSpace::BT2020());
+}
+
+TEST_F(ColorSpaceTest, LUTIsCached) {
+    ColorSpace::purgeLUTCache();
+    auto first = ColorSpace::createLUT(17, ColorSpace::sRGB(), ColorSpace::DisplayP3());
+    auto second = ColorSpace::createLUT(17, ColorSpace::sRGB(), ColorSpace::DisplayP3());
+    ASSERT_NE(first.get(), second.get());
+    EXPECT_TRUE(std::equal(first.get(), first.get() + 17 * 17 * 17, second.get()));
+
+    // Color spaces that only differ by their clamping function get their own LUT
+    ColorSpace clamped("sRGB", ColorSpace::sRGB().getRGBtoXYZ(),
+                       ColorSpace::sRGB().getTransferParameters(),
+                       std::bind(clamp<float>, std::placeholders::_1, 0.0f, 0.5f));
+    auto third = ColorSpace::createLUT(17, ColorSpace::sRGB(), clamped);
+    EXPECT_EQ(0.5f, third.get()[16 * 17 * 17 + 16].r);
+    expectLUTMatchesConnector(17, ColorSpace::sRGB(), clamped);
+}
+
 }; // namespace android
@@ -111,7 +111,11 @@ bool BufferLayer::isOpaque(const Layer::State& s) const {
 }
 
 bool BufferLayer::isVisible() const {
-    return !isHiddenByPolicy() && getAlpha() > 0.0f &&
+    return isVisibleWithPolicy(isHiddenByPolicy(), getAlpha());
+}
+
+bool BufferLayer::isVisibleWithPolicy(bool hiddenByPolicy, half alpha) const {
+    return !hiddenByPolicy && alpha > 0.0f &&
             (mBufferInfo.mBuffer != nullptr || mSidebandStream != nullptr);
 }
 
@@ -67,6 +67,7 @@ public:
 
     // isVisible - true if this layer is visible, false otherwise
     bool isVisible() const override;
+    bool isVisibleWithPolicy(bool hiddenByPolicy, half alpha) const override;
 
     // isProtected - true if the layer may contain protected content in the
     // GRALLOC_USAGE_PROTECTED sense.
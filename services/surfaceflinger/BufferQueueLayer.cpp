@@ -81,7 +81,6 @@ void BufferQueueLayer::releasePendingBuffer(nsecs_t dequeueReadyTime) {
     }
 
     auto releaseFenceTime = std::make_shared<FenceTime>(mConsumer->getPrevFinalReleaseFence());
-    mReleaseTimeline.updateSignalTimes();
     mReleaseTimeline.push(releaseFenceTime);
 
     Mutex::Autolock lock(mFrameEventHistoryMutex);
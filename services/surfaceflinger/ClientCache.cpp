@@ -19,42 +19,73 @@
 #define LOG_TAG "ClientCache"
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
+#include <algorithm>
 #include <cinttypes>
 
+#include <android-base/stringprintf.h>
+#include <gui/ITransactionCompletedListener.h>
+#include <ui/GraphicBufferMapper.h>
+#include <ui/PixelFormat.h>
+
 #include "ClientCache.h"
 
 namespace android {
 
+using base::StringAppendF;
+
 ANDROID_SINGLETON_STATIC_INSTANCE(ClientCache);
 
 ClientCache::ClientCache() : mDeathRecipient(new CacheDeathRecipient) {}
 
-bool ClientCache::getBuffer(const client_cache_t& cacheId,
+size_t ClientCache::getShardIndex(const wp<IBinder>& processToken) {
+    // Binder objects are aligned, so the low bits of their address are always the same. Take the
+    // high bits of a multiplicative hash instead.
+    const auto address = reinterpret_cast<uintptr_t>(processToken.unsafe_get());
+    return static_cast<size_t>((uint64_t(address) * 0x9e3779b97f4a7c15ull) >> (64 - kShardBits));
+}
+
+ClientCache::Shard& ClientCache::getShard(const wp<IBinder>& processToken) {
+    return mShards[getShardIndex(processToken)];
+}
+
+bool ClientCache::getBuffer(Shard& shard, const client_cache_t& cacheId,
                             ClientCacheBuffer** outClientCacheBuffer) {
     auto& [processToken, id] = cacheId;
     if (processToken == nullptr) {
         ALOGE("failed to get buffer, invalid (nullptr) process token");
         return false;
     }
-    auto it = mBuffers.find(processToken);
-    if (it == mBuffers.end()) {
+    auto it = shard.processes.find(processToken);
+    if (it == shard.processes.end()) {
         ALOGE("failed to get buffer, invalid process token");
         return false;
     }
 
-    auto& processBuffers = it->second.second;
+    auto& processBuffers = it->second;
 
-    auto bufItr = processBuffers.find(id);
-    if (bufItr == processBuffers.end()) {
+    auto bufItr = processBuffers.buffers.find(id);
+    if (bufItr == processBuffers.buffers.end()) {
         ALOGE("failed to get buffer, invalid buffer id");
         return false;
     }
 
     ClientCacheBuffer& buf = bufItr->second;
+    buf.lastUsed = processBuffers.counter++;
     *outClientCacheBuffer = &buf;
     return true;
 }
 
+void ClientCache::collectRecipients(
+        const ClientCacheBuffer& buffer, const client_cache_t& cacheId,
+        std::vector<std::pair<sp<ErasedRecipient>, client_cache_t>>* outRecipients) {
+    for (auto& recipient : buffer.recipients) {
+        sp<ErasedRecipient> erasedRecipient = recipient.promote();
+        if (erasedRecipient) {
+            outRecipients->emplace_back(erasedRecipient, cacheId);
+        }
+    }
+}
+
 bool ClientCache::add(const client_cache_t& cacheId, const sp<GraphicBuffer>& buffer) {
     auto& [processToken, id] = cacheId;
     if (processToken == nullptr) {
@@ -67,74 +98,97 @@ bool ClientCache::add(const client_cache_t& cacheId, const sp<GraphicBuffer>& bu
         return false;
     }
 
-    std::lock_guard lock(mMutex);
-    sp<IBinder> token;
+    std::vector<std::pair<sp<ErasedRecipient>, client_cache_t>> pendingErase;
+    sp<IBinder> evictedFrom;
+    uint64_t evictedId = 0;
+    {
+        Shard& shard = getShard(processToken);
+        std::lock_guard lock(shard.mutex);
+
+        // If this is a new process token, set a death recipient. If the client process dies, we
+        // will get a callback through binderDied.
+        auto it = shard.processes.find(processToken);
+        if (it == shard.processes.end()) {
+            sp<IBinder> token = processToken.promote();
+            if (!token) {
+                ALOGE("failed to cache buffer: invalid token");
+                return false;
+            }
 
-    // If this is a new process token, set a death recipient. If the client process dies, we will
-    // get a callback through binderDied.
-    auto it = mBuffers.find(processToken);
-    if (it == mBuffers.end()) {
-        token = processToken.promote();
-        if (!token) {
-            ALOGE("failed to cache buffer: invalid token");
-            return false;
+            status_t err = token->linkToDeath(mDeathRecipient);
+            if (err != NO_ERROR) {
+                ALOGE("failed to cache buffer: could not link to death");
+                return false;
+            }
+            auto [itr, success] = shard.processes.emplace(processToken, ProcessBuffers{});
+            LOG_ALWAYS_FATAL_IF(!success, "failed to insert new process into client cache");
+            itr->second.token = token;
+            it = itr;
         }
 
-        status_t err = token->linkToDeath(mDeathRecipient);
-        if (err != NO_ERROR) {
-            ALOGE("failed to cache buffer: could not link to death");
-            return false;
+        auto& processBuffers = it->second;
+
+        // The client uncaches its least recently used buffer before it runs out of slots, so
+        // this only evicts for clients that do not keep their cache in step with ours.
+        if (processBuffers.buffers.size() > BUFFER_CACHE_MAX_SIZE &&
+            processBuffers.buffers.count(id) == 0) {
+            auto lru = std::min_element(processBuffers.buffers.begin(),
+                                        processBuffers.buffers.end(),
+                                        [](const auto& lhs, const auto& rhs) {
+                                            return lhs.second.lastUsed < rhs.second.lastUsed;
+                                        });
+            ALOGW("client cache is full, evicting buffer %" PRIu64, lru->first);
+            collectRecipients(lru->second, {processToken, lru->first}, &pendingErase);
+            evictedFrom = processBuffers.token;
+            evictedId = lru->first;
+            processBuffers.buffers.erase(lru);
+            processBuffers.evictedCount++;
         }
-        auto [itr, success] =
-                mBuffers.emplace(processToken,
-                                 std::make_pair(token,
-                                                std::unordered_map<uint64_t, ClientCacheBuffer>()));
-        LOG_ALWAYS_FATAL_IF(!success, "failed to insert new process into client cache");
-        it = itr;
-    }
 
-    auto& processBuffers = it->second.second;
-
-    if (processBuffers.size() > BUFFER_CACHE_MAX_SIZE) {
-        ALOGE("failed to cache buffer: cache is full");
-        return false;
+        ClientCacheBuffer& buf = processBuffers.buffers[id];
+        buf.buffer = buffer;
+        buf.lastUsed = processBuffers.counter++;
     }
 
-    processBuffers[id].buffer = buffer;
+    for (auto& [recipient, erasedCacheId] : pendingErase) {
+        recipient->bufferErased(erasedCacheId);
+    }
+    // The process token is the client's transaction completed listener. Tell it so that it caches
+    // the buffer again instead of sending its id. Transactions already in flight still reference
+    // the evicted id, and their buffer is dropped.
+    if (evictedFrom) {
+        interface_cast<ITransactionCompletedListener>(evictedFrom)->onBufferEvicted(evictedId);
+    }
     return true;
 }
 
 void ClientCache::erase(const client_cache_t& cacheId) {
     auto& [processToken, id] = cacheId;
-    std::vector<sp<ErasedRecipient>> pendingErase;
+    std::vector<std::pair<sp<ErasedRecipient>, client_cache_t>> pendingErase;
     {
-        std::lock_guard lock(mMutex);
+        Shard& shard = getShard(processToken);
+        std::lock_guard lock(shard.mutex);
         ClientCacheBuffer* buf = nullptr;
-        if (!getBuffer(cacheId, &buf)) {
+        if (!getBuffer(shard, cacheId, &buf)) {
             ALOGE("failed to erase buffer, could not retrieve buffer");
             return;
         }
 
-        for (auto& recipient : buf->recipients) {
-            sp<ErasedRecipient> erasedRecipient = recipient.promote();
-            if (erasedRecipient) {
-                pendingErase.push_back(erasedRecipient);
-            }
-        }
-
-        mBuffers[processToken].second.erase(id);
+        collectRecipients(*buf, cacheId, &pendingErase);
+        shard.processes[processToken].buffers.erase(id);
     }
 
-    for (auto& recipient : pendingErase) {
-        recipient->bufferErased(cacheId);
+    for (auto& [recipient, erasedCacheId] : pendingErase) {
+        recipient->bufferErased(erasedCacheId);
     }
 }
 
 sp<GraphicBuffer> ClientCache::get(const client_cache_t& cacheId) {
-    std::lock_guard lock(mMutex);
+    Shard& shard = getShard(cacheId.token);
+    std::lock_guard lock(shard.mutex);
 
     ClientCacheBuffer* buf = nullptr;
-    if (!getBuffer(cacheId, &buf)) {
+    if (!getBuffer(shard, cacheId, &buf)) {
         ALOGE("failed to get buffer, could not retrieve buffer");
         return nullptr;
     }
@@ -144,10 +198,11 @@ sp<GraphicBuffer> ClientCache::get(const client_cache_t& cacheId) {
 
 bool ClientCache::registerErasedRecipient(const client_cache_t& cacheId,
                                           const wp<ErasedRecipient>& recipient) {
-    std::lock_guard lock(mMutex);
+    Shard& shard = getShard(cacheId.token);
+    std::lock_guard lock(shard.mutex);
 
     ClientCacheBuffer* buf = nullptr;
-    if (!getBuffer(cacheId, &buf)) {
+    if (!getBuffer(shard, cacheId, &buf)) {
         ALOGE("failed to register erased recipient, could not retrieve buffer");
         return false;
     }
@@ -157,10 +212,11 @@ bool ClientCache::registerErasedRecipient(const client_cache_t& cacheId,
 
 void ClientCache::unregisterErasedRecipient(const client_cache_t& cacheId,
                                             const wp<ErasedRecipient>& recipient) {
-    std::lock_guard lock(mMutex);
+    Shard& shard = getShard(cacheId.token);
+    std::lock_guard lock(shard.mutex);
 
     ClientCacheBuffer* buf = nullptr;
-    if (!getBuffer(cacheId, &buf)) {
+    if (!getBuffer(shard, cacheId, &buf)) {
         ALOGE("failed to unregister erased recipient");
         return;
     }
@@ -175,23 +231,18 @@ void ClientCache::removeProcess(const wp<IBinder>& processToken) {
             ALOGE("failed to remove process, invalid (nullptr) process token");
             return;
         }
-        std::lock_guard lock(mMutex);
-        auto itr = mBuffers.find(processToken);
-        if (itr == mBuffers.end()) {
+        Shard& shard = getShard(processToken);
+        std::lock_guard lock(shard.mutex);
+        auto itr = shard.processes.find(processToken);
+        if (itr == shard.processes.end()) {
             ALOGE("failed to remove process, could not find process");
             return;
         }
 
-        for (auto& [id, clientCacheBuffer] : itr->second.second) {
-            client_cache_t cacheId = {processToken, id};
-            for (auto& recipient : clientCacheBuffer.recipients) {
-                sp<ErasedRecipient> erasedRecipient = recipient.promote();
-                if (erasedRecipient) {
-                    pendingErase.emplace_back(erasedRecipient, cacheId);
-                }
-            }
+        for (auto& [id, clientCacheBuffer] : itr->second.buffers) {
+            collectRecipients(clientCacheBuffer, {processToken, id}, &pendingErase);
         }
-        mBuffers.erase(itr);
+        shard.processes.erase(itr);
     }
 
     for (auto& [recipient, cacheId] : pendingErase) {
@@ -199,6 +250,44 @@ void ClientCache::removeProcess(const wp<IBinder>& processToken) {
     }
 }
 
+uint64_t ClientCache::getAllocationSize(const sp<GraphicBuffer>& buffer) {
+    uint64_t size = 0;
+    if (GraphicBufferMapper::get().getAllocationSize(buffer->getNativeBuffer()->handle, &size) ==
+        NO_ERROR) {
+        return size;
+    }
+
+    // Mappers before gralloc 4 cannot report the size. Estimate it from the buffer layout,
+    // counting formats without a fixed pixel size, such as YUV, as 12 bits per pixel.
+    const uint64_t pixels =
+            uint64_t(buffer->getStride()) * buffer->getHeight() * buffer->getLayerCount();
+    const uint64_t pixelSize = bytesPerPixel(buffer->getPixelFormat());
+    return pixelSize > 0 ? pixels * pixelSize : pixels * 3 / 2;
+}
+
+void ClientCache::dump(std::string& result) {
+    size_t totalBuffers = 0;
+    uint64_t totalBytes = 0;
+    std::string processes;
+    for (Shard& shard : mShards) {
+        std::lock_guard lock(shard.mutex);
+        for (const auto& [processToken, processBuffers] : shard.processes) {
+            uint64_t bytes = 0;
+            for (const auto& [id, clientCacheBuffer] : processBuffers.buffers) {
+                bytes += getAllocationSize(clientCacheBuffer.buffer);
+            }
+            StringAppendF(&processes, "  %p: %zu buffers (%.2f KiB), %" PRIu64 " evicted\n",
+                          processToken.unsafe_get(), processBuffers.buffers.size(),
+                          float(bytes) / 1024.0f, processBuffers.evictedCount);
+            totalBuffers += processBuffers.buffers.size();
+            totalBytes += bytes;
+        }
+    }
+    StringAppendF(&result, "Client buffer cache: %zu buffers (%.2f KiB)\n", totalBuffers,
+                  float(totalBytes) / 1024.0f);
+    result.append(processes);
+}
+
 void ClientCache::CacheDeathRecipient::binderDied(const wp<IBinder>& who) {
     ClientCache::getInstance().removeProcess(who);
 }
@@ -23,10 +23,13 @@
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 
+#include <array>
 #include <map>
 #include <mutex>
 #include <set>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #define BUFFER_CACHE_MAX_SIZE 64
 
@@ -36,6 +39,11 @@ class ClientCache : public Singleton<ClientCache> {
 public:
     ClientCache();
 
+    // Caches buffer for the caching process. The client side cache holds at most
+    // BUFFER_CACHE_MAX_SIZE buffers and uncaches its least recently used buffer to make room, so
+    // this cache keeps one more. If a process exceeds that, its least recently used buffer is
+    // evicted: the recipients registered for it are notified as if the buffer was erased, and
+    // the process is told through ITransactionCompletedListener::onBufferEvicted.
     bool add(const client_cache_t& cacheId, const sp<GraphicBuffer>& buffer);
     void erase(const client_cache_t& cacheId);
 
@@ -53,17 +61,36 @@ public:
     void unregisterErasedRecipient(const client_cache_t& cacheId,
                                    const wp<ErasedRecipient>& recipient);
 
+    void dump(std::string& result);
+
+    size_t getShardIndexForTest(const wp<IBinder>& processToken) const {
+        return getShardIndex(processToken);
+    }
+
 private:
-    std::mutex mMutex;
+    // Caching processes are spread over a fixed number of shards, so that transactions from
+    // different processes rarely contend on the same lock.
+    static constexpr size_t kShardBits = 3;
+    static constexpr size_t kShardCount = 1 << kShardBits;
 
     struct ClientCacheBuffer {
         sp<GraphicBuffer> buffer;
         std::set<wp<ErasedRecipient>> recipients;
+        uint64_t lastUsed = 0;
+    };
+
+    struct ProcessBuffers {
+        sp<IBinder> token; // strong ref to caching process
+        std::unordered_map<uint64_t /*cache id*/, ClientCacheBuffer> buffers;
+        uint64_t counter = 0;
+        uint64_t evictedCount = 0;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::map<wp<IBinder> /*caching process*/, ProcessBuffers> processes GUARDED_BY(mutex);
     };
-    std::map<wp<IBinder> /*caching process*/,
-             std::pair<sp<IBinder> /*strong ref to caching process*/,
-                       std::unordered_map<uint64_t /*cache id*/, ClientCacheBuffer>>>
-            mBuffers GUARDED_BY(mMutex);
+    std::array<Shard, kShardCount> mShards;
 
     class CacheDeathRecipient : public IBinder::DeathRecipient {
     public:
@@ -72,8 +99,14 @@ private:
 
     sp<CacheDeathRecipient> mDeathRecipient;
 
-    bool getBuffer(const client_cache_t& cacheId, ClientCacheBuffer** outClientCacheBuffer)
-            REQUIRES(mMutex);
+    static size_t getShardIndex(const wp<IBinder>& processToken);
+    Shard& getShard(const wp<IBinder>& processToken);
+    static bool getBuffer(Shard& shard, const client_cache_t& cacheId,
+                          ClientCacheBuffer** outClientCacheBuffer) REQUIRES(shard.mutex);
+    static uint64_t getAllocationSize(const sp<GraphicBuffer>& buffer);
+    static void collectRecipients(const ClientCacheBuffer& buffer, const client_cache_t& cacheId,
+                                  std::vector<std::pair<sp<ErasedRecipient>, client_cache_t>>*
+                                          outRecipients);
 };
 
 }; // namespace android
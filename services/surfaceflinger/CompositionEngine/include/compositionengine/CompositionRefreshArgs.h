@@ -61,6 +61,11 @@ struct CompositionRefreshArgs {
     // Used to correctly apply an inverse-display buffer transform if applicable
     ui::Transform::RotationFlags internalDisplayRotationFlags{ui::Transform::ROT_0};
 
+    // If true, HWC displays may assume the composition types accepted by the
+    // HWC for the previous frame still hold, and only check that assumption
+    // with a combined present-or-validate once the client target is ready.
+    bool predictCompositionStrategy{false};
+
     // If true, GPU clocks will be increased when rendering blurs
     bool blursAreExpensive{false};
 
@@ -79,7 +79,9 @@ public:
     // Prepares the frame for rendering
     virtual void prepareFrame(bool usesClientComposition, bool usesDeviceComposition) = 0;
 
-    // Allocates a buffer as scratch space for GPU composition
+    // Allocates a buffer as scratch space for GPU composition. If a buffer was
+    // already dequeued and not yet queued, it is returned again with no fence,
+    // so that the frame can be composed again without holding another buffer.
     virtual sp<GraphicBuffer> dequeueBuffer(base::unique_fd* bufferFence) = 0;
 
     // Queues the drawn buffer for consumption by HWC. readyFence is the fence
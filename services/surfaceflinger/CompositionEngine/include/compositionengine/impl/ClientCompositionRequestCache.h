@@ -18,6 +18,7 @@
 
 #include <cstdint>
 #include <deque>
+#include <string>
 
 #include <compositionengine/LayerFE.h>
 #include <renderengine/DisplaySettings.h>
@@ -37,6 +38,9 @@ namespace compositionengine::impl {
 // the composition request. We need to make sure the request, including the order of the
 // layers, do not change from call to call. The snapshot removes strong references to the
 // client buffer id so we don't extend the lifetime of the buffer by storing it in the cache.
+//
+// If only some layers of a request differ from what was rendered into the buffer, the cache
+// reports their bounds as damage, so that only that part of the buffer needs to be redrawn.
 class ClientCompositionRequestCache {
 public:
     explicit ClientCompositionRequestCache(uint32_t cacheSize) : mMaxCacheSize(cacheSize){};
@@ -47,8 +51,23 @@ public:
              const std::vector<LayerFE::LayerSettings>& layerSettings);
     void remove(uint64_t bufferId);
 
+    // Compares the request with the one rendered into bufferId. Returns false if the whole buffer
+    // has to be redrawn. Otherwise, outDamage is set to the bounds, in layer stack space, of the
+    // layers that differ, and is empty if the request matches.
+    bool getDamage(uint64_t bufferId, const renderengine::DisplaySettings& display,
+                   const std::vector<LayerFE::LayerSettings>& layerSettings, FloatRect* outDamage);
+
+    void dump(std::string& out) const;
+
 private:
     uint32_t mMaxCacheSize;
+
+    // Number of getDamage calls for which the request matched, partially matched, or could not
+    // be reused.
+    uint64_t mHits = 0;
+    uint64_t mPartialHits = 0;
+    uint64_t mMisses = 0;
+
     struct ClientCompositionRequest {
         renderengine::DisplaySettings display;
         std::vector<LayerFE::LayerSettings> layerSettings;
@@ -56,6 +75,9 @@ private:
                                  const std::vector<LayerFE::LayerSettings>& _layerSettings);
         bool equals(const renderengine::DisplaySettings& _display,
                     const std::vector<LayerFE::LayerSettings>& _layerSettings) const;
+        bool getDamage(const renderengine::DisplaySettings& _display,
+                       const std::vector<LayerFE::LayerSettings>& _layerSettings,
+                       FloatRect* outDamage) const;
     };
 
     // Cache of requests, keyed by corresponding GraphicBuffer ID.
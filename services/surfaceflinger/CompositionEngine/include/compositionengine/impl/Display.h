@@ -17,6 +17,8 @@
 #pragma once
 
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include <compositionengine/Display.h>
 #include <compositionengine/DisplayColorProfile.h>
@@ -46,6 +48,7 @@ public:
     std::optional<DisplayId> getDisplayId() const override;
     bool isValid() const override;
     void dump(std::string&) const override;
+    void present(const CompositionRefreshArgs&) override;
     using compositionengine::impl::Output::setReleasedLayers;
     void setReleasedLayers(const CompositionRefreshArgs&) override;
     void setColorTransform(const CompositionRefreshArgs&) override;
@@ -78,6 +81,17 @@ public:
     virtual void applyLayerRequestsToLayers(const LayerRequests&);
     virtual void applyClientTargetRequests(const ClientTargetProperty&);
 
+    // Internal helpers used when the composition strategy is predicted
+    virtual void updateCompositionStrategyPrediction(const CompositionRefreshArgs&);
+    virtual void predictCompositionStrategy();
+    // Validates the predicted strategy with the HWC and applies any changes it
+    // requests. Returns true if the client target must be composed again.
+    virtual bool validatePredictedCompositionStrategy();
+    // Returns the layers composed into the client target, and for each whether
+    // it is drawn (true) or only clears its area (false).
+    using ClientTargetContent = std::vector<std::pair<const compositionengine::OutputLayer*, bool>>;
+    virtual ClientTargetContent getClientTargetContent() const;
+
     // Internal
     virtual void setConfiguration(const compositionengine::DisplayCreationArgs&);
     virtual std::optional<DisplayId> maybeAllocateDisplayIdForVirtualDisplay(ui::Size,
@@ -91,6 +105,18 @@ private:
     bool mIsVirtual = false;
     std::optional<DisplayId> mId;
     Hwc2::PowerAdvisor* mPowerAdvisor = nullptr;
+
+    // Composition strategy prediction state. A prediction is only made if the
+    // HWC accepted the requested composition types without changes for the
+    // previous frame.
+    bool mCanPredictCompositionStrategy = false;
+    bool mLastCompositionStrategyAccepted = false;
+    bool mCompositionStrategyPredicted = false;
+    // The client target property the HWC requested for the last validated
+    // frame. HWC 2.4 devices may request the same one every frame.
+    ClientTargetProperty mLastClientTargetProperty;
+    uint64_t mCompositionStrategyPredictionHits = 0;
+    uint64_t mCompositionStrategyPredictionMisses = 0;
 };
 
 // This template factory function standardizes the implementation details of the
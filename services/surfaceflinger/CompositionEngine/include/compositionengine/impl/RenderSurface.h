@@ -70,6 +70,8 @@ public:
     base::unique_fd& mutableBufferReadyForTest();
 
 private:
+    void cancelPendingBuffer();
+
     const compositionengine::CompositionEngine& mCompositionEngine;
     const compositionengine::Display& mDisplay;
 
@@ -15,6 +15,9 @@
  */
 
 #include <algorithm>
+#include <cinttypes>
+
+#include <android-base/stringprintf.h>
 
 #include <compositionengine/impl/ClientCompositionRequestCache.h>
 #include <renderengine/DisplaySettings.h>
@@ -66,6 +69,35 @@ bool layerSettingsAreEqual(const LayerFE::LayerSettings& lhs, const LayerFE::Lay
             equalIgnoringBuffer(lhs, rhs);
 }
 
+// Returns the bounds of the layer in layer stack space.
+FloatRect getLayerStackBounds(const renderengine::LayerSettings& settings) {
+    const FloatRect& bounds = settings.geometry.boundaries;
+    const mat4& transform = settings.geometry.positionTransform;
+    const vec4 corners[] = {transform * vec4(bounds.left, bounds.top, 0, 1),
+                            transform * vec4(bounds.right, bounds.top, 0, 1),
+                            transform * vec4(bounds.left, bounds.bottom, 0, 1),
+                            transform * vec4(bounds.right, bounds.bottom, 0, 1)};
+    FloatRect result(corners[0].x, corners[0].y, corners[0].x, corners[0].y);
+    for (const vec4& corner : corners) {
+        result.left = std::min(result.left, corner.x);
+        result.top = std::min(result.top, corner.y);
+        result.right = std::max(result.right, corner.x);
+        result.bottom = std::max(result.bottom, corner.y);
+    }
+    return result;
+}
+
+FloatRect unionRects(const FloatRect& lhs, const FloatRect& rhs) {
+    if (lhs.isEmpty()) {
+        return rhs;
+    }
+    if (rhs.isEmpty()) {
+        return lhs;
+    }
+    return FloatRect(std::min(lhs.left, rhs.left), std::min(lhs.top, rhs.top),
+                     std::max(lhs.right, rhs.right), std::max(lhs.bottom, rhs.bottom));
+}
+
 } // namespace
 
 ClientCompositionRequestCache::ClientCompositionRequest::ClientCompositionRequest(
@@ -86,6 +118,35 @@ bool ClientCompositionRequestCache::ClientCompositionRequest::equals(
                        newLayerSettings.end(), layerSettingsAreEqual);
 }
 
+bool ClientCompositionRequestCache::ClientCompositionRequest::getDamage(
+        const renderengine::DisplaySettings& newDisplay,
+        const std::vector<LayerFE::LayerSettings>& newLayerSettings, FloatRect* outDamage) const {
+    if (!(newDisplay == display) || newLayerSettings.size() != layerSettings.size()) {
+        return false;
+    }
+
+    FloatRect damage;
+    for (size_t i = 0; i < layerSettings.size(); i++) {
+        const LayerFE::LayerSettings& cachedLayer = layerSettings[i];
+        const LayerFE::LayerSettings& newLayer = newLayerSettings[i];
+        // Blurs sample everything below them, so any change may affect the whole buffer.
+        if (newLayer.backgroundBlurRadius > 0) {
+            return false;
+        }
+        if (layerSettingsAreEqual(cachedLayer, newLayer)) {
+            continue;
+        }
+        // Shadows are drawn outside of the layer bounds.
+        if (cachedLayer.shadow.length > 0.0f || newLayer.shadow.length > 0.0f) {
+            return false;
+        }
+        damage = unionRects(damage, getLayerStackBounds(cachedLayer));
+        damage = unionRects(damage, getLayerStackBounds(newLayer));
+    }
+    *outDamage = damage;
+    return true;
+}
+
 bool ClientCompositionRequestCache::exists(
         uint64_t bufferId, const renderengine::DisplaySettings& display,
         const std::vector<LayerFE::LayerSettings>& layerSettings) const {
@@ -97,6 +158,27 @@ bool ClientCompositionRequestCache::exists(
     return false;
 }
 
+bool ClientCompositionRequestCache::getDamage(
+        uint64_t bufferId, const renderengine::DisplaySettings& display,
+        const std::vector<LayerFE::LayerSettings>& layerSettings, FloatRect* outDamage) {
+    for (const auto& [cachedBufferId, cachedRequest] : mCache) {
+        if (cachedBufferId != bufferId) {
+            continue;
+        }
+        if (!cachedRequest.getDamage(display, layerSettings, outDamage)) {
+            break;
+        }
+        if (outDamage->isEmpty()) {
+            mHits++;
+        } else {
+            mPartialHits++;
+        }
+        return true;
+    }
+    mMisses++;
+    return false;
+}
+
 void ClientCompositionRequestCache::add(uint64_t bufferId,
                                         const renderengine::DisplaySettings& display,
                                         const std::vector<LayerFE::LayerSettings>& layerSettings) {
@@ -124,4 +206,11 @@ void ClientCompositionRequestCache::remove(uint64_t bufferId) {
     }
 }
 
+void ClientCompositionRequestCache::dump(std::string& out) const {
+    android::base::StringAppendF(&out,
+                                 "    Client composition cache: hits=%" PRIu64 " partial=%" PRIu64
+                                 " misses=%" PRIu64 "\n",
+                                 mHits, mPartialHits, mMisses);
+}
+
 } // namespace android::compositionengine::impl
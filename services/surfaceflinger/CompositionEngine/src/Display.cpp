@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <cinttypes>
+
 #include <android-base/stringprintf.h>
 #include <compositionengine/CompositionEngine.h>
 #include <compositionengine/CompositionRefreshArgs.h>
@@ -41,6 +43,22 @@
 
 namespace android::compositionengine::impl {
 
+namespace {
+
+bool isSameClientTargetProperty(const Display::ClientTargetProperty& lhs,
+                                const Display::ClientTargetProperty& rhs) {
+    return lhs.pixelFormat == rhs.pixelFormat && lhs.dataspace == rhs.dataspace;
+}
+
+bool hasDeviceRequestedChanges(const android::HWComposer::DeviceRequestedChanges& changes,
+                               const Display::ClientTargetProperty& lastClientTargetProperty) {
+    return !changes.changedTypes.empty() || static_cast<uint32_t>(changes.displayRequests) != 0 ||
+            !changes.layerRequests.empty() ||
+            !isSameClientTargetProperty(changes.clientTargetProperty, lastClientTargetProperty);
+}
+
+} // namespace
+
 std::shared_ptr<Display> createDisplay(
         const compositionengine::CompositionEngine& compositionEngine,
         const compositionengine::DisplayCreationArgs& args) {
@@ -159,9 +177,19 @@ void Display::dump(std::string& out) const {
 
     out.append("\n");
 
+    if (mId && !mIsVirtual) {
+        StringAppendF(&out, "   strategyPredictionHits=%" PRIu64 " misses=%" PRIu64 "\n",
+                      mCompositionStrategyPredictionHits, mCompositionStrategyPredictionMisses);
+    }
+
     Output::dumpBase(out);
 }
 
+void Display::present(const compositionengine::CompositionRefreshArgs& refreshArgs) {
+    updateCompositionStrategyPrediction(refreshArgs);
+    impl::Output::present(refreshArgs);
+}
+
 void Display::createDisplayColorProfile(const DisplayColorProfileCreationArgs& args) {
     setDisplayColorProfile(compositionengine::impl::createDisplayColorProfile(args));
 }
@@ -245,6 +273,11 @@ void Display::chooseCompositionStrategy() {
         return;
     }
 
+    if (mCanPredictCompositionStrategy) {
+        predictCompositionStrategy();
+        return;
+    }
+
     // Get any composition changes requested by the HWC device, and apply them.
     std::optional<android::HWComposer::DeviceRequestedChanges> changes;
     auto& hwc = getCompositionEngine().getHwComposer();
@@ -253,9 +286,13 @@ void Display::chooseCompositionStrategy() {
         result != NO_ERROR) {
         ALOGE("chooseCompositionStrategy failed for %s: %d (%s)", getName().c_str(), result,
               strerror(-result));
+        mLastCompositionStrategyAccepted = false;
         return;
     }
+    mLastCompositionStrategyAccepted =
+            !changes || !hasDeviceRequestedChanges(*changes, mLastClientTargetProperty);
     if (changes) {
+        mLastClientTargetProperty = changes->clientTargetProperty;
         applyChangedTypesToLayers(changes->changedTypes);
         applyDisplayRequests(changes->displayRequests);
         applyLayerRequestsToLayers(changes->layerRequests);
@@ -268,6 +305,106 @@ void Display::chooseCompositionStrategy() {
     state.usesDeviceComposition = !allLayersRequireClientComposition();
 }
 
+void Display::updateCompositionStrategyPrediction(
+        const compositionengine::CompositionRefreshArgs& refreshArgs) {
+    // The composition strategy is only predicted for physical HWC displays
+    // when nothing that would invalidate the previous frame's strategy has
+    // changed. Virtual displays are excluded as their DisplaySurface state
+    // machine does not support preparing the same frame twice.
+    mCanPredictCompositionStrategy = refreshArgs.predictCompositionStrategy && mId &&
+            !mIsVirtual && mLastCompositionStrategyAccepted &&
+            !refreshArgs.updatingGeometryThisFrame && !refreshArgs.devOptFlashDirtyRegionsDelay;
+}
+
+void Display::predictCompositionStrategy() {
+    ATRACE_CALL();
+
+    // Assume the HWC accepts the requested composition types, as it did for
+    // the previous frame, with no display or layer requests. The HWC is not
+    // asked until validatePredictedCompositionStrategy() runs in
+    // finishFrame(), after the client target composition has been started.
+    mCompositionStrategyPredicted = true;
+    applyDisplayRequests(static_cast<DisplayRequests>(0));
+    applyLayerRequestsToLayers({});
+
+    auto& state = editState();
+    state.usesClientComposition = anyLayersRequireClientComposition();
+    state.usesDeviceComposition = !allLayersRequireClientComposition();
+}
+
+bool Display::validatePredictedCompositionStrategy() {
+    ATRACE_CALL();
+    mCompositionStrategyPredicted = false;
+
+    // This is the same validation chooseCompositionStrategy() does, only run
+    // while the GPU composes the client target rather than before.
+    std::optional<android::HWComposer::DeviceRequestedChanges> changes;
+    auto& hwc = getCompositionEngine().getHwComposer();
+    if (status_t result = hwc.getDeviceCompositionChanges(*mId, anyLayersRequireClientComposition(),
+                                                          &changes);
+        result != NO_ERROR) {
+        ALOGE("validatePredictedCompositionStrategy failed for %s: %d (%s)", getName().c_str(),
+              result, strerror(-result));
+        mCompositionStrategyPredictionMisses++;
+        mLastCompositionStrategyAccepted = false;
+        return false;
+    }
+
+    if (!changes || !hasDeviceRequestedChanges(*changes, mLastClientTargetProperty)) {
+        mCompositionStrategyPredictionHits++;
+        return false;
+    }
+
+    // The prediction was wrong. The HWC has already validated the strategy it
+    // asked for, so only the client target may need to change to match.
+    ALOGV("Composition strategy misprediction for %s", getName().c_str());
+    mCompositionStrategyPredictionMisses++;
+    mLastCompositionStrategyAccepted = false;
+
+    auto& state = editState();
+    const bool predictedClientComposition = state.usesClientComposition;
+    const bool predictedDeviceComposition = state.usesDeviceComposition;
+    const bool predictedFlipClientTarget = state.flipClientTarget;
+    const auto predictedContent = getClientTargetContent();
+    const bool clientTargetPropertyChanged =
+            !isSameClientTargetProperty(changes->clientTargetProperty, mLastClientTargetProperty);
+
+    mLastClientTargetProperty = changes->clientTargetProperty;
+    applyChangedTypesToLayers(changes->changedTypes);
+    applyDisplayRequests(changes->displayRequests);
+    applyLayerRequestsToLayers(changes->layerRequests);
+    applyClientTargetRequests(changes->clientTargetProperty);
+
+    state.usesClientComposition = anyLayersRequireClientComposition();
+    state.usesDeviceComposition = !allLayersRequireClientComposition();
+
+    if (state.usesClientComposition != predictedClientComposition ||
+        state.usesDeviceComposition != predictedDeviceComposition) {
+        getRenderSurface()->prepareFrame(state.usesClientComposition, state.usesDeviceComposition);
+    }
+
+    // The client target composed for the prediction is kept unless what it
+    // holds has changed. This is usually the case when the HWC only changed
+    // requests for layers it composes itself.
+    return clientTargetPropertyChanged || state.flipClientTarget != predictedFlipClientTarget ||
+            getClientTargetContent() != predictedContent;
+}
+
+Display::ClientTargetContent Display::getClientTargetContent() const {
+    ClientTargetContent content;
+    if (!getState().usesClientComposition) {
+        return content;
+    }
+    for (const auto* layer : getOutputLayersOrderedByZ()) {
+        if (layer->requiresClientComposition()) {
+            content.emplace_back(layer, true);
+        } else if (layer->getState().clearClientTarget) {
+            content.emplace_back(layer, false);
+        }
+    }
+    return content;
+}
+
 bool Display::getSkipColorTransform() const {
     const auto& hwc = getCompositionEngine().getHwComposer();
     return mId ? hwc.hasDisplayCapability(*mId, hal::DisplayCapability::SKIP_CLIENT_COLOR_TRANSFORM)
@@ -384,7 +521,27 @@ void Display::finishFrame(const compositionengine::CompositionRefreshArgs& refre
         }
     }
 
-    impl::Output::finishFrame(refreshArgs);
+    if (!mCompositionStrategyPredicted) {
+        impl::Output::finishFrame(refreshArgs);
+        return;
+    }
+
+    // With a predicted strategy, the client target is composed before the HWC
+    // validates it, so that the GPU works while the HWC does. It is only
+    // queued once the strategy is known, as queueing it hands it to the HWC
+    // and advances the DisplaySurface to the next frame. A misprediction
+    // composes again into the buffer that is already dequeued.
+    const bool isEnabled = getState().isEnabled;
+    std::optional<base::unique_fd> optReadyFence;
+    if (isEnabled) {
+        optReadyFence = composeSurfaces(Region::INVALID_REGION, refreshArgs);
+    }
+    if (validatePredictedCompositionStrategy() && isEnabled) {
+        optReadyFence = composeSurfaces(Region::INVALID_REGION, refreshArgs);
+    }
+    if (optReadyFence) {
+        getRenderSurface()->queueBuffer(std::move(*optReadyFence));
+    }
 }
 
 } // namespace android::compositionengine::impl
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <cmath>
 #include <thread>
 
 #include <android-base/stringprintf.h>
@@ -200,6 +201,10 @@ void Output::dumpBase(std::string& out) const {
         out.append("    No render surface!\n");
     }
 
+    if (mClientCompositionRequestCache) {
+        mClientCompositionRequestCache->dump(out);
+    }
+
     android::base::StringAppendF(&out, "\n   %zu Layers\n", getOutputLayerCount());
     for (const auto* outputLayer : getOutputLayersOrderedByZ()) {
         if (!outputLayer) {
@@ -887,16 +892,28 @@ std::optional<base::unique_fd> Output::composeSurfaces(
     appendRegionFlashRequests(debugRegion, clientCompositionLayers);
 
     // Check if the client composition requests were rendered into the provided graphic buffer. If
-    // so, we can reuse the buffer and avoid client composition.
+    // so, we can reuse the buffer and avoid client composition. If only some of the layers
+    // changed, only the part of the buffer they cover needs to be redrawn.
     if (mClientCompositionRequestCache) {
-        if (mClientCompositionRequestCache->exists(buf->getId(), clientCompositionDisplay,
-                                                   clientCompositionLayers)) {
+        FloatRect damage;
+        const bool canReuseBuffer =
+                mClientCompositionRequestCache->getDamage(buf->getId(), clientCompositionDisplay,
+                                                          clientCompositionLayers, &damage);
+        if (canReuseBuffer && damage.isEmpty()) {
             outputCompositionState.reusedClientComposition = true;
             setExpensiveRenderingExpected(false);
             return readyFence;
         }
         mClientCompositionRequestCache->add(buf->getId(), clientCompositionDisplay,
                                             clientCompositionLayers);
+        if (canReuseBuffer) {
+            const FloatRect displayDamage = outputState.transform.transform(damage);
+            const Rect damageRect(static_cast<int32_t>(std::floor(displayDamage.left)),
+                                  static_cast<int32_t>(std::floor(displayDamage.top)),
+                                  static_cast<int32_t>(std::ceil(displayDamage.right)),
+                                  static_cast<int32_t>(std::ceil(displayDamage.bottom)));
+            damageRect.intersect(outputState.destinationClip, &clientCompositionDisplay.damage);
+        }
     }
 
     // We boost GPU frequency here because there will be color spaces conversion
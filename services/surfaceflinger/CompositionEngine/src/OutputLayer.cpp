@@ -504,7 +504,7 @@ void OutputLayer::writeSolidColorStateToHWC(HWC2::Layer* hwcLayer,
 
 void OutputLayer::writeSidebandStateToHWC(HWC2::Layer* hwcLayer,
                                           const LayerFECompositionState& outputIndependentState) {
-    if (auto error = hwcLayer->setSidebandStream(outputIndependentState.sidebandStream->handle());
+    if (auto error = hwcLayer->setSidebandStream(outputIndependentState.sidebandStream);
         error != hal::Error::NONE) {
         ALOGE("[%s] Failed to set sideband stream %p: %s (%d)", getLayerFE().getDebugName(),
               outputIndependentState.sidebandStream->handle(), to_string(error).c_str(),
@@ -81,8 +81,9 @@ void RenderSurface::initialize() {
     ALOGE_IF(status != NO_ERROR, "Unable to connect BQ producer: %d", status);
     status = native_window_set_buffers_format(window, HAL_PIXEL_FORMAT_RGBA_8888);
     ALOGE_IF(status != NO_ERROR, "Unable to set BQ format to RGBA888: %d", status);
-    status = native_window_set_usage(window, GRALLOC_USAGE_HW_RENDER);
-    ALOGE_IF(status != NO_ERROR, "Unable to set BQ usage bits for GPU rendering: %d", status);
+    status = native_window_set_usage(window,
+                                     mCompositionEngine.getRenderEngine().getOutputBufferUsage());
+    ALOGE_IF(status != NO_ERROR, "Unable to set BQ usage bits for rendering: %d", status);
 }
 
 const ui::Size& RenderSurface::getSize() const {
@@ -94,6 +95,11 @@ const sp<Fence>& RenderSurface::getClientTargetAcquireFence() const {
 }
 
 void RenderSurface::setDisplaySize(const ui::Size& size) {
+    if (mGraphicBuffer != nullptr &&
+        (static_cast<int32_t>(mGraphicBuffer->getWidth()) != size.width ||
+         static_cast<int32_t>(mGraphicBuffer->getHeight()) != size.height)) {
+        cancelPendingBuffer();
+    }
     mDisplaySurface->resizeBuffers(static_cast<uint32_t>(size.width),
                                    static_cast<uint32_t>(size.height));
     mSize = size;
@@ -105,21 +111,38 @@ void RenderSurface::setBufferDataspace(ui::Dataspace dataspace) {
 }
 
 void RenderSurface::setBufferPixelFormat(ui::PixelFormat pixelFormat) {
+    if (mGraphicBuffer != nullptr &&
+        static_cast<ui::PixelFormat>(mGraphicBuffer->getPixelFormat()) != pixelFormat) {
+        cancelPendingBuffer();
+    }
     native_window_set_buffers_format(mNativeWindow.get(), static_cast<int32_t>(pixelFormat));
 }
 
 void RenderSurface::setProtected(bool useProtected) {
-    uint64_t usageFlags = GRALLOC_USAGE_HW_RENDER;
+    uint64_t usageFlags = mCompositionEngine.getRenderEngine().getOutputBufferUsage();
     if (useProtected) {
         usageFlags |= GRALLOC_USAGE_PROTECTED;
     }
     const int status = native_window_set_usage(mNativeWindow.get(), usageFlags);
     ALOGE_IF(status != NO_ERROR, "Unable to set BQ usage bits for protected content: %d", status);
     if (status == NO_ERROR) {
+        if (useProtected != mProtected) {
+            cancelPendingBuffer();
+        }
         mProtected = useProtected;
     }
 }
 
+void RenderSurface::cancelPendingBuffer() {
+    // A buffer dequeued for a frame that was not queued no longer matches the
+    // buffers the window hands out, so it is not composed into again.
+    if (mGraphicBuffer == nullptr) {
+        return;
+    }
+    mNativeWindow->cancelBuffer(mNativeWindow.get(), mGraphicBuffer->getNativeBuffer(), -1);
+    mGraphicBuffer = nullptr;
+}
+
 status_t RenderSurface::beginFrame(bool mustRecompose) {
     return mDisplaySurface->beginFrame(mustRecompose);
 }
@@ -147,6 +170,11 @@ void RenderSurface::prepareFrame(bool usesClientComposition, bool usesDeviceComp
 
 sp<GraphicBuffer> RenderSurface::dequeueBuffer(base::unique_fd* bufferFence) {
     ATRACE_CALL();
+    if (mGraphicBuffer != nullptr) {
+        bufferFence->reset();
+        return mGraphicBuffer;
+    }
+
     int fd = -1;
     ANativeWindowBuffer* buffer = nullptr;
 
@@ -160,8 +188,6 @@ sp<GraphicBuffer> RenderSurface::dequeueBuffer(base::unique_fd* bufferFence) {
         return mGraphicBuffer;
     }
 
-    ALOGW_IF(mGraphicBuffer != nullptr, "Clobbering a non-null pointer to a buffer [%p].",
-             mGraphicBuffer->getNativeBuffer()->handle);
     mGraphicBuffer = GraphicBuffer::from(buffer);
 
     *bufferFence = base::unique_fd(fd);
@@ -124,6 +124,7 @@ struct DisplayTestCommon : public testing::Test {
         MOCK_METHOD1(applyChangedTypesToLayers, void(const impl::Display::ChangedTypes&));
         MOCK_METHOD1(applyDisplayRequests, void(const impl::Display::DisplayRequests&));
         MOCK_METHOD1(applyLayerRequestsToLayers, void(const impl::Display::LayerRequests&));
+        MOCK_CONST_METHOD0(getClientTargetContent, impl::Display::ClientTargetContent());
 
         const compositionengine::CompositionEngine& mCompositionEngine;
         impl::OutputCompositionState mState;
@@ -682,6 +683,257 @@ TEST_F(DisplayChooseCompositionStrategyTest, normalOperationWithChanges) {
     EXPECT_TRUE(state.usesDeviceComposition);
 }
 
+/*
+ * Display::chooseCompositionStrategy() with composition strategy prediction
+ */
+
+struct DisplayPredictCompositionStrategyTest : public PartialMockDisplayTestCommon {
+    DisplayPredictCompositionStrategyTest() {
+        mRefreshArgs.predictCompositionStrategy = true;
+
+        mDisplay->setRenderSurfaceForTest(std::unique_ptr<RenderSurface>(mRenderSurface));
+
+        EXPECT_CALL(*mDisplay, anyLayersRequireClientComposition()).WillRepeatedly(Return(true));
+        EXPECT_CALL(*mDisplay, allLayersRequireClientComposition()).WillRepeatedly(Return(false));
+    }
+
+    // Runs a frame where the HWC accepts the requested composition strategy,
+    // which allows the strategy for the following frame to be predicted.
+    void chooseAcceptedCompositionStrategy() {
+        EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, true, _))
+                .WillOnce(Return(NO_ERROR));
+
+        mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+        mDisplay->chooseCompositionStrategy();
+    }
+
+    void expectPrediction() {
+        EXPECT_CALL(*mDisplay, applyDisplayRequests(static_cast<hal::DisplayRequest>(0)))
+                .Times(1);
+        EXPECT_CALL(*mDisplay, applyLayerRequestsToLayers(_)).Times(1);
+    }
+
+    mock::RenderSurface* mRenderSurface = new StrictMock<mock::RenderSurface>();
+    CompositionRefreshArgs mRefreshArgs;
+};
+
+TEST_F(DisplayPredictCompositionStrategyTest, doesNotPredictWithoutAnAcceptedFrame) {
+    EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, true, _))
+            .WillOnce(Return(NO_ERROR));
+
+    mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+    mDisplay->chooseCompositionStrategy();
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, predictsAfterAnAcceptedFrame) {
+    chooseAcceptedCompositionStrategy();
+
+    expectPrediction();
+
+    mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+    mDisplay->chooseCompositionStrategy();
+
+    auto& state = mDisplay->getState();
+    EXPECT_TRUE(state.usesClientComposition);
+    EXPECT_TRUE(state.usesDeviceComposition);
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, doesNotPredictIfDisabled) {
+    chooseAcceptedCompositionStrategy();
+
+    mRefreshArgs.predictCompositionStrategy = false;
+    chooseAcceptedCompositionStrategy();
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, doesNotPredictIfGeometryChanged) {
+    chooseAcceptedCompositionStrategy();
+
+    mRefreshArgs.updatingGeometryThisFrame = true;
+    chooseAcceptedCompositionStrategy();
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, doesNotPredictAfterDeviceRequestedChanges) {
+    android::HWComposer::DeviceRequestedChanges changes{
+            {{nullptr, hal::Composition::CLIENT}},
+            static_cast<hal::DisplayRequest>(0),
+            {},
+            {hal::PixelFormat::RGBA_8888, hal::Dataspace::UNKNOWN},
+    };
+
+    EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, true, _))
+            .WillOnce(DoAll(SetArgPointee<2>(changes), Return(NO_ERROR)));
+    EXPECT_CALL(*mDisplay, applyChangedTypesToLayers(changes.changedTypes)).Times(1);
+    EXPECT_CALL(*mDisplay, applyDisplayRequests(changes.displayRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, applyLayerRequestsToLayers(changes.layerRequests)).Times(1);
+
+    mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+    mDisplay->chooseCompositionStrategy();
+
+    chooseAcceptedCompositionStrategy();
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, keepsPredictingOnHit) {
+    chooseAcceptedCompositionStrategy();
+
+    for (int frame = 0; frame < 2; frame++) {
+        expectPrediction();
+        EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, true, _))
+                .WillOnce(Return(NO_ERROR));
+
+        mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+        mDisplay->chooseCompositionStrategy();
+        EXPECT_FALSE(mDisplay->validatePredictedCompositionStrategy());
+    }
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, appliesChangesAndStopsPredictingOnMiss) {
+    android::HWComposer::DeviceRequestedChanges changes{
+            {{nullptr, hal::Composition::CLIENT}},
+            hal::DisplayRequest::FLIP_CLIENT_TARGET,
+            {{nullptr, hal::LayerRequest::CLEAR_CLIENT_TARGET}},
+            {},
+    };
+
+    chooseAcceptedCompositionStrategy();
+
+    expectPrediction();
+    mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+    mDisplay->chooseCompositionStrategy();
+
+    EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, true, _))
+            .WillOnce(DoAll(SetArgPointee<2>(changes), Return(NO_ERROR)));
+    EXPECT_CALL(*mDisplay, applyChangedTypesToLayers(changes.changedTypes)).Times(1);
+    EXPECT_CALL(*mDisplay, applyDisplayRequests(changes.displayRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, applyLayerRequestsToLayers(changes.layerRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, getClientTargetContent())
+            .WillRepeatedly(Return(impl::Display::ClientTargetContent{}));
+
+    mDisplay->validatePredictedCompositionStrategy();
+
+    chooseAcceptedCompositionStrategy();
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, keepsClientTargetIfUnchangedOnMiss) {
+    android::HWComposer::DeviceRequestedChanges changes{
+            {},
+            static_cast<hal::DisplayRequest>(0),
+            {{nullptr, hal::LayerRequest::CLEAR_CLIENT_TARGET}},
+            {},
+    };
+    const impl::Display::ClientTargetContent content{{nullptr, true}};
+
+    chooseAcceptedCompositionStrategy();
+
+    expectPrediction();
+    mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+    mDisplay->chooseCompositionStrategy();
+
+    // Neither the composition types nor the client target content change, so
+    // the render surface is neither prepared nor composed again.
+    EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, true, _))
+            .WillOnce(DoAll(SetArgPointee<2>(changes), Return(NO_ERROR)));
+    EXPECT_CALL(*mDisplay, applyChangedTypesToLayers(changes.changedTypes)).Times(1);
+    EXPECT_CALL(*mDisplay, applyDisplayRequests(changes.displayRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, applyLayerRequestsToLayers(changes.layerRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, getClientTargetContent()).Times(2).WillRepeatedly(Return(content));
+
+    EXPECT_FALSE(mDisplay->validatePredictedCompositionStrategy());
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, preparesRenderSurfaceForChangedTypesOnMiss) {
+    android::HWComposer::DeviceRequestedChanges changes{
+            {{nullptr, hal::Composition::CLIENT}},
+            static_cast<hal::DisplayRequest>(0),
+            {},
+            {},
+    };
+
+    chooseAcceptedCompositionStrategy();
+
+    // Predict a frame with no client composition.
+    EXPECT_CALL(*mDisplay, anyLayersRequireClientComposition()).WillRepeatedly(Return(false));
+    expectPrediction();
+    mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+    mDisplay->chooseCompositionStrategy();
+
+    EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, true, _))
+            .WillOnce(DoAll(SetArgPointee<2>(changes), Return(NO_ERROR)));
+    EXPECT_CALL(*mDisplay, applyChangedTypesToLayers(changes.changedTypes)).Times(1);
+    EXPECT_CALL(*mDisplay, applyDisplayRequests(changes.displayRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, applyLayerRequestsToLayers(changes.layerRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, anyLayersRequireClientComposition()).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mDisplay, getClientTargetContent())
+            .WillOnce(Return(impl::Display::ClientTargetContent{}))
+            .WillOnce(Return(impl::Display::ClientTargetContent{{nullptr, true}}));
+    EXPECT_CALL(*mRenderSurface, prepareFrame(true, true)).Times(1);
+
+    EXPECT_TRUE(mDisplay->validatePredictedCompositionStrategy());
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, composesAgainButQueuesOnceOnMiss) {
+    android::HWComposer::DeviceRequestedChanges changes{
+            {{nullptr, hal::Composition::DEVICE}},
+            static_cast<hal::DisplayRequest>(0),
+            {},
+            {},
+    };
+
+    chooseAcceptedCompositionStrategy();
+
+    // Predict a frame with no client composition, so that composing the
+    // client target only signals that no expensive rendering is expected.
+    EXPECT_CALL(*mDisplay, anyLayersRequireClientComposition()).WillRepeatedly(Return(false));
+    expectPrediction();
+    mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+    mDisplay->chooseCompositionStrategy();
+    mDisplay->editState().isEnabled = true;
+
+    EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, false, _))
+            .WillOnce(DoAll(SetArgPointee<2>(changes), Return(NO_ERROR)));
+    EXPECT_CALL(*mDisplay, applyChangedTypesToLayers(changes.changedTypes)).Times(1);
+    EXPECT_CALL(*mDisplay, applyDisplayRequests(changes.displayRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, applyLayerRequestsToLayers(changes.layerRequests)).Times(1);
+    EXPECT_CALL(*mDisplay, getClientTargetContent())
+            .WillOnce(Return(impl::Display::ClientTargetContent{}))
+            .WillOnce(Return(impl::Display::ClientTargetContent{{nullptr, false}}));
+
+    // The client target is composed for the prediction and again for the
+    // strategy the HWC asked for, but only queued once.
+    EXPECT_CALL(mPowerAdvisor, setExpensiveRenderingExpected(DEFAULT_DISPLAY_ID, false)).Times(2);
+    EXPECT_CALL(*mRenderSurface, queueBuffer(_)).Times(1);
+
+    mDisplay->finishFrame(mRefreshArgs);
+}
+
+TEST_F(DisplayPredictCompositionStrategyTest, predictsWithUnchangedClientTargetProperty) {
+    android::HWComposer::DeviceRequestedChanges changes{
+            {},
+            static_cast<hal::DisplayRequest>(0),
+            {},
+            {hal::PixelFormat::RGBA_8888, hal::Dataspace::DISPLAY_P3},
+    };
+
+    // HWC 2.4 devices may request the same client target property for every
+    // frame. Only a change in it prevents a prediction.
+    EXPECT_CALL(mHwComposer, getDeviceCompositionChanges(DEFAULT_DISPLAY_ID, true, _))
+            .Times(2)
+            .WillRepeatedly(DoAll(SetArgPointee<2>(changes), Return(NO_ERROR)));
+    EXPECT_CALL(*mDisplay, applyChangedTypesToLayers(changes.changedTypes)).Times(2);
+    EXPECT_CALL(*mDisplay, applyDisplayRequests(changes.displayRequests)).Times(2);
+    EXPECT_CALL(*mDisplay, applyLayerRequestsToLayers(changes.layerRequests)).Times(2);
+    EXPECT_CALL(*mRenderSurface, setBufferDataspace(ui::Dataspace::DISPLAY_P3)).Times(2);
+    EXPECT_CALL(*mRenderSurface, setBufferPixelFormat(ui::PixelFormat::RGBA_8888)).Times(2);
+
+    for (int frame = 0; frame < 2; frame++) {
+        mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+        mDisplay->chooseCompositionStrategy();
+    }
+
+    expectPrediction();
+    mDisplay->updateCompositionStrategyPrediction(mRefreshArgs);
+    mDisplay->chooseCompositionStrategy();
+}
+
 /*
  * Display::getSkipColorTransform()
  */
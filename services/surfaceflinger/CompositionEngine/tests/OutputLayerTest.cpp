@@ -778,7 +778,7 @@ struct OutputLayerWriteStateToHWCTest : public OutputLayerTest {
     }
 
     void expectSetSidebandHandleCall() {
-        EXPECT_CALL(*mHwcLayer, setSidebandStream(kSidebandStreamHandle));
+        EXPECT_CALL(*mHwcLayer, setSidebandStream(mLayerFEState.sidebandStream));
     }
 
     void expectSetHdrMetadataAndBufferCalls() {
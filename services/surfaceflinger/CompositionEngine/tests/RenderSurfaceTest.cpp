@@ -51,6 +51,8 @@ public:
         EXPECT_CALL(mDisplay, getId()).WillRepeatedly(ReturnRef(DEFAULT_DISPLAY_ID));
         EXPECT_CALL(mDisplay, getName()).WillRepeatedly(ReturnRef(DEFAULT_DISPLAY_NAME));
         EXPECT_CALL(mCompositionEngine, getRenderEngine).WillRepeatedly(ReturnRef(mRenderEngine));
+        EXPECT_CALL(mRenderEngine, getOutputBufferUsage())
+                .WillRepeatedly(Return(GRALLOC_USAGE_HW_RENDER));
         EXPECT_CALL(*mNativeWindow, disconnect(NATIVE_WINDOW_API_EGL))
                 .WillRepeatedly(Return(NO_ERROR));
     }
@@ -87,6 +89,17 @@ TEST_F(RenderSurfaceTest, initializeConfiguresNativeWindow) {
     mSurface.initialize();
 }
 
+TEST_F(RenderSurfaceTest, initializeRequestsRenderEngineOutputUsage) {
+    constexpr uint64_t kUsage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+    EXPECT_CALL(mRenderEngine, getOutputBufferUsage()).WillRepeatedly(Return(kUsage));
+    EXPECT_CALL(*mNativeWindow, connect(NATIVE_WINDOW_API_EGL)).WillOnce(Return(NO_ERROR));
+    EXPECT_CALL(*mNativeWindow, setBuffersFormat(HAL_PIXEL_FORMAT_RGBA_8888))
+            .WillOnce(Return(NO_ERROR));
+    EXPECT_CALL(*mNativeWindow, setUsage(kUsage)).WillOnce(Return(NO_ERROR));
+
+    mSurface.initialize();
+}
+
 /*
  * RenderSurface::getSize()
  */
@@ -230,6 +243,31 @@ TEST_F(RenderSurfaceTest, dequeueBufferObtainsABuffer) {
     EXPECT_EQ(buffer.get(), mSurface.mutableGraphicBufferForTest().get());
 }
 
+TEST_F(RenderSurfaceTest, dequeueBufferReturnsBufferNotYetQueued) {
+    sp<GraphicBuffer> buffer = new GraphicBuffer();
+    mSurface.mutableGraphicBufferForTest() = buffer;
+
+    EXPECT_CALL(*mNativeWindow, dequeueBuffer(_, _)).Times(0);
+
+    base::unique_fd fence;
+    EXPECT_EQ(buffer.get(), mSurface.dequeueBuffer(&fence).get());
+    EXPECT_EQ(-1, fence.get());
+}
+
+TEST_F(RenderSurfaceTest, setBufferPixelFormatCancelsBufferOfOtherFormat) {
+    sp<GraphicBuffer> buffer = new GraphicBuffer();
+    mSurface.mutableGraphicBufferForTest() = buffer;
+
+    EXPECT_CALL(*mNativeWindow, cancelBuffer(buffer->getNativeBuffer(), -1))
+            .WillOnce(Return(NO_ERROR));
+    EXPECT_CALL(*mNativeWindow, setBuffersFormat(PIXEL_FORMAT_RGBA_8888))
+            .WillOnce(Return(NO_ERROR));
+
+    mSurface.setBufferPixelFormat(ui::PixelFormat::RGBA_8888);
+
+    EXPECT_EQ(nullptr, mSurface.mutableGraphicBufferForTest().get());
+}
+
 /*
  * RenderSurface::queueBuffer()
  */
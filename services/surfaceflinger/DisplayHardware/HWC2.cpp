@@ -149,7 +149,8 @@ Error Display::createLayer(HWC2::Layer** outLayer) {
         return error;
     }
 
-    auto layer = std::make_unique<impl::Layer>(mComposer, mCapabilities, mId, layerId);
+    auto layer = std::make_unique<impl::Layer>(mComposer, mCapabilities, mId, layerId,
+                                               mLayerCommandStats);
     *outLayer = layer.get();
     mLayers.emplace(layerId, std::move(layer));
     return Error::NONE;
@@ -752,11 +753,12 @@ Layer::~Layer() = default;
 namespace impl {
 
 Layer::Layer(android::Hwc2::Composer& composer, const std::unordered_set<Capability>& capabilities,
-             HWDisplayId displayId, HWLayerId layerId)
+             HWDisplayId displayId, HWLayerId layerId, LayerCommandStats& commandStats)
       : mComposer(composer),
         mCapabilities(capabilities),
         mDisplayId(displayId),
         mId(layerId),
+        mCommandStats(commandStats),
         mColorMatrix(android::mat4()) {
     ALOGV("Created layer %" PRIu64 " on display %" PRIu64, layerId, displayId);
 }
@@ -780,24 +782,25 @@ Error Layer::setCursorPosition(int32_t x, int32_t y)
 Error Layer::setBuffer(uint32_t slot, const sp<GraphicBuffer>& buffer,
         const sp<Fence>& acquireFence)
 {
-    if (buffer == nullptr && mBufferSlot == slot) {
+    if (recordCommand(buffer == nullptr && mBufferSlot == slot)) {
         return Error::NONE;
     }
-    mBufferSlot = slot;
 
     int32_t fenceFd = acquireFence->dup();
     auto intError = mComposer.setLayerBuffer(mDisplayId, mId, slot, buffer,
                                              fenceFd);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    if (error == Error::NONE) {
+        mBufferSlot = slot;
+    }
+    return error;
 }
 
 Error Layer::setSurfaceDamage(const Region& damage)
 {
-    if (damage.isRect() && mDamageRegion.isRect() &&
-        (damage.getBounds() == mDamageRegion.getBounds())) {
+    if (recordCommand(damage.hasSameRects(mDamageRegion))) {
         return Error::NONE;
     }
-    mDamageRegion = damage;
 
     // We encode default full-screen damage as INVALID_RECT upstream, but as 0
     // rects for HWC
@@ -818,145 +821,194 @@ Error Layer::setSurfaceDamage(const Region& damage)
         intError = mComposer.setLayerSurfaceDamage(mDisplayId, mId, hwcRects);
     }
 
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    if (error == Error::NONE) {
+        mDamageRegion = damage;
+    }
+    return error;
 }
 
 Error Layer::setBlendMode(BlendMode mode)
 {
+    if (isCached(mBlendMode, mode)) {
+        return Error::NONE;
+    }
     auto intError = mComposer.setLayerBlendMode(mDisplayId, mId, mode);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    mBlendMode = error == Error::NONE ? std::make_optional(mode) : std::nullopt;
+    return error;
 }
 
 Error Layer::setColor(Color color) {
+    if (isCached(mColor, color)) {
+        return Error::NONE;
+    }
     auto intError = mComposer.setLayerColor(mDisplayId, mId, color);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    mColor = error == Error::NONE ? std::make_optional(color) : std::nullopt;
+    return error;
 }
 
 Error Layer::setCompositionType(Composition type)
 {
+    recordCommand(false);
     auto intError = mComposer.setLayerCompositionType(mDisplayId, mId, type);
+    // Some composers only pick up the solid color if it is set after the
+    // composition type, so always resend it after a change.
+    mColor.reset();
     return static_cast<Error>(intError);
 }
 
 Error Layer::setDataspace(Dataspace dataspace)
 {
-    if (dataspace == mDataSpace) {
+    if (recordCommand(dataspace == mDataSpace)) {
         return Error::NONE;
     }
-    mDataSpace = dataspace;
-    auto intError = mComposer.setLayerDataspace(mDisplayId, mId, mDataSpace);
-    return static_cast<Error>(intError);
+    auto intError = mComposer.setLayerDataspace(mDisplayId, mId, dataspace);
+    auto error = static_cast<Error>(intError);
+    if (error == Error::NONE) {
+        mDataSpace = dataspace;
+    }
+    return error;
 }
 
 Error Layer::setPerFrameMetadata(const int32_t supportedPerFrameMetadata,
         const android::HdrMetadata& metadata)
 {
-    if (metadata == mHdrMetadata) {
+    if (recordCommand(metadata == mHdrMetadata)) {
         return Error::NONE;
     }
 
-    mHdrMetadata = metadata;
-    int validTypes = mHdrMetadata.validTypes & supportedPerFrameMetadata;
+    int validTypes = metadata.validTypes & supportedPerFrameMetadata;
     std::vector<Hwc2::PerFrameMetadata> perFrameMetadatas;
     if (validTypes & HdrMetadata::SMPTE2086) {
         perFrameMetadatas.insert(perFrameMetadatas.end(),
                                  {{Hwc2::PerFrameMetadataKey::DISPLAY_RED_PRIMARY_X,
-                                   mHdrMetadata.smpte2086.displayPrimaryRed.x},
+                                   metadata.smpte2086.displayPrimaryRed.x},
                                   {Hwc2::PerFrameMetadataKey::DISPLAY_RED_PRIMARY_Y,
-                                   mHdrMetadata.smpte2086.displayPrimaryRed.y},
+                                   metadata.smpte2086.displayPrimaryRed.y},
                                   {Hwc2::PerFrameMetadataKey::DISPLAY_GREEN_PRIMARY_X,
-                                   mHdrMetadata.smpte2086.displayPrimaryGreen.x},
+                                   metadata.smpte2086.displayPrimaryGreen.x},
                                   {Hwc2::PerFrameMetadataKey::DISPLAY_GREEN_PRIMARY_Y,
-                                   mHdrMetadata.smpte2086.displayPrimaryGreen.y},
+                                   metadata.smpte2086.displayPrimaryGreen.y},
                                   {Hwc2::PerFrameMetadataKey::DISPLAY_BLUE_PRIMARY_X,
-                                   mHdrMetadata.smpte2086.displayPrimaryBlue.x},
+                                   metadata.smpte2086.displayPrimaryBlue.x},
                                   {Hwc2::PerFrameMetadataKey::DISPLAY_BLUE_PRIMARY_Y,
-                                   mHdrMetadata.smpte2086.displayPrimaryBlue.y},
+                                   metadata.smpte2086.displayPrimaryBlue.y},
                                   {Hwc2::PerFrameMetadataKey::WHITE_POINT_X,
-                                   mHdrMetadata.smpte2086.whitePoint.x},
+                                   metadata.smpte2086.whitePoint.x},
                                   {Hwc2::PerFrameMetadataKey::WHITE_POINT_Y,
-                                   mHdrMetadata.smpte2086.whitePoint.y},
+                                   metadata.smpte2086.whitePoint.y},
                                   {Hwc2::PerFrameMetadataKey::MAX_LUMINANCE,
-                                   mHdrMetadata.smpte2086.maxLuminance},
+                                   metadata.smpte2086.maxLuminance},
                                   {Hwc2::PerFrameMetadataKey::MIN_LUMINANCE,
-                                   mHdrMetadata.smpte2086.minLuminance}});
+                                   metadata.smpte2086.minLuminance}});
     }
 
     if (validTypes & HdrMetadata::CTA861_3) {
         perFrameMetadatas.insert(perFrameMetadatas.end(),
                                  {{Hwc2::PerFrameMetadataKey::MAX_CONTENT_LIGHT_LEVEL,
-                                   mHdrMetadata.cta8613.maxContentLightLevel},
+                                   metadata.cta8613.maxContentLightLevel},
                                   {Hwc2::PerFrameMetadataKey::MAX_FRAME_AVERAGE_LIGHT_LEVEL,
-                                   mHdrMetadata.cta8613.maxFrameAverageLightLevel}});
+                                   metadata.cta8613.maxFrameAverageLightLevel}});
     }
 
     Error error = static_cast<Error>(
             mComposer.setLayerPerFrameMetadata(mDisplayId, mId, perFrameMetadatas));
 
     if (validTypes & HdrMetadata::HDR10PLUS) {
-        if (CC_UNLIKELY(mHdrMetadata.hdr10plus.size() == 0)) {
+        if (CC_UNLIKELY(metadata.hdr10plus.size() == 0)) {
             return Error::BAD_PARAMETER;
         }
 
         std::vector<Hwc2::PerFrameMetadataBlob> perFrameMetadataBlobs;
         perFrameMetadataBlobs.push_back(
-                {Hwc2::PerFrameMetadataKey::HDR10_PLUS_SEI, mHdrMetadata.hdr10plus});
+                {Hwc2::PerFrameMetadataKey::HDR10_PLUS_SEI, metadata.hdr10plus});
         Error setMetadataBlobsError = static_cast<Error>(
                 mComposer.setLayerPerFrameMetadataBlobs(mDisplayId, mId, perFrameMetadataBlobs));
         if (error == Error::NONE) {
-            return setMetadataBlobsError;
+            error = setMetadataBlobsError;
         }
     }
+    if (error == Error::NONE) {
+        mHdrMetadata = metadata;
+    }
     return error;
 }
 
 Error Layer::setDisplayFrame(const Rect& frame)
 {
+    if (isCached(mDisplayFrame, frame)) {
+        return Error::NONE;
+    }
     Hwc2::IComposerClient::Rect hwcRect{frame.left, frame.top,
         frame.right, frame.bottom};
     auto intError = mComposer.setLayerDisplayFrame(mDisplayId, mId, hwcRect);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    mDisplayFrame = error == Error::NONE ? std::make_optional(frame) : std::nullopt;
+    return error;
 }
 
 Error Layer::setPlaneAlpha(float alpha)
 {
+    if (isCached(mPlaneAlpha, alpha)) {
+        return Error::NONE;
+    }
     auto intError = mComposer.setLayerPlaneAlpha(mDisplayId, mId, alpha);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    mPlaneAlpha = error == Error::NONE ? std::make_optional(alpha) : std::nullopt;
+    return error;
 }
 
-Error Layer::setSidebandStream(const native_handle_t* stream)
+Error Layer::setSidebandStream(const sp<NativeHandle>& stream)
 {
     if (mCapabilities.count(Capability::SIDEBAND_STREAM) == 0) {
         ALOGE("Attempted to call setSidebandStream without checking that the "
                 "device supports sideband streams");
         return Error::UNSUPPORTED;
     }
-    auto intError = mComposer.setLayerSidebandStream(mDisplayId, mId, stream);
-    return static_cast<Error>(intError);
+    // The cached NativeHandle keeps its native_handle_t alive, so a new stream
+    // can never have the same handle as the cached one.
+    if (recordCommand(stream != nullptr && stream == mSidebandStream)) {
+        return Error::NONE;
+    }
+    auto intError = mComposer.setLayerSidebandStream(mDisplayId, mId,
+                                                     stream ? stream->handle() : nullptr);
+    auto error = static_cast<Error>(intError);
+    mSidebandStream = error == Error::NONE ? stream : nullptr;
+    return error;
 }
 
 Error Layer::setSourceCrop(const FloatRect& crop)
 {
+    if (isCached(mSourceCrop, crop)) {
+        return Error::NONE;
+    }
     Hwc2::IComposerClient::FRect hwcRect{
         crop.left, crop.top, crop.right, crop.bottom};
     auto intError = mComposer.setLayerSourceCrop(mDisplayId, mId, hwcRect);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    mSourceCrop = error == Error::NONE ? std::make_optional(crop) : std::nullopt;
+    return error;
 }
 
 Error Layer::setTransform(Transform transform)
 {
+    if (isCached(mTransform, transform)) {
+        return Error::NONE;
+    }
     auto intTransform = static_cast<Hwc2::Transform>(transform);
     auto intError = mComposer.setLayerTransform(mDisplayId, mId, intTransform);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    mTransform = error == Error::NONE ? std::make_optional(transform) : std::nullopt;
+    return error;
 }
 
 Error Layer::setVisibleRegion(const Region& region)
 {
-    if (region.isRect() && mVisibleRegion.isRect() &&
-        (region.getBounds() == mVisibleRegion.getBounds())) {
+    if (recordCommand(region.hasSameRects(mVisibleRegion))) {
         return Error::NONE;
     }
-    mVisibleRegion = region;
 
     size_t rectCount = 0;
     auto rectArray = region.getArray(&rectCount);
@@ -968,24 +1020,39 @@ Error Layer::setVisibleRegion(const Region& region)
     }
 
     auto intError = mComposer.setLayerVisibleRegion(mDisplayId, mId, hwcRects);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    if (error == Error::NONE) {
+        mVisibleRegion = region;
+    }
+    return error;
 }
 
 Error Layer::setZOrder(uint32_t z)
 {
+    if (isCached(mZOrder, z)) {
+        return Error::NONE;
+    }
     auto intError = mComposer.setLayerZOrder(mDisplayId, mId, z);
-    return static_cast<Error>(intError);
+    auto error = static_cast<Error>(intError);
+    mZOrder = error == Error::NONE ? std::make_optional(z) : std::nullopt;
+    return error;
 }
 
 Error Layer::setInfo(uint32_t type, uint32_t appId)
 {
+  const auto info = std::make_pair(type, appId);
+  if (isCached(mInfo, info)) {
+      return Error::NONE;
+  }
   auto intError = mComposer.setLayerInfo(mDisplayId, mId, type, appId);
-  return static_cast<Error>(intError);
+  auto error = static_cast<Error>(intError);
+  mInfo = error == Error::NONE ? std::make_optional(info) : std::nullopt;
+  return error;
 }
 
 // Composer HAL 2.3
 Error Layer::setColorTransform(const android::mat4& matrix) {
-    if (matrix == mColorMatrix) {
+    if (recordCommand(matrix == mColorMatrix)) {
         return Error::NONE;
     }
     auto intError = mComposer.setLayerColorTransform(mDisplayId, mId, matrix.asArray());
@@ -20,14 +20,19 @@
 #include <gui/HdrMetadata.h>
 #include <math/mat4.h>
 #include <ui/DisplayInfo.h>
+#include <ui/FloatRect.h>
 #include <ui/HdrCapabilities.h>
+#include <ui/Rect.h>
 #include <ui/Region.h>
 #include <utils/Log.h>
+#include <utils/NativeHandle.h>
 #include <utils/StrongPointer.h>
 #include <utils/Timers.h>
 
+#include <atomic>
 #include <functional>
 #include <future>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -76,6 +81,13 @@ class ComposerCallback {
      virtual ~ComposerCallback() = default;
 };
 
+// Counts the layer commands for a display that were sent to the HWC, and those
+// that were skipped as the HWC already had the same state for the layer.
+struct LayerCommandStats {
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> skipped{0};
+};
+
 // Convenience C++ class to access per display functions directly.
 class Display {
 public:
@@ -160,6 +172,7 @@ public:
     virtual void setConnected(bool connected) = 0; // For use by Device only
     virtual const std::unordered_set<hal::DisplayCapability>& getCapabilities() const = 0;
     virtual bool isVsyncPeriodSwitchSupported() const = 0;
+    virtual const LayerCommandStats& getLayerCommandStats() const = 0;
 
     [[clang::warn_unused_result]] virtual hal::Error acceptChanges() = 0;
     [[clang::warn_unused_result]] virtual hal::Error createLayer(Layer** outLayer) = 0;
@@ -317,6 +330,7 @@ public:
         return mDisplayCapabilities;
     };
     virtual bool isVsyncPeriodSwitchSupported() const override;
+    const LayerCommandStats& getLayerCommandStats() const override { return mLayerCommandStats; }
 
 private:
     int32_t getAttribute(hal::HWConfigId configId, hal::Attribute attribute);
@@ -341,6 +355,9 @@ private:
     hal::DisplayType mType;
     bool mIsConnected = false;
 
+    // Shared by all the layers on this display, so must outlive them.
+    LayerCommandStats mLayerCommandStats;
+
     std::unordered_map<hal::HWLayerId, std::unique_ptr<Layer>> mLayers;
     std::unordered_map<hal::HWConfigId, std::shared_ptr<const Config>> mConfigs;
 
@@ -373,7 +390,7 @@ public:
             const android::Rect& frame) = 0;
     [[clang::warn_unused_result]] virtual hal::Error setPlaneAlpha(float alpha) = 0;
     [[clang::warn_unused_result]] virtual hal::Error setSidebandStream(
-            const native_handle_t* stream) = 0;
+            const android::sp<android::NativeHandle>& stream) = 0;
     [[clang::warn_unused_result]] virtual hal::Error setSourceCrop(
             const android::FloatRect& crop) = 0;
     [[clang::warn_unused_result]] virtual hal::Error setTransform(hal::Transform transform) = 0;
@@ -399,7 +416,7 @@ class Layer : public HWC2::Layer {
 public:
     Layer(android::Hwc2::Composer& composer,
           const std::unordered_set<hal::Capability>& capabilities, hal::HWDisplayId displayId,
-          hal::HWLayerId layerId);
+          hal::HWLayerId layerId, LayerCommandStats& commandStats);
     ~Layer() override;
 
     hal::HWLayerId getId() const override { return mId; }
@@ -417,7 +434,7 @@ public:
                                    const android::HdrMetadata& metadata) override;
     hal::Error setDisplayFrame(const android::Rect& frame) override;
     hal::Error setPlaneAlpha(float alpha) override;
-    hal::Error setSidebandStream(const native_handle_t* stream) override;
+    hal::Error setSidebandStream(const android::sp<android::NativeHandle>& stream) override;
     hal::Error setSourceCrop(const android::FloatRect& crop) override;
     hal::Error setTransform(hal::Transform transform) override;
     hal::Error setVisibleRegion(const android::Region& region) override;
@@ -432,6 +449,17 @@ public:
                                        const std::vector<uint8_t>& value) override;
 
 private:
+    // Returns true if the command setting a value can be skipped as the HWC
+    // already has that value, and records whether it was sent or skipped.
+    template <typename T>
+    bool isCached(const std::optional<T>& cached, const T& value) {
+        return recordCommand(cached && *cached == value);
+    }
+    bool recordCommand(bool skipped) {
+        (skipped ? mCommandStats.skipped : mCommandStats.sent)++;
+        return skipped;
+    }
+
     // These are references to data owned by HWC2::Device, which will outlive
     // this HWC2::Layer, so these references are guaranteed to be valid for
     // the lifetime of this object.
@@ -441,6 +469,9 @@ private:
     hal::HWDisplayId mDisplayId;
     hal::HWLayerId mId;
 
+    // Owned by the HWC2::Display for this layer, which outlives it.
+    LayerCommandStats& mCommandStats;
+
     // Cached HWC2 data, to ensure the same commands aren't sent to the HWC
     // multiple times.
     android::Region mVisibleRegion = android::Region::INVALID_REGION;
@@ -449,6 +480,15 @@ private:
     android::HdrMetadata mHdrMetadata;
     android::mat4 mColorMatrix;
     uint32_t mBufferSlot;
+    std::optional<hal::BlendMode> mBlendMode;
+    std::optional<hal::Color> mColor;
+    std::optional<android::Rect> mDisplayFrame;
+    std::optional<float> mPlaneAlpha;
+    android::sp<android::NativeHandle> mSidebandStream;
+    std::optional<android::FloatRect> mSourceCrop;
+    std::optional<hal::Transform> mTransform;
+    std::optional<uint32_t> mZOrder;
+    std::optional<std::pair<uint32_t, uint32_t>> mInfo;
 };
 
 } // namespace impl
@@ -26,6 +26,7 @@
 
 #include "HWComposer.h"
 
+#include <android-base/stringprintf.h>
 #include <compositionengine/Output.h>
 #include <compositionengine/OutputLayer.h>
 #include <compositionengine/impl/OutputLayerCompositionState.h>
@@ -863,6 +864,17 @@ const std::unordered_map<std::string, bool>& HWComposer::getSupportedLayerGeneri
 
 void HWComposer::dump(std::string& result) const {
     result.append(mComposer->dumpDebugInfo());
+
+    result.append("Layer commands (sent/skipped as unchanged):\n");
+    for (const auto& [displayId, displayData] : mDisplayData) {
+        if (!displayData.hwcDisplay) {
+            continue;
+        }
+        const auto& stats = displayData.hwcDisplay->getLayerCommandStats();
+        base::StringAppendF(&result, "  Display %s: %" PRIu64 "/%" PRIu64 "\n",
+                            to_string(displayId).c_str(), stats.sent.load(),
+                            stats.skipped.load());
+    }
 }
 
 std::optional<DisplayId> HWComposer::toPhysicalDisplayId(hal::HWDisplayId hwcDisplayId) const {
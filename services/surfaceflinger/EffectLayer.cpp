@@ -77,7 +77,11 @@ std::vector<compositionengine::LayerFE::LayerSettings> EffectLayer::prepareClien
 }
 
 bool EffectLayer::isVisible() const {
-    return !isHiddenByPolicy() && getAlpha() > 0.0_hf && hasSomethingToDraw();
+    return isVisibleWithPolicy(isHiddenByPolicy(), getAlpha());
+}
+
+bool EffectLayer::isVisibleWithPolicy(bool hiddenByPolicy, half alpha) const {
+    return !hiddenByPolicy && alpha > 0.0_hf && hasSomethingToDraw();
 }
 
 bool EffectLayer::setColor(const half3& color) {
@@ -37,6 +37,7 @@ public:
 
     const char* getType() const override { return "EffectLayer"; }
     bool isVisible() const override;
+    bool isVisibleWithPolicy(bool hiddenByPolicy, half alpha) const override;
 
     bool setColor(const half3& color) override;
 
@@ -369,6 +369,30 @@ FloatRect Layer::getBoundsPreScaling(const ui::Transform& bufferScaleTransform)
 
 void Layer::computeBounds(FloatRect parentBounds, ui::Transform parentTransform,
                           float parentShadowRadius) {
+    computeOwnBounds(parentBounds, parentTransform, parentShadowRadius);
+    computeChildBounds();
+}
+
+void Layer::computeChildBounds() {
+    for (const sp<Layer>& child : mDrawingChildren) {
+        child->computeOwnBoundsFromParent(*this);
+        child->computeChildBounds();
+    }
+}
+
+void Layer::computeOwnBoundsFromParent(const Layer& parent) {
+    // Shadow radius is passed down to only one layer so if the parent can draw shadows,
+    // don't pass it to its children.
+    const float parentShadowRadius = parent.canDrawShadows() ? 0.f : parent.mEffectiveShadowRadius;
+
+    // Add any buffer scaling of the parent to its children.
+    const ui::Transform bufferScaleTransform = parent.getBufferScaleTransform();
+    computeOwnBounds(parent.getBoundsPreScaling(bufferScaleTransform),
+                     parent.getTransformWithScale(bufferScaleTransform), parentShadowRadius);
+}
+
+void Layer::computeOwnBounds(FloatRect parentBounds, ui::Transform parentTransform,
+                             float parentShadowRadius) {
     const State& s(getDrawingState());
 
     // Calculate effective layer transform
@@ -398,17 +422,6 @@ void Layer::computeBounds(FloatRect parentBounds, ui::Transform parentTransform,
     } else {
         mEffectiveShadowRadius = parentShadowRadius;
     }
-
-    // Shadow radius is passed down to only one layer so if the layer can draw shadows,
-    // don't pass it to its children.
-    const float childShadowRadius = canDrawShadows() ? 0.f : mEffectiveShadowRadius;
-
-    // Add any buffer scaling to the layer's children.
-    ui::Transform bufferScaleTransform = getBufferScaleTransform();
-    for (const sp<Layer>& child : mDrawingChildren) {
-        child->computeBounds(getBoundsPreScaling(bufferScaleTransform),
-                             getTransformWithScale(bufferScaleTransform), childShadowRadius);
-    }
 }
 
 Rect Layer::getCroppedBufferSize(const State& s) const {
@@ -1696,12 +1709,7 @@ void Layer::addAndGetFrameTimestamps(const NewFrameEventsEntry* newTimestamps,
 
     Mutex::Autolock lock(mFrameEventHistoryMutex);
     if (newTimestamps) {
-        // If there are any unsignaled fences in the aquire timeline at this
-        // point, the previously queued frame hasn't been latched yet. Go ahead
-        // and try to get the signal time here so the syscall is taken out of
-        // the main thread's critical path.
-        mAcquireTimeline.updateSignalTimes();
-        // Push the new fence after updating since it's likely still pending.
+        // The timeline is updated with those of the other layers after composition.
         mAcquireTimeline.push(newTimestamps->acquireFence);
         mFrameEventHistory.addQueue(*newTimestamps);
     }
@@ -2201,171 +2209,219 @@ void Layer::setInputInfo(const InputWindowInfo& info) {
     setTransactionFlags(eTransactionNeeded);
 }
 
-LayerProto* Layer::writeToProto(LayersProto& layersProto, uint32_t traceFlags,
-                                const DisplayDevice* display) const {
-    LayerProto* layerProto = layersProto.add_layers();
-    writeToProtoDrawingState(layerProto, traceFlags, display);
-    writeToProtoCommonState(layerProto, LayerVector::StateSet::Drawing, traceFlags);
+void Layer::snapshotForProto(std::vector<LayerProtoSnapshot>& snapshots, uint32_t traceFlags,
+                             const DisplayDevice* display) const {
+    LayerProtoSnapshot& snapshot = snapshots.emplace_back();
+    snapshot.traceFlags = traceFlags;
+    const State& state = mDrawingState;
+
+    if (traceFlags & SurfaceTracing::TRACE_CRITICAL) {
+        snapshot.id = sequence;
+        snapshot.name = getName();
+        snapshot.type = getType();
 
-    if (traceFlags & SurfaceTracing::TRACE_COMPOSITION) {
-        // Only populate for the primary display.
-        if (display) {
-            const Hwc2::IComposerClient::Composition compositionType = getCompositionType(*display);
-            layerProto->set_hwc_composition_type(static_cast<HwcCompositionType>(compositionType));
+        for (const auto& pendingState : mPendingStatesSnapshot) {
+            auto barrierLayer = pendingState.barrierLayer_legacy.promote();
+            if (barrierLayer != nullptr) {
+                snapshot.barriers.emplace_back(barrierLayer->sequence,
+                                               pendingState.frameNumber_legacy);
+            }
         }
+
+        snapshot.buffer = getBuffer();
+        snapshot.bufferTransform = getBufferTransform();
+        snapshot.invalidate = contentDirty;
+        snapshot.isProtected = isProtected();
+        snapshot.dataspace = getDataSpace();
+        snapshot.queuedFrames = getQueuedFrameCount();
+        snapshot.refreshPending = isBufferLatched();
+        snapshot.currFrame = mCurrentFrameNumber;
+        snapshot.effectiveScalingMode = getEffectiveScalingMode();
+        snapshot.transform = getTransform();
+        snapshot.bounds = mBounds;
+        if (traceFlags & SurfaceTracing::TRACE_COMPOSITION) {
+            snapshot.visibleRegion = getVisibleRegion(display);
+        }
+        snapshot.damageRegion = surfaceDamageRegion;
+        if (hasColorTransform()) {
+            snapshot.colorTransform = getColorTransform();
+        }
+
+        for (const auto& child : mDrawingChildren) {
+            snapshot.childIds.push_back(child->sequence);
+        }
+        for (const wp<Layer>& weakRelative : state.zOrderRelatives) {
+            sp<Layer> strongRelative = weakRelative.promote();
+            if (strongRelative != nullptr) {
+                snapshot.relativeIds.push_back(strongRelative->sequence);
+            }
+        }
+        auto parent = mDrawingParent.promote();
+        snapshot.parentId = parent != nullptr ? parent->sequence : -1;
+        auto zOrderRelativeOf = state.zOrderRelativeOf.promote();
+        snapshot.zOrderRelativeOfId = zOrderRelativeOf != nullptr ? zOrderRelativeOf->sequence : -1;
+        snapshot.isRelativeOf = state.isRelativeOf;
+
+        snapshot.transparentRegion = state.activeTransparentRegion_legacy;
+        snapshot.layerStack = getLayerStack();
+        snapshot.z = state.z;
+        snapshot.requested = state.active_legacy;
+        snapshot.crop = state.crop_legacy;
+        snapshot.isOpaque = isOpaque(state);
+        snapshot.pixelFormat = getPixelFormat();
+        snapshot.color = getColor();
+        snapshot.requestedColor = state.color;
+        snapshot.flags = state.flags;
+    }
+
+    snapshot.roundedCorner = getRoundedCornerState();
+    snapshot.sourceBounds = mSourceBounds;
+    snapshot.screenBounds = mScreenBounds;
+    snapshot.shadowRadius = mEffectiveShadowRadius;
+
+    if ((traceFlags & SurfaceTracing::TRACE_COMPOSITION) && display) {
+        snapshot.compositionType = getCompositionType(*display);
     }
 
-    for (const sp<Layer>& layer : mDrawingChildren) {
-        layer->writeToProto(layersProto, traceFlags, display);
+    if (traceFlags & SurfaceTracing::TRACE_INPUT) {
+        snapshot.inputInfo = state.inputInfo;
+        auto cropLayer = state.touchableRegionCrop.promote();
+        if (cropLayer != nullptr) {
+            snapshot.touchableRegionCropId = cropLayer->sequence;
+            snapshot.touchableRegionCrop =
+                    cropLayer->getScreenBounds(false /* reduceTransparentRegion */);
+        }
     }
 
-    return layerProto;
+    if (traceFlags & SurfaceTracing::TRACE_EXTRA) {
+        snapshot.metadata = state.metadata;
+    }
 }
 
-void Layer::writeToProtoDrawingState(LayerProto* layerInfo, uint32_t traceFlags,
-                                     const DisplayDevice* display) const {
-    ui::Transform transform = getTransform();
+LayerProto* Layer::writeToProto(LayersProto& layersProto, const LayerProtoSnapshot& snapshot) {
+    LayerProto* layerInfo = layersProto.add_layers();
+    const uint32_t traceFlags = snapshot.traceFlags;
 
     if (traceFlags & SurfaceTracing::TRACE_CRITICAL) {
-        for (const auto& pendingState : mPendingStatesSnapshot) {
-            auto barrierLayer = pendingState.barrierLayer_legacy.promote();
-            if (barrierLayer != nullptr) {
-                BarrierLayerProto* barrierLayerProto = layerInfo->add_barrier_layer();
-                barrierLayerProto->set_id(barrierLayer->sequence);
-                barrierLayerProto->set_frame_number(pendingState.frameNumber_legacy);
-            }
+        for (const auto& [barrierLayerId, frameNumber] : snapshot.barriers) {
+            BarrierLayerProto* barrierLayerProto = layerInfo->add_barrier_layer();
+            barrierLayerProto->set_id(barrierLayerId);
+            barrierLayerProto->set_frame_number(frameNumber);
         }
 
-        auto buffer = getBuffer();
-        if (buffer != nullptr) {
-            LayerProtoHelper::writeToProto(buffer,
+        if (snapshot.buffer != nullptr) {
+            LayerProtoHelper::writeToProto(snapshot.buffer,
                                            [&]() { return layerInfo->mutable_active_buffer(); });
-            LayerProtoHelper::writeToProto(ui::Transform(getBufferTransform()),
+            LayerProtoHelper::writeToProto(ui::Transform(snapshot.bufferTransform),
                                            layerInfo->mutable_buffer_transform());
         }
-        layerInfo->set_invalidate(contentDirty);
-        layerInfo->set_is_protected(isProtected());
-        layerInfo->set_dataspace(dataspaceDetails(static_cast<android_dataspace>(getDataSpace())));
-        layerInfo->set_queued_frames(getQueuedFrameCount());
-        layerInfo->set_refresh_pending(isBufferLatched());
-        layerInfo->set_curr_frame(mCurrentFrameNumber);
-        layerInfo->set_effective_scaling_mode(getEffectiveScalingMode());
-
-        layerInfo->set_corner_radius(getRoundedCornerState().radius);
+        layerInfo->set_invalidate(snapshot.invalidate);
+        layerInfo->set_is_protected(snapshot.isProtected);
+        layerInfo->set_dataspace(
+                dataspaceDetails(static_cast<android_dataspace>(snapshot.dataspace)));
+        layerInfo->set_queued_frames(snapshot.queuedFrames);
+        layerInfo->set_refresh_pending(snapshot.refreshPending);
+        layerInfo->set_curr_frame(snapshot.currFrame);
+        layerInfo->set_effective_scaling_mode(snapshot.effectiveScalingMode);
+
+        layerInfo->set_corner_radius(snapshot.roundedCorner.radius);
+        const ui::Transform& transform = snapshot.transform;
         LayerProtoHelper::writeToProto(transform, layerInfo->mutable_transform());
         LayerProtoHelper::writePositionToProto(transform.tx(), transform.ty(),
                                                [&]() { return layerInfo->mutable_position(); });
-        LayerProtoHelper::writeToProto(mBounds, [&]() { return layerInfo->mutable_bounds(); });
+        LayerProtoHelper::writeToProto(snapshot.bounds,
+                                       [&]() { return layerInfo->mutable_bounds(); });
         if (traceFlags & SurfaceTracing::TRACE_COMPOSITION) {
-            LayerProtoHelper::writeToProto(getVisibleRegion(display),
+            LayerProtoHelper::writeToProto(snapshot.visibleRegion,
                                            [&]() { return layerInfo->mutable_visible_region(); });
         }
-        LayerProtoHelper::writeToProto(surfaceDamageRegion,
+        LayerProtoHelper::writeToProto(snapshot.damageRegion,
                                        [&]() { return layerInfo->mutable_damage_region(); });
 
-        if (hasColorTransform()) {
-            LayerProtoHelper::writeToProto(getColorTransform(),
+        if (snapshot.colorTransform) {
+            LayerProtoHelper::writeToProto(*snapshot.colorTransform,
                                            layerInfo->mutable_color_transform());
         }
-    }
 
-    LayerProtoHelper::writeToProto(mSourceBounds,
-                                   [&]() { return layerInfo->mutable_source_bounds(); });
-    LayerProtoHelper::writeToProto(mScreenBounds,
-                                   [&]() { return layerInfo->mutable_screen_bounds(); });
-    LayerProtoHelper::writeToProto(getRoundedCornerState().cropRect,
-                                   [&]() { return layerInfo->mutable_corner_radius_crop(); });
-    layerInfo->set_shadow_radius(mEffectiveShadowRadius);
-}
+        layerInfo->set_id(snapshot.id);
+        layerInfo->set_name(snapshot.name);
+        layerInfo->set_type(snapshot.type);
 
-void Layer::writeToProtoCommonState(LayerProto* layerInfo, LayerVector::StateSet stateSet,
-                                    uint32_t traceFlags) const {
-    const bool useDrawing = stateSet == LayerVector::StateSet::Drawing;
-    const LayerVector& children = useDrawing ? mDrawingChildren : mCurrentChildren;
-    const State& state = useDrawing ? mDrawingState : mCurrentState;
-
-    ui::Transform requestedTransform = state.active_legacy.transform;
-
-    if (traceFlags & SurfaceTracing::TRACE_CRITICAL) {
-        layerInfo->set_id(sequence);
-        layerInfo->set_name(getName().c_str());
-        layerInfo->set_type(getType());
-
-        for (const auto& child : children) {
-            layerInfo->add_children(child->sequence);
+        for (int32_t childId : snapshot.childIds) {
+            layerInfo->add_children(childId);
         }
-
-        for (const wp<Layer>& weakRelative : state.zOrderRelatives) {
-            sp<Layer> strongRelative = weakRelative.promote();
-            if (strongRelative != nullptr) {
-                layerInfo->add_relatives(strongRelative->sequence);
-            }
+        for (int32_t relativeId : snapshot.relativeIds) {
+            layerInfo->add_relatives(relativeId);
         }
 
-        LayerProtoHelper::writeToProto(state.activeTransparentRegion_legacy,
+        LayerProtoHelper::writeToProto(snapshot.transparentRegion,
                                        [&]() { return layerInfo->mutable_transparent_region(); });
 
-        layerInfo->set_layer_stack(getLayerStack());
-        layerInfo->set_z(state.z);
+        layerInfo->set_layer_stack(snapshot.layerStack);
+        layerInfo->set_z(snapshot.z);
 
+        const ui::Transform& requestedTransform = snapshot.requested.transform;
         LayerProtoHelper::writePositionToProto(requestedTransform.tx(), requestedTransform.ty(),
                                                [&]() {
                                                    return layerInfo->mutable_requested_position();
                                                });
 
-        LayerProtoHelper::writeSizeToProto(state.active_legacy.w, state.active_legacy.h,
+        LayerProtoHelper::writeSizeToProto(snapshot.requested.w, snapshot.requested.h,
                                            [&]() { return layerInfo->mutable_size(); });
 
-        LayerProtoHelper::writeToProto(state.crop_legacy,
-                                       [&]() { return layerInfo->mutable_crop(); });
+        LayerProtoHelper::writeToProto(snapshot.crop, [&]() { return layerInfo->mutable_crop(); });
 
-        layerInfo->set_is_opaque(isOpaque(state));
+        layerInfo->set_is_opaque(snapshot.isOpaque);
 
-
-        layerInfo->set_pixel_format(decodePixelFormat(getPixelFormat()));
-        LayerProtoHelper::writeToProto(getColor(), [&]() { return layerInfo->mutable_color(); });
-        LayerProtoHelper::writeToProto(state.color,
+        layerInfo->set_pixel_format(decodePixelFormat(snapshot.pixelFormat));
+        LayerProtoHelper::writeToProto(snapshot.color,
+                                       [&]() { return layerInfo->mutable_color(); });
+        LayerProtoHelper::writeToProto(snapshot.requestedColor,
                                        [&]() { return layerInfo->mutable_requested_color(); });
-        layerInfo->set_flags(state.flags);
+        layerInfo->set_flags(snapshot.flags);
 
         LayerProtoHelper::writeToProto(requestedTransform,
                                        layerInfo->mutable_requested_transform());
 
-        auto parent = useDrawing ? mDrawingParent.promote() : mCurrentParent.promote();
-        if (parent != nullptr) {
-            layerInfo->set_parent(parent->sequence);
-        } else {
-            layerInfo->set_parent(-1);
-        }
+        layerInfo->set_parent(snapshot.parentId);
+        layerInfo->set_z_order_relative_of(snapshot.zOrderRelativeOfId);
+        layerInfo->set_is_relative_of(snapshot.isRelativeOf);
+    }
 
-        auto zOrderRelativeOf = state.zOrderRelativeOf.promote();
-        if (zOrderRelativeOf != nullptr) {
-            layerInfo->set_z_order_relative_of(zOrderRelativeOf->sequence);
-        } else {
-            layerInfo->set_z_order_relative_of(-1);
-        }
+    LayerProtoHelper::writeToProto(snapshot.sourceBounds,
+                                   [&]() { return layerInfo->mutable_source_bounds(); });
+    LayerProtoHelper::writeToProto(snapshot.screenBounds,
+                                   [&]() { return layerInfo->mutable_screen_bounds(); });
+    LayerProtoHelper::writeToProto(snapshot.roundedCorner.cropRect,
+                                   [&]() { return layerInfo->mutable_corner_radius_crop(); });
+    layerInfo->set_shadow_radius(snapshot.shadowRadius);
 
-        layerInfo->set_is_relative_of(state.isRelativeOf);
+    if (snapshot.compositionType) {
+        layerInfo->set_hwc_composition_type(
+                static_cast<HwcCompositionType>(*snapshot.compositionType));
     }
 
     if (traceFlags & SurfaceTracing::TRACE_INPUT) {
-        LayerProtoHelper::writeToProto(state.inputInfo, state.touchableRegionCrop,
+        LayerProtoHelper::writeToProto(snapshot.inputInfo, snapshot.touchableRegionCropId,
+                                       snapshot.touchableRegionCrop,
                                        [&]() { return layerInfo->mutable_input_window_info(); });
     }
 
     if (traceFlags & SurfaceTracing::TRACE_EXTRA) {
         auto protoMap = layerInfo->mutable_metadata();
-        for (const auto& entry : state.metadata.mMap) {
+        for (const auto& entry : snapshot.metadata.mMap) {
             (*protoMap)[entry.first] = std::string(entry.second.cbegin(), entry.second.cend());
         }
     }
+
+    return layerInfo;
 }
 
 bool Layer::isRemovedFromCurrentState() const  {
     return mRemovedFromCurrentState;
 }
 
-InputWindowInfo Layer::fillInputInfo() {
+InputWindowInfo Layer::fillInputInfo(bool hiddenByPolicy, half alpha, const Layer* clonedRoot) {
     if (!hasInputInfo()) {
         mDrawingState.inputInfo.name = getName();
         mDrawingState.inputInfo.ownerUid = mCallingUid;
@@ -2431,13 +2487,13 @@ InputWindowInfo Layer::fillInputInfo() {
     info.touchableRegion = info.touchableRegion.translate(info.frameLeft, info.frameTop);
     // For compatibility reasons we let layers which can receive input
     // receive input before they have actually submitted a buffer. Because
-    // of this we use canReceiveInput instead of isVisible to check the
-    // policy-visibility, ignoring the buffer state. However for layers with
+    // of this we use the policy-visibility instead of isVisible, ignoring
+    // the buffer state. However for layers with
     // hasInputInfo()==false we can use the real visibility state.
     // We are just using these layers for occlusion detection in
     // InputDispatcher, and obviously if they aren't visible they can't occlude
     // anything.
-    info.visible = hasInputInfo() ? canReceiveInput() : isVisible();
+    info.visible = hasInputInfo() ? !hiddenByPolicy : isVisibleWithPolicy(hiddenByPolicy, alpha);
 
     auto cropLayer = mDrawingState.touchableRegionCrop.promote();
     if (info.replaceTouchableRegionWithCrop) {
@@ -2452,35 +2508,18 @@ InputWindowInfo Layer::fillInputInfo() {
 
     // If the layer is a clone, we need to crop the input region to cloned root to prevent
     // touches from going outside the cloned area.
-    if (isClone()) {
-        sp<Layer> clonedRoot = getClonedRoot();
-        if (clonedRoot != nullptr) {
-            Rect rect(clonedRoot->mScreenBounds);
-            info.touchableRegion = info.touchableRegion.intersect(rect);
-        }
+    if (isClone() && clonedRoot != nullptr) {
+        Rect rect(clonedRoot->mScreenBounds);
+        info.touchableRegion = info.touchableRegion.intersect(rect);
     }
 
     return info;
 }
 
-sp<Layer> Layer::getClonedRoot() {
-    if (mClonedChild != nullptr) {
-        return this;
-    }
-    if (mDrawingParent == nullptr || mDrawingParent.promote() == nullptr) {
-        return nullptr;
-    }
-    return mDrawingParent.promote()->getClonedRoot();
-}
-
 bool Layer::hasInputInfo() const {
     return mDrawingState.inputInfo.token != nullptr;
 }
 
-bool Layer::canReceiveInput() const {
-    return !isHiddenByPolicy();
-}
-
 compositionengine::OutputLayer* Layer::findOutputLayerForDisplay(
         const DisplayDevice* display) const {
     if (!display) return nullptr;
@@ -63,6 +63,7 @@ class DisplayDevice;
 class GraphicBuffer;
 class SurfaceFlinger;
 class LayerDebugInfo;
+struct LayerProtoSnapshot;
 
 namespace compositionengine {
 class OutputLayer;
@@ -443,8 +444,13 @@ public:
     FloatRect getBounds(const Region& activeTransparentRegion) const;
     FloatRect getBounds() const;
 
-    // Compute bounds for the layer and cache the results.
+    // Compute bounds for the layer and its drawing children, and cache the results.
     void computeBounds(FloatRect parentBounds, ui::Transform parentTransform, float shadowRadius);
+    // Compute bounds for the layer only, leaving its children as they are.
+    void computeOwnBounds(FloatRect parentBounds, ui::Transform parentTransform,
+                          float shadowRadius);
+    // As above, from the bounds of the parent, which must already be computed.
+    void computeOwnBoundsFromParent(const Layer& parent);
 
     // Returns the buffer scale transform if a scaling mode is set.
     ui::Transform getBufferScaleTransform() const;
@@ -492,6 +498,14 @@ public:
      */
     virtual bool isVisible() const = 0;
 
+    /*
+     * isVisibleWithPolicy - isVisible(), for a caller that already has the layer's
+     * isHiddenByPolicy() and getAlpha(), so that they are not walked up from the layer again.
+     */
+    virtual bool isVisibleWithPolicy(bool /*hiddenByPolicy*/, half /*alpha*/) const {
+        return isVisible();
+    }
+
     /*
      * isHiddenByPolicy - true if this layer has been forced invisible.
      * just because this is false, doesn't mean isVisible() is true.
@@ -500,11 +514,6 @@ public:
      */
     bool isHiddenByPolicy() const;
 
-    /*
-     * Returns whether this layer can receive input.
-     */
-    virtual bool canReceiveInput() const;
-
     /*
      * isProtected - true if the layer may contain protected content in the
      * GRALLOC_USAGE_PROTECTED sense.
@@ -528,19 +537,13 @@ public:
 
     bool isRemovedFromCurrentState() const;
 
-    LayerProto* writeToProto(LayersProto& layersProto, uint32_t traceFlags,
-                             const DisplayDevice*) const;
-
-    // Write states that are modified by the main thread. This includes drawing
-    // state as well as buffer data. This should be called in the main or tracing
-    // thread.
-    void writeToProtoDrawingState(LayerProto* layerInfo, uint32_t traceFlags,
-                                  const DisplayDevice*) const;
-    // Write drawing or current state. If writing current state, the caller should hold the
-    // external mStateLock. If writing drawing state, this function should be called on the
+    // Copies the drawing state written to the proto of this layer. This should be called in the
     // main or tracing thread.
-    void writeToProtoCommonState(LayerProto* layerInfo, LayerVector::StateSet stateSet,
-                                 uint32_t traceFlags = SurfaceTracing::TRACE_ALL) const;
+    void snapshotForProto(std::vector<LayerProtoSnapshot>& snapshots, uint32_t traceFlags,
+                          const DisplayDevice*) const;
+    // Does not touch the layer, so the proto can be written without holding the locks that
+    // guard its state.
+    static LayerProto* writeToProto(LayersProto& layersProto, const LayerProtoSnapshot& snapshot);
 
     virtual Geometry getActiveGeometry(const Layer::State& s) const { return s.active_legacy; }
     virtual uint32_t getActiveWidth(const Layer::State& s) const { return s.active_legacy.w; }
@@ -639,6 +642,13 @@ public:
     // If a buffer was replaced this frame, release the former buffer
     virtual void releasePendingBuffer(nsecs_t /*dequeueReadyTime*/) { }
 
+    // Adds the acquire and release fence timelines, so that SurfaceFlinger updates those of
+    // every layer together after composition.
+    void addFenceTimelines(std::vector<FenceTimeline*>* timelines) {
+        timelines->push_back(&mAcquireTimeline);
+        timelines->push_back(&mReleaseTimeline);
+    }
+
     virtual void finalizeFrameEventHistory(const std::shared_ptr<FenceTime>& /*glDoneFence*/,
                                            const CompositorTiming& /*compositorTiming*/) {}
     /*
@@ -791,6 +801,7 @@ public:
     // current children.  This is safe in the dtor as we will no longer update
     // the current state, but should not be called anywhere else!
     LayerVector& getCurrentChildren() { return mCurrentChildren; }
+    const LayerVector& getDrawingChildren() const { return mDrawingChildren; }
 
     void addChild(const sp<Layer>& layer);
     // Returns index if removed, or negative value otherwise
@@ -956,7 +967,9 @@ public:
     bool mPendingHWCDestroy{false};
     void setInputInfo(const InputWindowInfo& info);
 
-    InputWindowInfo fillInputInfo();
+    // The layer's isHiddenByPolicy(), getAlpha() and the root of the cloned hierarchy it is in are
+    // passed in from the drawing layer snapshot.
+    InputWindowInfo fillInputInfo(bool hiddenByPolicy, half alpha, const Layer* clonedRoot);
     /**
      * Returns whether this layer has an explicitly set input-info.
      */
@@ -1105,13 +1118,70 @@ private:
     // Returns true if the layer can draw shadows on its border.
     virtual bool canDrawShadows() const { return true; }
 
-    // Find the root of the cloned hierarchy, this means the first non cloned parent.
-    // This will return null if first non cloned parent is not found.
-    sp<Layer> getClonedRoot();
+    // Compute bounds for the drawing descendants of the layer, once its own bounds are computed.
+    void computeChildBounds();
 
     // Finds the top most layer in the hierarchy. This will find the root Layer where the parent is
     // null.
     sp<Layer> getRootLayer();
 };
 
+// The state of a layer written to its LayerProto. Only the fields selected by traceFlags are set.
+struct LayerProtoSnapshot {
+    uint32_t traceFlags = 0;
+
+    // TRACE_CRITICAL
+    int32_t id = -1;
+    std::string name;
+    const char* type = "";
+    int32_t parentId = -1;
+    int32_t zOrderRelativeOfId = -1;
+    bool isRelativeOf = false;
+    std::vector<int32_t> childIds;
+    std::vector<int32_t> relativeIds;
+    // The id and frame number of the barrier layers of pending states.
+    std::vector<std::pair<int32_t, uint64_t>> barriers;
+    sp<GraphicBuffer> buffer;
+    uint32_t bufferTransform = 0;
+    bool invalidate = false;
+    bool isProtected = false;
+    ui::Dataspace dataspace = ui::Dataspace::UNKNOWN;
+    int32_t queuedFrames = 0;
+    bool refreshPending = false;
+    uint64_t currFrame = 0;
+    uint32_t effectiveScalingMode = 0;
+    ui::Transform transform;
+    FloatRect bounds;
+    Region damageRegion;
+    std::optional<mat4> colorTransform;
+    Region transparentRegion;
+    uint32_t layerStack = 0;
+    int32_t z = 0;
+    Layer::Geometry requested = {};
+    Rect crop;
+    bool isOpaque = false;
+    PixelFormat pixelFormat = PIXEL_FORMAT_NONE;
+    half4 color;
+    half4 requestedColor;
+    uint32_t flags = 0;
+
+    // Always set
+    Layer::RoundedCornerState roundedCorner;
+    FloatRect sourceBounds;
+    FloatRect screenBounds;
+    float shadowRadius = 0.f;
+
+    // TRACE_COMPOSITION, for the primary display
+    Region visibleRegion;
+    std::optional<Hwc2::IComposerClient::Composition> compositionType;
+
+    // TRACE_INPUT
+    InputWindowInfo inputInfo;
+    int32_t touchableRegionCropId = -1;
+    Rect touchableRegionCrop;
+
+    // TRACE_EXTRA
+    LayerMetadata metadata;
+};
+
 } // namespace android
@@ -124,7 +124,7 @@ void LayerProtoHelper::writeToProto(const sp<GraphicBuffer>& buffer,
 }
 
 void LayerProtoHelper::writeToProto(
-        const InputWindowInfo& inputInfo, const wp<Layer>& touchableRegionBounds,
+        const InputWindowInfo& inputInfo, int32_t cropLayerId, const Rect& touchableRegionCrop,
         std::function<InputWindowInfoProto*()> getInputWindowInfoProto) {
     if (inputInfo.token == nullptr) {
         return;
@@ -150,11 +150,9 @@ void LayerProtoHelper::writeToProto(
     proto->set_window_x_scale(inputInfo.windowXScale);
     proto->set_window_y_scale(inputInfo.windowYScale);
     proto->set_replace_touchable_region_with_crop(inputInfo.replaceTouchableRegionWithCrop);
-    auto cropLayer = touchableRegionBounds.promote();
-    if (cropLayer != nullptr) {
-        proto->set_crop_layer_id(cropLayer->sequence);
-        LayerProtoHelper::writeToProto(cropLayer->getScreenBounds(
-                                               false /* reduceTransparentRegion */),
+    if (cropLayerId != -1) {
+        proto->set_crop_layer_id(cropLayerId);
+        LayerProtoHelper::writeToProto(touchableRegionCrop,
                                        [&]() { return proto->mutable_touchable_region_crop(); });
     }
 }
@@ -40,8 +40,9 @@ public:
     static void writeToProto(const ui::Transform& transform, TransformProto* transformProto);
     static void writeToProto(const sp<GraphicBuffer>& buffer,
                              std::function<ActiveBufferProto*()> getActiveBufferProto);
-    static void writeToProto(const InputWindowInfo& inputInfo,
-                             const wp<Layer>& touchableRegionBounds,
+    // cropLayerId is -1 if the touchable region is not cropped to the bounds of a layer.
+    static void writeToProto(const InputWindowInfo& inputInfo, int32_t cropLayerId,
+                             const Rect& touchableRegionCrop,
                              std::function<InputWindowInfoProto*()> getInputWindowInfoProto);
     static void writeToProto(const mat4 matrix, ColorTransformProto* colorTransformProto);
 };
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// TODO(b/129481165): remove the #pragma below and fix conversion issues
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+
+#include "LayerTreeSnapshot.h"
+
+#include <utils/Trace.h>
+
+#include <algorithm>
+
+#include "Layer.h"
+
+namespace android {
+
+void LayerTreeSnapshot::rebuild(const LayerVector& layers) {
+    ATRACE_CALL();
+
+    // Keep the capacity from the previous build, as the number of layers
+    // rarely changes much from one transaction to the next.
+    mEntries.clear();
+    for (const sp<Layer>& layer : layers) {
+        addHierarchy(layer.get(), NO_PARENT);
+    }
+    mHierarchySize = mEntries.size();
+
+    mIndices.clear();
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        mIndices.emplace_back(mEntries[i].layer, static_cast<int32_t>(i));
+    }
+    std::sort(mIndices.begin(), mIndices.end());
+
+    mZOrder.clear();
+    layers.traverseInZOrder(LayerVector::StateSet::Drawing, [&](Layer* layer) {
+        int32_t index = indexOf(layer);
+        if (index == NO_PARENT) {
+            // A relative whose own hierarchy is not in the LayerVector.
+            index = static_cast<int32_t>(mEntries.size());
+            mEntries.push_back({layer, layer->getCompositionEngineLayerFE().get()});
+        }
+        mZOrder.push_back(index);
+    });
+
+    // Parents come before their children, so their values are already resolved.
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        Entry& entry = mEntries[i];
+        entry.needsInputInfo = entry.layer->needsInputInfo();
+        if (entry.parentIndex == NO_PARENT) {
+            entry.alpha = entry.layer->getAlpha();
+        } else {
+            const Entry& parent = mEntries[entry.parentIndex];
+            entry.alpha = parent.alpha * entry.layer->getDrawingState().color.a;
+            entry.clonedRootIndex = parent.clonedRootIndex;
+        }
+        if (entry.layer->mClonedChild != nullptr) {
+            entry.clonedRootIndex = static_cast<int32_t>(i);
+        }
+    }
+
+    // A layer can be relative to one that comes after it, so resolve these on demand.
+    mResolutions.assign(mEntries.size(), Resolution::Unresolved);
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        resolveHiddenByPolicy(static_cast<int32_t>(i));
+    }
+
+    mValid = true;
+}
+
+void LayerTreeSnapshot::addHierarchy(Layer* layer, int32_t parentIndex) {
+    const auto index = static_cast<int32_t>(mEntries.size());
+    mEntries.push_back({layer, layer->getCompositionEngineLayerFE().get(), parentIndex});
+    for (const sp<Layer>& child : layer->getDrawingChildren()) {
+        addHierarchy(child.get(), index);
+    }
+}
+
+int32_t LayerTreeSnapshot::indexOf(const Layer* layer) const {
+    const auto it = std::lower_bound(mIndices.begin(), mIndices.end(), layer,
+                                     [](const auto& pair, const Layer* l) { return pair.first < l; });
+    return it != mIndices.end() && it->first == layer ? it->second : NO_PARENT;
+}
+
+bool LayerTreeSnapshot::resolveHiddenByPolicy(int32_t index) {
+    Entry& entry = mEntries[index];
+    if (mResolutions[index] == Resolution::Resolved) {
+        return entry.hiddenByPolicy;
+    }
+    if (mResolutions[index] == Resolution::Resolving) {
+        // Relatives that loop back to this layer do not hide it.
+        return false;
+    }
+
+    if (entry.parentIndex == NO_PARENT) {
+        // The layer either has no parent, or its parent is not in the snapshot.
+        entry.hiddenByPolicy = entry.layer->isHiddenByPolicy();
+        mResolutions[index] = Resolution::Resolved;
+        return entry.hiddenByPolicy;
+    }
+
+    mResolutions[index] = Resolution::Resolving;
+    const Layer::State& state = entry.layer->getDrawingState();
+    bool hidden = (state.flags & layer_state_t::eLayerHidden) ||
+            resolveHiddenByPolicy(entry.parentIndex);
+    if (!hidden && state.isRelativeOf) {
+        const auto relativeOf = state.zOrderRelativeOf.promote();
+        if (relativeOf != nullptr) {
+            const int32_t relativeIndex = indexOf(relativeOf.get());
+            hidden = relativeIndex != NO_PARENT ? resolveHiddenByPolicy(relativeIndex)
+                                                : relativeOf->isHiddenByPolicy();
+        }
+    }
+
+    entry.hiddenByPolicy = hidden;
+    mResolutions[index] = Resolution::Resolved;
+    return hidden;
+}
+
+} // namespace android
+
+// TODO(b/129481165): remove the #pragma below and fix conversion issues
+#pragma clang diagnostic pop // ignored "-Wconversion"
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <math/half.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "LayerVector.h"
+
+namespace android {
+
+namespace compositionengine {
+class LayerFE;
+} // namespace compositionengine
+
+class Layer;
+
+/*
+ * A flattened copy of the drawing state layer hierarchy.
+ *
+ * Walking the hierarchy with LayerVector::traverseInZOrder() recursively
+ * builds a traversal list for every layer with children or relatives, and
+ * promotes weak references along the way. The snapshot does that walk once
+ * when the hierarchy changes, so that the per-frame consumers can iterate
+ * contiguous arrays instead.
+ *
+ * The entries list each root of the LayerVector followed by its drawing
+ * descendants, with every parent before its children, and each entry holds
+ * the index of its parent's entry. Consumers that pass state down the
+ * hierarchy, such as bounds, can then iterate the entries in order instead
+ * of recursing. Z-order is kept as a separate list of entry indices.
+ *
+ * Each entry also holds the values that only change with a commit, so that
+ * composition does not go back to the layer, or walk its parents, for them.
+ *
+ * The snapshot does not hold references to the layers. It must be invalidated
+ * whenever the hierarchy it was built from changes.
+ */
+class LayerTreeSnapshot {
+public:
+    static constexpr int32_t NO_PARENT = -1;
+
+    struct Entry {
+        Layer* layer = nullptr;
+        // The layer's front end for composition, or null if it is not composed.
+        compositionengine::LayerFE* layerFE = nullptr;
+        // The entry of the layer's drawing parent, or NO_PARENT for a root.
+        int32_t parentIndex = NO_PARENT;
+        // The entry of the root of the cloned hierarchy the layer is in, or NO_PARENT.
+        int32_t clonedRootIndex = NO_PARENT;
+        bool needsInputInfo = false;
+        // Layer::isHiddenByPolicy() and Layer::getAlpha(), resolved through the parent entries.
+        bool hiddenByPolicy = false;
+        half alpha = 1.0_hf;
+    };
+
+    void rebuild(const LayerVector& layers);
+    void invalidate() { mValid = false; }
+    bool isValid() const { return mValid; }
+
+    // Entries in hierarchy order. The first getHierarchySize() entries are the hierarchy of the
+    // LayerVector; any after those are layers reached only through a relative outside of it.
+    const std::vector<Entry>& getEntries() const { return mEntries; }
+    size_t getHierarchySize() const { return mHierarchySize; }
+
+    template <typename Visitor>
+    void traverseInZOrder(Visitor&& visitor) const {
+        for (int32_t index : mZOrder) {
+            visitor(mEntries[index]);
+        }
+    }
+
+    template <typename Visitor>
+    void traverseInReverseZOrder(Visitor&& visitor) const {
+        for (auto it = mZOrder.crbegin(); it != mZOrder.crend(); ++it) {
+            visitor(mEntries[*it]);
+        }
+    }
+
+private:
+    enum class Resolution : uint8_t { Unresolved, Resolving, Resolved };
+
+    void addHierarchy(Layer* layer, int32_t parentIndex);
+    int32_t indexOf(const Layer* layer) const;
+    bool resolveHiddenByPolicy(int32_t index);
+
+    std::vector<Entry> mEntries;
+    size_t mHierarchySize = 0;
+    std::vector<int32_t> mZOrder;
+
+    // Scratch state for rebuild(), kept to reuse its capacity.
+    std::vector<std::pair<const Layer*, int32_t>> mIndices;
+    std::vector<Resolution> mResolutions;
+
+    bool mValid = false;
+};
+
+} // namespace android
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// TODO(b/129481165): remove the #pragma below and fix conversion issues
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+
+//#define LOG_NDEBUG 0
+#undef LOG_TAG
+#define LOG_TAG "RegionSamplingThread"
+
+#include "RegionSamplingLuma.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <log/log.h>
+#include <ui/Transform.h>
+
+namespace android {
+
+namespace {
+
+// Four pixels at a time, the width of a NEON or SSE2 register. The compiler
+// lowers operations on this type to those instructions, depending on the target.
+constexpr int32_t kLanes = 4;
+using PixelVector = uint32_t __attribute__((vector_size(kLanes * sizeof(uint32_t))));
+
+// Calculates luma with approximation of Rec. 709 primaries
+inline uint32_t luma(uint32_t pixel) {
+    const uint32_t r = pixel & 0xFF;
+    const uint32_t g = (pixel >> 8) & 0xFF;
+    const uint32_t b = (pixel >> 16) & 0xFF;
+    return (r * 7 + b * 2 + g * 23) >> 5;
+}
+
+inline PixelVector luma(PixelVector pixels) {
+    const PixelVector r = pixels & 0xFF;
+    const PixelVector g = (pixels >> 8) & 0xFF;
+    const PixelVector b = (pixels >> 16) & 0xFF;
+    return (r * 7 + b * 2 + g * 23) >> 5;
+}
+
+// Sums the luma of count contiguous pixels.
+uint32_t sumLuma(const uint32_t* pixels, int32_t count) {
+    PixelVector accumulated = {};
+    int32_t i = 0;
+    for (; i + kLanes <= count; i += kLanes) {
+        PixelVector vector;
+        memcpy(&vector, pixels + i, sizeof(vector));
+        accumulated += luma(vector);
+    }
+
+    uint32_t sum = 0;
+    for (int32_t lane = 0; lane < kLanes; lane++) {
+        sum += accumulated[lane];
+    }
+    for (; i < count; i++) {
+        sum += luma(pixels[i]);
+    }
+    return sum;
+}
+
+// Sums the luma of every step-th pixel out of count.
+uint32_t sumLuma(const uint32_t* pixels, int32_t count, int32_t step) {
+    if (step == 1) {
+        return sumLuma(pixels, count);
+    }
+
+    uint32_t sum = 0;
+    for (int32_t i = 0; i < count; i += step) {
+        sum += luma(pixels[i]);
+    }
+    return sum;
+}
+
+struct AreaSample {
+    Rect area;
+    bool valid = false;
+    uint64_t accumulatedLuma = 0;
+    uint64_t pixelCount = 0;
+};
+
+} // namespace
+
+float sampleArea(const uint32_t* data, int32_t width, int32_t height, int32_t stride,
+                 uint32_t orientation, const Rect& area) {
+    return sampleAreas(data, width, height, stride, orientation, {area}).front();
+}
+
+std::vector<float> sampleAreas(const uint32_t* data, int32_t width, int32_t height,
+                               int32_t stride, uint32_t orientation,
+                               const std::vector<Rect>& areas, int32_t step) {
+    step = std::max(step, 1);
+
+    std::vector<AreaSample> samples(areas.size());
+    int32_t top = height;
+    int32_t bottom = 0;
+    for (size_t i = 0; i < areas.size(); i++) {
+        const Rect& sampleArea = areas[i];
+        if (!sampleArea.isValid() || (sampleArea.getWidth() > width) ||
+            (sampleArea.getHeight() > height)) {
+            ALOGE("invalid sampling region requested");
+            continue;
+        }
+
+        // (b/133849373) ROT_90 screencap images produced upside down
+        auto area = sampleArea;
+        if (orientation & ui::Transform::ROT_90) {
+            area.top = height - area.top;
+            area.bottom = height - area.bottom;
+            std::swap(area.top, area.bottom);
+
+            area.left = width - area.left;
+            area.right = width - area.right;
+            std::swap(area.left, area.right);
+        }
+
+        samples[i].area = area;
+        samples[i].valid = true;
+        top = std::min(top, area.top);
+        bottom = std::max(bottom, area.bottom);
+    }
+
+    // Walk the rows in memory order, accumulating each row into every area
+    // it intersects, rather than walking the buffer once per area. Where
+    // areas overlap, the shared pixels are summed separately for each.
+    for (int32_t row = top; row < bottom; ++row) {
+        const uint32_t* rowBase = data + row * stride;
+        for (auto& sample : samples) {
+            const Rect& area = sample.area;
+            if (!sample.valid || row < area.top || row >= area.bottom ||
+                (row - area.top) % step != 0) {
+                continue;
+            }
+            const int32_t columns = area.right - area.left;
+            sample.accumulatedLuma += sumLuma(rowBase + area.left, columns, step);
+            sample.pixelCount += (columns + step - 1) / step;
+        }
+    }
+
+    std::vector<float> lumas(samples.size(), 0.0f);
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (samples[i].valid && samples[i].pixelCount > 0) {
+            lumas[i] = samples[i].accumulatedLuma / (255.0f * samples[i].pixelCount);
+        }
+    }
+    return lumas;
+}
+
+} // namespace android
+
+// TODO(b/129481165): remove the #pragma below and fix conversion issues
+#pragma clang diagnostic pop // ignored "-Wconversion"
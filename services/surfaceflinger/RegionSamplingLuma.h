@@ -0,0 +1,39 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <ui/Rect.h>
+
+namespace android {
+
+// Returns the mean luma, in [0, 1], of an area of an RGBA_8888 buffer.
+float sampleArea(const uint32_t* data, int32_t width, int32_t height, int32_t stride,
+                 uint32_t orientation, const Rect& area);
+
+// Returns the mean luma of each of the given areas, in order. The rows are
+// walked once from top to bottom, each summed into every area it crosses, so
+// disjoint areas read each pixel at most once. Pixels where areas overlap are
+// read once per area. If step is greater than one, only every step-th row and
+// column of each area is sampled. Invalid areas report a luma of 0.
+std::vector<float> sampleAreas(const uint32_t* data, int32_t width, int32_t height,
+                               int32_t stride, uint32_t orientation,
+                               const std::vector<Rect>& areas, int32_t step = 1);
+
+} // namespace android
@@ -83,6 +83,9 @@ RegionSamplingThread::EnvironmentTimingTunables::EnvironmentTimingTunables() {
                  toNsString(defaultRegionSamplingTimerTimeout).c_str());
     int const samplingTimerTimeoutNsRaw = atoi(value);
 
+    property_get("debug.sf.region_sampling_stride", value, "1");
+    mSamplingStride = std::max(atoi(value), 1);
+
     if ((samplingPeriodNsRaw < 0) || (samplingTimerTimeoutNsRaw < 0)) {
         ALOGW("User-specified sampling tuning options nonsensical. Using defaults");
         mSamplingOffset = defaultRegionSamplingOffset;
@@ -268,45 +271,6 @@ void RegionSamplingThread::binderDied(const wp<IBinder>& who) {
     mDescriptors.erase(who);
 }
 
-float sampleArea(const uint32_t* data, int32_t width, int32_t height, int32_t stride,
-                 uint32_t orientation, const Rect& sample_area) {
-    if (!sample_area.isValid() || (sample_area.getWidth() > width) ||
-        (sample_area.getHeight() > height)) {
-        ALOGE("invalid sampling region requested");
-        return 0.0f;
-    }
-
-    // (b/133849373) ROT_90 screencap images produced upside down
-    auto area = sample_area;
-    if (orientation & ui::Transform::ROT_90) {
-        area.top = height - area.top;
-        area.bottom = height - area.bottom;
-        std::swap(area.top, area.bottom);
-
-        area.left = width - area.left;
-        area.right = width - area.right;
-        std::swap(area.left, area.right);
-    }
-
-    const uint32_t pixelCount = (area.bottom - area.top) * (area.right - area.left);
-    uint32_t accumulatedLuma = 0;
-
-    // Calculates luma with approximation of Rec. 709 primaries
-    for (int32_t row = area.top; row < area.bottom; ++row) {
-        const uint32_t* rowBase = data + row * stride;
-        for (int32_t column = area.left; column < area.right; ++column) {
-            uint32_t pixel = rowBase[column];
-            const uint32_t r = pixel & 0xFF;
-            const uint32_t g = (pixel >> 8) & 0xFF;
-            const uint32_t b = (pixel >> 16) & 0xFF;
-            const uint32_t luma = (r * 7 + b * 2 + g * 23) >> 5;
-            accumulatedLuma += luma;
-        }
-    }
-
-    return accumulatedLuma / (255.0f * pixelCount);
-}
-
 std::vector<float> RegionSamplingThread::sampleBuffer(
         const sp<GraphicBuffer>& buffer, const Point& leftTop,
         const std::vector<RegionSamplingThread::Descriptor>& descriptors, uint32_t orientation) {
@@ -319,13 +283,11 @@ std::vector<float> RegionSamplingThread::sampleBuffer(
     const int32_t width = buffer->getWidth();
     const int32_t height = buffer->getHeight();
     const int32_t stride = buffer->getStride();
-    std::vector<float> lumas(descriptors.size());
-    std::transform(descriptors.begin(), descriptors.end(), lumas.begin(),
-                   [&](auto const& descriptor) {
-                       return sampleArea(data.get(), width, height, stride, orientation,
-                                         descriptor.area - leftTop);
-                   });
-    return lumas;
+    std::vector<Rect> areas(descriptors.size());
+    std::transform(descriptors.begin(), descriptors.end(), areas.begin(),
+                   [&](auto const& descriptor) { return descriptor.area - leftTop; });
+    return sampleAreas(data.get(), width, height, stride, orientation, areas,
+                       mTunables.mSamplingStride);
 }
 
 void RegionSamplingThread::captureSample() {
@@ -27,6 +27,7 @@
 #include <ui/GraphicBuffer.h>
 #include <ui/Rect.h>
 #include <utils/StrongPointer.h>
+#include "RegionSamplingLuma.h"
 #include "Scheduler/OneShotTimer.h"
 
 namespace android {
@@ -37,9 +38,6 @@ class Scheduler;
 class SurfaceFlinger;
 struct SamplingOffsetCallback;
 
-float sampleArea(const uint32_t* data, int32_t width, int32_t height, int32_t stride,
-                 uint32_t orientation, const Rect& area);
-
 class RegionSamplingThread : public IBinder::DeathRecipient {
 public:
     struct TimingTunables {
@@ -57,6 +55,9 @@ public:
         // This is the interval at which the luma sampling system will check that the luma clients
         // have up to date information. It defaults to the mSamplingPeriod.
         std::chrono::nanoseconds mSamplingTimerTimeout;
+        // debug.sf.region_sampling_stride
+        // Only every Nth row and column of each sampling area is used to compute its luma.
+        int32_t mSamplingStride = 1;
     };
     struct EnvironmentTimingTunables : TimingTunables {
         EnvironmentTimingTunables();
@@ -22,8 +22,11 @@
 
 #include <pthread.h>
 #include <sched.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstdint>
 #include <optional>
@@ -71,6 +74,19 @@ std::string toString(const EventThreadConnection& connection) {
                         toString(connection.vsyncRequest).c_str());
 }
 
+std::string toString(const EventThreadConnection::DeliveryStats& stats) {
+    std::string result =
+            StringPrintf("delivered %" PRIu64 " events in %" PRIu64 " writes, %" PRIu64
+                         " failed writes",
+                         stats.events, stats.writes, stats.failedWrites);
+    if (stats.vsyncs > 0) {
+        StringAppendF(&result, ", VSYNC latency avg=%.3fms max=%.3fms",
+                      stats.totalVSyncLatency / 1e6 / static_cast<double>(stats.vsyncs),
+                      stats.maxVSyncLatency / 1e6);
+    }
+    return result;
+}
+
 std::string toString(const DisplayEventReceiver::Event& event) {
     switch (event.header.type) {
         case DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG:
@@ -153,9 +169,34 @@ void EventThreadConnection::requestNextVsync() {
     mEventThread->requestNextVsync(this);
 }
 
-status_t EventThreadConnection::postEvent(const DisplayEventReceiver::Event& event) {
-    ssize_t size = DisplayEventReceiver::sendEvents(&mChannel, &event, 1);
-    return size < 0 ? status_t(size) : status_t(NO_ERROR);
+status_t EventThreadConnection::getVsyncTimeline(gui::VsyncTimeline* outTimeline) {
+    return mEventThread->getVsyncTimeline(outTimeline);
+}
+
+ssize_t EventThreadConnection::postEvents(const DisplayEventReceiver::Event* const* events,
+                                          size_t count) {
+    LOG_ALWAYS_FATAL_IF(count > kMaxEventBatchSize, "Too many events: %zu", count);
+    if (count == 1) {
+        return DisplayEventReceiver::sendEvents(&mChannel, events[0], 1);
+    }
+
+    // The channel is a SOCK_SEQPACKET socket: sending the events as one message would make
+    // receivers that read fewer events at a time discard the rest.
+    std::array<iovec, kMaxEventBatchSize> buffers;
+    std::array<mmsghdr, kMaxEventBatchSize> messages{};
+    for (size_t i = 0; i < count; i++) {
+        buffers[i].iov_base = const_cast<DisplayEventReceiver::Event*>(events[i]);
+        buffers[i].iov_len = sizeof(DisplayEventReceiver::Event);
+        messages[i].msg_hdr.msg_iov = &buffers[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int sent;
+    do {
+        sent = sendmmsg(mChannel.getSendFd(), messages.data(), count, MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    // sendmmsg stops at the first message that does not fit, and only fails if none did.
+    return sent < 0 ? -errno : sent;
 }
 
 // ---------------------------------------------------------------------------
@@ -167,6 +208,8 @@ namespace impl {
 EventThread::EventThread(std::unique_ptr<VSyncSource> vsyncSource,
                          InterceptVSyncsCallback interceptVSyncsCallback)
       : mVSyncSource(std::move(vsyncSource)),
+        mVsyncTimeline(gui::VsyncTimeline::create(
+                StringPrintf("VsyncTimeline-%s", mVSyncSource->getName()).c_str())),
         mInterceptVSyncsCallback(std::move(interceptVSyncsCallback)),
         mThreadName(mVSyncSource->getName()) {
     mVSyncSource->setCallback(this);
@@ -225,6 +268,9 @@ status_t EventThread::registerDisplayEventConnection(const sp<EventThreadConnect
         return ALREADY_EXISTS;
     }
 
+    // Connections that are gone are otherwise only noticed when an event goes to every
+    // connection, which is rare.
+    removeDeadConnectionsLocked();
     mDisplayEventConnections.push_back(connection);
     mCondition.notify_all();
     return NO_ERROR;
@@ -236,6 +282,19 @@ void EventThread::removeDisplayEventConnectionLocked(const wp<EventThreadConnect
     if (it != mDisplayEventConnections.cend()) {
         mDisplayEventConnections.erase(it);
     }
+    it = std::find(mVSyncConnections.cbegin(), mVSyncConnections.cend(), connection);
+    if (it != mVSyncConnections.cend()) {
+        mVSyncConnections.erase(it);
+    }
+}
+
+void EventThread::removeDeadConnectionsLocked() {
+    mDisplayEventConnections.erase(std::remove_if(mDisplayEventConnections.begin(),
+                                                  mDisplayEventConnections.end(),
+                                                  [](const wp<EventThreadConnection>& ptr) {
+                                                      return ptr.promote() == nullptr;
+                                                  }),
+                                   mDisplayEventConnections.end());
 }
 
 void EventThread::setVsyncRate(uint32_t rate, const sp<EventThreadConnection>& connection) {
@@ -247,6 +306,15 @@ void EventThread::setVsyncRate(uint32_t rate, const sp<EventThreadConnection>& c
 
     const auto request = rate == 0 ? VSyncRequest::None : static_cast<VSyncRequest>(rate);
     if (connection->vsyncRequest != request) {
+        if (connection->vsyncRequest == VSyncRequest::None) {
+            mVSyncConnections.push_back(connection);
+        } else if (request == VSyncRequest::None) {
+            const auto it = std::find(mVSyncConnections.cbegin(), mVSyncConnections.cend(),
+                                      connection);
+            if (it != mVSyncConnections.cend()) {
+                mVSyncConnections.erase(it);
+            }
+        }
         connection->vsyncRequest = request;
         mCondition.notify_all();
     }
@@ -261,6 +329,7 @@ void EventThread::requestNextVsync(const sp<EventThreadConnection>& connection)
 
     if (connection->vsyncRequest == VSyncRequest::None) {
         connection->vsyncRequest = VSyncRequest::Single;
+        mVSyncConnections.push_back(connection);
         mCondition.notify_all();
     }
 }
@@ -272,6 +341,10 @@ void EventThread::onScreenReleased() {
     }
 
     mVSyncState->synthetic = true;
+    // Synthetic VSYNC events do not follow the display's timeline.
+    if (mVsyncTimeline) {
+        mVsyncTimeline->invalidate();
+    }
     mCondition.notify_all();
 }
 
@@ -292,6 +365,17 @@ void EventThread::onVSyncEvent(nsecs_t timestamp, nsecs_t expectedVSyncTimestamp
     mPendingEvents.push_back(makeVSync(mVSyncState->displayId, timestamp, ++mVSyncState->count,
                                        expectedVSyncTimestamp));
     mCondition.notify_all();
+
+    // A late event from a source that was just disabled must not make the timeline look current.
+    if (mVsyncTimeline && mState == State::VSync) {
+        const nsecs_t period = mVSyncSource->getVSyncPeriod();
+        if (period > 0) {
+            mVsyncTimeline->publish(
+                    {mVSyncState->count, timestamp, expectedVSyncTimestamp, period});
+        } else {
+            mVsyncTimeline->invalidate();
+        }
+    }
 }
 
 void EventThread::onHotplugReceived(PhysicalDisplayId displayId, bool connected) {
@@ -306,63 +390,102 @@ void EventThread::onConfigChanged(PhysicalDisplayId displayId, HwcConfigIndexTyp
     std::lock_guard<std::mutex> lock(mMutex);
 
     mPendingEvents.push_back(makeConfigChanged(displayId, configId, vsyncPeriod));
+    // The phase of the new period is only known once the next VSYNC event arrives.
+    if (mVsyncTimeline) {
+        mVsyncTimeline->invalidate();
+    }
     mCondition.notify_all();
 }
 
 size_t EventThread::getEventThreadConnectionCount() {
     std::lock_guard<std::mutex> lock(mMutex);
+    removeDeadConnectionsLocked();
     return mDisplayEventConnections.size();
 }
 
+status_t EventThread::getVsyncTimeline(gui::VsyncTimeline* outTimeline) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mVsyncTimeline) {
+        return NO_INIT;
+    }
+    return mVsyncTimeline->share(outTimeline);
+}
+
 void EventThread::threadMain(std::unique_lock<std::mutex>& lock) {
+    DisplayEvents events;
     DisplayEventConsumers consumers;
 
     while (mState != State::Quit) {
-        std::optional<DisplayEventReceiver::Event> event;
-
-        // Determine next event to dispatch.
-        if (!mPendingEvents.empty()) {
-            event = mPendingEvents.front();
+        // Take the pending events in batches, so that each connection receives all of its events
+        // with a single write.
+        while (!mPendingEvents.empty() &&
+               events.size() < EventThreadConnection::kMaxEventBatchSize) {
+            events.push_back(mPendingEvents.front());
             mPendingEvents.pop_front();
+        }
+        mDispatchPass++;
 
-            switch (event->header.type) {
+        for (size_t i = 0; i < events.size(); i++) {
+            const DisplayEventReceiver::Event& event = events[i];
+            switch (event.header.type) {
                 case DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG:
-                    if (event->hotplug.connected && !mVSyncState) {
-                        mVSyncState.emplace(event->header.displayId);
-                    } else if (!event->hotplug.connected && mVSyncState &&
-                               mVSyncState->displayId == event->header.displayId) {
+                    if (event.hotplug.connected && !mVSyncState) {
+                        mVSyncState.emplace(event.header.displayId);
+                    } else if (!event.hotplug.connected && mVSyncState &&
+                               mVSyncState->displayId == event.header.displayId) {
                         mVSyncState.reset();
+                        if (mVsyncTimeline) {
+                            mVsyncTimeline->invalidate();
+                        }
                     }
                     break;
 
                 case DisplayEventReceiver::DISPLAY_EVENT_VSYNC:
                     if (mInterceptVSyncsCallback) {
-                        mInterceptVSyncsCallback(event->header.timestamp);
+                        mInterceptVSyncsCallback(event.header.timestamp);
                     }
                     break;
             }
-        }
-
-        bool vsyncRequested = false;
 
-        // Find connections that should consume this event.
-        auto it = mDisplayEventConnections.begin();
-        while (it != mDisplayEventConnections.end()) {
-            if (const auto connection = it->promote()) {
-                vsyncRequested |= connection->vsyncRequest != VSyncRequest::None;
-
-                if (event && shouldConsumeEvent(*event, connection)) {
-                    consumers.push_back(connection);
+            // Find connections that should consume this event. Only connections that requested
+            // VSYNC events can consume those.
+            if (event.header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+                for (const auto& ptr : mVSyncConnections) {
+                    const auto connection = ptr.promote();
+                    if (connection && shouldConsumeEvent(event, connection)) {
+                        addConsumerLocked(connection, i, consumers);
+                    }
                 }
+                continue;
+            }
 
-                ++it;
-            } else {
-                it = mDisplayEventConnections.erase(it);
+            auto it = mDisplayEventConnections.begin();
+            while (it != mDisplayEventConnections.end()) {
+                if (const auto connection = it->promote()) {
+                    if (shouldConsumeEvent(event, connection)) {
+                        addConsumerLocked(connection, i, consumers);
+                    }
+                    ++it;
+                } else {
+                    it = mDisplayEventConnections.erase(it);
+                }
             }
         }
 
+        // Forget connections that are gone or no longer want VSYNC events, e.g. because they only
+        // wanted the one they just consumed.
+        mVSyncConnections.erase(std::remove_if(mVSyncConnections.begin(), mVSyncConnections.end(),
+                                               [](const wp<EventThreadConnection>& ptr) {
+                                                   const auto connection = ptr.promote();
+                                                   return !connection ||
+                                                           connection->vsyncRequest ==
+                                                           VSyncRequest::None;
+                                               }),
+                                mVSyncConnections.end());
+        const bool vsyncRequested = !mVSyncConnections.empty();
+
         if (!consumers.empty()) {
-            dispatchEvent(*event, consumers);
+            dispatchEvents(events, consumers);
             consumers.clear();
         }
 
@@ -376,6 +499,10 @@ void EventThread::threadMain(std::unique_lock<std::mutex>& lock) {
 
         if (mState != nextState) {
             if (mState == State::VSync) {
+                // The timeline is no longer updated, so readers must not extrapolate from it.
+                if (mVsyncTimeline) {
+                    mVsyncTimeline->invalidate();
+                }
                 mVSyncSource->setVSyncEnabled(false);
             } else if (nextState == State::VSync) {
                 mVSyncSource->setVSyncEnabled(true);
@@ -384,7 +511,8 @@ void EventThread::threadMain(std::unique_lock<std::mutex>& lock) {
             mState = nextState;
         }
 
-        if (event) {
+        if (!events.empty()) {
+            events.clear();
             continue;
         }
 
@@ -448,22 +576,59 @@ bool EventThread::shouldConsumeEvent(const DisplayEventReceiver::Event& event,
     }
 }
 
-void EventThread::dispatchEvent(const DisplayEventReceiver::Event& event,
-                                const DisplayEventConsumers& consumers) {
+void EventThread::addConsumerLocked(const sp<EventThreadConnection>& connection,
+                                    size_t eventIndex, DisplayEventConsumers& consumers) {
+    if (connection->dispatchPass != mDispatchPass) {
+        connection->dispatchPass = mDispatchPass;
+        connection->dispatchIndex = consumers.size();
+        consumers.push_back({connection, 0});
+    }
+    consumers[connection->dispatchIndex].eventMask |= 1u << eventIndex;
+}
+
+void EventThread::dispatchEvents(const DisplayEvents& events,
+                                 const DisplayEventConsumers& consumers) {
+    std::array<const DisplayEventReceiver::Event*, EventThreadConnection::kMaxEventBatchSize>
+            batch;
     for (const auto& consumer : consumers) {
-        switch (consumer->postEvent(event)) {
-            case NO_ERROR:
-                break;
-
-            case -EAGAIN:
-                // TODO: Try again if pipe is full.
-                ALOGW("Failed dispatching %s for %s", toString(event).c_str(),
-                      toString(*consumer).c_str());
-                break;
-
-            default:
-                // Treat EPIPE and other errors as fatal.
-                removeDisplayEventConnectionLocked(consumer);
+        size_t count = 0;
+        for (uint32_t mask = consumer.eventMask; mask != 0; mask &= mask - 1) {
+            batch[count++] = &events[__builtin_ctz(mask)];
+        }
+
+        const auto& connection = consumer.connection;
+        auto& stats = connection->deliveryStats;
+        ssize_t sent = connection->postEvents(batch.data(), count);
+        if (sent == -EAGAIN) {
+            sent = 0;
+        } else if (sent < 0) {
+            // Treat EPIPE and other errors as fatal.
+            removeDisplayEventConnectionLocked(connection);
+            continue;
+        }
+
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < static_cast<size_t>(sent); i++) {
+            if (batch[i]->header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+                const nsecs_t latency = now - batch[i]->header.timestamp;
+                stats.vsyncs++;
+                stats.totalVSyncLatency += latency;
+                stats.maxVSyncLatency = std::max(stats.maxVSyncLatency, latency);
+            }
+        }
+        if (sent > 0) {
+            stats.events += static_cast<size_t>(sent);
+            stats.writes++;
+        }
+
+        // Only the events that did not fit are lost.
+        // TODO: Try again if pipe is full.
+        if (static_cast<size_t>(sent) < count) {
+            stats.failedWrites++;
+            for (size_t i = static_cast<size_t>(sent); i < count; i++) {
+                ALOGW("Failed dispatching %s for %s", toString(*batch[i]).c_str(),
+                      toString(*connection).c_str());
+            }
         }
     }
 }
@@ -480,6 +645,13 @@ void EventThread::dump(std::string& result) const {
         StringAppendF(&result, "none\n");
     }
 
+    if (gui::VsyncTimeline::Snapshot snapshot; mVsyncTimeline && mVsyncTimeline->read(&snapshot)) {
+        StringAppendF(&result, "  timeline: count=%u timestamp=%" PRId64 " period=%" PRId64 "\n",
+                      snapshot.count, snapshot.timestamp, snapshot.period);
+    } else {
+        StringAppendF(&result, "  timeline: %s\n", mVsyncTimeline ? "invalid" : "unavailable");
+    }
+
     StringAppendF(&result, "  pending events (count=%zu):\n", mPendingEvents.size());
     for (const auto& event : mPendingEvents) {
         StringAppendF(&result, "    %s\n", toString(event).c_str());
@@ -488,7 +660,8 @@ void EventThread::dump(std::string& result) const {
     StringAppendF(&result, "  connections (count=%zu):\n", mDisplayEventConnections.size());
     for (const auto& ptr : mDisplayEventConnections) {
         if (const auto connection = ptr.promote()) {
-            StringAppendF(&result, "    %s\n", toString(*connection).c_str());
+            StringAppendF(&result, "    %s\n      %s\n", toString(*connection).c_str(),
+                          toString(connection->deliveryStats).c_str());
         }
     }
 }
@@ -19,6 +19,7 @@
 #include <android-base/thread_annotations.h>
 #include <gui/DisplayEventReceiver.h>
 #include <gui/IDisplayEventConnection.h>
+#include <gui/VsyncTimeline.h>
 #include <private/gui/BitTube.h>
 #include <sys/types.h>
 #include <utils/Errors.h>
@@ -66,6 +67,8 @@ public:
     virtual void setVSyncEnabled(bool enable) = 0;
     virtual void setCallback(Callback* callback) = 0;
     virtual void setPhaseOffset(nsecs_t phaseOffset) = 0;
+    // Returns the predicted VSYNC period, or 0 if VSYNC events are not predictable.
+    virtual nsecs_t getVSyncPeriod() const = 0;
 
     virtual void dump(std::string& result) const = 0;
 };
@@ -76,11 +79,19 @@ public:
                           ISurfaceComposer::ConfigChanged configChanged);
     virtual ~EventThreadConnection();
 
-    virtual status_t postEvent(const DisplayEventReceiver::Event& event);
+    // Maximum number of events dispatched to a connection at once.
+    static constexpr size_t kMaxEventBatchSize = 16;
+
+    // Sends events to the receiver in order, each as its own message so that receivers reading
+    // one event at a time see all of them, but with a single system call. Returns the number of
+    // events sent, which is less than count if the receiver is too far behind to take the rest,
+    // or a negative error if none were sent.
+    virtual ssize_t postEvents(const DisplayEventReceiver::Event* const* events, size_t count);
 
     status_t stealReceiveChannel(gui::BitTube* outChannel) override;
     status_t setVsyncRate(uint32_t rate) override;
     void requestNextVsync() override; // asynchronous
+    status_t getVsyncTimeline(gui::VsyncTimeline* outTimeline) override;
 
     // Called in response to requestNextVsync.
     const ResyncCallback resyncCallback;
@@ -89,6 +100,23 @@ public:
     const ISurfaceComposer::ConfigChanged mConfigChanged =
             ISurfaceComposer::ConfigChanged::eConfigChangedSuppress;
 
+    // Where the EventThread collects the events for this connection during a dispatch pass. Only
+    // valid while dispatchPass matches the EventThread's current pass.
+    uint64_t dispatchPass = 0;
+    size_t dispatchIndex = 0;
+
+    // Stats for dumpsys. Like the fields above, guarded by the EventThread's mutex.
+    struct DeliveryStats {
+        uint64_t events = 0;
+        uint64_t writes = 0;
+        uint64_t failedWrites = 0;
+        // Time from VSYNC to the event being written to the receiver.
+        uint64_t vsyncs = 0;
+        nsecs_t totalVSyncLatency = 0;
+        nsecs_t maxVSyncLatency = 0;
+    };
+    DeliveryStats deliveryStats;
+
 private:
     virtual void onFirstRef();
     EventThread* const mEventThread;
@@ -126,6 +154,9 @@ public:
 
     // Retrieves the number of event connections tracked by this EventThread.
     virtual size_t getEventThreadConnectionCount() = 0;
+
+    // Shares the memory through which the VSYNC timeline of this EventThread is published.
+    virtual status_t getVsyncTimeline(gui::VsyncTimeline* outTimeline) const = 0;
 };
 
 namespace impl {
@@ -161,25 +192,44 @@ public:
 
     size_t getEventThreadConnectionCount() override;
 
+    status_t getVsyncTimeline(gui::VsyncTimeline* outTimeline) const override;
+
 private:
     friend EventThreadTest;
 
-    using DisplayEventConsumers = std::vector<sp<EventThreadConnection>>;
+    using DisplayEvents = std::vector<DisplayEventReceiver::Event>;
+
+    struct DisplayEventConsumer {
+        sp<EventThreadConnection> connection;
+        // Bit i is set if the connection consumes the i-th event of the batch.
+        uint32_t eventMask = 0;
+    };
+    using DisplayEventConsumers = std::vector<DisplayEventConsumer>;
+
+    static_assert(EventThreadConnection::kMaxEventBatchSize <=
+                  sizeof(DisplayEventConsumer::eventMask) * 8);
 
     void threadMain(std::unique_lock<std::mutex>& lock) REQUIRES(mMutex);
 
     bool shouldConsumeEvent(const DisplayEventReceiver::Event& event,
                             const sp<EventThreadConnection>& connection) const REQUIRES(mMutex);
-    void dispatchEvent(const DisplayEventReceiver::Event& event,
-                       const DisplayEventConsumers& consumers) REQUIRES(mMutex);
+    void addConsumerLocked(const sp<EventThreadConnection>& connection, size_t eventIndex,
+                           DisplayEventConsumers& consumers) REQUIRES(mMutex);
+    void dispatchEvents(const DisplayEvents& events, const DisplayEventConsumers& consumers)
+            REQUIRES(mMutex);
 
     void removeDisplayEventConnectionLocked(const wp<EventThreadConnection>& connection)
             REQUIRES(mMutex);
+    void removeDeadConnectionsLocked() REQUIRES(mMutex);
 
     // Implements VSyncSource::Callback
     void onVSyncEvent(nsecs_t timestamp, nsecs_t expectedVSyncTimestamp) override;
 
     const std::unique_ptr<VSyncSource> mVSyncSource GUARDED_BY(mMutex);
+    // Where the most recent VSYNC event and the predicted period are published, so that clients
+    // can predict upcoming events without waiting for them. Invalid while VSYNC is disabled. Null
+    // if it could not be created.
+    const std::unique_ptr<gui::VsyncTimeline> mVsyncTimeline GUARDED_BY(mMutex);
 
     const InterceptVSyncsCallback mInterceptVSyncsCallback;
     const char* const mThreadName;
@@ -189,7 +239,11 @@ private:
     mutable std::condition_variable mCondition;
 
     std::vector<wp<EventThreadConnection>> mDisplayEventConnections GUARDED_BY(mMutex);
+    // The connections whose vsyncRequest is not None, so that dispatching VSYNC events, which is
+    // most of what this thread does, does not scan every connection.
+    std::vector<wp<EventThreadConnection>> mVSyncConnections GUARDED_BY(mMutex);
     std::deque<DisplayEventReceiver::Event> mPendingEvents GUARDED_BY(mMutex);
+    uint64_t mDispatchPass GUARDED_BY(mMutex) = 0;
 
     // VSYNC state of connected display.
     struct VSyncState {
@@ -45,6 +45,8 @@ public:
     const char* getName() const override { return "inject"; }
     void setVSyncEnabled(bool) override {}
     void setPhaseOffset(nsecs_t) override {}
+    // Injected VSYNC events replay a trace, so they cannot be predicted.
+    nsecs_t getVSyncPeriod() const override { return 0; }
     void dump(std::string&) const override {}
 
 private:
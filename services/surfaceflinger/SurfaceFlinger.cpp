@@ -250,6 +250,20 @@ bool validateCompositionDataspace(Dataspace dataspace) {
     return dataspace == Dataspace::V0_SRGB || dataspace == Dataspace::DISPLAY_P3;
 }
 
+// Collects the acquire fences a transaction has to wait for before it can be
+// applied, so that checking whether a queued transaction is ready does not
+// need to walk every ComposerState again.
+std::vector<sp<Fence>> getAcquireFences(const Vector<ComposerState>& states) {
+    std::vector<sp<Fence>> fences;
+    for (const ComposerState& state : states) {
+        const layer_state_t& s = state.state;
+        if ((s.what & layer_state_t::eAcquireFenceChanged) && s.acquireFence) {
+            fences.push_back(s.acquireFence);
+        }
+    }
+    return fences;
+}
+
 class FrameRateFlexibilityToken : public BBinder {
 public:
     FrameRateFlexibilityToken(std::function<void()> callback) : mCallback(callback) {}
@@ -438,6 +452,13 @@ SurfaceFlinger::SurfaceFlinger(Factory& factory) : SurfaceFlinger(factory, SkipI
     property_get("debug.sf.disable_client_composition_cache", value, "0");
     mDisableClientCompositionCache = atoi(value);
 
+    property_get("debug.sf.predict_composition_strategy", value, "0");
+    mPredictCompositionStrategy = atoi(value);
+    ALOGI_IF(mPredictCompositionStrategy, "Enabling composition strategy prediction");
+
+    property_get("debug.sf.layer_trace_keyframe_interval", value, "0");
+    mTracing.setKeyframeInterval(std::max(atoi(value), 0));
+
     // We should be reading 'persist.sys.sf.color_saturation' here
     // but since /data may be encrypted, we need to wait until after vold
     // comes online to attempt to read the property. The property is
@@ -1465,8 +1486,8 @@ status_t SurfaceFlinger::getLayerDebugInfo(std::vector<LayerDebugInfo>* outLayer
     outLayers->clear();
     schedule([=] {
         const auto display = ON_MAIN_THREAD(getDefaultDisplayDeviceLocked());
-        mDrawingState.traverseInZOrder([&](Layer* layer) {
-            outLayers->push_back(layer->getLayerDebugInfo(display.get()));
+        getDrawingLayerSnapshot().traverseInZOrder([&](const LayerTreeSnapshot::Entry& entry) {
+            outLayers->push_back(entry.layer->getLayerDebugInfo(display.get()));
         });
     }).wait();
     return NO_ERROR;
@@ -1984,6 +2005,9 @@ void SurfaceFlinger::onMessageInvalidate(nsecs_t expectedVSyncTime) {
         refreshNeeded = handleMessageTransaction();
         refreshNeeded |= handleMessageInvalidate();
         if (mTracingEnabled) {
+            // Rebuild the layer snapshot while the tracing thread is locked out, so that it can
+            // read the snapshot without rebuilding it.
+            getDrawingLayerSnapshot();
             mAddCompositionStateToTrace =
                     mTracing.flagIsSetLocked(SurfaceTracing::TRACE_COMPOSITION);
             if (mVisibleRegionsDirty && !mAddCompositionStateToTrace) {
@@ -2058,9 +2082,10 @@ void SurfaceFlinger::onMessageRefresh() {
     for (const auto& [_, display] : displays) {
         refreshArgs.outputs.push_back(display->getCompositionDisplay());
     }
-    mDrawingState.traverseInZOrder([&refreshArgs](Layer* layer) {
-        if (auto layerFE = layer->getCompositionEngineLayerFE())
-            refreshArgs.layers.push_back(layerFE);
+    const auto& layerSnapshot = getDrawingLayerSnapshot();
+    refreshArgs.layers.reserve(layerSnapshot.getEntries().size());
+    layerSnapshot.traverseInZOrder([&refreshArgs](const LayerTreeSnapshot::Entry& entry) {
+        if (entry.layerFE) refreshArgs.layers.push_back(entry.layerFE);
     });
     refreshArgs.layersWithQueuedFrames.reserve(mLayersWithQueuedFrames.size());
     for (sp<Layer> layer : mLayersWithQueuedFrames) {
@@ -2078,6 +2103,7 @@ void SurfaceFlinger::onMessageRefresh() {
     refreshArgs.updatingOutputGeometryThisFrame = mVisibleRegionsDirty;
     refreshArgs.updatingGeometryThisFrame = mGeometryInvalid || mVisibleRegionsDirty;
     refreshArgs.blursAreExpensive = mBlursAreExpensive;
+    refreshArgs.predictCompositionStrategy = mPredictCompositionStrategy;
     refreshArgs.internalDisplayRotationFlags = DisplayDevice::getPrimaryDisplayRotationFlags();
 
     if (CC_UNLIKELY(mDrawingState.colorMatrixChanged)) {
@@ -2224,14 +2250,21 @@ void SurfaceFlinger::postComposition()
     ATRACE_CALL();
     ALOGV("postComposition");
 
+    // Polls the pending fences of every timeline in one system call, before the fences of this
+    // frame, which are likely still pending, are pushed.
+    auto& fenceTimelines = getBE().mFenceTimelines;
+    fenceTimelines.clear();
+    fenceTimelines.push_back(&getBE().mGlCompositionDoneTimeline);
+    fenceTimelines.push_back(&getBE().mDisplayTimeline);
+    mDrawingState.traverse([&](Layer* layer) { layer->addFenceTimelines(&fenceTimelines); });
+    getBE().mFenceTimelinePoller.updateSignalTimes(fenceTimelines);
+
     nsecs_t dequeueReadyTime = systemTime();
     for (auto& layer : mLayersWithQueuedFrames) {
         layer->releasePendingBuffer(dequeueReadyTime);
     }
 
     const auto* display = ON_MAIN_THREAD(getDefaultDisplayDeviceLocked()).get();
-
-    getBE().mGlCompositionDoneTimeline.updateSignalTimes();
     std::shared_ptr<FenceTime> glCompositionDoneFenceTime;
     if (display && display->getCompositionDisplay()->getState().usesClientComposition) {
         glCompositionDoneFenceTime =
@@ -2243,7 +2276,6 @@ void SurfaceFlinger::postComposition()
         glCompositionDoneFenceTime = FenceTime::NO_FENCE;
     }
 
-    getBE().mDisplayTimeline.updateSignalTimes();
     mPreviousPresentFences[1] = mPreviousPresentFences[0];
     mPreviousPresentFences[0] =
             display ? getHwComposer().getPresentFence(*display->getId()) : Fence::NO_FENCE;
@@ -2384,17 +2416,29 @@ FloatRect SurfaceFlinger::getLayerClipBoundsForDisplay(const DisplayDevice& disp
 }
 
 void SurfaceFlinger::computeLayerBounds() {
+    const auto& layerSnapshot = getDrawingLayerSnapshot();
+    const auto& entries = layerSnapshot.getEntries();
     for (const auto& pair : ON_MAIN_THREAD(mDisplays)) {
         const auto& displayDevice = pair.second;
         const auto display = displayDevice->getCompositionDisplay();
-        for (const auto& layer : mDrawingState.layersSortedByZ) {
-            // only consider the layers on the given layer stack
-            if (!display->belongsInOutput(layer->getLayerStack(), layer->getPrimaryDisplayOnly())) {
-                continue;
+        const FloatRect clipBounds = getLayerClipBoundsForDisplay(*displayDevice);
+
+        // Each root is followed by its descendants, parents first, so a parent's bounds are
+        // always computed before its children's.
+        bool rootInOutput = false;
+        for (size_t i = 0; i < layerSnapshot.getHierarchySize(); i++) {
+            const auto& entry = entries[i];
+            if (entry.parentIndex == LayerTreeSnapshot::NO_PARENT) {
+                // only consider the layers on the given layer stack
+                rootInOutput = display->belongsInOutput(entry.layer->getLayerStack(),
+                                                        entry.layer->getPrimaryDisplayOnly());
+                if (rootInOutput) {
+                    entry.layer->computeOwnBounds(clipBounds, ui::Transform(),
+                                                  0.f /* shadowRadius */);
+                }
+            } else if (rootInOutput) {
+                entry.layer->computeOwnBoundsFromParent(*entries[entry.parentIndex].layer);
             }
-
-            layer->computeBounds(getLayerClipBoundsForDisplay(*displayDevice), ui::Transform(),
-                                 0.f /* shadowRadius */);
         }
     }
 }
@@ -2911,12 +2955,12 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
     if (mLayersRemoved) {
         mLayersRemoved = false;
         mVisibleRegionsDirty = true;
-        mDrawingState.traverseInZOrder([&](Layer* layer) {
-            if (mLayersPendingRemoval.indexOf(layer) >= 0) {
+        getDrawingLayerSnapshot().traverseInZOrder([&](const LayerTreeSnapshot::Entry& entry) {
+            if (mLayersPendingRemoval.indexOf(entry.layer) >= 0) {
                 // this layer is not visible anymore
                 Region visibleReg;
-                visibleReg.set(layer->getScreenBounds());
-                invalidateLayerStack(layer, visibleReg);
+                visibleReg.set(entry.layer->getScreenBounds());
+                invalidateLayerStack(entry.layer, visibleReg);
             }
         });
     }
@@ -2946,11 +2990,17 @@ void SurfaceFlinger::updateInputFlinger() {
 void SurfaceFlinger::updateInputWindowInfo() {
     std::vector<InputWindowInfo> inputHandles;
 
-    mDrawingState.traverseInReverseZOrder([&](Layer* layer) {
-        if (layer->needsInputInfo()) {
+    const auto& layerSnapshot = getDrawingLayerSnapshot();
+    const auto& entries = layerSnapshot.getEntries();
+    layerSnapshot.traverseInReverseZOrder([&](const LayerTreeSnapshot::Entry& entry) {
+        if (entry.needsInputInfo) {
+            const Layer* clonedRoot = entry.clonedRootIndex != LayerTreeSnapshot::NO_PARENT
+                    ? entries[entry.clonedRootIndex].layer
+                    : nullptr;
             // When calculating the screen bounds we ignore the transparent region since it may
             // result in an unwanted offset.
-            inputHandles.push_back(layer->fillInputInfo());
+            inputHandles.push_back(
+                    entry.layer->fillInputInfo(entry.hiddenByPolicy, entry.alpha, clonedRoot));
         }
     });
 
@@ -3087,6 +3137,14 @@ void SurfaceFlinger::commitTransactionLocked() {
 
     commitOffscreenLayers();
     mDrawingState.traverse([&](Layer* layer) { layer->updateMirrorInfo(); });
+    mDrawingLayerSnapshot.invalidate();
+}
+
+const LayerTreeSnapshot& SurfaceFlinger::getDrawingLayerSnapshot() {
+    if (!mDrawingLayerSnapshot.isValid()) {
+        mDrawingLayerSnapshot.rebuild(mDrawingState.layersSortedByZ);
+    }
+    return mDrawingLayerSnapshot;
 }
 
 void SurfaceFlinger::commitOffscreenLayers() {
@@ -3206,7 +3264,7 @@ status_t SurfaceFlinger::addClientLayer(const sp<Client>& client, const sp<IBind
         Mutex::Autolock _l(mStateLock);
         sp<Layer> parent;
         if (parentHandle != nullptr) {
-            parent = fromHandleLocked(parentHandle).promote();
+            parent = fromHandle(parentHandle).promote();
             if (parent == nullptr) {
                 return NAME_NOT_FOUND;
             }
@@ -3220,7 +3278,10 @@ status_t SurfaceFlinger::addClientLayer(const sp<Client>& client, const sp<IBind
             return NO_MEMORY;
         }
 
-        mLayersByLocalBinderToken.emplace(handle->localBinder(), lbc);
+        {
+            std::lock_guard lock(mLayerHandlesLock);
+            mLayersByLocalBinderToken.emplace(handle->localBinder(), lbc);
+        }
 
         if (parent == nullptr && addToCurrentState) {
             mCurrentState.layersSortedByZ.add(lbc);
@@ -3295,7 +3356,7 @@ bool SurfaceFlinger::flushTransactionQueues() {
     // to prevent onHandleDestroyed from being called while the lock is held,
     // we must keep a copy of the transactions (specifically the composer
     // states) around outside the scope of the lock
-    std::vector<const TransactionState> transactions;
+    std::vector<TransactionState> transactions;
     bool flushedATransaction = false;
     {
         Mutex::Autolock _l(mStateLock);
@@ -3305,18 +3366,22 @@ bool SurfaceFlinger::flushTransactionQueues() {
             auto& [applyToken, transactionQueue] = *it;
 
             while (!transactionQueue.empty()) {
-                const auto& transaction = transactionQueue.front();
+                auto& transaction = transactionQueue.front();
                 if (!transactionIsReadyToBeApplied(transaction.desiredPresentTime,
-                                                   transaction.states)) {
+                                                   transaction.acquireFences)) {
                     setTransactionFlags(eTransactionFlushNeeded);
                     break;
                 }
-                transactions.push_back(transaction);
-                applyTransactionState(transaction.states, transaction.displays, transaction.flags,
-                                      mPendingInputWindowCommands, transaction.desiredPresentTime,
-                                      transaction.buffer, transaction.postTime,
-                                      transaction.privileged, transaction.hasListenerCallbacks,
+                applyTransactionState(transaction.states, transaction.resolvedStates,
+                                      transaction.displays, transaction.flags,
+                                      mPendingInputWindowCommands,
+                                      transaction.desiredPresentTime, transaction.buffer,
+                                      transaction.postTime, transaction.privileged,
+                                      transaction.hasListenerCallbacks,
                                       transaction.listenerCallbacks, /*isMainThread*/ true);
+                // Move rather than copy the transaction out of the queue, as
+                // it may hold hundreds of ComposerStates.
+                transactions.push_back(std::move(transaction));
                 transactionQueue.pop();
                 flushedATransaction = true;
             }
@@ -3338,7 +3403,7 @@ bool SurfaceFlinger::transactionFlushNeeded() {
 
 
 bool SurfaceFlinger::transactionIsReadyToBeApplied(int64_t desiredPresentTime,
-                                                   const Vector<ComposerState>& states) {
+                                                   const std::vector<sp<Fence>>& acquireFences) {
 
     const nsecs_t expectedPresentTime = mExpectedPresentTime.load();
     // Do not present if the desiredPresentTime has not passed unless it is more than one second
@@ -3348,18 +3413,41 @@ bool SurfaceFlinger::transactionIsReadyToBeApplied(int64_t desiredPresentTime,
         return false;
     }
 
-    for (const ComposerState& state : states) {
-        const layer_state_t& s = state.state;
-        if (!(s.what & layer_state_t::eAcquireFenceChanged)) {
-            continue;
-        }
-        if (s.acquireFence && s.acquireFence->getStatus() == Fence::Status::Unsignaled) {
+    for (const auto& fence : acquireFences) {
+        if (fence->getStatus() == Fence::Status::Unsignaled) {
             return false;
         }
     }
     return true;
 }
 
+std::vector<SurfaceFlinger::ResolvedComposerState> SurfaceFlinger::resolveComposerStates(
+        const Vector<ComposerState>& states, bool privileged) {
+    std::vector<ResolvedComposerState> resolvedStates;
+    resolvedStates.reserve(states.size());
+    for (const ComposerState& composerState : states) {
+        const layer_state_t& s = composerState.state;
+        ResolvedComposerState& resolvedState = resolvedStates.emplace_back();
+        resolvedState.layer = s.surface ? fromHandle(s.surface) : nullptr;
+        resolvedState.what = s.what;
+
+        if (!privileged) {
+            if (s.what & layer_state_t::eInputInfoChanged) {
+                ALOGE("Attempt to update InputWindowInfo without permission "
+                      "ACCESS_SURFACE_FLINGER");
+            }
+            resolvedState.what &= ~static_cast<uint64_t>(layer_state_t::eInputInfoChanged |
+                                                         layer_state_t::eFrameRateSelectionPriority);
+        }
+        if ((s.what & layer_state_t::eFrameRateChanged) &&
+            !ValidateFrameRate(s.frameRate, s.frameRateCompatibility,
+                               "SurfaceFlinger::setTransactionState")) {
+            resolvedState.what &= ~static_cast<uint64_t>(layer_state_t::eFrameRateChanged);
+        }
+    }
+    return resolvedStates;
+}
+
 void SurfaceFlinger::setTransactionState(
         const Vector<ComposerState>& states, const Vector<DisplayState>& displays, uint32_t flags,
         const sp<IBinder>& applyToken, const InputWindowCommands& inputWindowCommands,
@@ -3371,6 +3459,13 @@ void SurfaceFlinger::setTransactionState(
 
     bool privileged = callingThreadHasUnscopedSurfaceFlingerAccess();
 
+    // Gather what can be derived from the transaction alone before taking the
+    // state lock, so the main thread does not have to when it is flushed.
+    // The handles are held by the ComposerStates, so the layers they resolve
+    // to cannot change before the transaction is applied.
+    std::vector<ResolvedComposerState> resolvedStates = resolveComposerStates(states, privileged);
+    std::vector<sp<Fence>> acquireFences = getAcquireFences(states);
+
     Mutex::Autolock _l(mStateLock);
 
     // If its TransactionQueue already has a pending TransactionState or if it is pending
@@ -3396,21 +3491,25 @@ void SurfaceFlinger::setTransactionState(
         mExpectedPresentTime = calculateExpectedPresentTime(systemTime());
     }
 
-    if (pendingTransactions || !transactionIsReadyToBeApplied(desiredPresentTime, states)) {
+    if (pendingTransactions || !transactionIsReadyToBeApplied(desiredPresentTime, acquireFences)) {
         mTransactionQueues[applyToken].emplace(states, displays, flags, desiredPresentTime,
                                                uncacheBuffer, postTime, privileged,
-                                               hasListenerCallbacks, listenerCallbacks);
+                                               hasListenerCallbacks, listenerCallbacks,
+                                               std::move(resolvedStates),
+                                               std::move(acquireFences));
         setTransactionFlags(eTransactionFlushNeeded);
         return;
     }
 
-    applyTransactionState(states, displays, flags, inputWindowCommands, desiredPresentTime,
-                          uncacheBuffer, postTime, privileged, hasListenerCallbacks,
-                          listenerCallbacks);
+    applyTransactionState(states, resolvedStates, displays, flags, inputWindowCommands,
+                          desiredPresentTime, uncacheBuffer, postTime, privileged,
+                          hasListenerCallbacks, listenerCallbacks);
 }
 
 void SurfaceFlinger::applyTransactionState(
-        const Vector<ComposerState>& states, const Vector<DisplayState>& displays, uint32_t flags,
+        const Vector<ComposerState>& states,
+        const std::vector<ResolvedComposerState>& resolvedStates,
+        const Vector<DisplayState>& displays, uint32_t flags,
         const InputWindowCommands& inputWindowCommands, const int64_t desiredPresentTime,
         const client_cache_t& uncacheBuffer, const int64_t postTime, bool privileged,
         bool hasListenerCallbacks, const std::vector<ListenerCallbacks>& listenerCallbacks,
@@ -3447,14 +3546,14 @@ void SurfaceFlinger::applyTransactionState(
 
     std::unordered_set<ListenerCallbacks, ListenerCallbacksHash> listenerCallbacksWithSurfaces;
     uint32_t clientStateFlags = 0;
-    for (const ComposerState& state : states) {
-        clientStateFlags |= setClientStateLocked(state, desiredPresentTime, postTime, privileged,
-                                                 listenerCallbacksWithSurfaces);
-        if ((flags & eAnimation) && state.state.surface) {
-            if (const auto layer = fromHandleLocked(state.state.surface).promote(); layer) {
-                mScheduler->recordLayerHistory(layer.get(), desiredPresentTime,
-                                               LayerHistory::LayerUpdateType::AnimationTX);
-            }
+    for (size_t i = 0; i < states.size(); i++) {
+        const sp<Layer> layer = resolvedStates[i].layer.promote();
+        clientStateFlags |=
+                setClientStateLocked(states[i], layer, resolvedStates[i].what, desiredPresentTime,
+                                     postTime, privileged, listenerCallbacksWithSurfaces);
+        if ((flags & eAnimation) && layer) {
+            mScheduler->recordLayerHistory(layer.get(), desiredPresentTime,
+                                           LayerHistory::LayerUpdateType::AnimationTX);
         }
     }
 
@@ -3628,8 +3727,8 @@ bool SurfaceFlinger::callingThreadHasUnscopedSurfaceFlingerAccess(bool usePermis
 }
 
 uint32_t SurfaceFlinger::setClientStateLocked(
-        const ComposerState& composerState, int64_t desiredPresentTime, int64_t postTime,
-        bool privileged,
+        const ComposerState& composerState, const sp<Layer>& layer, uint64_t what,
+        int64_t desiredPresentTime, int64_t postTime, bool privileged,
         std::unordered_set<ListenerCallbacks, ListenerCallbacksHash>& listenerCallbacks) {
     const layer_state_t& s = composerState.state;
 
@@ -3640,10 +3739,7 @@ uint32_t SurfaceFlinger::setClientStateLocked(
         listenerCallbacks.insert(listener);
     }
 
-    sp<Layer> layer = nullptr;
-    if (s.surface) {
-        layer = fromHandleLocked(s.surface).promote();
-    } else {
+    if (!s.surface) {
         // The client may provide us a null handle. Treat it as if the layer was removed.
         ALOGW("Attempt to set client state with a null layer handle");
     }
@@ -3657,8 +3753,6 @@ uint32_t SurfaceFlinger::setClientStateLocked(
 
     uint32_t flags = 0;
 
-    const uint64_t what = s.what;
-
     // If we are deferring transaction, make sure to push the pending state, as otherwise the
     // pending state will also be deferred.
     if (what & layer_state_t::eDeferTransaction_legacy) {
@@ -3853,12 +3947,8 @@ uint32_t SurfaceFlinger::setClientStateLocked(
         if (layer->setSidebandStream(s.sidebandStream)) flags |= eTraversalNeeded;
     }
     if (what & layer_state_t::eInputInfoChanged) {
-        if (privileged) {
-            layer->setInputInfo(s.inputInfo);
-            flags |= eTraversalNeeded;
-        } else {
-            ALOGE("Attempt to update InputWindowInfo without permission ACCESS_SURFACE_FLINGER");
-        }
+        layer->setInputInfo(s.inputInfo);
+        flags |= eTraversalNeeded;
     }
     if (what & layer_state_t::eMetadataChanged) {
         if (layer->setMetadata(s.metadata)) flags |= eTraversalNeeded;
@@ -3872,14 +3962,12 @@ uint32_t SurfaceFlinger::setClientStateLocked(
         if (layer->setShadowRadius(s.shadowRadius)) flags |= eTraversalNeeded;
     }
     if (what & layer_state_t::eFrameRateSelectionPriority) {
-        if (privileged && layer->setFrameRateSelectionPriority(s.frameRateSelectionPriority)) {
+        if (layer->setFrameRateSelectionPriority(s.frameRateSelectionPriority)) {
             flags |= eTraversalNeeded;
         }
     }
     if (what & layer_state_t::eFrameRateChanged) {
-        if (ValidateFrameRate(s.frameRate, s.frameRateCompatibility,
-                              "SurfaceFlinger::setClientStateLocked") &&
-            layer->setFrameRate(Layer::FrameRate(s.frameRate,
+        if (layer->setFrameRate(Layer::FrameRate(s.frameRate,
                                                  Layer::FrameRate::convertCompatibility(
                                                          s.frameRateCompatibility)))) {
             flags |= eTraversalNeeded;
@@ -3963,7 +4051,7 @@ status_t SurfaceFlinger::mirrorLayer(const sp<Client>& client, const sp<IBinder>
 
     {
         Mutex::Autolock _l(mStateLock);
-        mirrorFrom = fromHandleLocked(mirrorFromHandle).promote();
+        mirrorFrom = fromHandle(mirrorFromHandle).promote();
         if (!mirrorFrom) {
             return NAME_NOT_FOUND;
         }
@@ -4185,12 +4273,15 @@ void SurfaceFlinger::onHandleDestroyed(sp<Layer>& layer)
     }
     markLayerPendingRemovalLocked(layer);
 
-    auto it = mLayersByLocalBinderToken.begin();
-    while (it != mLayersByLocalBinderToken.end()) {
-        if (it->second == layer) {
-            it = mLayersByLocalBinderToken.erase(it);
-        } else {
-            it++;
+    {
+        std::lock_guard handlesLock(mLayerHandlesLock);
+        auto it = mLayersByLocalBinderToken.begin();
+        while (it != mLayersByLocalBinderToken.end()) {
+            if (it->second == layer) {
+                it = mLayersByLocalBinderToken.erase(it);
+            } else {
+                it++;
+            }
         }
     }
 
@@ -4650,38 +4741,70 @@ void SurfaceFlinger::dumpWideColorInfo(std::string& result) const {
 }
 
 LayersProto SurfaceFlinger::dumpDrawingStateProto(uint32_t traceFlags) const {
+    std::vector<LayerProtoSnapshot> snapshots;
+    snapshotDrawingStateProto(snapshots, traceFlags);
+
+    LayersProto layersProto;
+    writeLayersProto(layersProto, snapshots);
+    return layersProto;
+}
+
+void SurfaceFlinger::snapshotDrawingStateProto(std::vector<LayerProtoSnapshot>& snapshots,
+                                               uint32_t traceFlags) const {
     // If context is SurfaceTracing thread, mTracingLock blocks display transactions on main thread.
     const auto display = ON_MAIN_THREAD(getDefaultDisplayDeviceLocked());
 
-    LayersProto layersProto;
-    for (const sp<Layer>& layer : mDrawingState.layersSortedByZ) {
-        layer->writeToProto(layersProto, traceFlags, display.get());
+    // The main thread only rebuilds the layer snapshot while holding mTracingLock, so a valid
+    // snapshot is not modified under the tracing thread. Its entries are in hierarchy order,
+    // which is the order the layers are written to the proto in.
+    if (mDrawingLayerSnapshot.isValid()) {
+        const auto& entries = mDrawingLayerSnapshot.getEntries();
+        for (size_t i = 0; i < mDrawingLayerSnapshot.getHierarchySize(); i++) {
+            entries[i].layer->snapshotForProto(snapshots, traceFlags, display.get());
+        }
+        return;
     }
 
-    return layersProto;
+    for (const sp<Layer>& root : mDrawingState.layersSortedByZ) {
+        root->traverse(LayerVector::StateSet::Drawing, [&](Layer* layer) {
+            layer->snapshotForProto(snapshots, traceFlags, display.get());
+        });
+    }
 }
 
 void SurfaceFlinger::dumpHwc(std::string& result) const {
     getHwComposer().dump(result);
 }
 
-void SurfaceFlinger::dumpOffscreenLayersProto(LayersProto& layersProto, uint32_t traceFlags) const {
-    // Add a fake invisible root layer to the proto output and parent all the offscreen layers to
-    // it.
-    LayerProto* rootProto = layersProto.add_layers();
-    const int32_t offscreenRootLayerId = INT32_MAX - 2;
-    rootProto->set_id(offscreenRootLayerId);
-    rootProto->set_name("Offscreen Root");
-    rootProto->set_parent(-1);
+static constexpr int32_t kOffscreenRootLayerId = INT32_MAX - 2;
 
+void SurfaceFlinger::snapshotOffscreenLayersProto(std::vector<LayerProtoSnapshot>& snapshots,
+                                                  uint32_t traceFlags) const {
     for (Layer* offscreenLayer : mOffscreenLayers) {
-        // Add layer as child of the fake root
-        rootProto->add_children(offscreenLayer->sequence);
-
-        // Add layer
-        LayerProto* layerProto =
-                offscreenLayer->writeToProto(layersProto, traceFlags, nullptr /*device*/);
-        layerProto->set_parent(offscreenRootLayerId);
+        const size_t index = snapshots.size();
+        offscreenLayer->traverse(LayerVector::StateSet::Drawing, [&](Layer* layer) {
+            layer->snapshotForProto(snapshots, traceFlags, nullptr /*device*/);
+        });
+        snapshots[index].parentId = kOffscreenRootLayerId;
+    }
+}
+
+void SurfaceFlinger::writeLayersProto(LayersProto& layersProto,
+                                      const std::vector<LayerProtoSnapshot>& snapshots) {
+    LayerProto* rootProto = nullptr;
+    for (const LayerProtoSnapshot& snapshot : snapshots) {
+        if (snapshot.parentId == kOffscreenRootLayerId) {
+            // Add a fake invisible root layer to the proto output and parent all the offscreen
+            // layers to it.
+            if (rootProto == nullptr) {
+                rootProto = layersProto.add_layers();
+                rootProto->set_id(kOffscreenRootLayerId);
+                rootProto->set_name("Offscreen Root");
+                rootProto->set_parent(-1);
+            }
+            rootProto->add_children(snapshot.id);
+        }
+        Layer::writeToProto(layersProto, snapshot);
     }
 }
 
@@ -4833,6 +4956,12 @@ void SurfaceFlinger::dumpAllLocked(const DumpArgs& args, std::string& result) co
     mTracing.dump(result);
     result.append("\n");
 
+    /*
+     * Client buffer cache
+     */
+    ClientCache::getInstance().dump(result);
+    result.append("\n");
+
     /*
      * HWC layer minidump
      */
@@ -5681,7 +5810,7 @@ status_t SurfaceFlinger::captureLayers(
     {
         Mutex::Autolock lock(mStateLock);
 
-        parent = fromHandleLocked(layerHandleBinder).promote();
+        parent = fromHandle(layerHandleBinder).promote();
         if (parent == nullptr || parent->isRemovedFromCurrentState()) {
             ALOGE("captureLayers called with an invalid or removed parent");
             return NAME_NOT_FOUND;
@@ -5714,7 +5843,7 @@ status_t SurfaceFlinger::captureLayers(
         reqHeight = crop.height() * frameScale;
 
         for (const auto& handle : excludeHandles) {
-            sp<Layer> excludeLayer = fromHandleLocked(handle).promote();
+            sp<Layer> excludeLayer = fromHandle(handle).promote();
             if (excludeLayer != nullptr) {
                 excludeLayers.emplace(excludeLayer);
             } else {
@@ -6191,11 +6320,6 @@ void SurfaceFlinger::SetInputWindowsListener::onSetInputWindowsFinished() {
 }
 
 wp<Layer> SurfaceFlinger::fromHandle(const sp<IBinder>& handle) {
-    Mutex::Autolock _l(mStateLock);
-    return fromHandleLocked(handle);
-}
-
-wp<Layer> SurfaceFlinger::fromHandleLocked(const sp<IBinder>& handle) {
     BBinder* b = nullptr;
     if (handle) {
         b = handle->localBinder();
@@ -6203,6 +6327,7 @@ wp<Layer> SurfaceFlinger::fromHandleLocked(const sp<IBinder>& handle) {
     if (b == nullptr) {
         return nullptr;
     }
+    std::lock_guard lock(mLayerHandlesLock);
     auto it = mLayersByLocalBinderToken.find(b);
     if (it != mLayersByLocalBinderToken.end()) {
         return it->second;
@@ -55,6 +55,7 @@
 #include "DisplayHardware/PowerAdvisor.h"
 #include "Effects/Daltonizer.h"
 #include "FrameTracker.h"
+#include "LayerTreeSnapshot.h"
 #include "LayerVector.h"
 #include "Scheduler/RefreshRateConfigs.h"
 #include "Scheduler/RefreshRateStats.h"
@@ -92,6 +93,7 @@ class HWComposer;
 class IGraphicBufferProducer;
 class IInputFlinger;
 class Layer;
+struct LayerProtoSnapshot;
 class MessageBase;
 class RefreshRateOverlay;
 class RegionSamplingThread;
@@ -133,6 +135,9 @@ public:
 
     FenceTimeline mGlCompositionDoneTimeline;
     FenceTimeline mDisplayTimeline;
+    // Updates the timelines above and those of every layer. Only accessed from the main thread.
+    FenceTimeline::Poller mFenceTimelinePoller;
+    std::vector<FenceTimeline*> mFenceTimelines;
 
     // protected by mCompositorTimingLock;
     mutable std::mutex mCompositorTimingLock;
@@ -326,8 +331,8 @@ public:
     // Returns nullptr if the handle does not point to an existing layer.
     // Otherwise, returns a weak reference so that callers off the main-thread
     // won't accidentally hold onto the last strong reference.
+    // This does not need mStateLock, and may be called with or without it.
     wp<Layer> fromHandle(const sp<IBinder>& handle);
-    wp<Layer> fromHandleLocked(const sp<IBinder>& handle) REQUIRES(mStateLock);
 
     // Inherit from ClientCache::ErasedRecipient
     void bufferErased(const client_cache_t& clientCacheId) override;
@@ -336,6 +341,12 @@ public:
     // debug.sf.disable_client_composition_cache
     bool mDisableClientCompositionCache = false;
 
+    // If set, displays reuse the previous frame's composition strategy when it
+    // was accepted unchanged by the HWC, deferring validation until after the
+    // client target is rendered. This can be set by
+    // debug.sf.predict_composition_strategy
+    bool mPredictCompositionStrategy = false;
+
 private:
     friend class BufferLayer;
     friend class BufferQueueLayer;
@@ -618,7 +629,16 @@ private:
     /* ------------------------------------------------------------------------
      * Transactions
      */
+    // What is derived from a ComposerState without looking at any layer state, on the binder
+    // thread that receives the transaction.
+    struct ResolvedComposerState {
+        wp<Layer> layer;
+        // The changes in the state, without those the caller may not make or that are invalid.
+        uint64_t what = 0;
+    };
+
     void applyTransactionState(const Vector<ComposerState>& state,
+                               const std::vector<ResolvedComposerState>& resolvedStates,
                                const Vector<DisplayState>& displays, uint32_t flags,
                                const InputWindowCommands& inputWindowCommands,
                                const int64_t desiredPresentTime,
@@ -644,15 +664,20 @@ private:
     void commitTransaction() REQUIRES(mStateLock);
     void commitOffscreenLayers();
     bool transactionIsReadyToBeApplied(int64_t desiredPresentTime,
-                                       const Vector<ComposerState>& states);
+                                       const std::vector<sp<Fence>>& acquireFences);
+    // Resolves the layer handle of each ComposerState, in order, and drops the changes that
+    // fail validation. This is done when a transaction is received, before taking mStateLock,
+    // so neither the binder thread nor the main thread holds the lock for it.
+    std::vector<ResolvedComposerState> resolveComposerStates(const Vector<ComposerState>& states,
+                                                             bool privileged);
     uint32_t setDisplayStateLocked(const DisplayState& s) REQUIRES(mStateLock);
     uint32_t addInputWindowCommands(const InputWindowCommands& inputWindowCommands)
             REQUIRES(mStateLock);
 
 protected:
     virtual uint32_t setClientStateLocked(
-            const ComposerState& composerState, int64_t desiredPresentTime, int64_t postTime,
-            bool privileged,
+            const ComposerState& composerState, const sp<Layer>& layer, uint64_t what,
+            int64_t desiredPresentTime, int64_t postTime, bool privileged,
             std::unordered_set<ListenerCallbacks, ListenerCallbacksHash>& listenerCallbacks)
             REQUIRES(mStateLock);
     virtual void commitTransactionLocked();
@@ -711,6 +736,10 @@ private:
     // Traverse through all the layers and compute and cache its bounds.
     void computeLayerBounds();
 
+    // Returns the flattened drawing state layer hierarchy, rebuilding it first
+    // if the hierarchy changed since it was last used.
+    const LayerTreeSnapshot& getDrawingLayerSnapshot();
+
     /* ------------------------------------------------------------------------
      * Boot animation, on/off animations and screen capture
      */
@@ -963,8 +992,15 @@ private:
     void dumpRawDisplayIdentificationData(const DumpArgs&, std::string& result) const;
     void dumpWideColorInfo(std::string& result) const REQUIRES(mStateLock);
     LayersProto dumpDrawingStateProto(uint32_t traceFlags) const;
-    void dumpOffscreenLayersProto(LayersProto& layersProto,
-                                  uint32_t traceFlags = SurfaceTracing::TRACE_ALL) const;
+    // Copy what the layer protos are written from, so that SurfaceTracing can write them with
+    // writeLayersProto() once it releases mTracingLock.
+    void snapshotDrawingStateProto(std::vector<LayerProtoSnapshot>& snapshots,
+                                   uint32_t traceFlags) const;
+    // Parents the offscreen layers to a fake root layer.
+    void snapshotOffscreenLayersProto(std::vector<LayerProtoSnapshot>& snapshots,
+                                      uint32_t traceFlags = SurfaceTracing::TRACE_ALL) const;
+    static void writeLayersProto(LayersProto& layersProto,
+                                 const std::vector<LayerProtoSnapshot>& snapshots);
     // Dumps state from HW Composer
     void dumpHwc(std::string& result) const;
     LayersProto dumpProtoFromMainThread(uint32_t traceFlags = SurfaceTracing::TRACE_ALL)
@@ -1036,6 +1072,8 @@ private:
     // Can only accessed from the main thread, these members
     // don't need synchronization
     State mDrawingState{LayerVector::StateSet::Drawing};
+    // Flattened view of mDrawingState, invalidated on every transaction commit.
+    LayerTreeSnapshot mDrawingLayerSnapshot;
     bool mVisibleRegionsDirty = false;
     // Set during transaction commit stage to track if the input info for a layer has changed.
     bool mInputInfoChanged = false;
@@ -1074,7 +1112,11 @@ private:
     std::map<wp<IBinder>, sp<DisplayDevice>> mDisplays GUARDED_BY(mStateLock);
     std::unordered_map<DisplayId, sp<IBinder>> mPhysicalDisplayTokens GUARDED_BY(mStateLock);
 
-    std::unordered_map<BBinder*, wp<Layer>> mLayersByLocalBinderToken GUARDED_BY(mStateLock);
+    // Guards the layer handles separately from mStateLock, so that transactions can resolve
+    // their handles without it. This is taken after mStateLock when both are held.
+    std::mutex mLayerHandlesLock;
+    std::unordered_map<BBinder*, wp<Layer>> mLayersByLocalBinderToken
+            GUARDED_BY(mLayerHandlesLock);
 
     // don't use a lock for these, we don't care
     int mDebugRegion = 0;
@@ -1134,7 +1176,9 @@ private:
                          const Vector<DisplayState>& displayStates, uint32_t transactionFlags,
                          int64_t desiredPresentTime, const client_cache_t& uncacheBuffer,
                          int64_t postTime, bool privileged, bool hasListenerCallbacks,
-                         std::vector<ListenerCallbacks> listenerCallbacks)
+                         std::vector<ListenerCallbacks> listenerCallbacks,
+                         std::vector<ResolvedComposerState> resolvedComposerStates,
+                         std::vector<sp<Fence>> pendingAcquireFences)
               : states(composerStates),
                 displays(displayStates),
                 flags(transactionFlags),
@@ -1143,7 +1187,9 @@ private:
                 postTime(postTime),
                 privileged(privileged),
                 hasListenerCallbacks(hasListenerCallbacks),
-                listenerCallbacks(listenerCallbacks) {}
+                listenerCallbacks(listenerCallbacks),
+                resolvedStates(std::move(resolvedComposerStates)),
+                acquireFences(std::move(pendingAcquireFences)) {}
 
         Vector<ComposerState> states;
         Vector<DisplayState> displays;
@@ -1154,6 +1200,14 @@ private:
         bool privileged;
         bool hasListenerCallbacks;
         std::vector<ListenerCallbacks> listenerCallbacks;
+
+        // Derived from states when the transaction was received, on the
+        // binder thread. resolvedStates holds the resolved layer and validated
+        // changes for each entry in states, and acquireFences holds the
+        // acquire fences that have to signal before the transaction can be
+        // applied.
+        std::vector<ResolvedComposerState> resolvedStates;
+        std::vector<sp<Fence>> acquireFences;
     };
     std::unordered_map<sp<IBinder>, std::queue<TransactionState>, IListenerHash> mTransactionQueues;
 
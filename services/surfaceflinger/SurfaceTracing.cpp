@@ -24,8 +24,11 @@
 #include "SurfaceTracing.h"
 #include <SurfaceFlinger.h>
 
+#include "Layer.h"
+
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
+#include <layerproto/LayerProtoParser.h>
 #include <log/log.h>
 #include <utils/SystemClock.h>
 #include <utils/Trace.h>
@@ -37,35 +40,36 @@ SurfaceTracing::SurfaceTracing(SurfaceFlinger& flinger)
 
 void SurfaceTracing::mainLoop() {
     bool enabled = addFirstEntry();
+    LayersSnapshot snapshot;
     while (enabled) {
-        LayersTraceProto entry = traceWhenNotified();
+        snapshotWhenNotified(&snapshot);
+        LayersTraceProto entry = writeEntry(snapshot);
         enabled = addTraceToBuffer(entry);
     }
 }
 
 bool SurfaceTracing::addFirstEntry() {
-    LayersTraceProto entry;
+    LayersSnapshot snapshot;
     {
         std::scoped_lock lock(mSfLock);
-        entry = traceLayersLocked("tracing.enable");
+        snapshotLayersLocked("tracing.enable", &snapshot);
     }
+    LayersTraceProto entry = writeEntry(snapshot);
     return addTraceToBuffer(entry);
 }
 
-LayersTraceProto SurfaceTracing::traceWhenNotified() {
+void SurfaceTracing::snapshotWhenNotified(LayersSnapshot* snapshot) {
     std::unique_lock<std::mutex> lock(mSfLock);
     mCanStartTrace.wait(lock);
     android::base::ScopedLockAssertion assumeLock(mSfLock);
-    LayersTraceProto entry = traceLayersLocked(mWhere);
+    snapshotLayersLocked(mWhere, snapshot);
     mTracingInProgress = false;
     mMissedTraceEntries = 0;
-    lock.unlock();
-    return entry;
 }
 
 bool SurfaceTracing::addTraceToBuffer(LayersTraceProto& entry) {
     std::scoped_lock lock(mTraceLock);
-    mBuffer.emplace(std::move(entry));
+    addEntryLocked(entry);
     if (mWriteToFile) {
         writeProtoFileLocked();
         mWriteToFile = false;
@@ -73,6 +77,77 @@ bool SurfaceTracing::addTraceToBuffer(LayersTraceProto& entry) {
     return mEnabled;
 }
 
+void SurfaceTracing::addEntryLocked(LayersTraceProto& entry) {
+    ATRACE_CALL();
+
+    // The buffer is empty when tracing starts and after it was written to file, so the first
+    // entry is always a keyframe. Entries without layers are keyframes too, as an empty
+    // layer_order means that the order did not change.
+    const bool canEncodeDelta = mKeyframeInterval > 0 && mBuffer.frameCount() > 0 &&
+            mEntriesSinceKeyframe < mKeyframeInterval && entry.layers().layers_size() > 0;
+    if (!canEncodeDelta) {
+        mDeltaEncoder.update(entry, nullptr);
+        mBuffer.emplace(std::move(entry));
+        mEntriesSinceKeyframe = 1;
+        return;
+    }
+
+    LayersTraceProto delta;
+    mDeltaEncoder.update(entry, &delta);
+    if (mBuffer.emplace(std::move(delta))) {
+        mEntriesSinceKeyframe++;
+        return;
+    }
+
+    // The entries the delta depends on were dropped from the buffer, record a keyframe instead.
+    mBuffer.emplace(std::move(entry));
+    mEntriesSinceKeyframe = 1;
+}
+
+void SurfaceTracing::LayersDeltaEncoder::update(const LayersTraceProto& entry,
+                                                LayersTraceProto* delta) {
+    const auto& layerProtos = entry.layers().layers();
+
+    std::vector<int32_t> layerOrder;
+    layerOrder.reserve(layerProtos.size());
+    std::unordered_map<int32_t, std::string> layers;
+    layers.reserve(layerProtos.size());
+
+    for (const LayerProto& layerProto : layerProtos) {
+        layerOrder.push_back(layerProto.id());
+        std::string serializedLayer = layerProto.SerializeAsString();
+        if (delta) {
+            const auto it = mLayers.find(layerProto.id());
+            if (it == mLayers.end() || it->second != serializedLayer) {
+                *delta->mutable_layers()->add_layers() = layerProto;
+            }
+        }
+        layers.emplace(layerProto.id(), std::move(serializedLayer));
+    }
+
+    if (delta) {
+        delta->set_elapsed_realtime_nanos(entry.elapsed_realtime_nanos());
+        delta->set_where(entry.where());
+        if (entry.has_hwc_blob()) {
+            delta->set_hwc_blob(entry.hwc_blob());
+        }
+        if (entry.has_excludes_composition_state()) {
+            delta->set_excludes_composition_state(entry.excludes_composition_state());
+        }
+        delta->set_missed_entries(entry.missed_entries());
+        delta->set_delta(true);
+        if (layerOrder != mLayerOrder) {
+            delta->mutable_layer_order()->Reserve(layerOrder.size());
+            for (int32_t id : layerOrder) {
+                delta->add_layer_order(id);
+            }
+        }
+    }
+
+    mLayerOrder.swap(layerOrder);
+    mLayers.swap(layers);
+}
+
 void SurfaceTracing::notify(const char* where) {
     std::scoped_lock lock(mSfLock);
     notifyLocked(where);
@@ -100,18 +175,27 @@ void SurfaceTracing::LayersTraceBuffer::reset(size_t newSize) {
     mUsedInBytes = 0U;
 }
 
-void SurfaceTracing::LayersTraceBuffer::emplace(LayersTraceProto&& proto) {
+bool SurfaceTracing::LayersTraceBuffer::emplace(LayersTraceProto&& proto) {
     auto protoSize = proto.ByteSize();
     while (mUsedInBytes + protoSize > mSizeInBytes) {
         if (mStorage.empty()) {
-            return;
+            return true;
         }
         mUsedInBytes -= mStorage.front().ByteSize();
         mStorage.pop();
+        // Deltas cannot be decoded without the keyframe they follow, so drop them with it.
+        while (!mStorage.empty() && mStorage.front().delta()) {
+            mUsedInBytes -= mStorage.front().ByteSize();
+            mStorage.pop();
+        }
+    }
+    if (mStorage.empty() && proto.delta()) {
+        return false;
     }
     mUsedInBytes += protoSize;
     mStorage.emplace();
     mStorage.back().Swap(&proto);
+    return true;
 }
 
 void SurfaceTracing::LayersTraceBuffer::flush(LayersTraceFileProto* fileProto) {
@@ -176,28 +260,47 @@ void SurfaceTracing::setTraceFlags(uint32_t flags) {
     mTraceFlags = flags;
 }
 
-LayersTraceProto SurfaceTracing::traceLayersLocked(const char* where) {
+void SurfaceTracing::setKeyframeInterval(uint32_t interval) {
+    std::scoped_lock lock(mTraceLock);
+    mKeyframeInterval = interval;
+}
+
+void SurfaceTracing::snapshotLayersLocked(const char* where, LayersSnapshot* snapshot) {
     ATRACE_CALL();
 
-    LayersTraceProto entry;
-    entry.set_elapsed_realtime_nanos(elapsedRealtimeNano());
-    entry.set_where(where);
-    LayersProto layers(mFlinger.dumpDrawingStateProto(mTraceFlags));
+    snapshot->elapsedRealtimeNanos = elapsedRealtimeNano();
+    snapshot->where = where;
+    // Keeps the capacity of the previous entry.
+    snapshot->layers.clear();
+    mFlinger.snapshotDrawingStateProto(snapshot->layers, mTraceFlags);
 
     if (flagIsSetLocked(SurfaceTracing::TRACE_EXTRA)) {
-        mFlinger.dumpOffscreenLayersProto(layers);
+        mFlinger.snapshotOffscreenLayersProto(snapshot->layers);
     }
-    entry.mutable_layers()->Swap(&layers);
 
+    snapshot->hwcBlob.clear();
     if (mTraceFlags & SurfaceTracing::TRACE_HWC) {
-        std::string hwcDump;
-        mFlinger.dumpHwc(hwcDump);
-        entry.set_hwc_blob(hwcDump);
+        mFlinger.dumpHwc(snapshot->hwcBlob);
     }
-    if (!flagIsSetLocked(SurfaceTracing::TRACE_COMPOSITION)) {
+    snapshot->excludesCompositionState = !flagIsSetLocked(SurfaceTracing::TRACE_COMPOSITION);
+    snapshot->missedEntries = mMissedTraceEntries;
+}
+
+LayersTraceProto SurfaceTracing::writeEntry(const LayersSnapshot& snapshot) {
+    ATRACE_CALL();
+
+    LayersTraceProto entry;
+    entry.set_elapsed_realtime_nanos(snapshot.elapsedRealtimeNanos);
+    entry.set_where(snapshot.where);
+    SurfaceFlinger::writeLayersProto(*entry.mutable_layers(), snapshot.layers);
+
+    if (!snapshot.hwcBlob.empty()) {
+        entry.set_hwc_blob(snapshot.hwcBlob);
+    }
+    if (snapshot.excludesCompositionState) {
         entry.set_excludes_composition_state(true);
     }
-    entry.set_missed_entries(mMissedTraceEntries);
+    entry.set_missed_entries(snapshot.missedEntries);
 
     return entry;
 }
@@ -212,6 +315,9 @@ void SurfaceTracing::writeProtoFileLocked() {
                                LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_L);
     mBuffer.flush(&fileProto);
     mBuffer.reset(mBufferSize);
+    // Deltas only save memory in the ring buffer. Readers of the file, such as winscope, expect
+    // every entry to hold all layers.
+    LayerProtoParser::expandLayersTrace(&fileProto);
 
     if (!fileProto.SerializeToString(&output)) {
         ALOGE("Could not save the proto file! Permission denied");
@@ -235,6 +341,10 @@ void SurfaceTracing::dump(std::string& result) const {
     base::StringAppendF(&result, "  number of entries: %zu (%.2fMB / %.2fMB)\n",
                         mBuffer.frameCount(), float(mBuffer.used()) / float(1_MB),
                         float(mBuffer.size()) / float(1_MB));
+    if (mKeyframeInterval > 0) {
+        base::StringAppendF(&result, "  delta encoded, keyframe every %u entries\n",
+                            mKeyframeInterval);
+    }
 }
 
 } // namespace android
@@ -26,12 +26,15 @@
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 using namespace android::surfaceflinger;
 
 namespace android {
 
 class SurfaceFlinger;
+struct LayerProtoSnapshot;
 
 constexpr auto operator""_MB(unsigned long long const num) {
     return num * 1024 * 1024;
@@ -62,10 +65,27 @@ public:
         TRACE_ALL = 0xffffffff
     };
     void setTraceFlags(uint32_t flags);
+    // Records every entry but one in each interval as a delta against the previous entry.
+    // An interval of 0 records every entry in full.
+    void setKeyframeInterval(uint32_t interval);
     bool flagIsSetLocked(uint32_t flags) NO_THREAD_SAFETY_ANALYSIS /* REQUIRES(mSfLock) */ {
         return (mTraceFlags & flags) == flags;
     }
 
+    // Encodes trace entries as per-layer deltas against the previously encoded entry, so that
+    // the ring buffer holds a longer window. Each layer is serialized to be compared, on the
+    // tracing thread once mSfLock is released.
+    class LayersDeltaEncoder {
+    public:
+        // Records the layers of entry as the reference for the next delta. If delta is not
+        // null, it is filled in with the layers that changed since the previous reference.
+        void update(const LayersTraceProto& entry, LayersTraceProto* delta);
+
+    private:
+        std::vector<int32_t> mLayerOrder;
+        std::unordered_map<int32_t, std::string> mLayers;
+    };
+
 private:
     static constexpr auto kDefaultBufferCapInByte = 5_MB;
     static constexpr auto kDefaultFileName = "/data/misc/wmtrace/layers_trace.pb";
@@ -78,7 +98,9 @@ private:
 
         void setSize(size_t newSize) { mSizeInBytes = newSize; }
         void reset(size_t newSize);
-        void emplace(LayersTraceProto&& proto);
+        // Returns false if proto is a delta and the entries it depends on had to be dropped
+        // to make room for it. The proto is not added in that case.
+        bool emplace(LayersTraceProto&& proto);
         void flush(LayersTraceFileProto* fileProto);
 
     private:
@@ -87,13 +109,26 @@ private:
         std::queue<LayersTraceProto> mStorage;
     };
 
+    // What a trace entry is written from. Only copying it holds mSfLock, which blocks the main
+    // thread. Writing the protos, delta encoding and serializing them happen after it is released.
+    struct LayersSnapshot {
+        int64_t elapsedRealtimeNanos = 0;
+        const char* where = "";
+        std::vector<LayerProtoSnapshot> layers;
+        std::string hwcBlob;
+        bool excludesCompositionState = false;
+        uint32_t missedEntries = 0;
+    };
+
     void mainLoop();
     bool addFirstEntry();
-    LayersTraceProto traceWhenNotified();
-    LayersTraceProto traceLayersLocked(const char* where) REQUIRES(mSfLock);
+    void snapshotWhenNotified(LayersSnapshot* snapshot);
+    void snapshotLayersLocked(const char* where, LayersSnapshot* snapshot) REQUIRES(mSfLock);
+    static LayersTraceProto writeEntry(const LayersSnapshot& snapshot);
 
     // Returns true if trace is enabled.
     bool addTraceToBuffer(LayersTraceProto& entry);
+    void addEntryLocked(LayersTraceProto& entry) REQUIRES(mTraceLock);
     void writeProtoFileLocked() REQUIRES(mTraceLock);
 
     SurfaceFlinger& mFlinger;
@@ -112,6 +147,9 @@ private:
     size_t mBufferSize GUARDED_BY(mTraceLock) = kDefaultBufferCapInByte;
     bool mEnabled GUARDED_BY(mTraceLock) = false;
     bool mWriteToFile GUARDED_BY(mTraceLock) = false;
+    uint32_t mKeyframeInterval GUARDED_BY(mTraceLock) = 0;
+    uint32_t mEntriesSinceKeyframe GUARDED_BY(mTraceLock) = 0;
+    LayersDeltaEncoder mDeltaEncoder GUARDED_BY(mTraceLock);
 };
 
 } // namespace android
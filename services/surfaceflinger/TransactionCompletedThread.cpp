@@ -26,6 +26,7 @@
 #include "TransactionCompletedThread.h"
 
 #include <cinttypes>
+#include <iterator>
 
 #include <binder/IInterface.h>
 #include <utils/RefBase.h>
@@ -60,7 +61,7 @@ TransactionCompletedThread::~TransactionCompletedThread() {
 
     {
         std::lock_guard lock(mMutex);
-        for (const auto& [listener, transactionStats] : mCompletedTransactions) {
+        for (const auto& [listener, listenerState] : mListeners) {
             listener->unlinkToDeath(mDeathRecipient);
         }
     }
@@ -91,15 +92,17 @@ status_t TransactionCompletedThread::startRegistration(const ListenerCallbacks&
     auto& [listener, callbackIds] = listenerCallbacks;
 
     if (inserted) {
-        if (mCompletedTransactions.count(listener) == 0) {
+        if (mListeners.count(listener) == 0) {
             status_t err = listener->linkToDeath(mDeathRecipient);
             if (err != NO_ERROR) {
                 ALOGE("cannot add callback because linkToDeath failed, err: %d", err);
+                mRegisteringTransactions.erase(itr);
                 return err;
             }
         }
-        auto& transactionStatsDeque = mCompletedTransactions[listener];
-        transactionStatsDeque.emplace_back(callbackIds);
+        auto& listenerState = mListeners[listener];
+        listenerState.transactionStats.emplace_back(callbackIds);
+        listenerState.registeringCount++;
     }
 
     return NO_ERROR;
@@ -119,12 +122,21 @@ status_t TransactionCompletedThread::endRegistration(const ListenerCallbacks& li
     }
 
     mRegisteringTransactions.erase(itr);
+    auto listenerState = mListeners.find(listenerCallbacks.transactionCompletedListener);
+    if (listenerState != mListeners.end() && listenerState->second.registeringCount > 0) {
+        listenerState->second.registeringCount--;
+    }
 
     return NO_ERROR;
 }
 
 bool TransactionCompletedThread::isRegisteringTransaction(
-        const sp<IBinder>& transactionListener, const std::vector<CallbackId>& callbackIds) {
+        const ListenerState& listenerState, const sp<IBinder>& transactionListener,
+        const std::vector<CallbackId>& callbackIds) {
+    // Most listeners have no transaction being registered, which saves building the key.
+    if (listenerState.registeringCount == 0) {
+        return false;
+    }
     ListenerCallbacks listenerCallbacks(transactionListener, callbackIds);
 
     auto itr = mRegisteringTransactions.find(listenerCallbacks);
@@ -139,16 +151,24 @@ status_t TransactionCompletedThread::registerPendingCallbackHandle(
         return BAD_VALUE;
     }
 
+    // The listener is gone if its process died after the transaction was applied.
+    auto listenerState = mListeners.find(handle->listener);
+    if (listenerState == mListeners.end()) {
+        ALOGW("cannot register callback handle for a listener that is gone");
+        return BAD_VALUE;
+    }
+
     // If we can't find the transaction stats something has gone wrong. The client should call
     // startRegistration before trying to register a pending callback handle.
     TransactionStats* transactionStats;
-    status_t err = findTransactionStats(handle->listener, handle->callbackIds, &transactionStats);
+    status_t err =
+            findTransactionStats(listenerState->second, handle->callbackIds, &transactionStats);
     if (err != NO_ERROR) {
         ALOGE("cannot find transaction stats");
         return err;
     }
 
-    mPendingTransactions[handle->listener][handle->callbackIds]++;
+    listenerState->second.pendingCallbackHandles[handle->callbackIds]++;
     return NO_ERROR;
 }
 
@@ -164,29 +184,27 @@ status_t TransactionCompletedThread::finalizePendingCallbackHandles(
     }
 
     for (const auto& handle : handles) {
-        auto listener = mPendingTransactions.find(handle->listener);
-        if (listener != mPendingTransactions.end()) {
-            auto& pendingCallbacks = listener->second;
-            auto pendingCallback = pendingCallbacks.find(handle->callbackIds);
+        // Skip the handles of listeners that died, their callbacks were dropped with them.
+        auto listener = mListeners.find(handle->listener);
+        if (listener == mListeners.end()) {
+            ALOGW("cannot find listener in pending callback handles");
+            continue;
+        }
 
-            if (pendingCallback != pendingCallbacks.end()) {
-                auto& pendingCount = pendingCallback->second;
+        auto& pendingCallbacks = listener->second.pendingCallbackHandles;
+        auto pendingCallback = pendingCallbacks.find(handle->callbackIds);
+        if (pendingCallback != pendingCallbacks.end()) {
+            auto& pendingCount = pendingCallback->second;
 
-                // Decrease the pending count for this listener
-                if (--pendingCount == 0) {
-                    pendingCallbacks.erase(pendingCallback);
-                }
-            } else {
-                ALOGW("there are more latched callbacks than there were registered callbacks");
-            }
-            if (listener->second.size() == 0) {
-                mPendingTransactions.erase(listener);
+            // Decrease the pending count for this listener
+            if (--pendingCount == 0) {
+                pendingCallbacks.erase(pendingCallback);
             }
         } else {
-            ALOGW("cannot find listener in mPendingTransactions");
+            ALOGW("there are more latched callbacks than there were registered callbacks");
         }
 
-        status_t err = addCallbackHandle(handle);
+        status_t err = addCallbackHandle(listener->second, handle);
         if (err != NO_ERROR) {
             ALOGE("could not add callback handle");
             return err;
@@ -204,13 +222,18 @@ status_t TransactionCompletedThread::registerUnpresentedCallbackHandle(
         return BAD_VALUE;
     }
 
-    return addCallbackHandle(handle);
+    auto listenerState = mListeners.find(handle->listener);
+    if (listenerState == mListeners.end()) {
+        ALOGW("cannot add unpresented callback handle for a listener that is gone");
+        return BAD_VALUE;
+    }
+    return addCallbackHandle(listenerState->second, handle);
 }
 
 status_t TransactionCompletedThread::findTransactionStats(
-        const sp<IBinder>& listener, const std::vector<CallbackId>& callbackIds,
+        ListenerState& listenerState, const std::vector<CallbackId>& callbackIds,
         TransactionStats** outTransactionStats) {
-    auto& transactionStatsDeque = mCompletedTransactions[listener];
+    auto& transactionStatsDeque = listenerState.transactionStats;
 
     // Search back to front because the most recent transactions are at the back of the deque
     auto itr = transactionStatsDeque.rbegin();
@@ -225,11 +248,12 @@ status_t TransactionCompletedThread::findTransactionStats(
     return BAD_VALUE;
 }
 
-status_t TransactionCompletedThread::addCallbackHandle(const sp<CallbackHandle>& handle) {
+status_t TransactionCompletedThread::addCallbackHandle(ListenerState& listenerState,
+                                                       const sp<CallbackHandle>& handle) {
     // If we can't find the transaction stats something has gone wrong. The client should call
     // startRegistration before trying to add a callback handle.
     TransactionStats* transactionStats;
-    status_t err = findTransactionStats(handle->listener, handle->callbackIds, &transactionStats);
+    status_t err = findTransactionStats(listenerState, handle->callbackIds, &transactionStats);
     if (err != NO_ERROR) {
         return err;
     }
@@ -259,6 +283,7 @@ void TransactionCompletedThread::addPresentFence(const sp<Fence>& presentFence)
 void TransactionCompletedThread::sendCallbacks() {
     std::lock_guard lock(mMutex);
     if (mRunning) {
+        mSendCallbacksRequested = true;
         mConditionVariable.notify_all();
     }
 }
@@ -266,15 +291,37 @@ void TransactionCompletedThread::sendCallbacks() {
 void TransactionCompletedThread::threadMain() {
     std::lock_guard lock(mMutex);
 
+    // Reused across frames so the vector itself is not reallocated. Each ListenerStats that is
+    // sent is moved into the binder call, taking its transactionStats allocation with it.
+    std::vector<ListenerStats> completedListenerStats;
+
     while (mKeepRunning) {
-        mConditionVariable.wait(mMutex);
-        std::vector<ListenerStats> completedListenerStats;
+        mConditionVariable.wait(mMutex, [this]() REQUIRES(mMutex) {
+            return mSendCallbacksRequested || !mKeepRunning;
+        });
+        mSendCallbacksRequested = false;
+        size_t completedListenerCount = 0;
 
         // For each listener
-        auto completedTransactionsItr = mCompletedTransactions.begin();
-        while (completedTransactionsItr != mCompletedTransactions.end()) {
-            auto& [listener, transactionStatsDeque] = *completedTransactionsItr;
-            ListenerStats listenerStats;
+        auto listenerStateItr = mListeners.begin();
+        while (listenerStateItr != mListeners.end()) {
+            auto& [listener, listenerState] = *listenerStateItr;
+            auto& transactionStatsDeque = listenerState.transactionStats;
+            if (completedListenerCount == completedListenerStats.size()) {
+                completedListenerStats.emplace_back();
+            }
+            ListenerStats& listenerStats = completedListenerStats[completedListenerCount];
+
+            // If the listener is dead, drop everything pending for it, including transactions
+            // still waiting on callback handles, which would otherwise keep it here forever. Its
+            // stats are still released below, outside of mMutex, but not sent.
+            if (!listener->isBinderAlive()) {
+                std::move(transactionStatsDeque.begin(), transactionStatsDeque.end(),
+                          std::back_inserter(listenerStats.transactionStats));
+                completedListenerCount++;
+                listenerStateItr = mListeners.erase(listenerStateItr);
+                continue;
+            }
             listenerStats.listener = listener;
 
             // For each transaction
@@ -284,16 +331,15 @@ void TransactionCompletedThread::threadMain() {
 
                 // If this transaction is still registering, it is not safe to send a callback
                 // because there could be surface controls that haven't been added to
-                // transaction stats or mPendingTransactions.
-                if (isRegisteringTransaction(listener, transactionStats.callbackIds)) {
+                // transaction stats or the pending callback handles.
+                if (isRegisteringTransaction(listenerState, listener,
+                                             transactionStats.callbackIds)) {
                     break;
                 }
 
                 // If we are still waiting on the callback handles for this transaction, stop
                 // here because all transaction callbacks for the same listener must come in order
-                auto pendingTransactions = mPendingTransactions.find(listener);
-                if (pendingTransactions != mPendingTransactions.end() &&
-                    pendingTransactions->second.count(transactionStats.callbackIds) != 0) {
+                if (listenerState.pendingCallbackHandles.count(transactionStats.callbackIds) != 0) {
                     break;
                 }
 
@@ -309,56 +355,64 @@ void TransactionCompletedThread::threadMain() {
                 listenerStats.transactionStats.push_back(std::move(transactionStats));
                 transactionStatsItr = transactionStatsDeque.erase(transactionStatsItr);
             }
-            // If the listener has completed transactions
-            if (!listenerStats.transactionStats.empty()) {
-                // If the listener is still alive
-                if (listener->isBinderAlive()) {
-                    // Send callback.  The listener stored in listenerStats
-                    // comes from the cross-process setTransactionState call to
-                    // SF.  This MUST be an ITransactionCompletedListener.  We
-                    // keep it as an IBinder due to consistency reasons: if we
-                    // interface_cast at the IPC boundary when reading a Parcel,
-                    // we get pointers that compare unequal in the SF process.
-                    interface_cast<ITransactionCompletedListener>(listenerStats.listener)
-                            ->onTransactionCompleted(listenerStats);
-                    if (transactionStatsDeque.empty()) {
-                        listener->unlinkToDeath(mDeathRecipient);
-                        completedTransactionsItr =
-                                mCompletedTransactions.erase(completedTransactionsItr);
-                    } else {
-                        completedTransactionsItr++;
-                    }
-                } else {
-                    completedTransactionsItr =
-                            mCompletedTransactions.erase(completedTransactionsItr);
-                }
-            } else {
-                completedTransactionsItr++;
+
+            // If the listener has no completed transactions
+            if (listenerStats.transactionStats.empty()) {
+                listenerStats.listener.clear();
+                listenerStateItr++;
+                continue;
             }
 
-            completedListenerStats.push_back(std::move(listenerStats));
+            completedListenerCount++;
+            if (transactionStatsDeque.empty()) {
+                listener->unlinkToDeath(mDeathRecipient);
+                listenerStateItr = mListeners.erase(listenerStateItr);
+            } else {
+                listenerStateItr++;
+            }
         }
 
         if (mPresentFence) {
             mPresentFence.clear();
         }
 
-        // If everyone else has dropped their reference to a layer and its listener is dead,
-        // we are about to cause the layer to be deleted. If this happens at the wrong time and
-        // we are holding mMutex, we will cause a deadlock.
+        // Send the callbacks without holding mMutex, so that SurfaceFlinger's main thread is not
+        // held up registering and finalizing callback handles for the next frame while binder
+        // calls go out. This thread is the only one sending, so callbacks for a listener still
+        // go out in order, all of the frame's transactions in a single oneway call.
+        //
+        // This also matters for releasing the stats. If everyone else has dropped their
+        // reference to a layer and its listener is dead, we are about to cause the layer to be
+        // deleted. If this happens at the wrong time and we are holding mMutex, we will cause a
+        // deadlock.
         //
         // The deadlock happens because this thread is holding on to mMutex and when we delete
         // the layer, it grabs SF's mStateLock. A different SF binder thread grabs mStateLock,
         // then call's TransactionCompletedThread::run() which tries to grab mMutex.
-        //
-        // To avoid this deadlock, we need to unlock mMutex when dropping our last reference to
-        // to the layer.
         mMutex.unlock();
-        completedListenerStats.clear();
+        for (size_t i = 0; i < completedListenerCount; i++) {
+            ListenerStats& listenerStats = completedListenerStats[i];
+            if (listenerStats.listener != nullptr) {
+                // The listener stored in listenerStats comes from the cross-process
+                // setTransactionState call to SF.  This MUST be an
+                // ITransactionCompletedListener.  We keep it as an IBinder due to consistency
+                // reasons: if we interface_cast at the IPC boundary when reading a Parcel, we
+                // get pointers that compare unequal in the SF process.
+                interface_cast<ITransactionCompletedListener>(listenerStats.listener)
+                        ->onTransactionCompleted(std::move(listenerStats));
+            }
+            listenerStats.listener.clear();
+            listenerStats.transactionStats.clear();
+        }
         mMutex.lock();
     }
 }
 
+size_t TransactionCompletedThread::getListenerCountForTest() {
+    std::lock_guard lock(mMutex);
+    return mListeners.size();
+}
+
 // -----------------------------------------------------------------------
 
 CallbackHandle::CallbackHandle(const sp<IBinder>& transactionListener,
@@ -83,17 +83,34 @@ public:
 
     void sendCallbacks();
 
+    size_t getListenerCountForTest() EXCLUDES(mMutex);
+
 private:
+    // Everything that is waiting to be sent to one listener, so that a callback handle only
+    // costs a single lookup.
+    struct ListenerState {
+        // Transactions in the order they were applied. Callbacks for the same listener must be
+        // sent in that order.
+        std::deque<TransactionStats> transactionStats;
+        // Number of callback handles that still have to be presented, per transaction.
+        std::unordered_map<std::vector<CallbackId>, uint32_t /*count*/, CallbackIdsHash>
+                pendingCallbackHandles;
+        // Number of this listener's transactions in mRegisteringTransactions.
+        uint32_t registeringCount = 0;
+    };
+
     void threadMain();
 
-    bool isRegisteringTransaction(const sp<IBinder>& transactionListener,
+    bool isRegisteringTransaction(const ListenerState& listenerState,
+                                  const sp<IBinder>& transactionListener,
                                   const std::vector<CallbackId>& callbackIds) REQUIRES(mMutex);
 
-    status_t findTransactionStats(const sp<IBinder>& listener,
+    status_t findTransactionStats(ListenerState& listenerState,
                                   const std::vector<CallbackId>& callbackIds,
                                   TransactionStats** outTransactionStats) REQUIRES(mMutex);
 
-    status_t addCallbackHandle(const sp<CallbackHandle>& handle) REQUIRES(mMutex);
+    status_t addCallbackHandle(ListenerState& listenerState, const sp<CallbackHandle>& handle)
+            REQUIRES(mMutex);
 
     class ThreadDeathRecipient : public IBinder::DeathRecipient {
     public:
@@ -117,17 +134,12 @@ private:
     std::unordered_set<ListenerCallbacks, ListenerCallbacksHash> mRegisteringTransactions
             GUARDED_BY(mMutex);
 
-    std::unordered_map<
-            sp<IBinder>,
-            std::unordered_map<std::vector<CallbackId>, uint32_t /*count*/, CallbackIdsHash>,
-            IListenerHash>
-            mPendingTransactions GUARDED_BY(mMutex);
-
-    std::unordered_map<sp<IBinder>, std::deque<TransactionStats>, IListenerHash>
-            mCompletedTransactions GUARDED_BY(mMutex);
+    std::unordered_map<sp<IBinder>, ListenerState, IListenerHash> mListeners GUARDED_BY(mMutex);
 
     bool mRunning GUARDED_BY(mMutex) = false;
     bool mKeepRunning GUARDED_BY(mMutex) = true;
+    // Set by sendCallbacks, so that a request made while the thread is sending is not missed.
+    bool mSendCallbacksRequested GUARDED_BY(mMutex) = false;
 
     sp<Fence> mPresentFence GUARDED_BY(mMutex);
 };
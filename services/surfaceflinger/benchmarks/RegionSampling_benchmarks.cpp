@@ -0,0 +1,81 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <numeric>
+#include <vector>
+
+#include <ui/Transform.h>
+
+#include "../RegionSamplingLuma.h"
+
+namespace android {
+namespace {
+
+// A capture spanning a 1080p status bar and navigation bar, which is what
+// the region sampling listeners typically cover.
+constexpr int32_t kWidth = 1080;
+constexpr int32_t kStride = 1088;
+constexpr int32_t kHeight = 2340;
+constexpr int32_t kBarHeight = 132;
+
+std::vector<uint32_t> makeBuffer() {
+    std::vector<uint32_t> buffer(kStride * kHeight);
+    std::iota(buffer.begin(), buffer.end(), 0x12345678u);
+    return buffer;
+}
+
+const std::vector<Rect> kBarAreas = {
+        Rect(0, 0, kWidth, kBarHeight),
+        Rect(0, kHeight - kBarHeight, kWidth, kHeight),
+};
+
+void BM_SampleAreaPerListener(benchmark::State& state) {
+    const auto buffer = makeBuffer();
+    for (auto _ : state) {
+        for (const auto& area : kBarAreas) {
+            benchmark::DoNotOptimize(sampleArea(buffer.data(), kWidth, kHeight, kStride,
+                                                ui::Transform::ROT_0, area));
+        }
+    }
+}
+BENCHMARK(BM_SampleAreaPerListener);
+
+void BM_SampleAreas(benchmark::State& state) {
+    const auto buffer = makeBuffer();
+    const int32_t step = static_cast<int32_t>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(sampleAreas(buffer.data(), kWidth, kHeight, kStride,
+                                             ui::Transform::ROT_0, kBarAreas, step));
+    }
+}
+BENCHMARK(BM_SampleAreas)->Arg(1)->Arg(2)->Arg(4);
+
+void BM_SampleAreasFullScreen(benchmark::State& state) {
+    const auto buffer = makeBuffer();
+    const std::vector<Rect> areas = {Rect(0, 0, kWidth, kHeight)};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(sampleAreas(buffer.data(), kWidth, kHeight, kStride,
+                                             ui::Transform::ROT_0, areas));
+    }
+}
+BENCHMARK(BM_SampleAreasFullScreen);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -199,6 +199,51 @@ void LayerProtoParser::updateChildrenAndRelative(const LayerProto& layerProto,
     }
 }
 
+LayersProto LayerProtoParser::applyLayersDelta(const LayersProto& previousLayers,
+                                               const LayersTraceProto& entry) {
+    std::unordered_map<int32_t, const LayerProto*> layerMap;
+    for (const LayerProto& layerProto : previousLayers.layers()) {
+        layerMap[layerProto.id()] = &layerProto;
+    }
+    for (const LayerProto& layerProto : entry.layers().layers()) {
+        layerMap[layerProto.id()] = &layerProto;
+    }
+
+    LayersProto layers;
+    if (entry.layer_order_size() > 0) {
+        layers.mutable_layers()->Reserve(entry.layer_order_size());
+        for (int32_t id : entry.layer_order()) {
+            const auto it = layerMap.find(id);
+            if (it != layerMap.end()) {
+                *layers.add_layers() = *it->second;
+            }
+        }
+    } else {
+        layers.mutable_layers()->Reserve(previousLayers.layers_size());
+        for (const LayerProto& layerProto : previousLayers.layers()) {
+            *layers.add_layers() = *layerMap[layerProto.id()];
+        }
+    }
+    return layers;
+}
+
+void LayerProtoParser::expandLayersTrace(LayersTraceFileProto* fileProto) {
+    const LayersProto* previousLayers = nullptr;
+    for (LayersTraceProto& entry : *fileProto->mutable_entry()) {
+        if (entry.delta()) {
+            // A delta without a preceding keyframe cannot be expanded, leave it as is.
+            if (previousLayers == nullptr) {
+                continue;
+            }
+            LayersProto layers = applyLayersDelta(*previousLayers, entry);
+            entry.mutable_layers()->Swap(&layers);
+            entry.clear_delta();
+            entry.clear_layer_order();
+        }
+        previousLayers = &entry.layers();
+    }
+}
+
 std::string LayerProtoParser::layerTreeToString(const LayerTree& layerTree) {
     std::string result;
     for (const LayerProtoParser::Layer* layer : layerTree.topLevelLayers) {
@@ -130,6 +130,14 @@ public:
     static LayerTree generateLayerTree(const LayersProto& layersProto);
     static std::string layerTreeToString(const LayerTree& layerTree);
 
+    // Returns the full set of layers described by a delta trace entry, given the full set of
+    // layers of the entry before it.
+    static LayersProto applyLayersDelta(const LayersProto& previousLayers,
+                                        const LayersTraceProto& entry);
+    // Rewrites the delta entries of a trace as keyframes, so that the trace can be read by tools
+    // that do not understand delta entries.
+    static void expandLayersTrace(LayersTraceFileProto* fileProto);
+
 private:
     static std::vector<Layer> generateLayerList(const LayersProto& layersProto);
     static LayerProtoParser::Layer generateLayer(const LayerProto& layerProto);
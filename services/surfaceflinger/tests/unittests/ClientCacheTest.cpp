@@ -0,0 +1,144 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <gui/ITransactionCompletedListener.h>
+
+#include <set>
+
+#include "ClientCache.h"
+
+namespace android {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+// Stands in for the transaction completed listener that a client process caches buffers with.
+class FakeProcessToken : public BnTransactionCompletedListener {
+public:
+    // Local binders cannot be linked to death, but the cache requires it of the caching process.
+    status_t linkToDeath(const sp<DeathRecipient>&, void*, uint32_t) override { return NO_ERROR; }
+
+    void onTransactionCompleted(ListenerStats) override {}
+    void onBufferEvicted(uint64_t cacheId) override { evictedIds.push_back(cacheId); }
+
+    std::vector<uint64_t> evictedIds;
+};
+
+class FakeErasedRecipient : public ClientCache::ErasedRecipient {
+public:
+    void bufferErased(const client_cache_t& clientCacheId) override {
+        erasedIds.push_back(clientCacheId.id);
+    }
+
+    std::vector<uint64_t> erasedIds;
+};
+
+class ClientCacheTest : public testing::Test {
+protected:
+    client_cache_t cacheId(uint64_t id) const {
+        client_cache_t clientCacheId;
+        clientCacheId.token = mProcessToken;
+        clientCacheId.id = id;
+        return clientCacheId;
+    }
+
+    void fill() {
+        for (uint64_t id = 0; id <= BUFFER_CACHE_MAX_SIZE; id++) {
+            ASSERT_TRUE(mCache.add(cacheId(id), new GraphicBuffer()));
+        }
+    }
+
+    ClientCache mCache;
+    sp<FakeProcessToken> mProcessToken = new FakeProcessToken();
+};
+
+TEST_F(ClientCacheTest, holdsOneMoreBufferThanTheClient) {
+    fill();
+    for (uint64_t id = 0; id <= BUFFER_CACHE_MAX_SIZE; id++) {
+        EXPECT_NE(nullptr, mCache.get(cacheId(id)));
+    }
+    EXPECT_THAT(mProcessToken->evictedIds, IsEmpty());
+}
+
+TEST_F(ClientCacheTest, evictsLeastRecentlyUsedBufferAndTellsClient) {
+    fill();
+    sp<FakeErasedRecipient> recipient = new FakeErasedRecipient();
+    ASSERT_TRUE(mCache.registerErasedRecipient(cacheId(1), recipient));
+    // Buffer 0 was added first, but is now more recently used than buffer 1.
+    ASSERT_NE(nullptr, mCache.get(cacheId(0)));
+
+    const uint64_t newId = BUFFER_CACHE_MAX_SIZE + 1;
+    sp<GraphicBuffer> buffer = new GraphicBuffer();
+    ASSERT_TRUE(mCache.add(cacheId(newId), buffer));
+
+    EXPECT_EQ(buffer, mCache.get(cacheId(newId)));
+    EXPECT_NE(nullptr, mCache.get(cacheId(0)));
+    EXPECT_EQ(nullptr, mCache.get(cacheId(1)));
+    EXPECT_THAT(mProcessToken->evictedIds, ElementsAre(1u));
+    EXPECT_THAT(recipient->erasedIds, ElementsAre(1u));
+}
+
+TEST_F(ClientCacheTest, replacingBufferDoesNotEvict) {
+    fill();
+    sp<GraphicBuffer> buffer = new GraphicBuffer();
+    ASSERT_TRUE(mCache.add(cacheId(0), buffer));
+
+    EXPECT_EQ(buffer, mCache.get(cacheId(0)));
+    for (uint64_t id = 1; id <= BUFFER_CACHE_MAX_SIZE; id++) {
+        EXPECT_NE(nullptr, mCache.get(cacheId(id)));
+    }
+    EXPECT_THAT(mProcessToken->evictedIds, IsEmpty());
+}
+
+TEST_F(ClientCacheTest, evictionIsPerProcess) {
+    fill();
+    sp<FakeProcessToken> otherProcessToken = new FakeProcessToken();
+    client_cache_t otherCacheId;
+    otherCacheId.token = otherProcessToken;
+    otherCacheId.id = 0;
+    ASSERT_TRUE(mCache.add(otherCacheId, new GraphicBuffer()));
+
+    EXPECT_NE(nullptr, mCache.get(otherCacheId));
+    for (uint64_t id = 0; id <= BUFFER_CACHE_MAX_SIZE; id++) {
+        EXPECT_NE(nullptr, mCache.get(cacheId(id)));
+    }
+    EXPECT_THAT(mProcessToken->evictedIds, IsEmpty());
+    EXPECT_THAT(otherProcessToken->evictedIds, IsEmpty());
+}
+
+TEST_F(ClientCacheTest, spreadsProcessesOverShards) {
+    constexpr size_t kProcessCount = 64;
+    std::vector<sp<FakeProcessToken>> processTokens;
+    std::set<size_t> shards;
+    for (size_t i = 0; i < kProcessCount; i++) {
+        processTokens.push_back(new FakeProcessToken());
+        shards.insert(mCache.getShardIndexForTest(processTokens.back()));
+    }
+
+    // Binder objects are allocated at aligned addresses, which must not all land in one shard.
+    // Allow for an uneven spread, as the addresses are up to the allocator.
+    EXPECT_GE(shards.size(), 4u);
+    EXPECT_LT(*shards.rbegin(), 8u);
+}
+
+} // namespace
+} // namespace android
@@ -20,6 +20,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <log/log.h>
+#include <sys/socket.h>
 #include <utils/Errors.h>
 
 #include "AsyncCallRecorder.h"
@@ -31,6 +32,7 @@ using namespace std::placeholders;
 
 using testing::_;
 using testing::Invoke;
+using testing::Return;
 
 namespace android {
 
@@ -39,6 +41,7 @@ namespace {
 constexpr PhysicalDisplayId INTERNAL_DISPLAY_ID = 111;
 constexpr PhysicalDisplayId EXTERNAL_DISPLAY_ID = 222;
 constexpr PhysicalDisplayId DISPLAY_ID_64BIT = 0xabcd12349876fedcULL;
+constexpr nsecs_t VSYNC_PERIOD = 16666666;
 
 class MockVSyncSource : public VSyncSource {
 public:
@@ -47,6 +50,7 @@ public:
     MOCK_METHOD1(setVSyncEnabled, void(bool));
     MOCK_METHOD1(setCallback, void(VSyncSource::Callback*));
     MOCK_METHOD1(setPhaseOffset, void(nsecs_t));
+    MOCK_CONST_METHOD0(getVSyncPeriod, nsecs_t());
     MOCK_METHOD1(pauseVsyncCallback, void(bool));
     MOCK_CONST_METHOD1(dump, void(std::string&));
 };
@@ -61,10 +65,22 @@ protected:
                                   ISurfaceComposer::ConfigChanged configChanged)
               : EventThreadConnection(eventThread, std::move(resyncCallback), configChanged) {}
         MOCK_METHOD1(postEvent, status_t(const DisplayEventReceiver::Event& event));
+
+        // Like the real connection, reports how many events were sent before the first error.
+        ssize_t postEvents(const DisplayEventReceiver::Event* const* events,
+                           size_t count) override {
+            for (size_t i = 0; i < count; i++) {
+                if (const status_t status = postEvent(*events[i]); status != NO_ERROR) {
+                    return i > 0 ? static_cast<ssize_t>(i) : status;
+                }
+            }
+            return static_cast<ssize_t>(count);
+        }
     };
 
     using ConnectionEventRecorder =
             AsyncCallRecorderWithCannedReturn<status_t (*)(const DisplayEventReceiver::Event&)>;
+    using DisplayEvents = std::vector<DisplayEventReceiver::Event>;
 
     EventThreadTest();
     ~EventThreadTest() override;
@@ -73,6 +89,20 @@ protected:
     sp<MockEventThreadConnection> createConnection(ConnectionEventRecorder& recorder,
                                                    ISurfaceComposer::ConfigChanged configChanged);
 
+    // Creates a connection that writes to its channel, whose receive end is moved to receiver.
+    sp<EventThreadConnection> createRealConnection(gui::BitTube* receiver);
+    // Posts events to the connection until its channel is full, and returns how many fit. Their
+    // timestamps count up from 0.
+    static size_t fillChannel(const sp<EventThreadConnection>& connection);
+    // Returns the timestamp of the next event in the channel, or -1 if there is none. Each
+    // message must hold exactly one event.
+    static nsecs_t receiveEvent(const gui::BitTube& receiver);
+    // Dispatches events to the connection the way the thread does once it consumes all of them.
+    void dispatchEvents(const DisplayEvents& events, const sp<EventThreadConnection>& connection);
+    // Returns count VSYNC events with timestamps counting up from firstTimestamp.
+    static DisplayEvents makeVSyncEvents(size_t count, nsecs_t firstTimestamp);
+    static std::vector<const DisplayEventReceiver::Event*> makeBatch(const DisplayEvents& events);
+
     void expectVSyncSetEnabledCallReceived(bool expectedState);
     void expectVSyncSetPhaseOffsetCallReceived(nsecs_t expectedPhaseOffset);
     VSyncSource::Callback* expectVSyncSetCallbackCallReceived();
@@ -117,6 +147,8 @@ EventThreadTest::EventThreadTest() {
     EXPECT_CALL(*mVSyncSource, setPhaseOffset(_))
             .WillRepeatedly(Invoke(mVSyncSetPhaseOffsetCallRecorder.getInvocable()));
 
+    EXPECT_CALL(*mVSyncSource, getVSyncPeriod()).WillRepeatedly(Return(VSYNC_PERIOD));
+
     createThread(std::move(vsyncSource));
     mConnection = createConnection(mConnectionEventCallRecorder,
                                    ISurfaceComposer::eConfigChangedDispatch);
@@ -153,6 +185,66 @@ sp<EventThreadTest::MockEventThreadConnection> EventThreadTest::createConnection
     return connection;
 }
 
+sp<EventThreadConnection> EventThreadTest::createRealConnection(gui::BitTube* receiver) {
+    sp<EventThreadConnection> connection =
+            new EventThreadConnection(mThread.get(), mResyncCallRecorder.getInvocable(),
+                                      ISurfaceComposer::eConfigChangedSuppress);
+    EXPECT_EQ(NO_ERROR, connection->stealReceiveChannel(receiver));
+    return connection;
+}
+
+size_t EventThreadTest::fillChannel(const sp<EventThreadConnection>& connection) {
+    constexpr size_t kMaxEvents = 100000;
+    for (size_t count = 0; count < kMaxEvents; count++) {
+        const auto events = makeVSyncEvents(1, static_cast<nsecs_t>(count));
+        const DisplayEventReceiver::Event* event = &events[0];
+        const ssize_t sent = connection->postEvents(&event, 1);
+        if (sent != 1) {
+            EXPECT_EQ(-EAGAIN, sent);
+            return count;
+        }
+    }
+    ADD_FAILURE() << "The channel never filled up";
+    return kMaxEvents;
+}
+
+nsecs_t EventThreadTest::receiveEvent(const gui::BitTube& receiver) {
+    // Room for two events, so that a message holding more than one would show.
+    DisplayEventReceiver::Event events[2];
+    const ssize_t size = recv(receiver.getFd(), events, sizeof(events), MSG_DONTWAIT);
+    if (size < 0) {
+        return -1;
+    }
+    EXPECT_EQ(static_cast<ssize_t>(sizeof(DisplayEventReceiver::Event)), size);
+    return events[0].header.timestamp;
+}
+
+void EventThreadTest::dispatchEvents(const DisplayEvents& events,
+                                     const sp<EventThreadConnection>& connection) {
+    std::lock_guard<std::mutex> lock(mThread->mMutex);
+    mThread->dispatchEvents(events, {{connection, (1u << events.size()) - 1}});
+}
+
+EventThreadTest::DisplayEvents EventThreadTest::makeVSyncEvents(size_t count,
+                                                                nsecs_t firstTimestamp) {
+    DisplayEvents events(count);
+    for (size_t i = 0; i < count; i++) {
+        events[i].header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
+        events[i].header.displayId = INTERNAL_DISPLAY_ID;
+        events[i].header.timestamp = firstTimestamp + static_cast<nsecs_t>(i);
+    }
+    return events;
+}
+
+std::vector<const DisplayEventReceiver::Event*> EventThreadTest::makeBatch(
+        const DisplayEvents& events) {
+    std::vector<const DisplayEventReceiver::Event*> batch;
+    for (const auto& event : events) {
+        batch.push_back(&event);
+    }
+    return batch;
+}
+
 void EventThreadTest::expectVSyncSetEnabledCallReceived(bool expectedState) {
     auto args = mVSyncSetEnabledCallRecorder.waitForCall();
     ASSERT_TRUE(args.has_value());
@@ -494,6 +586,130 @@ TEST_F(EventThreadTest, postConfigChangedPrimary64bit) {
     expectConfigChangedEventReceivedByConnection(DISPLAY_ID_64BIT, 7, 16666666);
 }
 
+TEST_F(EventThreadTest, eventsPostedTogetherAreDeliveredInOrder) {
+    mThread->onHotplugReceived(EXTERNAL_DISPLAY_ID, true);
+    mThread->onConfigChanged(EXTERNAL_DISPLAY_ID, HwcConfigIndexType(3), 16666666);
+    mThread->onHotplugReceived(EXTERNAL_DISPLAY_ID, false);
+    expectHotplugEventReceivedByConnection(EXTERNAL_DISPLAY_ID, true);
+    expectConfigChangedEventReceivedByConnection(EXTERNAL_DISPLAY_ID, 3, 16666666);
+    expectHotplugEventReceivedByConnection(EXTERNAL_DISPLAY_ID, false);
+}
+
+TEST_F(EventThreadTest, postEventsSendsEachEventAsItsOwnMessage) {
+    gui::BitTube receiver;
+    const sp<EventThreadConnection> connection = createRealConnection(&receiver);
+
+    const auto events = makeVSyncEvents(3, 0);
+    const auto batch = makeBatch(events);
+    EXPECT_EQ(3, connection->postEvents(batch.data(), batch.size()));
+
+    EXPECT_EQ(0, receiveEvent(receiver));
+    EXPECT_EQ(1, receiveEvent(receiver));
+    EXPECT_EQ(2, receiveEvent(receiver));
+    EXPECT_EQ(-1, receiveEvent(receiver));
+}
+
+TEST_F(EventThreadTest, postEventsReportsEventsSentBeforeReceiverFellBehind) {
+    gui::BitTube receiver;
+    const sp<EventThreadConnection> connection = createRealConnection(&receiver);
+    const size_t queued = fillChannel(connection);
+    ASSERT_GT(queued, 0u);
+
+    // Only the room of the event read fits in the channel.
+    EXPECT_EQ(0, receiveEvent(receiver));
+    const auto events = makeVSyncEvents(EventThreadConnection::kMaxEventBatchSize, queued);
+    const auto batch = makeBatch(events);
+    const ssize_t sent = connection->postEvents(batch.data(), batch.size());
+    ASSERT_GT(sent, 0);
+    ASSERT_LT(sent, static_cast<ssize_t>(batch.size()));
+
+    // The events that were sent come after the ones already queued, in order.
+    for (nsecs_t timestamp = 1; timestamp < static_cast<nsecs_t>(queued) + sent; timestamp++) {
+        ASSERT_EQ(timestamp, receiveEvent(receiver));
+    }
+    EXPECT_EQ(-1, receiveEvent(receiver));
+}
+
+TEST_F(EventThreadTest, dispatchWritesEventsOfConnectionTogether) {
+    gui::BitTube receiver;
+    const sp<EventThreadConnection> connection = createRealConnection(&receiver);
+
+    dispatchEvents(makeVSyncEvents(3, 0), connection);
+
+    EXPECT_EQ(3u, connection->deliveryStats.events);
+    EXPECT_EQ(1u, connection->deliveryStats.writes);
+    EXPECT_EQ(0u, connection->deliveryStats.failedWrites);
+    EXPECT_EQ(0, receiveEvent(receiver));
+    EXPECT_EQ(1, receiveEvent(receiver));
+    EXPECT_EQ(2, receiveEvent(receiver));
+}
+
+TEST_F(EventThreadTest, dispatchOnlyCountsEventsThatDidNotFitAsFailed) {
+    gui::BitTube receiver;
+    const sp<EventThreadConnection> connection = createRealConnection(&receiver);
+    const size_t queued = fillChannel(connection);
+    ASSERT_EQ(0, receiveEvent(receiver));
+
+    dispatchEvents(makeVSyncEvents(3, queued), connection);
+
+    EXPECT_EQ(1u, connection->deliveryStats.events);
+    EXPECT_EQ(1u, connection->deliveryStats.writes);
+    EXPECT_EQ(1u, connection->deliveryStats.failedWrites);
+}
+
+TEST_F(EventThreadTest, vsyncTimelineFollowsVSyncEvents) {
+    gui::VsyncTimeline timeline;
+    ASSERT_EQ(NO_ERROR, mConnection->getVsyncTimeline(&timeline));
+    gui::VsyncTimeline::Snapshot snapshot;
+    EXPECT_FALSE(timeline.read(&snapshot));
+
+    // Keeps VSYNC enabled, which the timeline is only valid while.
+    mThread->setVsyncRate(1, mConnection);
+    expectVSyncSetEnabledCallReceived(true);
+    mCallback->onVSyncEvent(123, 456);
+    ASSERT_TRUE(timeline.read(&snapshot));
+    EXPECT_EQ(1u, snapshot.count);
+    EXPECT_EQ(123, snapshot.timestamp);
+    EXPECT_EQ(456, snapshot.expectedVSyncTimestamp);
+    EXPECT_EQ(VSYNC_PERIOD, snapshot.period);
+    expectVsyncEventReceivedByConnection(123, 1u);
+
+    const auto next = snapshot.nextAfter(124);
+    EXPECT_EQ(2u, next.count);
+    EXPECT_EQ(123 + VSYNC_PERIOD, next.timestamp);
+    EXPECT_EQ(456 + VSYNC_PERIOD, next.expectedVSyncTimestamp);
+
+    // The phase of the new period is unknown until the next VSYNC event.
+    mThread->onConfigChanged(INTERNAL_DISPLAY_ID, HwcConfigIndexType(1), VSYNC_PERIOD / 2);
+    EXPECT_FALSE(timeline.read(&snapshot));
+}
+
+TEST_F(EventThreadTest, vsyncTimelineIsInvalidWhileVSyncIsDisabled) {
+    gui::VsyncTimeline timeline;
+    ASSERT_EQ(NO_ERROR, mConnection->getVsyncTimeline(&timeline));
+    gui::VsyncTimeline::Snapshot snapshot;
+
+    mThread->requestNextVsync(mConnection);
+    expectVSyncSetEnabledCallReceived(true);
+    mCallback->onVSyncEvent(123, 456);
+    expectVsyncEventReceivedByConnection(123, 1u);
+
+    // Nobody requested another VSYNC event, so the source is disabled and the timeline goes
+    // stale.
+    expectVSyncSetEnabledCallReceived(false);
+    EXPECT_FALSE(timeline.read(&snapshot));
+
+    // An event that was already on its way when the source was disabled does not revive it.
+    mCallback->onVSyncEvent(123 + VSYNC_PERIOD, 456 + VSYNC_PERIOD);
+    EXPECT_FALSE(timeline.read(&snapshot));
+
+    mThread->setVsyncRate(1, mConnection);
+    expectVSyncSetEnabledCallReceived(true);
+    mCallback->onVSyncEvent(123 + 2 * VSYNC_PERIOD, 456 + 2 * VSYNC_PERIOD);
+    ASSERT_TRUE(timeline.read(&snapshot));
+    EXPECT_EQ(123 + 2 * VSYNC_PERIOD, snapshot.timestamp);
+}
+
 TEST_F(EventThreadTest, suppressConfigChanged) {
     ConnectionEventRecorder suppressConnectionEventRecorder{0};
     sp<MockEventThreadConnection> suppressConnection =
@@ -23,9 +23,11 @@
 
 #include <vector>
 
+#include <cutils/native_handle.h>
 #include <gmock/gmock.h>
 #include <gui/LayerMetadata.h>
 #include <log/log.h>
+#include <utils/NativeHandle.h>
 
 #include "DisplayHardware/HWComposer.h"
 #include "mock/DisplayHardware/MockComposer.h"
@@ -122,7 +124,8 @@ struct HWComposerLayerTest : public testing::Test {
 
     std::unique_ptr<Hwc2::mock::Composer> mHal{new StrictMock<Hwc2::mock::Composer>()};
     const std::unordered_set<hal::Capability> mCapabilies;
-    HWC2::impl::Layer mLayer{*mHal, mCapabilies, kDisplayId, kLayerId};
+    HWC2::LayerCommandStats mCommandStats;
+    HWC2::impl::Layer mLayer{*mHal, mCapabilies, kDisplayId, kLayerId, mCommandStats};
 };
 
 struct HWComposerLayerGenericMetadataTest : public HWComposerLayerTest {
@@ -171,5 +174,97 @@ TEST_F(HWComposerLayerGenericMetadataTest, forwardsSupportedMetadata) {
     EXPECT_EQ(hal::Error::UNSUPPORTED, result);
 }
 
+struct HWComposerLayerCommandCacheTest : public HWComposerLayerTest {
+    HWComposerLayerCommandCacheTest() : HWComposerLayerTest({}) {}
+};
+
+TEST_F(HWComposerLayerCommandCacheTest, skipsUnchangedGeometry) {
+    const Rect kFrame{1, 2, 3, 4};
+
+    EXPECT_CALL(*mHal, setLayerDisplayFrame(kDisplayId, kLayerId, _))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::NONE));
+    EXPECT_CALL(*mHal, setLayerZOrder(kDisplayId, kLayerId, 5u))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::NONE));
+
+    EXPECT_EQ(hal::Error::NONE, mLayer.setDisplayFrame(kFrame));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setZOrder(5u));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setDisplayFrame(kFrame));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setZOrder(5u));
+
+    EXPECT_EQ(2u, mCommandStats.sent.load());
+    EXPECT_EQ(2u, mCommandStats.skipped.load());
+}
+
+TEST_F(HWComposerLayerCommandCacheTest, sendsChangedValues) {
+    EXPECT_CALL(*mHal, setLayerPlaneAlpha(kDisplayId, kLayerId, 0.5f))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::NONE));
+    EXPECT_CALL(*mHal, setLayerPlaneAlpha(kDisplayId, kLayerId, 1.0f))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::NONE));
+
+    EXPECT_EQ(hal::Error::NONE, mLayer.setPlaneAlpha(0.5f));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setPlaneAlpha(1.0f));
+
+    EXPECT_EQ(2u, mCommandStats.sent.load());
+    EXPECT_EQ(0u, mCommandStats.skipped.load());
+}
+
+TEST_F(HWComposerLayerCommandCacheTest, resendsValueAfterError) {
+    EXPECT_CALL(*mHal, setLayerZOrder(kDisplayId, kLayerId, 3u))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::BAD_LAYER))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::NONE));
+
+    EXPECT_EQ(hal::Error::BAD_LAYER, mLayer.setZOrder(3u));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setZOrder(3u));
+}
+
+TEST_F(HWComposerLayerCommandCacheTest, skipsUnchangedMultiRectVisibleRegion) {
+    Region region{Rect(0, 0, 10, 10)};
+    region.orSelf(Rect(20, 20, 30, 30));
+
+    EXPECT_CALL(*mHal, setLayerVisibleRegion(kDisplayId, kLayerId, _))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::NONE));
+
+    EXPECT_EQ(hal::Error::NONE, mLayer.setVisibleRegion(region));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setVisibleRegion(region));
+}
+
+TEST_F(HWComposerLayerCommandCacheTest, resendsDataspaceAfterError) {
+    EXPECT_CALL(*mHal, setLayerDataspace(kDisplayId, kLayerId, hal::Dataspace::SRGB))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::BAD_LAYER))
+            .WillOnce(Return(hardware::graphics::composer::V2_4::Error::NONE));
+
+    EXPECT_EQ(hal::Error::BAD_LAYER, mLayer.setDataspace(hal::Dataspace::SRGB));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setDataspace(hal::Dataspace::SRGB));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setDataspace(hal::Dataspace::SRGB));
+
+    EXPECT_EQ(2u, mCommandStats.sent.load());
+    EXPECT_EQ(1u, mCommandStats.skipped.load());
+}
+
+struct HWComposerLayerSidebandStreamTest : public HWComposerLayerTest {
+    HWComposerLayerSidebandStreamTest()
+          : HWComposerLayerTest({hal::Capability::SIDEBAND_STREAM}) {}
+    ~HWComposerLayerSidebandStreamTest() override { native_handle_delete(mHandle); }
+
+    native_handle_t* mHandle = native_handle_create(0, 0);
+};
+
+TEST_F(HWComposerLayerSidebandStreamTest, sendsNewStreamWithSameHandle) {
+    // A new stream may reuse the address of a freed stream's handle.
+    const auto stream = NativeHandle::create(mHandle, false);
+    const auto newStream = NativeHandle::create(mHandle, false);
+
+    EXPECT_CALL(*mHal, setLayerSidebandStream(kDisplayId, kLayerId, mHandle))
+            .Times(2)
+            .WillRepeatedly(Return(hardware::graphics::composer::V2_4::Error::NONE));
+
+    EXPECT_EQ(hal::Error::NONE, mLayer.setSidebandStream(stream));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setSidebandStream(stream));
+    EXPECT_EQ(hal::Error::NONE, mLayer.setSidebandStream(newStream));
+
+    EXPECT_EQ(2u, mCommandStats.sent.load());
+    EXPECT_EQ(1u, mCommandStats.skipped.load());
+}
+
 } // namespace
 } // namespace android
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <gui/LayerMetadata.h>
+
+// TODO(b/129481165): remove the #pragma below and fix conversion issues
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include "EffectLayer.h"
+#include "Layer.h"
+#include "LayerTreeSnapshot.h"
+// TODO(b/129481165): remove the #pragma below and fix conversion issues
+#pragma clang diagnostic pop // ignored "-Wconversion"
+#include "TestableSurfaceFlinger.h"
+#include "mock/DisplayHardware/MockComposer.h"
+#include "mock/MockMessageQueue.h"
+
+namespace android {
+namespace {
+
+using testing::Mock;
+using testing::Return;
+
+class LayerTreeSnapshotTest : public testing::Test {
+protected:
+    static constexpr uint32_t WIDTH = 100;
+    static constexpr uint32_t HEIGHT = 100;
+    static constexpr uint32_t LAYER_FLAGS = 0;
+
+    LayerTreeSnapshotTest() {
+        const ::testing::TestInfo* const test_info =
+                ::testing::UnitTest::GetInstance()->current_test_info();
+        ALOGD("**** Setting up for %s.%s\n", test_info->test_case_name(), test_info->name());
+
+        mComposer = new Hwc2::mock::Composer();
+        EXPECT_CALL(*mComposer, getMaxVirtualDisplayCount()).WillOnce(Return(0));
+        mFlinger.setupComposer(std::unique_ptr<Hwc2::Composer>(mComposer));
+        Mock::VerifyAndClear(mComposer);
+
+        mFlinger.mutableEventQueue().reset(mMessageQueue);
+    }
+
+    ~LayerTreeSnapshotTest() override {
+        mFlinger.mutableDrawingState().layersSortedByZ.clear();
+
+        const ::testing::TestInfo* const test_info =
+                ::testing::UnitTest::GetInstance()->current_test_info();
+        ALOGD("**** Tearing down after %s.%s\n", test_info->test_case_name(), test_info->name());
+    }
+
+    sp<Layer> createLayer(int32_t z) {
+        sp<Client> client;
+        LayerCreationArgs args(mFlinger.flinger(), client, "effect-layer", WIDTH, HEIGHT,
+                               LAYER_FLAGS, LayerMetadata());
+        sp<Layer> layer = new EffectLayer(args);
+        layer->setLayer(z);
+        mLayers.push_back(layer);
+        return layer;
+    }
+
+    // Copies the current state of every layer to its drawing state, as a
+    // transaction commit would.
+    void commitTransaction() {
+        for (const auto& layer : mLayers) {
+            layer->commitTransaction(layer->getCurrentState());
+        }
+        for (const auto& layer : mLayers) {
+            layer->commitChildList();
+        }
+    }
+
+    TestableSurfaceFlinger mFlinger;
+    Hwc2::mock::Composer* mComposer = nullptr;
+    mock::MessageQueue* mMessageQueue = new mock::MessageQueue();
+    std::vector<sp<Layer>> mLayers;
+};
+
+TEST_F(LayerTreeSnapshotTest, isInvalidUntilRebuilt) {
+    LayerTreeSnapshot snapshot;
+    EXPECT_FALSE(snapshot.isValid());
+
+    snapshot.rebuild(mFlinger.mutableDrawingState().layersSortedByZ);
+    EXPECT_TRUE(snapshot.isValid());
+    EXPECT_TRUE(snapshot.getEntries().empty());
+
+    snapshot.invalidate();
+    EXPECT_FALSE(snapshot.isValid());
+}
+
+TEST_F(LayerTreeSnapshotTest, flattensHierarchyWithParentIndices) {
+    auto root1 = createLayer(1);
+    auto root2 = createLayer(2);
+    auto childAbove = createLayer(1);
+    auto childBelow = createLayer(-1);
+    root1->addChild(childAbove);
+    root1->addChild(childBelow);
+    commitTransaction();
+
+    mFlinger.mutableDrawingState().layersSortedByZ.add(root2);
+    mFlinger.mutableDrawingState().layersSortedByZ.add(root1);
+
+    LayerTreeSnapshot snapshot;
+    snapshot.rebuild(mFlinger.mutableDrawingState().layersSortedByZ);
+
+    const auto& entries = snapshot.getEntries();
+    ASSERT_EQ(4u, entries.size());
+    EXPECT_EQ(4u, snapshot.getHierarchySize());
+
+    EXPECT_EQ(root1.get(), entries[0].layer);
+    EXPECT_EQ(LayerTreeSnapshot::NO_PARENT, entries[0].parentIndex);
+    EXPECT_EQ(childBelow.get(), entries[1].layer);
+    EXPECT_EQ(0, entries[1].parentIndex);
+    EXPECT_EQ(childAbove.get(), entries[2].layer);
+    EXPECT_EQ(0, entries[2].parentIndex);
+    EXPECT_EQ(root2.get(), entries[3].layer);
+    EXPECT_EQ(LayerTreeSnapshot::NO_PARENT, entries[3].parentIndex);
+
+    std::vector<Layer*> layers;
+    snapshot.traverseInZOrder(
+            [&](const LayerTreeSnapshot::Entry& entry) { layers.push_back(entry.layer); });
+    EXPECT_EQ((std::vector<Layer*>{childBelow.get(), root1.get(), childAbove.get(), root2.get()}),
+              layers);
+}
+
+TEST_F(LayerTreeSnapshotTest, resolvesPolicyThroughParents) {
+    auto root = createLayer(0);
+    auto child = createLayer(0);
+    auto grandchild = createLayer(0);
+    auto visibleRoot = createLayer(1);
+    root->addChild(child);
+    child->addChild(grandchild);
+    root->setAlpha(0.5f);
+    child->setAlpha(0.5f);
+    child->setFlags(layer_state_t::eLayerHidden, layer_state_t::eLayerHidden);
+    commitTransaction();
+
+    mFlinger.mutableDrawingState().layersSortedByZ.add(root);
+    mFlinger.mutableDrawingState().layersSortedByZ.add(visibleRoot);
+
+    LayerTreeSnapshot snapshot;
+    snapshot.rebuild(mFlinger.mutableDrawingState().layersSortedByZ);
+
+    const auto& entries = snapshot.getEntries();
+    ASSERT_EQ(4u, entries.size());
+    for (const auto& entry : entries) {
+        EXPECT_EQ(entry.layer->isHiddenByPolicy(), entry.hiddenByPolicy);
+        EXPECT_EQ(entry.layer->getAlpha(), entry.alpha);
+        EXPECT_EQ(LayerTreeSnapshot::NO_PARENT, entry.clonedRootIndex);
+    }
+
+    EXPECT_FALSE(entries[0].hiddenByPolicy);
+    EXPECT_TRUE(entries[1].hiddenByPolicy);
+    EXPECT_TRUE(entries[2].hiddenByPolicy);
+    EXPECT_FALSE(entries[3].hiddenByPolicy);
+    EXPECT_EQ(0.25_hf, entries[2].alpha);
+}
+
+TEST_F(LayerTreeSnapshotTest, capturesPerLayerState) {
+    auto root = createLayer(0);
+    auto child = createLayer(0);
+    root->addChild(child);
+    commitTransaction();
+
+    mFlinger.mutableDrawingState().layersSortedByZ.add(root);
+
+    LayerTreeSnapshot snapshot;
+    snapshot.rebuild(mFlinger.mutableDrawingState().layersSortedByZ);
+
+    const auto& entries = snapshot.getEntries();
+    ASSERT_EQ(2u, entries.size());
+    for (const auto& entry : entries) {
+        EXPECT_EQ(entry.layer->getCompositionEngineLayerFE().get(), entry.layerFE);
+        EXPECT_NE(nullptr, entry.layerFE);
+        EXPECT_EQ(entry.layer->needsInputInfo(), entry.needsInputInfo);
+    }
+}
+
+TEST_F(LayerTreeSnapshotTest, traversesInBothOrders) {
+    auto bottom = createLayer(0);
+    auto top = createLayer(1);
+    commitTransaction();
+
+    mFlinger.mutableDrawingState().layersSortedByZ.add(bottom);
+    mFlinger.mutableDrawingState().layersSortedByZ.add(top);
+
+    LayerTreeSnapshot snapshot;
+    snapshot.rebuild(mFlinger.mutableDrawingState().layersSortedByZ);
+
+    std::vector<Layer*> layers;
+    snapshot.traverseInZOrder(
+            [&](const LayerTreeSnapshot::Entry& entry) { layers.push_back(entry.layer); });
+    EXPECT_EQ((std::vector<Layer*>{bottom.get(), top.get()}), layers);
+
+    layers.clear();
+    snapshot.traverseInReverseZOrder(
+            [&](const LayerTreeSnapshot::Entry& entry) { layers.push_back(entry.layer); });
+    EXPECT_EQ((std::vector<Layer*>{top.get(), bottom.get()}), layers);
+}
+
+} // namespace
+} // namespace android
@@ -27,6 +27,7 @@
 #include <gtest/gtest.h>
 #include <array>
 #include <limits>
+#include <random>
 
 #include "RegionSamplingThread.h"
 
@@ -140,6 +141,79 @@ TEST_F(RegionSamplingTest, orientation_90) {
                 testing::Eq(1.0));
 }
 
+// A straightforward per-pixel implementation, kept independent of the one under test.
+float referenceLuma(const uint32_t* data, int32_t stride, const Rect& area, int32_t step = 1) {
+    uint64_t accumulatedLuma = 0;
+    uint64_t pixelCount = 0;
+    for (int32_t row = area.top; row < area.bottom; row += step) {
+        for (int32_t column = area.left; column < area.right; column += step) {
+            const uint32_t pixel = data[row * stride + column];
+            const uint32_t r = pixel & 0xFF;
+            const uint32_t g = (pixel >> 8) & 0xFF;
+            const uint32_t b = (pixel >> 16) & 0xFF;
+            accumulatedLuma += (r * 7 + b * 2 + g * 23) >> 5;
+            pixelCount++;
+        }
+    }
+    return accumulatedLuma / (255.0f * pixelCount);
+}
+
+TEST_F(RegionSamplingTest, sample_areas_match_reference) {
+    std::mt19937 generator(0);
+    std::generate(buffer.begin(), buffer.end(), generator);
+    // Fill the padding past the width of each row, which must never be read.
+    for (int32_t row = 0; row < kHeight; row++) {
+        std::fill(buffer.begin() + row * kStride + kWidth, buffer.begin() + (row + 1) * kStride,
+                  kWhite);
+    }
+
+    // Widths of 1 to 9 cover every remainder of the vector width, with and without
+    // a full vector, at both aligned and unaligned starting columns.
+    std::vector<Rect> areas{whole_area, {3, 2, 50, 20}, {20, 10, 60, kHeight}};
+    for (int32_t width = 1; width <= 9; width++) {
+        areas.push_back({0, 0, width, 3});
+        areas.push_back({5, 4, 5 + width, 7});
+        areas.push_back({kWidth - width, kHeight - 3, kWidth, kHeight});
+    }
+
+    auto const lumas = sampleAreas(buffer.data(), kWidth, kHeight, kStride, kOrientation, areas);
+    ASSERT_EQ(areas.size(), lumas.size());
+    for (size_t i = 0; i < areas.size(); i++) {
+        EXPECT_THAT(lumas[i], testing::FloatEq(referenceLuma(buffer.data(), kStride, areas[i])))
+                << "area " << i;
+        EXPECT_THAT(sampleArea(buffer.data(), kWidth, kHeight, kStride, kOrientation, areas[i]),
+                    testing::FloatEq(lumas[i]))
+                << "area " << i;
+    }
+
+    auto const steppedLumas =
+            sampleAreas(buffer.data(), kWidth, kHeight, kStride, kOrientation, areas, 3);
+    ASSERT_EQ(areas.size(), steppedLumas.size());
+    for (size_t i = 0; i < areas.size(); i++) {
+        EXPECT_THAT(steppedLumas[i],
+                    testing::FloatEq(referenceLuma(buffer.data(), kStride, areas[i], 3)))
+                << "area " << i;
+    }
+}
+
+TEST_F(RegionSamplingTest, sample_areas_reports_invalid_areas_as_black) {
+    std::fill(buffer.begin(), buffer.end(), kWhite);
+    auto const lumas = sampleAreas(buffer.data(), kWidth, kHeight, kStride, kOrientation,
+                                   {{0, 0, 4, kHeight + 1}, whole_area});
+    ASSERT_EQ(2u, lumas.size());
+    EXPECT_THAT(lumas[0], testing::Eq(0.0));
+    EXPECT_THAT(lumas[1], testing::FloatEq(1.0f));
+}
+
+TEST_F(RegionSamplingTest, sample_areas_with_step) {
+    std::fill(buffer.begin(), buffer.end(), kWhite);
+    auto const lumas = sampleAreas(buffer.data(), kWidth, kHeight, kStride, kOrientation,
+                                   {whole_area, {1, 1, 2, 2}}, 3);
+    ASSERT_EQ(2u, lumas.size());
+    EXPECT_THAT(lumas[0], testing::FloatEq(1.0f));
+    EXPECT_THAT(lumas[1], testing::FloatEq(1.0f));
+}
+
 } // namespace android
 
 // TODO(b/129481165): remove the #pragma below and fix conversion issues
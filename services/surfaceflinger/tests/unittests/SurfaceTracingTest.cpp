@@ -0,0 +1,122 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <layerproto/LayerProtoParser.h>
+
+#include "SurfaceTracing.h"
+
+namespace android {
+namespace {
+
+using surfaceflinger::LayerProtoParser;
+
+class SurfaceTracingDeltaTest : public testing::Test {
+protected:
+    static void addLayer(LayersTraceProto& entry, int32_t id, const std::string& name,
+                         int32_t z) {
+        LayerProto* layerProto = entry.mutable_layers()->add_layers();
+        layerProto->set_id(id);
+        layerProto->set_name(name);
+        layerProto->set_z(z);
+    }
+
+    static std::vector<int32_t> layerIds(const LayersProto& layers) {
+        std::vector<int32_t> ids;
+        for (const LayerProto& layerProto : layers.layers()) {
+            ids.push_back(layerProto.id());
+        }
+        return ids;
+    }
+
+    SurfaceTracing::LayersDeltaEncoder mEncoder;
+};
+
+TEST_F(SurfaceTracingDeltaTest, deltaOnlyHoldsChangedLayers) {
+    LayersTraceProto keyframe;
+    addLayer(keyframe, 1, "a", 0);
+    addLayer(keyframe, 2, "b", 1);
+    mEncoder.update(keyframe, nullptr);
+
+    LayersTraceProto entry;
+    entry.set_where("visibleRegionsDirty");
+    addLayer(entry, 1, "a", 0);
+    addLayer(entry, 2, "b", 2);
+
+    LayersTraceProto delta;
+    mEncoder.update(entry, &delta);
+    EXPECT_TRUE(delta.delta());
+    EXPECT_EQ("visibleRegionsDirty", delta.where());
+    EXPECT_EQ(0, delta.layer_order_size());
+    ASSERT_EQ(1, delta.layers().layers_size());
+    EXPECT_EQ(2, delta.layers().layers(0).id());
+    EXPECT_EQ(2, delta.layers().layers(0).z());
+
+    const LayersProto layers = LayerProtoParser::applyLayersDelta(keyframe.layers(), delta);
+    EXPECT_EQ(entry.layers().SerializeAsString(), layers.SerializeAsString());
+}
+
+TEST_F(SurfaceTracingDeltaTest, deltaRecordsAddedRemovedAndReorderedLayers) {
+    LayersTraceProto keyframe;
+    addLayer(keyframe, 1, "a", 0);
+    addLayer(keyframe, 2, "b", 1);
+    addLayer(keyframe, 3, "c", 2);
+    mEncoder.update(keyframe, nullptr);
+
+    LayersTraceProto entry;
+    addLayer(entry, 3, "c", 2);
+    addLayer(entry, 1, "a", 0);
+    addLayer(entry, 4, "d", 3);
+
+    LayersTraceProto delta;
+    mEncoder.update(entry, &delta);
+    EXPECT_THAT(delta.layer_order(), testing::ElementsAre(3, 1, 4));
+    EXPECT_THAT(layerIds(delta.layers()), testing::ElementsAre(4));
+
+    const LayersProto layers = LayerProtoParser::applyLayersDelta(keyframe.layers(), delta);
+    EXPECT_EQ(entry.layers().SerializeAsString(), layers.SerializeAsString());
+}
+
+TEST_F(SurfaceTracingDeltaTest, expandLayersTraceRestoresKeyframes) {
+    LayersTraceFileProto fileProto;
+    std::vector<LayersTraceProto> entries(3);
+    addLayer(entries[0], 1, "a", 0);
+    addLayer(entries[1], 1, "a", 1);
+    addLayer(entries[1], 2, "b", 2);
+    addLayer(entries[2], 2, "b", 2);
+
+    mEncoder.update(entries[0], nullptr);
+    *fileProto.add_entry() = entries[0];
+    for (size_t i = 1; i < entries.size(); i++) {
+        mEncoder.update(entries[i], fileProto.add_entry());
+    }
+
+    LayerProtoParser::expandLayersTrace(&fileProto);
+    ASSERT_EQ(static_cast<int>(entries.size()), fileProto.entry_size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        EXPECT_FALSE(fileProto.entry(i).delta());
+        EXPECT_EQ(0, fileProto.entry(i).layer_order_size());
+        EXPECT_EQ(entries[i].layers().SerializeAsString(),
+                  fileProto.entry(i).layers().SerializeAsString());
+    }
+}
+
+} // namespace
+} // namespace android
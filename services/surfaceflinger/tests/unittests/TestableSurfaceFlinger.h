@@ -390,7 +390,12 @@ public:
     auto& mutableCurrentState() { return mFlinger->mCurrentState; }
     auto& mutableDisplayColorSetting() { return mFlinger->mDisplayColorSetting; }
     auto& mutableDisplays() { return mFlinger->mDisplays; }
-    auto& mutableDrawingState() { return mFlinger->mDrawingState; }
+    auto& mutableDrawingState() {
+        // The caller may change the layer hierarchy without committing a
+        // transaction, which would otherwise leave the flattened copy stale.
+        mFlinger->mDrawingLayerSnapshot.invalidate();
+        return mFlinger->mDrawingState;
+    }
     auto& mutableEventQueue() { return mFlinger->mEventQueue; }
     auto& mutableGeometryInvalid() { return mFlinger->mGeometryInvalid; }
     auto& mutableInterceptor() { return mFlinger->mInterceptor; }
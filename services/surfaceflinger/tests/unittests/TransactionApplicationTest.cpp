@@ -283,6 +283,51 @@ TEST_F(TransactionApplicationTest, Flush_RemovesFromQueue) {
     EXPECT_EQ(0, transactionQueue.size());
 }
 
+TEST_F(TransactionApplicationTest, QueuedTransactionIsResolvedWhenReceived) {
+    ASSERT_EQ(0, mFlinger.getTransactionQueue().size());
+    // called in SurfaceFlinger::signalTransaction
+    EXPECT_CALL(*mMessageQueue, invalidate()).Times(1);
+    EXPECT_CALL(*mPrimaryDispSync, expectedPresentTime(_)).WillOnce(Return(nsecs_t(5 * 1e8)));
+
+    TransactionInfo transaction;
+    setupSingle(transaction, /*flags*/ 0, /*syncInputWindows*/ false,
+                /*desiredPresentTime*/ s2ns(1));
+
+    // A state without a layer handle, one with an acquire fence, and one with an invalid frame
+    // rate.
+    ComposerState noHandleState;
+    transaction.states.add(noHandleState);
+    ComposerState fenceState;
+    fenceState.state.what = layer_state_t::eAcquireFenceChanged;
+    fenceState.state.acquireFence = Fence::NO_FENCE;
+    transaction.states.add(fenceState);
+    ComposerState frameRateState;
+    frameRateState.state.what = layer_state_t::eFrameRateChanged;
+    frameRateState.state.frameRate = -1.0f;
+    transaction.states.add(frameRateState);
+
+    mFlinger.setTransactionState(transaction.states, transaction.displays, transaction.flags,
+                                 transaction.applyToken, transaction.inputWindowCommands,
+                                 transaction.desiredPresentTime, transaction.uncacheBuffer,
+                                 mHasListenerCallbacks, mCallbacks);
+
+    auto& transactionQueue = mFlinger.getTransactionQueue();
+    ASSERT_EQ(1, transactionQueue.size());
+
+    auto& [applyToken, transactionStates] = *(transactionQueue.begin());
+    ASSERT_EQ(1, transactionStates.size());
+
+    const auto& transactionState = transactionStates.front();
+    ASSERT_EQ(3u, transactionState.resolvedStates.size());
+    EXPECT_EQ(nullptr, transactionState.resolvedStates[0].layer.promote());
+    EXPECT_EQ(nullptr, transactionState.resolvedStates[1].layer.promote());
+    EXPECT_EQ(static_cast<uint64_t>(layer_state_t::eAcquireFenceChanged),
+              transactionState.resolvedStates[1].what);
+    EXPECT_EQ(0u, transactionState.resolvedStates[2].what);
+    ASSERT_EQ(1u, transactionState.acquireFences.size());
+    EXPECT_EQ(Fence::NO_FENCE, transactionState.acquireFences[0]);
+}
+
 TEST_F(TransactionApplicationTest, NotPlacedOnTransactionQueue_Synchronous) {
     NotPlacedOnTransactionQueue(ISurfaceComposer::eSynchronous, /*syncInputWindows*/ false);
 }
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "AsyncCallRecorder.h"
+#include "TransactionCompletedThread.h"
+
+namespace android {
+namespace {
+
+using testing::ElementsAre;
+
+using CallbackIds = std::vector<CallbackId>;
+
+// Stands in for the transaction completed listener of a client process, and records the callback
+// ids of the transactions in each callback.
+class FakeListener : public BnTransactionCompletedListener {
+public:
+    // Local binders cannot be linked to death, but the thread requires it of listeners.
+    status_t linkToDeath(const sp<DeathRecipient>&, void*, uint32_t) override { return NO_ERROR; }
+    status_t unlinkToDeath(const wp<DeathRecipient>&, void*, uint32_t,
+                           wp<DeathRecipient>*) override {
+        return NO_ERROR;
+    }
+    bool isBinderAlive() const override { return alive; }
+
+    void onTransactionCompleted(ListenerStats stats) override {
+        std::vector<CallbackIds> transactions;
+        for (const auto& transactionStats : stats.transactionStats) {
+            transactions.push_back(transactionStats.callbackIds);
+        }
+        callbacks.recordCall(transactions);
+    }
+    void onBufferEvicted(uint64_t) override {}
+
+    std::atomic<bool> alive = true;
+    AsyncCallRecorder<void (*)(std::vector<CallbackIds>)> callbacks;
+};
+
+class TransactionCompletedThreadTest : public testing::Test {
+protected:
+    // Applies a transaction with a single layer that is presented this frame, and returns the
+    // layer's callback handle.
+    sp<CallbackHandle> applyTransaction(const sp<FakeListener>& listener, CallbackId id) {
+        const sp<IBinder> binder = IInterface::asBinder(listener);
+        const ListenerCallbacks listenerCallbacks(binder, CallbackIds{id});
+        EXPECT_EQ(NO_ERROR, mThread.startRegistration(listenerCallbacks));
+        sp<CallbackHandle> handle = new CallbackHandle(binder, CallbackIds{id}, nullptr);
+        EXPECT_EQ(NO_ERROR, mThread.registerPendingCallbackHandle(handle));
+        EXPECT_EQ(NO_ERROR, mThread.endRegistration(listenerCallbacks));
+        return handle;
+    }
+
+    TransactionCompletedThread mThread;
+};
+
+TEST_F(TransactionCompletedThreadTest, callbacksAreSentInOrderWhenPresentedOutOfOrder) {
+    sp<FakeListener> listener = new FakeListener();
+    const sp<CallbackHandle> first = applyTransaction(listener, 1);
+    const sp<CallbackHandle> second = applyTransaction(listener, 2);
+
+    // The second transaction must wait for the first one.
+    ASSERT_EQ(NO_ERROR, mThread.finalizePendingCallbackHandles({second}));
+    mThread.sendCallbacks();
+    EXPECT_FALSE(listener->callbacks.waitForUnexpectedCall().has_value());
+
+    ASSERT_EQ(NO_ERROR, mThread.finalizePendingCallbackHandles({first}));
+    mThread.sendCallbacks();
+    const auto args = listener->callbacks.waitForCall();
+    ASSERT_TRUE(args.has_value());
+    EXPECT_THAT(std::get<0>(*args), ElementsAre(CallbackIds{1}, CallbackIds{2}));
+    EXPECT_FALSE(listener->callbacks.waitForUnexpectedCall().has_value());
+}
+
+TEST_F(TransactionCompletedThreadTest, deadListenerIsDropped) {
+    sp<FakeListener> deadListener = new FakeListener();
+    sp<FakeListener> listener = new FakeListener();
+    const sp<CallbackHandle> deadHandle = applyTransaction(deadListener, 1);
+    const sp<CallbackHandle> handle = applyTransaction(listener, 2);
+    ASSERT_EQ(2u, mThread.getListenerCountForTest());
+
+    // The dead listener's transaction is still waiting to be presented.
+    deadListener->alive = false;
+    ASSERT_EQ(NO_ERROR, mThread.finalizePendingCallbackHandles({handle}));
+    mThread.sendCallbacks();
+    const auto args = listener->callbacks.waitForCall();
+    ASSERT_TRUE(args.has_value());
+    EXPECT_THAT(std::get<0>(*args), ElementsAre(CallbackIds{2}));
+    EXPECT_EQ(0u, mThread.getListenerCountForTest());
+
+    // Handles of the dead listener that arrive late must not bring it back, nor keep the
+    // handles after them from being finalized.
+    const sp<CallbackHandle> nextHandle = applyTransaction(listener, 3);
+    EXPECT_EQ(NO_ERROR, mThread.finalizePendingCallbackHandles({deadHandle, nextHandle}));
+    EXPECT_NE(NO_ERROR, mThread.registerPendingCallbackHandle(deadHandle));
+    EXPECT_NE(NO_ERROR, mThread.registerUnpresentedCallbackHandle(deadHandle));
+    EXPECT_EQ(1u, mThread.getListenerCountForTest());
+
+    mThread.sendCallbacks();
+    const auto nextArgs = listener->callbacks.waitForCall();
+    ASSERT_TRUE(nextArgs.has_value());
+    EXPECT_THAT(std::get<0>(*nextArgs), ElementsAre(CallbackIds{3}));
+    EXPECT_FALSE(deadListener->callbacks.waitForUnexpectedCall().has_value());
+}
+
+} // namespace
+} // namespace android
@@ -96,6 +96,7 @@ public:
     MOCK_METHOD1(getClientTargetProperty, hal::Error(hal::ClientTargetProperty*));
     MOCK_CONST_METHOD1(getConnectionType, hal::Error(android::DisplayConnectionType*));
     MOCK_CONST_METHOD0(isVsyncPeriodSwitchSupported, bool());
+    MOCK_CONST_METHOD0(getLayerCommandStats, const HWC2::LayerCommandStats&());
 };
 
 } // namespace mock
@@ -43,6 +43,7 @@ public:
     MOCK_METHOD1(requestLatestConfig, void(const sp<android::EventThreadConnection> &));
     MOCK_METHOD1(pauseVsyncCallback, void(bool));
     MOCK_METHOD0(getEventThreadConnectionCount, size_t());
+    MOCK_CONST_METHOD1(getVsyncTimeline, status_t(gui::VsyncTimeline*));
 };
 
 } // namespace mock